@@ -61,10 +61,12 @@ public:
 
     auto lcfg = _light.config();
 
+    // PowerManager drives the backlight on LCD_BL_PWM_CHANNEL; giving the
+    // pin to Light_PWM as well would have two owners for one LEDC channel
     lcfg.pin_bl = -1;
     lcfg.invert = false;
-    lcfg.freq   = 44100;
-    lcfg.pwm_channel = 7;
+    lcfg.freq   = LCD_BL_PWM_FREQ;
+    lcfg.pwm_channel = LCD_BL_PWM_CHANNEL;
 
     _light.config(lcfg);
     _panel.setLight(&_light);
@@ -3,6 +3,8 @@
 
 /*ESP32-S3R8*/
 #define PIN_LCD_BL 38
+#define LCD_BL_PWM_CHANNEL 7
+#define LCD_BL_PWM_FREQ 44100
 
 #define PIN_LCD_D0 39
 #define PIN_LCD_D1 40
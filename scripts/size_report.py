@@ -0,0 +1,155 @@
+# PlatformIO post-link step: flash and RAM use per component, read from the
+# linker map, plus a comparison with every other environment built so far.
+#
+# Each build writes .pio/build/<env>/size_report.json; the totals of the
+# other environments' reports are printed next to this one, so building
+# e.g. the default and ble-only environments shows the difference.
+
+import json
+import os
+import re
+
+Import("env")  # noqa: F821
+
+MAP_NAME = "firmware.map"
+REPORT_NAME = "size_report.json"
+TOP_COMPONENTS = 15
+
+env.Append(LINKFLAGS=["-Wl,-Map,${BUILD_DIR}/" + MAP_NAME])  # noqa: F821
+
+OUTPUT_SECTION = re.compile(r"^(\.[\w.]+)(?:\s+0x[0-9a-f]+\s+0x[0-9a-f]+)?\s*$")
+INPUT_FULL = re.compile(r"^ (\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+INPUT_NAME = re.compile(r"^ (\S+)\s*$")
+INPUT_CONT = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+
+
+def region_of(section):
+    """Where an output section lives: flash-only, IRAM or DRAM (loaded or zeroed)."""
+    if section.startswith(".flash"):
+        return "flash"
+    if section.startswith(".iram") or section.startswith(".rtc.text"):
+        return "iram"
+    if section.endswith("bss") or section.startswith(".noinit"):
+        return "bss"
+    if section.startswith(".dram") or section.startswith(".rtc"):
+        return "data"
+    return None
+
+
+def component_of(path):
+    """Group an object by project directory, library or core archive."""
+    path = path.replace("\\", "/")
+    archive = re.search(r"lib([^/()]+)\.a\(", path)
+    if archive:
+        return archive.group(1)
+    project = re.search(r"/src/(?:([^/]+)/)?[^/]+\.o$", path)
+    if project:
+        return "src/" + project.group(1) if project.group(1) else "src"
+    library = re.search(r"/lib[0-9a-f]+/([^/]+)/", path)
+    if library:
+        return library.group(1)
+    return os.path.basename(path)
+
+
+def parse_map(map_path):
+    components = {}
+    section = None
+    pending = None
+    in_memory_map = False
+
+    with open(map_path, errors="replace") as handle:
+        for line in handle:
+            line = line.rstrip("\n")
+            if not in_memory_map:
+                in_memory_map = line.startswith("Linker script and memory map")
+                continue
+
+            match = OUTPUT_SECTION.match(line)
+            if match:
+                section = match.group(1)
+                pending = None
+                continue
+
+            region = region_of(section) if section else None
+            match = INPUT_FULL.match(line)
+            if match:
+                address, size, path = match.group(2), match.group(3), match.group(4)
+            elif pending:
+                match = INPUT_CONT.match(line)
+                pending = None
+                if not match:
+                    continue
+                address, size, path = match.group(1), match.group(2), match.group(3)
+            else:
+                if INPUT_NAME.match(line):
+                    pending = line
+                continue
+
+            size = int(size, 16)
+            if not region or not size or int(address, 16) == 0:
+                continue
+            usage = components.setdefault(component_of(path),
+                                          {"flash": 0, "iram": 0, "data": 0, "bss": 0})
+            usage[region] += size
+
+    return components
+
+
+def totals_of(components):
+    total = {"flash": 0, "iram": 0, "data": 0, "bss": 0}
+    for usage in components.values():
+        for region in total:
+            total[region] += usage[region]
+    # Image bytes: everything loaded from flash; RAM: what DRAM keeps at rest
+    return {
+        "image": total["flash"] + total["iram"] + total["data"],
+        "ram": total["data"] + total["bss"],
+        "iram": total["iram"],
+    }
+
+
+def report(target, source, env):
+    build_dir = env.subst("$BUILD_DIR")
+    map_path = os.path.join(build_dir, MAP_NAME)
+    if not os.path.isfile(map_path):
+        print("size_report: %s not found, skipping" % map_path)
+        return
+
+    components = parse_map(map_path)
+    totals = totals_of(components)
+    name = env.subst("$PIOENV")
+
+    print("")
+    print("Size by component (%s), bytes" % name)
+    print("  %-28s %9s %8s %8s %8s" % ("component", "flash", "iram", "data", "bss"))
+    ranked = sorted(components.items(),
+                    key=lambda item: -(item[1]["flash"] + item[1]["iram"] + item[1]["data"]))
+    for component, usage in ranked[:TOP_COMPONENTS]:
+        print("  %-28s %9d %8d %8d %8d" % (component[:28], usage["flash"], usage["iram"],
+                                           usage["data"], usage["bss"]))
+    if len(ranked) > TOP_COMPONENTS:
+        print("  ... %d more in %s" % (len(ranked) - TOP_COMPONENTS, REPORT_NAME))
+
+    with open(os.path.join(build_dir, REPORT_NAME), "w") as handle:
+        json.dump({"env": name, "totals": totals, "components": components}, handle,
+                  indent=1, sort_keys=True)
+
+    print("")
+    print("  %-28s %9s %8s %8s" % ("environment", "image", "ram", "iram"))
+    print("  %-28s %9d %8d %8d" % (name + " (this build)", totals["image"],
+                                   totals["ram"], totals["iram"]))
+    builds_dir = os.path.dirname(build_dir)
+    # Other environments, as differences from this one
+    for other in sorted(os.listdir(builds_dir)):
+        path = os.path.join(builds_dir, other, REPORT_NAME)
+        if other == name or not os.path.isfile(path):
+            continue
+        with open(path) as handle:
+            other_totals = json.load(handle)["totals"]
+        print("  %-28s %+9d %+8d %+8d" % (other, other_totals["image"] - totals["image"],
+                                          other_totals["ram"] - totals["ram"],
+                                          other_totals["iram"] - totals["iram"]))
+    print("")
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report)  # noqa: F821
@@ -0,0 +1,288 @@
+#!/usr/bin/env python3
+# Host side of the USB control protocol (src/control/usb_control.h).
+#
+# Frames are 0x00, COBS(payload + CRC-32 LE), 0x00 and share the port with
+# the device's text log: anything between delimiters that isn't a valid
+# frame is printed to stderr as log text. Needs pyserial, which PlatformIO
+# already ships. The port can be a pty for running against a host build.
+#
+#   usb_control.py /dev/ttyACM0 ping
+#   usb_control.py /dev/ttyACM0 registry dump
+#   usb_control.py /dev/ttyACM0 registry load macs.txt [--replace]
+#   usb_control.py /dev/ttyACM0 counter get|add|set CHANNEL [VALUE]
+#   usb_control.py /dev/ttyACM0 channels
+#   usb_control.py /dev/ttyACM0 metrics [--tasks]
+#   usb_control.py /dev/ttyACM0 logs [--from OFFSET] [--follow]
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+OP_PING = 0x01
+OP_REGISTRY_DUMP = 0x10
+OP_REGISTRY_APPLY = 0x11
+OP_COUNTER_GET = 0x20
+OP_COUNTER_ADD = 0x21
+OP_COUNTER_SET = 0x22
+OP_CHANNELS_DUMP = 0x23
+OP_METRICS = 0x30
+OP_LOG_EXPORT = 0x40
+
+STATUS_OK = 0x00
+STATUS_MORE = 0x01
+STATUS_NAMES = {
+    0x10: "bad request",
+    0x11: "unknown opcode",
+    0x12: "version conflict",
+    0x13: "capacity",
+    0x14: "read-only",
+}
+
+APPLY_REPLACE = 0x01
+RESPONSE_FLAG = 0x80
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_index = 0
+    code = 1
+    for byte in data:
+        if byte == 0:
+            out[code_index] = code
+            code = 1
+            code_index = len(out)
+            out.append(0)
+            continue
+        out.append(byte)
+        code += 1
+        if code == 0xFF:
+            out[code_index] = code
+            code = 1
+            code_index = len(out)
+            out.append(0)
+    out[code_index] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    """Decoded bytes, or None if data is not valid COBS."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class ControlError(Exception):
+    pass
+
+
+class Device:
+    def __init__(self, port, timeout):
+        self.port = serial.Serial(port, 115200, timeout=0.05)
+        self.timeout = timeout
+        self.seq = 0
+        self.pending = bytearray()
+
+    def request(self, opcode, body=b""):
+        """Yields (status, body) for each response until the last one."""
+        self.seq = (self.seq + 1) & 0xFF
+        payload = bytes([self.seq, opcode]) + body
+        frame = payload + struct.pack("<I", zlib.crc32(payload))
+        self.port.write(b"\x00" + cobs_encode(frame) + b"\x00")
+
+        deadline = time.monotonic() + self.timeout
+        while True:
+            for segment in self._segments(deadline):
+                response = self._parse(segment)
+                if response is None:
+                    sys.stderr.write(segment.decode("utf-8", "replace") + "\n")
+                    continue
+                seq, op, status, data = response
+                if seq != self.seq or op != opcode | RESPONSE_FLAG:
+                    continue
+                if status not in (STATUS_OK, STATUS_MORE):
+                    raise ControlError(STATUS_NAMES.get(status, "status 0x%02x" % status), data)
+                yield status, data
+                if status == STATUS_OK:
+                    return
+                deadline = time.monotonic() + self.timeout
+
+    def call(self, opcode, body=b""):
+        """The single response to a request."""
+        return next(self.request(opcode, body))[1]
+
+    def _segments(self, deadline):
+        while True:
+            if b"\x00" in self.pending:
+                segment, _, rest = bytes(self.pending).partition(b"\x00")
+                self.pending = bytearray(rest)
+                if segment:
+                    yield segment
+                continue
+            if time.monotonic() > deadline:
+                raise ControlError("timed out", b"")
+            self.pending += self.port.read(4096)
+
+    @staticmethod
+    def _parse(segment):
+        decoded = cobs_decode(segment)
+        if decoded is None or len(decoded) < 7:
+            return None
+        payload, crc = decoded[:-4], struct.unpack("<I", decoded[-4:])[0]
+        if zlib.crc32(payload) != crc or not payload[1] & RESPONSE_FLAG:
+            return None
+        return payload[0], payload[1], payload[2], payload[3:]
+
+
+def format_mac(mac):
+    return ":".join("%02X" % b for b in mac)
+
+
+def parse_mac(text):
+    parts = text.strip().replace("-", ":").split(":")
+    if len(parts) != 6:
+        raise ValueError("bad MAC address: %s" % text)
+    return bytes(int(p, 16) for p in parts)
+
+
+def registry_summary(data):
+    version, digest, count = struct.unpack_from("<IIH", data)
+    return version, digest, count
+
+
+def cmd_ping(device, args):
+    version, max_payload, channels, read_only, uptime = struct.unpack("<BHBBI", device.call(OP_PING))
+    print("protocol v%d, max payload %d, %d channels%s, up %.1f s" %
+          (version, max_payload, channels, ", read-only" if read_only else "", uptime / 1000))
+
+
+def cmd_registry(device, args):
+    data = device.call(OP_REGISTRY_DUMP)
+    version, digest, count = registry_summary(data)
+    current = [data[10 + i * 6:16 + i * 6] for i in range(count)]
+
+    if args.action == "dump":
+        print("version %d, hash %08x, %d devices" % (version, digest, count))
+        for mac in current:
+            print(format_mac(mac))
+        return
+
+    with open(args.file) as f:
+        wanted = [parse_mac(line) for line in f if line.strip() and not line.startswith("#")]
+
+    if args.replace:
+        adds, removes, flags = wanted, [], APPLY_REPLACE
+    else:
+        adds = [mac for mac in wanted if mac not in current]
+        removes = [mac for mac in current if mac not in wanted]
+        flags = 0
+
+    body = struct.pack("<IBHH", version, flags, len(adds), len(removes)) + b"".join(adds + removes)
+    version, digest, count = registry_summary(device.call(OP_REGISTRY_APPLY, body))
+    print("applied +%d -%d: version %d, hash %08x, %d devices" %
+          (len(adds), len(removes), version, digest, count))
+
+
+def cmd_counter(device, args):
+    if args.action == "get":
+        body = bytes([args.channel])
+        opcode = OP_COUNTER_GET
+    else:
+        if args.value is None:
+            raise ControlError("%s needs a value" % args.action, b"")
+        body = struct.pack("<Bi", args.channel, args.value)
+        opcode = OP_COUNTER_ADD if args.action == "add" else OP_COUNTER_SET
+    channel, value = struct.unpack("<Bi", device.call(opcode, body))
+    print("channel %d: %d" % (channel, value))
+
+
+def cmd_channels(device, args):
+    data = device.call(OP_CHANNELS_DUMP)
+    offset = 1
+    for channel in range(data[0]):
+        value = struct.unpack_from("<i", data, offset)[0]
+        end = data.index(b"\x00", offset + 4)
+        name = data[offset + 4:end].decode("utf-8", "replace")
+        print("%2d %-16s %d" % (channel, name, value))
+        offset = end + 1
+
+
+def cmd_metrics(device, args):
+    data = device.call(OP_METRICS, bytes([1 if args.tasks else 0]))
+    for i in range(0, len(data), 16):
+        print("%04x  %s" % (i, data[i:i + 16].hex(" ")))
+
+
+def cmd_logs(device, args):
+    offset = args.offset
+    while True:
+        for _, data in device.request(OP_LOG_EXPORT, struct.pack("<I", offset)):
+            start = struct.unpack_from("<I", data)[0]
+            if start > offset:
+                sys.stderr.write("[%d bytes lost]\n" % (start - offset))
+            sys.stdout.write(data[4:].decode("utf-8", "replace"))
+            offset = start + len(data) - 4
+        sys.stdout.flush()
+        if not args.follow:
+            print("[next offset %d]" % offset, file=sys.stderr)
+            return
+        time.sleep(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="USB control client")
+    parser.add_argument("port", help="serial port, e.g. /dev/ttyACM0 or a pty")
+    parser.add_argument("--timeout", type=float, default=2.0, help="seconds to wait for a response")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    commands.add_parser("ping").set_defaults(run=cmd_ping)
+
+    registry = commands.add_parser("registry")
+    registry.add_argument("action", choices=["dump", "load"])
+    registry.add_argument("file", nargs="?", help="one MAC per line, for load")
+    registry.add_argument("--replace", action="store_true", help="replace the registry instead of diffing")
+    registry.set_defaults(run=cmd_registry)
+
+    counter = commands.add_parser("counter")
+    counter.add_argument("action", choices=["get", "add", "set"])
+    counter.add_argument("channel", type=int)
+    counter.add_argument("value", type=int, nargs="?")
+    counter.set_defaults(run=cmd_counter)
+
+    commands.add_parser("channels").set_defaults(run=cmd_channels)
+
+    metrics = commands.add_parser("metrics")
+    metrics.add_argument("--tasks", action="store_true", help="task table instead of counters")
+    metrics.set_defaults(run=cmd_metrics)
+
+    logs = commands.add_parser("logs")
+    logs.add_argument("--from", dest="offset", type=int, default=0, help="log offset to start at")
+    logs.add_argument("--follow", action="store_true", help="keep exporting new output")
+    logs.set_defaults(run=cmd_logs)
+
+    args = parser.parse_args()
+    if args.command == "registry" and args.action == "load" and not args.file:
+        parser.error("registry load needs a file")
+
+    try:
+        args.run(Device(args.port, args.timeout), args)
+    except ControlError as e:
+        print("error: %s" % e.args[0], file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
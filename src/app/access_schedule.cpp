@@ -0,0 +1,353 @@
+#include "access_schedule.h"
+#include <time.h>
+#include <ctype.h>
+
+static_assert(24 * 60 % SCHEDULE_SLOT_MINUTES == 0, "SCHEDULE_SLOT_MINUTES must divide a day");
+static_assert(24 * 60 / SCHEDULE_SLOT_MINUTES <= 256, "slot index must fit in a byte");
+static_assert(SCHEDULE_MAX < 256, "schedule index must fit in a byte");
+
+static const char* const DAY_NAMES[] = { "Mo", "Tu", "We", "Th", "Fr", "Sa", "Su", "Ho" };
+
+static void skipSpaces(const char*& p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+}
+
+// Mo..Su -> 0..6, Ho -> 7, anything else -> -1
+static int parseDay(const char*& p) {
+    for (int d = 0; d < 8; d++) {
+        if (tolower(p[0]) == tolower(DAY_NAMES[d][0]) && tolower(p[1]) == tolower(DAY_NAMES[d][1])) {
+            p += 2;
+            return d;
+        }
+    }
+    return -1;
+}
+
+// HH:MM, 00:00 to 24:00 -> minutes since midnight, or -1
+static int parseTime(const char*& p) {
+    if (!isdigit(p[0]) || !isdigit(p[1]) || p[2] != ':' || !isdigit(p[3]) || !isdigit(p[4])) {
+        return -1;
+    }
+    int hours = (p[0] - '0') * 10 + (p[1] - '0');
+    int minutes = (p[3] - '0') * 10 + (p[4] - '0');
+    if (minutes > 59 || hours > 24 || (hours == 24 && minutes != 0)) {
+        return -1;
+    }
+    p += 5;
+    return hours * 60 + minutes;
+}
+
+AccessSchedule& AccessSchedule::getInstance() {
+    static AccessSchedule instance;
+    return instance;
+}
+
+AccessSchedule::AccessSchedule()
+    : logger(nullptr)
+    , memberCount(0)
+    , holidayCount(0)
+    , clock(0)
+    , clockTimer([](void* arg) { static_cast<AccessSchedule*>(arg)->updateClock(); }, this) {
+    memset(schedules, 0, sizeof(schedules));
+    memset(members, 0, sizeof(members));
+    memset(holidays, 0, sizeof(holidays));
+}
+
+bool AccessSchedule::begin(IConfig* config, LogRing* log) {
+    if (!config || !log) {
+        return false;
+    }
+
+    logger = log;
+    memberCount = 0;
+    size_t defined = 0;
+
+    for (size_t i = 0; i < SCHEDULE_MAX; i++) {
+        char key[40];
+        snprintf(key, sizeof(key), "%s.%zu.rules", CONFIG_SCHEDULES_PREFIX, i);
+        std::string rules = config->getString(key, "");
+        if (rules.empty()) {
+            continue;
+        }
+
+        if (!compile(rules.c_str(), schedules[i])) {
+            // Fail closed: the schedule's devices get no window at all
+            memset(&schedules[i], 0, sizeof(schedules[i]));
+            logger->log("ERROR: Schedule %zu rules not understood, denying its devices: \"%s\"",
+                i, rules.c_str());
+        }
+
+        snprintf(key, sizeof(key), "%s.%zu.devices", CONFIG_SCHEDULES_PREFIX, i);
+        std::string devices = config->getString(key, "");
+        size_t assigned = parseMembers(devices.c_str(), (uint8_t)(i + 1));
+        logger->log("Schedule %zu: %zu devices, \"%s\"", i, assigned, rules.c_str());
+        defined++;
+    }
+
+    holidayCount = parseHolidays(config->getString(CONFIG_SCHEDULE_HOLIDAYS, "").c_str());
+
+    if (defined) {
+        updateClock();
+        TimerWheel::getInstance().arm(clockTimer, SCHEDULE_CLOCK_MS, SCHEDULE_CLOCK_MS);
+        logger->log("Access schedules: %zu defined, %zu holidays, clock %s",
+            defined, holidayCount, (clock & CLOCK_VALID) ? "set" : "not set yet");
+    }
+
+    return true;
+}
+
+uint8_t AccessSchedule::lookup(const uint8_t* macAddress) const {
+    for (size_t i = 0; i < memberCount; i++) {
+        if (memcmp(members[i].macAddress, macAddress, 6) == 0) {
+            return members[i].schedule;
+        }
+    }
+    return 0;
+}
+
+void AccessSchedule::report() {
+    if (!logger || !memberCount) {
+        return;
+    }
+
+    uint16_t now = clock;
+    if (!(now & CLOCK_VALID)) {
+        logger->log("Schedules: clock not set, scheduled devices %s",
+            SCHEDULE_ALLOW_WITHOUT_TIME ? "allowed" : "denied");
+        return;
+    }
+
+    uint16_t minute = (now & 0xFF) * SCHEDULE_SLOT_MINUTES;
+    logger->log("Schedules: %s %02u:%02u slot%s, %zu scheduled devices",
+        DAY_NAMES[(now >> 8) & 0x07], minute / 60, minute % 60,
+        (now & CLOCK_HOLIDAY) ? " (holiday)" : "", memberCount);
+}
+
+// ============================================================================
+// Clock
+// ============================================================================
+
+void AccessSchedule::updateClock() {
+    time_t now = time(nullptr);
+    if (now < TIME_MIN_VALID_EPOCH) {
+        clock = 0;
+        return;
+    }
+
+    struct tm local;
+    localtime_r(&now, &local);
+
+    uint16_t weekday = (uint16_t)((local.tm_wday + 6) % 7);   // tm_wday 0 is Sunday
+    uint16_t slot = (uint16_t)((local.tm_hour * 60 + local.tm_min) / SCHEDULE_SLOT_MINUTES);
+    uint16_t state = CLOCK_VALID | (weekday << 8) | slot;
+    if (isHoliday(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday)) {
+        state |= CLOCK_HOLIDAY;
+    }
+
+    // Yesterday's date, for windows that ran past midnight; noon keeps a
+    // DST change from landing on the wrong day
+    struct tm previous = local;
+    previous.tm_mday -= 1;
+    previous.tm_hour = 12;
+    previous.tm_isdst = -1;
+    mktime(&previous);
+    if (isHoliday(previous.tm_year + 1900, previous.tm_mon + 1, previous.tm_mday)) {
+        state |= CLOCK_PREV_HOLIDAY;
+    }
+    clock = state;
+}
+
+bool AccessSchedule::isHoliday(int year, int month, int day) const {
+    uint32_t yearly = ((uint32_t)month << 5) | (uint32_t)day;
+    uint32_t dated = ((uint32_t)year << 9) | yearly;
+    for (size_t i = 0; i < holidayCount; i++) {
+        if (holidays[i] == yearly || holidays[i] == dated) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// Config Parsing
+// ============================================================================
+
+size_t AccessSchedule::parseMembers(const char* list, uint8_t schedule) {
+    size_t assigned = 0;
+    const char* p = list;
+
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+
+        unsigned int mac[6];
+        int consumed = 0;
+        if (sscanf(p, "%02X:%02X:%02X:%02X:%02X:%02X%n",
+                   &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5], &consumed) != 6) {
+            logger->log("ERROR: Schedule %u device list not understood at \"%s\"", schedule - 1, p);
+            break;
+        }
+        p += consumed;
+
+        uint8_t macAddress[6];
+        for (int j = 0; j < 6; j++) {
+            macAddress[j] = (uint8_t)mac[j];
+        }
+        if (lookup(macAddress)) {
+            logger->log("ERROR: Device listed in two schedules, keeping the first");
+            continue;
+        }
+        if (memberCount >= SCHEDULE_MAX_MEMBERS) {
+            logger->log("ERROR: More than %d scheduled devices", SCHEDULE_MAX_MEMBERS);
+            break;
+        }
+
+        memcpy(members[memberCount].macAddress, macAddress, 6);
+        members[memberCount].schedule = schedule;
+        memberCount++;
+        assigned++;
+    }
+
+    return assigned;
+}
+
+size_t AccessSchedule::parseHolidays(const char* list) {
+    size_t count = 0;
+    const char* p = list;
+
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+
+        // YYYY-MM-DD for one date, MM-DD for every year
+        unsigned int year = 0, month = 0, day = 0;
+        int consumed = 0;
+        if (sscanf(p, "%4u-%2u-%2u%n", &year, &month, &day, &consumed) != 3) {
+            year = 0;
+            if (sscanf(p, "%2u-%2u%n", &month, &day, &consumed) != 2) {
+                logger->log("ERROR: Holiday list not understood at \"%s\"", p);
+                break;
+            }
+        }
+        p += consumed;
+
+        if (month < 1 || month > 12 || day < 1 || day > 31) {
+            logger->log("ERROR: Holiday date out of range, skipped");
+            continue;
+        }
+        if (count >= SCHEDULE_MAX_HOLIDAYS) {
+            logger->log("ERROR: More than %d holidays", SCHEDULE_MAX_HOLIDAYS);
+            break;
+        }
+        holidays[count++] = (year << 9) | (month << 5) | day;
+    }
+
+    return count;
+}
+
+// ============================================================================
+// Rule Compiler
+// ============================================================================
+
+void AccessSchedule::setSlots(uint8_t* row, uint16_t startMinute, uint16_t endMinute) {
+    // A slot is open if any part of it is inside the window
+    uint16_t first = startMinute / SCHEDULE_SLOT_MINUTES;
+    uint16_t last = (endMinute + SCHEDULE_SLOT_MINUTES - 1) / SCHEDULE_SLOT_MINUTES;
+    for (uint16_t slot = first; slot < last; slot++) {
+        row[slot >> 3] |= (uint8_t)(1 << (slot & 7));
+    }
+}
+
+bool AccessSchedule::compile(const char* rules, Schedule& out) {
+    memset(&out, 0, sizeof(out));
+    const char* p = rules;
+
+    while (true) {
+        skipSpaces(p);
+        if (!*p) {
+            return true;
+        }
+        if (*p == ';') {
+            p++;
+            continue;
+        }
+
+        // Days: "Mo", "Mo-Fr", "Fr-Mo", "Sa,Su", "Ho"
+        uint8_t days = 0;
+        while (true) {
+            int first = parseDay(p);
+            if (first < 0) {
+                return false;
+            }
+            int last = first;
+            if (*p == '-') {
+                p++;
+                last = parseDay(p);
+                if (last < 0 || first == HOLIDAY_ROW || last == HOLIDAY_ROW) {
+                    return false;
+                }
+            }
+            for (int d = first; ; d = (d + 1) % 7) {
+                days |= (uint8_t)(1 << d);
+                if (d == last) {
+                    break;
+                }
+            }
+            if (*p != ',') {
+                break;
+            }
+            p++;
+        }
+
+        // One or more windows: "07:00-18:00", "22:00-06:00 12:00-13:00"
+        skipSpaces(p);
+        bool any = false;
+        while (isdigit(*p)) {
+            int start = parseTime(p);
+            if (start < 0 || *p++ != '-') {
+                return false;
+            }
+            int end = parseTime(p);
+            if (end < 0 || end == start) {
+                return false;
+            }
+
+            for (uint8_t d = 0; d <= HOLIDAY_ROW; d++) {
+                if (!(days & (1 << d))) {
+                    continue;
+                }
+                if (end > start) {
+                    setSlots(out.bits[d], (uint16_t)start, (uint16_t)end);
+                } else {
+                    // Past midnight: the rest is kept under the day it
+                    // started on and applies the next morning
+                    setSlots(out.bits[d], (uint16_t)start, 24 * 60);
+                    setSlots(out.spill[d], 0, (uint16_t)end);
+                }
+            }
+            any = true;
+            skipSpaces(p);
+            if (*p == ',') {
+                p++;
+                skipSpaces(p);
+            }
+        }
+
+        if (!any || (*p && *p != ';')) {
+            return false;
+        }
+        if (days & (1 << HOLIDAY_ROW)) {
+            out.hasHolidayRow = true;
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef ACCESS_SCHEDULE_H
+#define ACCESS_SCHEDULE_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "config/IConfig.h"
+#include "../diag/log_ring.h"
+#include "timer_wheel.h"
+
+/**
+ * Weekly access windows for registered devices.
+ *
+ * Each schedule in config.json is a rule string such as
+ *   "Mo-Fr 07:00-18:00; Sa 08:00-12:00"   (contractors)
+ *   "Mo-Su 22:00-06:00; Ho 00:00-24:00"  (cleaners; past midnight spills
+ *                                         into the next day)
+ * applied to the devices listed with it. Days are Mo..Su, ranges may wrap
+ * (Fr-Mo), and Ho is the holiday row: on a date listed in
+ * schedules.holidays, a schedule that has Ho rules uses them instead of
+ * the weekday's. A window past midnight belongs to the day it starts on:
+ * its tail applies the next morning whatever that day is, and only if
+ * the day it started on used that row. begin() compiles every schedule
+ * into one bit per SCHEDULE_SLOT_MINUTES slot per day, plus a row of
+ * spilled slots per day, and a timer keeps the current day and slot from
+ * the system clock (set by the framework's time sync), so allows() is two
+ * bit tests, safe from any task.
+ *
+ * Devices without a schedule are always allowed. Scheduled devices are
+ * refused while the clock is unset unless SCHEDULE_ALLOW_WITHOUT_TIME, and
+ * a schedule with a syntax error allows nothing.
+ */
+class AccessSchedule {
+public:
+    static AccessSchedule& getInstance();
+
+    // Compiles schedules and holidays from config and starts the clock
+    bool begin(IConfig* config, LogRing* log);
+
+    // Schedule for a device: 1-based index, 0 if it has none. Resolve once
+    // when a device enters the registry, not per check.
+    uint8_t lookup(const uint8_t* macAddress) const;
+
+    bool allows(uint8_t schedule) const {
+        if (!schedule) {
+            return true;
+        }
+        uint16_t now = clock;
+        if (!(now & CLOCK_VALID)) {
+            return SCHEDULE_ALLOW_WITHOUT_TIME;
+        }
+        const Schedule& s = schedules[schedule - 1];
+        uint8_t weekday = (now >> 8) & 0x07;
+        uint8_t row = ((now & CLOCK_HOLIDAY) && s.hasHolidayRow) ? HOLIDAY_ROW : weekday;
+        uint8_t previous = ((now & CLOCK_PREV_HOLIDAY) && s.hasHolidayRow) ? HOLIDAY_ROW : (weekday + 6) % 7;
+        uint8_t slot = now & 0xFF;
+        uint8_t mask = (uint8_t)(1 << (slot & 7));
+        return (s.bits[row][slot >> 3] & mask) || (s.spill[previous][slot >> 3] & mask);
+    }
+
+    // Clock state and schedule table
+    void report();
+
+private:
+    AccessSchedule();
+
+    // Prevent copying
+    AccessSchedule(const AccessSchedule&) = delete;
+    AccessSchedule& operator=(const AccessSchedule&) = delete;
+
+    static const uint16_t SLOTS_PER_DAY = 24 * 60 / SCHEDULE_SLOT_MINUTES;
+    static const uint16_t SLOT_BYTES = (SLOTS_PER_DAY + 7) / 8;
+    static const uint8_t HOLIDAY_ROW = 7;
+
+    // Packed so the BLE task always reads a consistent day and slot
+    static const uint16_t CLOCK_VALID = 0x8000;
+    static const uint16_t CLOCK_HOLIDAY = 0x4000;
+    static const uint16_t CLOCK_PREV_HOLIDAY = 0x2000;
+
+    struct Schedule {
+        uint8_t bits[HOLIDAY_ROW + 1][SLOT_BYTES];   // Mo..Su, holiday
+        uint8_t spill[HOLIDAY_ROW + 1][SLOT_BYTES];  // after midnight, by the day it started
+        bool hasHolidayRow;
+    };
+
+    struct Member {
+        uint8_t macAddress[6];
+        uint8_t schedule;
+    };
+
+    LogRing* logger;
+    Schedule schedules[SCHEDULE_MAX];
+    Member members[SCHEDULE_MAX_MEMBERS];
+    size_t memberCount;
+
+    // (year << 9) | (month << 5) | day; year 0 repeats every year
+    uint32_t holidays[SCHEDULE_MAX_HOLIDAYS];
+    size_t holidayCount;
+
+    // valid | holiday | previous day holiday | weekday << 8 | slot
+    volatile uint16_t clock;
+    TimerWheel::Timer clockTimer;
+
+    void updateClock();
+    bool isHoliday(int year, int month, int day) const;
+    size_t parseMembers(const char* list, uint8_t schedule);
+    size_t parseHolidays(const char* list);
+
+    static bool compile(const char* rules, Schedule& out);
+    static void setSlots(uint8_t* row, uint16_t startMinute, uint16_t endMinute);
+};
+
+#endif // ACCESS_SCHEDULE_H
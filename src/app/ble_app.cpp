@@ -2,18 +2,20 @@
 
 BLEApp::BLEApp()
     : ApplicationBase("ESP32-BLE-Demo", "1.0.0")
-#if HAS_BUTTONS
+#if HAS_BUTTONS && !FAST_INPUT_ENABLED
     , button1(nullptr)
     , button2(nullptr)
 #endif
 #if HAS_DISPLAY
     , counterModule(nullptr)
 #endif
-    , currentState(SystemState::INITIALIZING) {
+    , appLog(&LogRing::getInstance())
+    , currentState(SystemState::INITIALIZING)
+    , metricsTimer([](void* arg) { static_cast<BLEApp*>(arg)->dumpDiagnostics(); }, this) {
 }
 
 BLEApp::~BLEApp() {
-#if HAS_BUTTONS
+#if HAS_BUTTONS && !FAST_INPUT_ENABLED
     if (button1) delete button1;
     if (button2) delete button2;
 #endif
@@ -32,65 +34,142 @@ const char* BLEApp::getSystemTitle() {
 }
 
 void BLEApp::onSetup() {
-    setupButtons();
+    BootTrace::mark("setup");
+
+    // Timer callbacks are dispatched from onLoop() on this task
+    TimerWheel::getInstance().begin();
 
     if (!config) {
-        logger->log("FATAL: Config is null - cannot initialize");
+        appLog->log("FATAL: Config is null - cannot initialize");
         currentState = SystemState::ERROR;
         return;
     }
 
-    logger->log("Config is valid, initializing CounterApp");
-
-    if (!CounterApp::getInstance().begin(config, &Logger::getInstance())) {
-        logger->log("FATAL: Counter app initialization failed");
+    if (!ConfigStore::getInstance().begin(config, appLog)) {
+        appLog->log("FATAL: Config store initialization failed");
         currentState = SystemState::ERROR;
         return;
     }
 
-    setupBLE();
+    // The BLE controller comes up on its own core while app state and the
+    // display load here; advertising waits for both the stack and the state
+    // it will be serving.
+    BootScheduler boot(appLog);
 
+    uint32_t bleStack = boot.addStage("ble stack", BOOT_BLE_CORE, 0, [this]() {
+        return setupBLE();
+    });
+    uint32_t counter = boot.addStage("counter", BootScheduler::CALLER_CORE, 0, [this]() {
+        return setupCounter();
+    });
+    uint32_t relay = boot.addStage("relay", BootScheduler::CALLER_CORE, 0, [this]() {
+        return RelayController::getInstance().begin(appLog);
+    });
+    boot.addStage("advertising", BootScheduler::CALLER_CORE, bleStack | counter | relay, []() {
+        BLEManager::getInstance().startAdvertising();
+        return true;
+    });
+    boot.addStage("buttons", BootScheduler::CALLER_CORE, counter, [this]() {
+        setupButtons();
+        return true;
+    });
 #if HAS_DISPLAY
-    int systemModuleHeight = 30;
-    int32_t startX = 0;
-    int32_t startY = systemModuleHeight;
-    int32_t width = display->getWidth();
-    int32_t height = display->getHeight() - systemModuleHeight;
+    boot.addStage("display", BootScheduler::CALLER_CORE, counter, [this]() {
+        return setupDisplay();
+    });
+#endif
 
-    counterModule = new CounterModule(logger);
-    if (!moduleManager->registerModule(counterModule, startX, startY, width, height)) {
-        logger->log("ERROR: Failed to register CounterModule");
-        currentState = SystemState::ERROR;
-        return;
-    }
+    bool ok = boot.run();
+    boot.dumpTimeline();
 
-    if (!moduleManager->startAllModules()) {
-        logger->log("ERROR: Failed to start all modules");
+    if (!ok) {
+        appLog->log("FATAL: Boot failed");
         currentState = SystemState::ERROR;
         return;
     }
 
-    logger->log("CounterModule registered and started");
+    currentState = SystemState::NORMAL;
+    appLog->log("BLE app initialized successfully!");
+
+    BootTrace::mark("ready");
+    BootTrace::dump(appLog);
+
+    TaskProfiler::getInstance().begin(appLog);
+    JitterBench::begin(appLog);
+    EventTrace::begin(appLog, [](void* arg, uint8_t button, bool longPress) {
+        static_cast<BLEApp*>(arg)->handleButton(button, longPress);
+    }, this);
+    PowerManager::getInstance().begin(appLog);
+    SensorSampler::getInstance().begin(appLog);
+    MqttBridge::getInstance().begin(config, appLog);
+    CounterHistory::getInstance().begin(appLog);
+    PresenceStats::getInstance().begin(appLog);
+    UsbControl::getInstance().begin(appLog);
+    CounterReplica::getInstance().startGossip();
+
+#if METRICS_DUMP_INTERVAL_MS > 0
+    TimerWheel::getInstance().arm(metricsTimer, METRICS_DUMP_INTERVAL_MS, METRICS_DUMP_INTERVAL_MS);
 #endif
 
-    currentState = SystemState::NORMAL;
-    logger->log("BLE app initialized successfully!");
+    if (xPortGetCoreID() != CORE_APP) {
+        appLog->log("ERROR: App loop is on core %d, task plan expects core %d", xPortGetCoreID(), CORE_APP);
+    }
+
+    // From here on, steady-state paths must not allocate
+    HeapGuard::seal();
+    HeapGuard::report(appLog);
 }
 
 void BLEApp::onStateUpdate(AppState state) {
+    // MqttBridge owns its broker session (with an offline spool), so the
+    // framework's MQTT step is skipped once WiFi is up
     if (state == AppState::MQTT_CONNECT) {
         ApplicationBase::currentState = AppState::RUNNING;
     }
 }
 
 void BLEApp::onLoop() {
-    BLEManager::getInstance().update();
+    TaskProfiler::getInstance().loopTick();
+
+    if (CounterApp::getInstance().needsReconcile()) {
+        CounterApp::getInstance().reconcileWithStorage();
+    }
+
+    // Ahead of the bus so a click is notified in this same pass
+    pollButtons();
+    StateBus::getInstance().dispatch();
+    TimerWheel::getInstance().dispatch();
+    RelayController::getInstance().update();
+    EventTrace::update();
+    CounterReplica::getInstance().update();
+    SensorSampler::getInstance().update();
+    PowerManager::getInstance().update();
+    TaskProfiler::getInstance().update();
 
     if (BLEManager::getInstance().isInPairingMode()) {
         currentState = SystemState::PAIRING_MODE;
     } else if (currentState == SystemState::PAIRING_MODE) {
         currentState = SystemState::NORMAL;
     }
+
+    // Nothing else is polled here, so rest until the next timer is due
+    uint32_t sleptUs = TimerWheel::getInstance().sleep(PowerManager::getInstance().loopSleepCapMs());
+    TaskProfiler::getInstance().excludeIdle(sleptUs);
+}
+
+void BLEApp::dumpDiagnostics() {
+    HeapGuard::report(appLog);
+    Metrics::dump(appLog);
+    TaskProfiler::getInstance().dump();
+    PowerManager::getInstance().report();
+    SensorSampler::getInstance().report();
+    MqttBridge::getInstance().report();
+    CounterReplica::getInstance().report();
+    AccessSchedule::getInstance().report();
+    CounterHistory::getInstance().report();
+    PresenceStats::getInstance().report();
+    UsbControl::getInstance().report();
+    InputTrace::report(appLog);
 }
 
 #if HAS_BUTTONS
@@ -103,52 +182,168 @@ void BLEApp::onAlwaysLoop() {
 // ============================================================================
 
 void BLEApp::setupButtons() {
-#if HAS_BUTTONS
-    logger->log("Initializing buttons...");
+#if HAS_BUTTONS && FAST_INPUT_ENABLED
+    ButtonInput::getInstance().begin(appLog);
+#elif HAS_BUTTONS
+    appLog->log("Initializing buttons...");
 
+    // A multi-click arrives as one callback; each click still counts
     button1 = new ButtonHandler(PIN_BUTTON_1, true, true, LONG_PRESS_DURATION_MS, 250, BUTTON_DEBOUNCE_MS);
     button1->setOnClickCallback([this](int pinNumber, int clickCount) {
-        if (BLEManager::getInstance().isInPairingMode()) {
-            BLEManager::getInstance().exitPairingMode();
-            return;
+        for (int i = 0; i < clickCount; i++) {
+            onButton(1, false);
         }
-
-        CounterApp::getInstance().decrement();
     });
     button1->setOnLongPressStartCallback([this](int pinNumber) {
-        logger->log("Button 1 long press - Enter pairing mode");
-        if (!BLEManager::getInstance().isInPairingMode()) {
-            BLEManager::getInstance().enterPairingMode();
-        }
+        onButton(1, true);
     });
 
     button2 = new ButtonHandler(PIN_BUTTON_2, true, true, LONG_PRESS_DURATION_MS, 250, BUTTON_DEBOUNCE_MS);
     button2->setOnClickCallback([this](int pinNumber, int clickCount) {
-        if (BLEManager::getInstance().isInPairingMode()) {
-            BLEManager::getInstance().exitPairingMode();
-            return;
+        for (int i = 0; i < clickCount; i++) {
+            onButton(2, false);
         }
-
-        CounterApp::getInstance().increment();
     });
     button2->setOnLongPressStartCallback([this](int pinNumber) {
-        logger->log("Button 2 long press - Clear all registered devices");
-        if (!BLEManager::getInstance().isInPairingMode()) {
-            CounterApp::getInstance().clearAllDevices();
-        }
+        onButton(2, true);
     });
 
-    logger->log("Buttons initialized successfully");
+    appLog->log("Buttons initialized successfully");
 #else
-    logger->log("No buttons available");
+    appLog->log("No buttons available");
 #endif
 }
 
-void BLEApp::setupBLE() {
-    logger->log("Initializing BLE...");
-    if (!BLEManager::getInstance().begin(&CounterApp::getInstance(), &Logger::getInstance())) {
-        logger->log("FATAL: BLE initialization failed");
-        currentState = SystemState::ERROR;
+bool BLEApp::acceptButton(uint8_t button, bool longPress) {
+    // A press on a blanked panel only wakes it
+    if (PowerManager::getInstance().noteActivity()) {
+        return false;
+    }
+
+    EventTrace::record(longPress ? EventTrace::Type::BUTTON_LONG_PRESS : EventTrace::Type::BUTTON_CLICK,
+                       EventTrace::Target::NONE, &button, 1);
+    return true;
+}
+
+void BLEApp::onButton(uint8_t button, bool longPress) {
+    if (acceptButton(button, longPress)) {
+        handleButton(button, longPress);
+    }
+}
+
+void BLEApp::pollButtons() {
+#if HAS_BUTTONS && FAST_INPUT_ENABLED
+    ButtonInput::Event event;
+    int32_t delta = 0;
+    uint32_t clicks = 0;
+
+    while (ButtonInput::getInstance().poll(event)) {
+        if (!acceptButton(event.button, event.longPress)) {
+            continue;
+        }
+
+        if (event.longPress || BLEManager::getInstance().isInPairingMode()) {
+            // Not a count: apply what came before it first to keep the order
+            if (clicks) {
+                CounterApp::getInstance().add(delta);
+                InputTrace::applied();
+                delta = 0;
+                clicks = 0;
+            }
+            handleButton(event.button, event.longPress);
+            continue;
+        }
+
+        InputTrace::decided(event.edgeUs, event.decidedUs);
+        delta += event.button == 1 ? -1 : 1;
+        clicks++;
+    }
+
+    if (clicks) {
+        CounterApp::getInstance().add(delta);
+        InputTrace::applied();
+    }
+#endif
+}
+
+void BLEApp::handleButton(uint8_t button, bool longPress) {
+    BLEManager& ble = BLEManager::getInstance();
+
+    if (longPress) {
+        if (button == 1) {
+            appLog->log("Button 1 long press - Enter pairing mode");
+            if (!ble.isInPairingMode()) {
+                ble.enterPairingMode();
+            }
+        } else {
+            appLog->log("Button 2 long press - Clear all registered devices");
+            if (!ble.isInPairingMode()) {
+                CounterApp::getInstance().clearAllDevices();
+            }
+        }
+        return;
+    }
+
+    if (ble.isInPairingMode()) {
+        ble.exitPairingMode();
         return;
     }
+
+    if (button == 1) {
+        CounterApp::getInstance().decrement();
+    } else {
+        CounterApp::getInstance().increment();
+    }
 }
+
+bool BLEApp::setupCounter() {
+    // After a warm reset, come back from the RTC snapshot so advertising is
+    // not held up by flash; the flash copy is reconciled from onLoop().
+    if (CounterApp::getInstance().beginFromSnapshot(config, appLog)) {
+        appLog->log("Warm boot: restored state from RTC snapshot");
+        return true;
+    }
+
+    appLog->log("Config is valid, initializing CounterApp");
+
+    if (!CounterApp::getInstance().begin(config, appLog)) {
+        appLog->log("FATAL: Counter app initialization failed");
+        return false;
+    }
+
+    return true;
+}
+
+bool BLEApp::setupBLE() {
+    appLog->log("Initializing BLE...");
+    if (!BLEManager::getInstance().initStack(&CounterApp::getInstance(), appLog)) {
+        appLog->log("FATAL: BLE initialization failed");
+        return false;
+    }
+
+    return true;
+}
+
+#if HAS_DISPLAY
+bool BLEApp::setupDisplay() {
+    int systemModuleHeight = 30;
+    int32_t startX = 0;
+    int32_t startY = systemModuleHeight;
+    int32_t width = display->getWidth();
+    int32_t height = display->getHeight() - systemModuleHeight;
+
+    counterModule = new CounterModule(logger);
+    if (!moduleManager->registerModule(counterModule, startX, startY, width, height)) {
+        appLog->log("ERROR: Failed to register CounterModule");
+        return false;
+    }
+
+    if (!moduleManager->startAllModules()) {
+        appLog->log("ERROR: Failed to start all modules");
+        return false;
+    }
+
+    appLog->log("CounterModule registered and started");
+    return true;
+}
+#endif
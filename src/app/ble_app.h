@@ -14,6 +14,27 @@
 #include "../config.h"
 #include "../ble/ble_manager.h"
 #include "counter_app.h"
+#include "access_schedule.h"
+#include "counter_history.h"
+#include "presence_stats.h"
+#include "button_input.h"
+#include "../storage/config_store.h"
+#include "../diag/boot_trace.h"
+#include "boot_scheduler.h"
+#include "timer_wheel.h"
+#include "../gate/relay_controller.h"
+#include "../diag/metrics.h"
+#include "../diag/log_ring.h"
+#include "../diag/heap_guard.h"
+#include "../diag/task_profiler.h"
+#include "../diag/jitter_bench.h"
+#include "../diag/event_trace.h"
+#include "../diag/input_trace.h"
+#include "../power/power_manager.h"
+#include "../sensors/sensor_sampler.h"
+#include "../telemetry/mqtt_bridge.h"
+#include "../replication/counter_replica.h"
+#include "../control/usb_control.h"
 
 /**
  * BLE Application for ESP32
@@ -37,7 +58,7 @@ protected:
 #endif
 
 private:
-#if HAS_BUTTONS
+#if HAS_BUTTONS && !FAST_INPUT_ENABLED
     ButtonHandler* button1;
     ButtonHandler* button2;
 #endif
@@ -46,12 +67,32 @@ private:
     CounterModule* counterModule;
 #endif
 
+    // Every module logs through the ring so USB can export recent lines;
+    // CounterModule takes the framework's Logger directly
+    LogRing* appLog;
+
     // Application state
     SystemState currentState;
+    TimerWheel::Timer metricsTimer;
 
-    // Setup helpers
+    // Setup helpers (boot stages)
     void setupButtons();
-    void setupBLE();
+    bool setupCounter();
+    bool setupBLE();
+#if HAS_DISPLAY
+    bool setupDisplay();
+#endif
+
+    void dumpDiagnostics();
+
+    // Button actions. Live presses pass acceptButton() (wake check, event
+    // trace); pollButtons() drains the fast input path and applies a burst
+    // of clicks as one change; handleButton() is the action itself, shared
+    // with the framework handler path and event replay
+    bool acceptButton(uint8_t button, bool longPress);
+    void onButton(uint8_t button, bool longPress);
+    void pollButtons();
+    void handleButton(uint8_t button, bool longPress);
 };
 
 #endif // BLE_APP_H
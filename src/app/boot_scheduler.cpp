@@ -0,0 +1,166 @@
+#include "boot_scheduler.h"
+#include "../diag/boot_trace.h"
+#include <esp_timer.h>
+
+BootScheduler::BootScheduler(LogRing* log)
+    : logger(log)
+    , events(nullptr)
+    , stageCount(0)
+    , failedBits(0) {
+}
+
+BootScheduler::~BootScheduler() {
+    if (events) {
+        vEventGroupDelete(events);
+    }
+}
+
+uint32_t BootScheduler::addStage(const char* name, int core, uint32_t dependsOn, StageFn fn) {
+    if (stageCount >= BOOT_MAX_STAGES) {
+        logger->log("ERROR: Too many boot stages, dropping '%s'", name);
+        return 0;
+    }
+
+    Stage& stage = stages[stageCount];
+    stage.name = name;
+    stage.core = core;
+    stage.dependsOn = dependsOn;
+    stage.fn = fn;
+    stage.remote = false;
+    stage.ok = false;
+    stage.ranOnCore = -1;
+    stage.startUs = 0;
+    stage.endUs = 0;
+    stage.owner = this;
+    stage.bit = 1u << stageCount;
+
+    stageCount++;
+    return stage.bit;
+}
+
+bool BootScheduler::run() {
+    uint32_t allBits = stageCount ? (1u << stageCount) - 1 : 0;
+    uint32_t remoteBits = 0;
+    uint32_t doneInline = 0;
+
+    events = xEventGroupCreate();
+
+#if BOOT_PARALLEL_ENABLED
+    if (events) {
+        int callerCore = xPortGetCoreID();
+        for (size_t i = 0; i < stageCount; i++) {
+            Stage& stage = stages[i];
+            if (stage.core == CALLER_CORE || stage.core == callerCore) {
+                continue;
+            }
+
+            stage.remote = true;
+            if (xTaskCreatePinnedToCore(stageTaskEntry, stage.name, BOOT_STAGE_TASK_STACK, &stage,
+                                        BOOT_STAGE_TASK_PRIORITY, nullptr, stage.core) != pdPASS) {
+                logger->log("Boot: could not start '%s' on core %d, running serially", stage.name, stage.core);
+                stage.remote = false;
+                continue;
+            }
+            remoteBits |= stage.bit;
+        }
+    }
+#endif
+
+    if (!events) {
+        logger->log("Boot: no event group, running stages serially");
+    }
+
+    // Run caller stages as their dependencies complete
+    while ((doneInline | remoteBits) != allBits) {
+        uint32_t done = events ? (xEventGroupGetBits(events) & allBits) : doneInline;
+        Stage* next = nullptr;
+
+        for (size_t i = 0; i < stageCount; i++) {
+            Stage& stage = stages[i];
+            if (stage.remote || (doneInline & stage.bit)) {
+                continue;
+            }
+            if ((stage.dependsOn & ~done) == 0) {
+                next = &stage;
+                break;
+            }
+        }
+
+        if (next) {
+            execute(*next);
+            doneInline |= next->bit;
+            continue;
+        }
+
+        uint32_t waitingOn = remoteBits & ~done;
+        if (waitingOn == 0) {
+            logger->log("ERROR: Boot stage dependencies cannot be satisfied");
+            return false;
+        }
+
+        if (!xEventGroupWaitBits(events, waitingOn, pdFALSE, pdFALSE, pdMS_TO_TICKS(BOOT_STAGE_TIMEOUT_MS))) {
+            logger->log("WARNING: Boot still waiting on parallel stages after %d ms", BOOT_STAGE_TIMEOUT_MS);
+        }
+    }
+
+    // Join the remaining parallel stages
+    while (remoteBits && (xEventGroupGetBits(events) & remoteBits) != remoteBits) {
+        if (!xEventGroupWaitBits(events, remoteBits, pdFALSE, pdTRUE, pdMS_TO_TICKS(BOOT_STAGE_TIMEOUT_MS))) {
+            logger->log("WARNING: Boot still waiting on parallel stages after %d ms", BOOT_STAGE_TIMEOUT_MS);
+        }
+    }
+
+    return failedBits == 0;
+}
+
+bool BootScheduler::dependenciesFailed(const Stage& stage) const {
+    return (stage.dependsOn & failedBits) != 0;
+}
+
+void BootScheduler::execute(Stage& stage) {
+    stage.ranOnCore = xPortGetCoreID();
+    stage.startUs = esp_timer_get_time();
+
+    if (dependenciesFailed(stage)) {
+        logger->log("Boot: skipping '%s', a dependency failed", stage.name);
+        stage.ok = false;
+    } else {
+        stage.ok = stage.fn();
+    }
+
+    stage.endUs = esp_timer_get_time();
+    BootTrace::mark(stage.name);
+
+    if (!stage.ok) {
+        failedBits |= stage.bit;
+    }
+
+    if (events) {
+        xEventGroupSetBits(events, stage.bit);
+    }
+}
+
+void BootScheduler::stageTaskEntry(void* param) {
+    Stage* stage = static_cast<Stage*>(param);
+    BootScheduler* owner = stage->owner;
+
+    if (stage->dependsOn) {
+        xEventGroupWaitBits(owner->events, stage->dependsOn, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    owner->execute(*stage);
+    vTaskDelete(nullptr);
+}
+
+void BootScheduler::dumpTimeline() {
+    logger->log("=== Boot stages ===");
+
+    for (size_t i = 0; i < stageCount; i++) {
+        const Stage& stage = stages[i];
+        logger->log("  %-12s core %d  %7lld -> %7lld us  (%lld us)%s",
+            stage.name, stage.ranOnCore, stage.startUs, stage.endUs,
+            stage.endUs - stage.startUs, stage.ok ? "" : "  FAILED");
+    }
+
+    logger->log("===================");
+}
@@ -0,0 +1,64 @@
+#ifndef BOOT_SCHEDULER_H
+#define BOOT_SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+#include "../config.h"
+#include "../diag/log_ring.h"
+
+/**
+ * Dependency-aware boot scheduler.
+ *
+ * Stages are added with a core and a dependency mask (the values returned
+ * by earlier addStage() calls OR-ed together). Stages pinned to another
+ * core run on their own short-lived task; CALLER_CORE stages run on the
+ * calling task, picking the first one whose dependencies are met. If a
+ * stage task cannot be created the stage runs on the caller instead, so
+ * boot degrades to serial rather than failing.
+ */
+class BootScheduler {
+public:
+    static const int CALLER_CORE = -1;
+
+    using StageFn = std::function<bool()>;
+
+    explicit BootScheduler(LogRing* log);
+    ~BootScheduler();
+
+    // Returns the stage's dependency bit
+    uint32_t addStage(const char* name, int core, uint32_t dependsOn, StageFn fn);
+
+    // Runs every stage; false if any stage failed or timed out
+    bool run();
+
+    // Per-stage start/end times and cores
+    void dumpTimeline();
+
+private:
+    struct Stage {
+        const char* name;
+        int core;
+        uint32_t dependsOn;
+        StageFn fn;
+        bool remote;
+        bool ok;
+        int ranOnCore;
+        int64_t startUs;
+        int64_t endUs;
+        BootScheduler* owner;
+        uint32_t bit;
+    };
+
+    LogRing* logger;
+    EventGroupHandle_t events;
+    Stage stages[BOOT_MAX_STAGES];
+    size_t stageCount;
+    volatile uint32_t failedBits;
+
+    void execute(Stage& stage);
+    bool dependenciesFailed(const Stage& stage) const;
+
+    static void stageTaskEntry(void* param);
+};
+
+#endif // BOOT_SCHEDULER_H
@@ -0,0 +1,187 @@
+#include "button_input.h"
+#include "timer_wheel.h"
+#include <driver/gpio.h>
+#include <esp_timer.h>
+
+// The input task's handle for the ISR; set once before interrupts attach
+static TaskHandle_t inputTask = nullptr;
+
+// Edge stamps (ISR vs input task) and the event ring (input task vs loop)
+static portMUX_TYPE edgeMux = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const int64_t DEBOUNCE_US = (int64_t)BUTTON_DEBOUNCE_MS * 1000;
+static const int64_t LONG_PRESS_US = (int64_t)LONG_PRESS_DURATION_MS * 1000;
+
+ButtonInput& ButtonInput::getInstance() {
+    static ButtonInput instance;
+    return instance;
+}
+
+ButtonInput::ButtonInput()
+    : logger(nullptr)
+    , task(nullptr)
+    , ringHead(0)
+    , ringTail(0)
+    , dropped(0) {
+    memset(buttons, 0, sizeof(buttons));
+    memset(ring, 0, sizeof(ring));
+    buttons[0].pin = PIN_BUTTON_1;
+    buttons[0].number = 1;
+    buttons[1].pin = PIN_BUTTON_2;
+    buttons[1].number = 2;
+}
+
+bool ButtonInput::begin(LogRing* log) {
+    if (!log) {
+        return false;
+    }
+    logger = log;
+
+    // Buttons are active low
+    for (Button& button : buttons) {
+        pinMode(button.pin, INPUT_PULLUP);
+        button.pressed = digitalRead(button.pin) == LOW;
+    }
+
+    if (xTaskCreatePinnedToCore(taskEntry, "Input", INPUT_TASK_STACK, this,
+                                TASK_PRIORITY_INPUT, &task, CORE_INPUT) != pdPASS) {
+        logger->log("ERROR: Input task failed to start");
+        return false;
+    }
+    inputTask = task;
+
+    for (Button& button : buttons) {
+        attachInterruptArg(button.pin, onEdge, &button, button.pressed ? ONHIGH : ONLOW);
+    }
+
+    logger->log("Buttons: interrupt-driven on GPIO %u and %u", buttons[0].pin, buttons[1].pin);
+    return true;
+}
+
+void IRAM_ATTR ButtonInput::onEdge(void* arg) {
+    Button* button = static_cast<Button*>(arg);
+    int64_t now = esp_timer_get_time();
+
+    // Wait for the opposite level next, which makes this an edge interrupt
+    bool released = gpio_get_level((gpio_num_t)button->pin);
+    gpio_set_intr_type((gpio_num_t)button->pin, released ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+
+    portENTER_CRITICAL_ISR(&edgeMux);
+    if (!button->edgeUs) {
+        button->edgeUs = now;
+    }
+    portEXIT_CRITICAL_ISR(&edgeMux);
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(inputTask, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+// ============================================================================
+// Input Task
+// ============================================================================
+
+void ButtonInput::taskEntry(void* param) {
+    static_cast<ButtonInput*>(param)->run();
+}
+
+void ButtonInput::run() {
+    TickType_t wait = portMAX_DELAY;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        int64_t now = esp_timer_get_time();
+        int64_t nextUs = -1;
+        for (Button& button : buttons) {
+            int64_t dueUs = service(button, now);
+            if (dueUs >= 0 && (nextUs < 0 || dueUs < nextUs)) {
+                nextUs = dueUs;
+            }
+        }
+
+        // Sleep until the next edge, or until a bounce settles or a hold
+        // becomes a long press
+        wait = nextUs < 0 ? portMAX_DELAY : pdMS_TO_TICKS((uint32_t)(nextUs / 1000) + 1);
+    }
+}
+
+int64_t ButtonInput::service(Button& button, int64_t nowUs) {
+    portENTER_CRITICAL(&edgeMux);
+    int64_t edgeUs = button.edgeUs;
+    button.edgeUs = 0;
+    portEXIT_CRITICAL(&edgeMux);
+
+    if (edgeUs && !button.pendingEdgeUs) {
+        button.pendingEdgeUs = edgeUs;
+    }
+
+    bool pressed = digitalRead(button.pin) == LOW;
+    if (pressed != button.pressed) {
+        // Leading-edge debounce: the first edge counts, then the pin is
+        // ignored until it has had BUTTON_DEBOUNCE_MS to settle
+        int64_t settleUs = button.changedUs + DEBOUNCE_US - nowUs;
+        if (button.changedUs && settleUs > 0) {
+            return settleUs;
+        }
+
+        int64_t startUs = button.pendingEdgeUs ? button.pendingEdgeUs : nowUs;
+        button.pressed = pressed;
+        button.changedUs = nowUs;
+        button.pendingEdgeUs = 0;
+
+        if (pressed) {
+            button.pressStartUs = startUs;
+            button.longFired = false;
+        } else if (!button.longFired) {
+            push(button.number, false, startUs, nowUs);
+        }
+    } else {
+        // Bounced back to where it was
+        button.pendingEdgeUs = 0;
+    }
+
+    if (button.pressed && !button.longFired) {
+        int64_t holdUs = button.pressStartUs + LONG_PRESS_US - nowUs;
+        if (holdUs > 0) {
+            return holdUs;
+        }
+        button.longFired = true;
+        push(button.number, true, button.pressStartUs + LONG_PRESS_US, nowUs);
+    }
+
+    return -1;
+}
+
+void ButtonInput::push(uint8_t button, bool longPress, int64_t edgeUs, int64_t decidedUs) {
+    portENTER_CRITICAL(&ringMux);
+    size_t next = (ringHead + 1) % INPUT_EVENT_RING_LEN;
+    bool full = next == ringTail;
+    if (!full) {
+        Event& event = ring[ringHead];
+        event.button = button;
+        event.longPress = longPress;
+        event.edgeUs = edgeUs;
+        event.decidedUs = decidedUs;
+        ringHead = next;
+    }
+    portEXIT_CRITICAL(&ringMux);
+
+    if (full) {
+        dropped++;
+        return;
+    }
+    TimerWheel::getInstance().wake();
+}
+
+bool ButtonInput::poll(Event& event) {
+    portENTER_CRITICAL(&ringMux);
+    bool available = ringTail != ringHead;
+    if (available) {
+        event = ring[ringTail];
+        ringTail = (ringTail + 1) % INPUT_EVENT_RING_LEN;
+    }
+    portEXIT_CRITICAL(&ringMux);
+    return available;
+}
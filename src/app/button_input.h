@@ -0,0 +1,75 @@
+#ifndef BUTTON_INPUT_H
+#define BUTTON_INPUT_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "../diag/log_ring.h"
+
+/**
+ * Low-latency button input.
+ *
+ * Both pins interrupt on every level change. The interrupt stamps the edge
+ * and wakes a small input task, which debounces on the leading edge and
+ * reports a click on release, or a long press once LONG_PRESS_DURATION_MS
+ * is reached while held. A click is reported as soon as the button is
+ * released: there is no multi-click window. Presses queue for the app loop,
+ * which wakes at once and can apply a burst as a single change.
+ *
+ * The interrupts are level-triggered and re-armed for the opposite level
+ * each time they fire, so the pins stay valid light-sleep wake sources.
+ */
+class ButtonInput {
+public:
+    struct Event {
+        uint8_t button;     // 1 or 2
+        bool longPress;
+        int64_t edgeUs;     // GPIO edge that started it
+        int64_t decidedUs;  // when the input task reported it
+    };
+
+    static ButtonInput& getInstance();
+
+    bool begin(LogRing* log);
+
+    // Next decided press, oldest first; app loop only
+    bool poll(Event& event);
+
+    uint32_t getDropped() const { return dropped; }
+
+private:
+    ButtonInput();
+
+    // Prevent copying
+    ButtonInput(const ButtonInput&) = delete;
+    ButtonInput& operator=(const ButtonInput&) = delete;
+
+    struct Button {
+        uint8_t pin;
+        uint8_t number;
+        volatile int64_t edgeUs;    // first edge the task hasn't seen (ISR)
+        int64_t pendingEdgeUs;      // edge of a change still bouncing
+        int64_t changedUs;          // last accepted change
+        int64_t pressStartUs;
+        bool pressed;
+        bool longFired;
+    };
+
+    LogRing* logger;
+    Button buttons[2];
+    TaskHandle_t task;
+
+    Event ring[INPUT_EVENT_RING_LEN];
+    size_t ringHead;
+    size_t ringTail;
+    volatile uint32_t dropped;
+
+    static void IRAM_ATTR onEdge(void* arg);
+    static void taskEntry(void* param);
+    void run();
+
+    // Returns how long (us) until this button needs another look, or -1
+    int64_t service(Button& button, int64_t nowUs);
+    void push(uint8_t button, bool longPress, int64_t edgeUs, int64_t decidedUs);
+};
+
+#endif // BUTTON_INPUT_H
@@ -1,5 +1,35 @@
 #include "counter_app.h"
-#include "logger/Logger.h"
+#include "registry_sync.h"
+#include "access_schedule.h"
+#include "counter_history.h"
+#include "presence_stats.h"
+#include "../storage/config_store.h"
+#include "../storage/rtc_snapshot.h"
+#include "../gate/relay_controller.h"
+#include "../diag/metrics.h"
+#include "../diag/heap_guard.h"
+#include "../telemetry/mqtt_bridge.h"
+#include "../replication/counter_replica.h"
+#include "../diag/log_ring.h"
+
+static_assert(COUNTER_CHANNELS >= 1 && COUNTER_CHANNELS <= 64, "Channel masks are 64-bit");
+static_assert(COUNTER_CHANNEL_MAIN == 0, "The main counter is channel 0");
+
+static const size_t CHANNEL_MASK_LEN = (COUNTER_CHANNELS + 7) / 8;
+
+// Channel values and change masks are updated from the BLE task and the app loop
+static portMUX_TYPE channelMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void putU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
 
 CounterApp& CounterApp::getInstance() {
     static CounterApp instance;
@@ -7,18 +37,37 @@ CounterApp& CounterApp::getInstance() {
 }
 
 CounterApp::CounterApp()
-    : counterValue(0)
+    : counterValue(channelValues[COUNTER_CHANNEL_MAIN])
+    , notifyMask(0)
+    , persistMask(0)
     , deviceNearby(false)
     , registeredDeviceCount(0)
+    , registryVersion(0)
+    , reconcilePending(false)
+    , persistTimer([](void* arg) { static_cast<CounterApp*>(arg)->saveCounter(); }, this)
     , config(nullptr)
-    , logger(nullptr) {
+    , logger(nullptr)
+    , stateMutex(nullptr) {
+    // Static storage: usable before begin() and never fails
+    stateMutex = xSemaphoreCreateRecursiveMutexStatic(&stateMutexBuffer);
+    memset(channelValues, 0, sizeof(channelValues));
+    memset(channelNames, 0, sizeof(channelNames));
     memset(registeredDevices, 0, sizeof(registeredDevices));
+    memset(nearbyMac, 0, sizeof(nearbyMac));
 }
 
 CounterApp::~CounterApp() {
 }
 
-bool CounterApp::begin(IConfig* cfg, Logger* log) {
+CounterApp::Lock::Lock() {
+    xSemaphoreTakeRecursive(CounterApp::getInstance().stateMutex, portMAX_DELAY);
+}
+
+CounterApp::Lock::~Lock() {
+    xSemaphoreGiveRecursive(CounterApp::getInstance().stateMutex);
+}
+
+bool CounterApp::begin(IConfig* cfg, LogRing* log) {
     if (!log) {
         return false;
     }
@@ -33,31 +82,243 @@ bool CounterApp::begin(IConfig* cfg, Logger* log) {
 
     config = cfg;
 
+    AccessSchedule::getInstance().begin(config, logger);
+
+    loadChannels();
     loadCounter();
     loadDevices();
+    resolveSchedules();
+
+#if REPLICATION_ENABLED
+    counterValue = CounterReplica::getInstance().begin(config, logger, counterValue);
+#endif
+
+    RegistrySync::getInstance().begin(config, logger);
 
     logger->log("Counter app initialized with value: %d", counterValue);
     logger->log("Registered devices: %zu", registeredDeviceCount);
 
+    updateSnapshot();
+    updateRegistrySnapshot();
+    subscribeToState();
+
     return true;
 }
 
+bool CounterApp::beginFromSnapshot(IConfig* cfg, LogRing* log) {
+    if (!log || !cfg) {
+        return false;
+    }
+
+    RtcSnapshotData snapshot;
+    if (!RtcSnapshot::load(snapshot)) {
+        return false;
+    }
+
+    logger = log;
+    config = cfg;
+
+    loadChannels();
+    memcpy(channelValues, snapshot.channelValues, sizeof(channelValues));
+    registryVersion = snapshot.registryVersion;
+    registeredDeviceCount = snapshot.registeredDeviceCount;
+    memset(registeredDevices, 0, sizeof(registeredDevices));
+    for (size_t i = 0; i < registeredDeviceCount; i++) {
+        memcpy(registeredDevices[i].macAddress, snapshot.macAddresses[i], 6);
+        registeredDevices[i].isValid = true;
+    }
+
+    if (hashRegistry(registeredDevices, registeredDeviceCount) != snapshot.registryHash) {
+        logger->log("Warm boot snapshot registry digest mismatch, falling back to flash");
+        RtcSnapshot::invalidate();
+        return false;
+    }
+
+    AccessSchedule::getInstance().begin(config, logger);
+    resolveSchedules();
+
+    RegistrySync::getInstance().begin(config, logger);
+
+#if REPLICATION_ENABLED
+    counterValue = CounterReplica::getInstance().begin(config, logger, counterValue);
+#endif
+
+    // Timestamps and anything the snapshot doesn't carry come from flash later
+    reconcilePending = true;
+    subscribeToState();
+
+    logger->log("Counter app restored from RTC snapshot (warm boot #%u): value %d, %zu devices",
+        snapshot.bootCount, counterValue, registeredDeviceCount);
+
+    return true;
+}
+
+void CounterApp::reconcileWithStorage() {
+    if (!reconcilePending || !config) {
+        return;
+    }
+
+    reconcilePending = false;
+    Lock lock;
+
+    // Once per warm boot, after the heap is sealed: reads the registry and
+    // schedules back out of the config document
+    HeapGuard::Allow oneOff;
+
+    RegisteredDevice* stored = scratchDevices;
+    size_t storedCount = readStoredDevices(stored);
+    uint32_t storedVersion = config->getInt(CONFIG_REGISTRY_VERSION, 0);
+    uint32_t storedHash = hashRegistry(stored, storedCount);
+
+    if (storedVersion > registryVersion) {
+        // Flash is newer than RAM (should not happen); trust flash
+        logger->log("Reconcile: flash registry v%u newer than snapshot v%u, reloading",
+            storedVersion, registryVersion);
+        loadDevices();
+        StateBus::getInstance().publish(StateBus::REGISTRY);
+    } else if (storedVersion < registryVersion || storedHash != getRegistryHash()) {
+        // The reset beat the last flush; persist what RAM holds
+        logger->log("Reconcile: persisting registry v%u over flash v%u", registryVersion, storedVersion);
+        saveDevices();
+    } else {
+        // Same set: pick up the registration timestamps from flash
+        for (size_t i = 0; i < registeredDeviceCount; i++) {
+            for (size_t j = 0; j < storedCount; j++) {
+                if (memcmp(registeredDevices[i].macAddress, stored[j].macAddress, 6) == 0) {
+                    registeredDevices[i].registeredTimestamp = stored[j].registeredTimestamp;
+                    break;
+                }
+            }
+        }
+    }
+
+    resolveSchedules();
+
+    bool stale = false;
+    for (uint8_t channel = 0; channel < COUNTER_CHANNELS; channel++) {
+        char key[32];
+        snprintf(key, sizeof(key), "%s.%u.value", CONFIG_CHANNELS_PREFIX, channel);
+        int32_t storedValue = channel == COUNTER_CHANNEL_MAIN ? config->getInt(CONFIG_COUNTER_VALUE, 0)
+                                                              : config->getInt(key, 0);
+        if (storedValue != channelValues[channel]) {
+            channelChanged(channel);
+            stale = true;
+        }
+    }
+    if (stale) {
+        logger->log("Reconcile: persisting counter table (value %d)", counterValue);
+        saveCounter();
+    }
+
+    updateSnapshot();
+    updateRegistrySnapshot();
+    logger->log("Reconciled warm boot state with flash");
+}
+
 void CounterApp::increment() {
-    counterValue++;
-    BLEManager::getInstance().updateCounterValue(counterValue);
+    add(1);
 }
 
 void CounterApp::decrement() {
-    counterValue--;
-    BLEManager::getInstance().updateCounterValue(counterValue);
+    add(-1);
+}
+
+void CounterApp::add(int32_t delta) {
+    // A burst of clicks is one change: one snapshot, one notify, one frame
+    HeapGuard::Scope heapScope;
+    Lock lock;
+    applyDelta(delta);
+    CounterHistory::getInstance().record(counterValue);
+    channelChanged(COUNTER_CHANNEL_MAIN);
+    updateSnapshot();
+    StateBus::getInstance().publish(StateBus::COUNTER);
 }
 
 void CounterApp::setValue(int32_t value) {
-    counterValue = value;
-    BLEManager::getInstance().updateCounterValue(counterValue);
+    Lock lock;
+    // Replicated, an absolute write becomes this gate's share of the change
+    applyDelta(value - counterValue);
+    CounterHistory::getInstance().record(counterValue);
+    channelChanged(COUNTER_CHANNEL_MAIN);
+    updateSnapshot();
+    StateBus::getInstance().publish(StateBus::COUNTER);
+}
+
+void CounterApp::applyDelta(int32_t delta) {
+#if REPLICATION_ENABLED
+    CounterReplica::getInstance().add(delta);
+    syncReplicatedValue();
+#else
+    portENTER_CRITICAL(&channelMux);
+    counterValue += delta;
+    portEXIT_CRITICAL(&channelMux);
+#endif
+}
+
+void CounterApp::syncReplicatedValue() {
+    // BLE adds and app-loop merges both land here; whoever writes last reads
+    // the replica last, so neither can overwrite the other with a stale total
+    portENTER_CRITICAL(&channelMux);
+    counterValue = CounterReplica::getInstance().value();
+    portEXIT_CRITICAL(&channelMux);
+}
+
+void CounterApp::applyReplicatedValue() {
+    Lock lock;
+    syncReplicatedValue();
+    CounterHistory::getInstance().record(counterValue);
+    channelChanged(COUNTER_CHANNEL_MAIN);
+    updateSnapshot();
+    StateBus::getInstance().publish(StateBus::COUNTER);
+}
+
+bool CounterApp::addToChannel(uint8_t channel, int32_t delta) {
+    if (channel >= COUNTER_CHANNELS) {
+        return false;
+    }
+    if (channel == COUNTER_CHANNEL_MAIN) {
+        add(delta);
+        return true;
+    }
+
+    portENTER_CRITICAL(&channelMux);
+    channelValues[channel] += delta;
+    portEXIT_CRITICAL(&channelMux);
+
+    channelChanged(channel);
+    updateSnapshot();
+    StateBus::getInstance().publish(StateBus::CHANNELS);
+    return true;
+}
+
+bool CounterApp::setChannel(uint8_t channel, int32_t value) {
+    if (channel >= COUNTER_CHANNELS) {
+        return false;
+    }
+    if (channel == COUNTER_CHANNEL_MAIN) {
+        setValue(value);
+        return true;
+    }
+
+    portENTER_CRITICAL(&channelMux);
+    channelValues[channel] = value;
+    portEXIT_CRITICAL(&channelMux);
+
+    channelChanged(channel);
+    updateSnapshot();
+    StateBus::getInstance().publish(StateBus::CHANNELS);
+    return true;
+}
+
+void CounterApp::channelChanged(uint8_t channel) {
+    portENTER_CRITICAL(&channelMux);
+    notifyMask |= 1ull << channel;
+    persistMask |= 1ull << channel;
+    portEXIT_CRITICAL(&channelMux);
 }
 
 void CounterApp::registerDevice(uint8_t* macAddress) {
+    Lock lock;
     for (size_t i = 0; i < registeredDeviceCount; i++) {
         if (registeredDevices[i].isValid &&
             memcmp(registeredDevices[i].macAddress, macAddress, 6) == 0) {
@@ -70,7 +331,11 @@ void CounterApp::registerDevice(uint8_t* macAddress) {
         registeredDevices[registeredDeviceCount].isValid = true;
         memcpy(registeredDevices[registeredDeviceCount].macAddress, macAddress, 6);
         registeredDevices[registeredDeviceCount].registeredTimestamp = millis();
+        registeredDevices[registeredDeviceCount].schedule = AccessSchedule::getInstance().lookup(macAddress);
         registeredDeviceCount++;
+        registryVersion++;
+        updateRegistrySnapshot();
+        StateBus::getInstance().publish(StateBus::REGISTRY);
 
         logger->log("Device registered: %02X:%02X:%02X:%02X:%02X:%02X",
             macAddress[0], macAddress[1], macAddress[2],
@@ -84,23 +349,34 @@ void CounterApp::registerDevice(uint8_t* macAddress) {
 void CounterApp::clearAllDevices() {
     logger->log("Clearing all registered devices");
 
+    // Before the lock: bond removal runs on the BLE stack, which may be
+    // waiting for it in isDeviceAllowed
     BLEManager::getInstance().clearAllBonds();
 
+    Lock lock;
     memset(registeredDevices, 0, sizeof(registeredDevices));
     registeredDeviceCount = 0;
 
     // Clear from config storage
+    ConfigStore& store = ConfigStore::getInstance();
+    store.beginTransaction();
     for (size_t i = 0; i < MAX_REGISTERED_DEVICES; i++) {
         char key[32];
         snprintf(key, sizeof(key), "%s.%zu.valid", CONFIG_DEVICES_PREFIX, i);
-        config->setBool(key, false);
+        store.setBool(key, false);
     }
-    config->save();
+    registryVersion++;
+    store.setInt(CONFIG_REGISTRY_VERSION, registryVersion);
+    store.commit();
+
+    updateRegistrySnapshot();
+    StateBus::getInstance().publish(StateBus::REGISTRY);
 
     logger->log("All devices and BLE bonds cleared");
 }
 
 bool CounterApp::isDeviceRegistered(uint8_t* macAddress) {
+    Lock lock;
     for (size_t i = 0; i < registeredDeviceCount; i++) {
         if (registeredDevices[i].isValid &&
             memcmp(registeredDevices[i].macAddress, macAddress, 6) == 0) {
@@ -110,7 +386,126 @@ bool CounterApp::isDeviceRegistered(uint8_t* macAddress) {
     return false;
 }
 
+bool CounterApp::isDeviceAllowed(uint8_t* macAddress) {
+    Lock lock;
+    for (size_t i = 0; i < registeredDeviceCount; i++) {
+        if (registeredDevices[i].isValid &&
+            memcmp(registeredDevices[i].macAddress, macAddress, 6) == 0) {
+            return AccessSchedule::getInstance().allows(registeredDevices[i].schedule);
+        }
+    }
+    return false;
+}
+
+void CounterApp::resolveSchedules() {
+    AccessSchedule& schedules = AccessSchedule::getInstance();
+    for (size_t i = 0; i < registeredDeviceCount; i++) {
+        registeredDevices[i].schedule = schedules.lookup(registeredDevices[i].macAddress);
+    }
+}
+
+bool CounterApp::applyRegistryDiff(const uint8_t adds[][6], size_t addCount,
+                                   const uint8_t removes[][6], size_t removeCount) {
+    // Build the result in a scratch table so a rejected diff changes nothing
+    Lock lock;
+    RegisteredDevice* next = scratchDevices;
+    size_t nextCount = 0;
+
+    for (size_t i = 0; i < registeredDeviceCount; i++) {
+        bool removed = false;
+        for (size_t r = 0; r < removeCount; r++) {
+            if (memcmp(registeredDevices[i].macAddress, removes[r], 6) == 0) {
+                removed = true;
+                break;
+            }
+        }
+        if (!removed) {
+            next[nextCount++] = registeredDevices[i];
+        }
+    }
+
+    uint32_t now = millis();
+    for (size_t a = 0; a < addCount; a++) {
+        bool present = false;
+        for (size_t i = 0; i < nextCount; i++) {
+            if (memcmp(next[i].macAddress, adds[a], 6) == 0) {
+                present = true;
+                break;
+            }
+        }
+        if (present) {
+            continue;
+        }
+
+        if (nextCount >= MAX_REGISTERED_DEVICES) {
+            logger->log("ERROR: Registry diff exceeds %d devices", MAX_REGISTERED_DEVICES);
+            return false;
+        }
+
+        memcpy(next[nextCount].macAddress, adds[a], 6);
+        next[nextCount].registeredTimestamp = now;
+        next[nextCount].schedule = AccessSchedule::getInstance().lookup(adds[a]);
+        next[nextCount].isValid = true;
+        nextCount++;
+    }
+
+    memcpy(registeredDevices, next, nextCount * sizeof(RegisteredDevice));
+    registeredDeviceCount = nextCount;
+    registryVersion++;
+    saveDevices();
+    updateRegistrySnapshot();
+    StateBus::getInstance().publish(StateBus::REGISTRY);
+
+    return true;
+}
+
+uint32_t CounterApp::getRegistryHash() const {
+    Lock lock;
+    return hashRegistry(registeredDevices, registeredDeviceCount);
+}
+
+uint32_t CounterApp::hashRegistry(const RegisteredDevice* devices, size_t count) {
+    // Order-independent digest: sum of per-device FNV-1a hashes, so two gates
+    // holding the same set in a different slot order agree.
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t h = 2166136261u;
+        for (int j = 0; j < 6; j++) {
+            h ^= devices[i].macAddress[j];
+            h *= 16777619u;
+        }
+        sum += h;
+    }
+
+    // Fold in the count so the empty set and colliding sums still differ
+    sum ^= (uint32_t)count * 0x9E3779B9u;
+    return sum;
+}
+
+void CounterApp::updateSnapshot() {
+    int32_t values[COUNTER_CHANNELS];
+    portENTER_CRITICAL(&channelMux);
+    memcpy(values, channelValues, sizeof(values));
+    portEXIT_CRITICAL(&channelMux);
+    RtcSnapshot::storeChannels(values);
+}
+
+void CounterApp::updateRegistrySnapshot() {
+    RtcSnapshot::storeRegistry(registryVersion, getRegistryHash(), registeredDevices, registeredDeviceCount);
+    Metrics::setGauge(Metrics::Gauge::REGISTERED_DEVICES, (int32_t)registeredDeviceCount);
+}
+
 void CounterApp::onDeviceConnected(uint8_t* macAddress) {
+    // Gate fast path: actuate before any logging or notification work
+    bool authorized = !BLEManager::getInstance().isInPairingMode() && isDeviceAllowed(macAddress);
+    if (authorized) {
+        RelayController::getInstance().trigger(RelaySource::AUTHORIZED_CONNECT,
+                                               BLEManager::getInstance().getLastConnectTimeUs());
+    }
+
+    RegistrySync::getInstance().resetSession();
+    StateBus::getInstance().publish(StateBus::CONNECTION);
+
     logger->log("Device connected callback: %02X:%02X:%02X:%02X:%02X:%02X",
         macAddress[0], macAddress[1], macAddress[2],
         macAddress[3], macAddress[4], macAddress[5]);
@@ -118,32 +513,48 @@ void CounterApp::onDeviceConnected(uint8_t* macAddress) {
     // If in pairing mode, register the device and allow connection
     if (BLEManager::getInstance().isInPairingMode()) {
         registerDevice(macAddress);
-        deviceNearby = true;
-        BLEManager::getInstance().updateProximityStatus(true);
+        markNearby(macAddress);
+        StateBus::getInstance().publish(StateBus::PROXIMITY);
         logger->log("Device registered and connected (pairing mode)");
         return;
     }
 
     // Check if device is authorized (registered)
-    if (!isDeviceRegistered(macAddress)) {
-        logger->log("UNAUTHORIZED: Device not registered");
+    if (!authorized) {
+        logger->log("UNAUTHORIZED: Device not registered or outside its schedule");
+        denyAccess(AccessDenial::CONNECT);
         // Don't allow proximity status or operations
         // The device will be rejected at the characteristic level
         return;
     }
 
     // Device is authorized
-    deviceNearby = true;
-    BLEManager::getInstance().updateProximityStatus(true);
+    markNearby(macAddress);
+    StateBus::getInstance().publish(StateBus::PROXIMITY);
     logger->log("Authorized device connected");
 }
 
+void CounterApp::markNearby(const uint8_t* macAddress) {
+    Lock lock;
+    deviceNearby = true;
+    memcpy(nearbyMac, macAddress, 6);
+    PresenceStats::getInstance().arrive(macAddress);
+}
+
 void CounterApp::onDeviceDisconnected() {
-    deviceNearby = false;
+    RegistrySync::getInstance().resetSession();
+    CounterHistory::getInstance().cancelQuery();
+
+    {
+        Lock lock;
+        if (deviceNearby) {
+            PresenceStats::getInstance().depart(nearbyMac);
+        }
+        deviceNearby = false;
+    }
     logger->log("Device disconnected callback");
 
-    // Update proximity status
-    BLEManager::getInstance().updateProximityStatus(false);
+    StateBus::getInstance().publish(StateBus::PROXIMITY | StateBus::CONNECTION);
 }
 
 void CounterApp::onCounterRead(int32_t& value) {
@@ -151,8 +562,9 @@ void CounterApp::onCounterRead(int32_t& value) {
     uint8_t macAddress[6];
     BLEManager::getInstance().getConnectedDeviceMAC(macAddress);
 
-    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceRegistered(macAddress)) {
-        logger->log("UNAUTHORIZED: Read attempt from unregistered device");
+    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceAllowed(macAddress)) {
+        logger->log("UNAUTHORIZED: Read attempt from unregistered or out-of-schedule device");
+        denyAccess(AccessDenial::READ);
         value = 0;
         return;
     }
@@ -166,8 +578,9 @@ void CounterApp::onCounterWrite(int32_t value) {
     uint8_t macAddress[6];
     BLEManager::getInstance().getConnectedDeviceMAC(macAddress);
 
-    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceRegistered(macAddress)) {
-        logger->log("UNAUTHORIZED: Write attempt from unregistered device");
+    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceAllowed(macAddress)) {
+        logger->log("UNAUTHORIZED: Write attempt from unregistered or out-of-schedule device");
+        denyAccess(AccessDenial::WRITE);
         return;
     }
 
@@ -175,15 +588,280 @@ void CounterApp::onCounterWrite(int32_t value) {
     setValue(value);
 }
 
+void CounterApp::onGateCommand(uint8_t command, int64_t eventTimeUs) {
+    uint8_t macAddress[6];
+    BLEManager::getInstance().getConnectedDeviceMAC(macAddress);
+
+    if (!isDeviceAllowed(macAddress)) {
+        logger->log("UNAUTHORIZED: Gate command from unregistered or out-of-schedule device");
+        denyAccess(AccessDenial::GATE);
+        return;
+    }
+
+    if (command != GATE_COMMAND_OPEN) {
+        logger->log("Unknown gate command: 0x%02X", command);
+        return;
+    }
+
+    RelayController::getInstance().trigger(RelaySource::GATE_COMMAND, eventTimeUs);
+}
+
+void CounterApp::onPairingModeEnter() {
+    StateBus::getInstance().publish(StateBus::PAIRING);
+}
+
 void CounterApp::onPairingModeExit() {
     logger->log("Pairing mode exited - saving registered devices");
     saveDevices();
+    StateBus::getInstance().publish(StateBus::PAIRING);
+}
+
+void CounterApp::onRegistryCommand(const uint8_t* data, size_t length) {
+    RegistrySync::getInstance().handleCommand(data, length);
+}
+
+bool CounterApp::onChannelsRead() {
+    uint8_t macAddress[6];
+    BLEManager::getInstance().getConnectedDeviceMAC(macAddress);
+
+    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceAllowed(macAddress)) {
+        logger->log("UNAUTHORIZED: Channel read from unregistered or out-of-schedule device");
+        denyAccess(AccessDenial::READ);
+        return false;
+    }
+
+    return true;
 }
 
+size_t CounterApp::getChannelsPage(uint8_t page, uint8_t* out, size_t capacity) {
+    size_t length = 0;
+    if (page == CHANNELS_PAGE_NAMES) {
+        // NUL-terminated names in channel order
+        for (uint8_t channel = 0; channel < COUNTER_CHANNELS; channel++) {
+            size_t nameLength = strlen(channelNames[channel]) + 1;
+            if (length + nameLength > capacity) {
+                break;
+            }
+            memcpy(out + length, channelNames[channel], nameLength);
+            length += nameLength;
+        }
+        return length;
+    }
+
+    // Every value, packed little-endian in channel order
+    portENTER_CRITICAL(&channelMux);
+    for (uint8_t channel = 0; channel < COUNTER_CHANNELS && length + 4 <= capacity; channel++) {
+        putU32(out + length, (uint32_t)channelValues[channel]);
+        length += 4;
+    }
+    portEXIT_CRITICAL(&channelMux);
+    return length;
+}
+
+void CounterApp::onChannelRead(uint8_t channel, int32_t& value) {
+    uint8_t macAddress[6];
+    BLEManager::getInstance().getConnectedDeviceMAC(macAddress);
+
+    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceAllowed(macAddress)) {
+        denyAccess(AccessDenial::READ);
+        value = 0;
+        return;
+    }
+
+    value = getChannel(channel);
+}
+
+void CounterApp::onChannelsWrite(const uint8_t* ops, size_t count) {
+    uint8_t macAddress[6];
+    BLEManager::getInstance().getConnectedDeviceMAC(macAddress);
+
+    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceAllowed(macAddress)) {
+        logger->log("UNAUTHORIZED: Channel write from unregistered or out-of-schedule device");
+        denyAccess(AccessDenial::WRITE);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* op = ops + i * CHANNEL_OP_LEN;
+        uint8_t channel = op[1];
+        int32_t operand = (int32_t)getU32(op + 2);
+
+        bool applied = false;
+        if (op[0] == CHANNEL_OP_ADD) {
+            applied = addToChannel(channel, operand);
+        } else if (op[0] == CHANNEL_OP_SET) {
+            applied = setChannel(channel, operand);
+        }
+        if (!applied) {
+            logger->log("Channel op 0x%02X on channel %u rejected", op[0], channel);
+        }
+    }
+}
+
+void CounterApp::denyAccess(AccessDenial reason) {
+    MqttBridge::getInstance().record(TelemetryEvent::ACCESS_DENIED, (int32_t)reason);
+#if COUNTER_CHANNEL_DENIED < COUNTER_CHANNELS
+    addToChannel(COUNTER_CHANNEL_DENIED, 1);
+#endif
+}
+
+void CounterApp::onHistoryQuery(const uint8_t* data, size_t length) {
+    uint8_t macAddress[6];
+    BLEManager::getInstance().getConnectedDeviceMAC(macAddress);
+
+    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceAllowed(macAddress)) {
+        logger->log("UNAUTHORIZED: History query from unregistered or out-of-schedule device");
+        denyAccess(AccessDenial::READ);
+        return;
+    }
+
+    CounterHistory::getInstance().handleQuery(data, length);
+}
+
+bool CounterApp::onDiagnosticsRequest() {
+    uint8_t macAddress[6];
+    BLEManager::getInstance().getConnectedDeviceMAC(macAddress);
+
+    if (!BLEManager::getInstance().isInPairingMode() && !isDeviceAllowed(macAddress)) {
+        logger->log("UNAUTHORIZED: Diagnostics request from unregistered or out-of-schedule device");
+        denyAccess(AccessDenial::READ);
+        return false;
+    }
+
+    return true;
+}
+
+// ============================================================================
+// State Propagation
+// ============================================================================
+
+void CounterApp::subscribeToState() {
+    StateBus::getInstance().subscribe(this, StateBus::COUNTER | StateBus::CHANNELS | StateBus::PROXIMITY,
+                                      StateBus::Delivery::APP_LOOP);
+}
+
+void CounterApp::onStateChanged(uint32_t fields, uint32_t version) {
+    // One notify per loop iteration however many changes landed in between
+    if (fields & StateBus::COUNTER) {
+        BLEManager::getInstance().updateCounterValue(counterValue);
+    }
+
+    if (fields & (StateBus::COUNTER | StateBus::CHANNELS)) {
+        notifyChannels();
+
+        // Re-arming pushes the write out until the values settle
+        TimerWheel::getInstance().arm(persistTimer, COUNTER_PERSIST_DELAY_MS);
+    }
+
+    if (fields & StateBus::PROXIMITY) {
+        BLEManager::getInstance().updateProximityStatus(deviceNearby);
+    }
+}
+
+// Sends the channels changed since the last call: a mask of
+// CHANNEL_MASK_LEN bytes (bit n = channel n), then the new value of each
+// set bit in channel order. Split across notifications, each with its own
+// mask, when it won't fit one. Also refreshes the values page in the
+// characteristic, so a read of the table copies nothing.
+void CounterApp::notifyChannels() {
+    portENTER_CRITICAL(&channelMux);
+    uint64_t pending = notifyMask;
+    notifyMask = 0;
+    int32_t values[COUNTER_CHANNELS];
+    memcpy(values, channelValues, sizeof(values));
+    portEXIT_CRITICAL(&channelMux);
+
+    if (!pending) {
+        return;
+    }
+
+    // The values page reads are answered from, whether or not anyone listens
+    uint8_t page[COUNTER_CHANNELS * 4];
+    for (uint8_t channel = 0; channel < COUNTER_CHANNELS; channel++) {
+        putU32(page + channel * 4, (uint32_t)values[channel]);
+    }
+    BLEManager::getInstance().updateChannelsValue(page, sizeof(page));
+
+    size_t maxPayload = BLEManager::getInstance().getMaxNotifyPayload();
+    size_t perNotify = maxPayload > CHANNEL_MASK_LEN ? (maxPayload - CHANNEL_MASK_LEN) / 4 : 0;
+    if (!perNotify) {
+        return;
+    }
+
+    uint8_t payload[CHANNEL_MASK_LEN + COUNTER_CHANNELS * 4];
+    uint8_t channel = 0;
+    while (channel < COUNTER_CHANNELS && (pending >> channel)) {
+        memset(payload, 0, CHANNEL_MASK_LEN);
+        size_t count = 0;
+        for (; channel < COUNTER_CHANNELS && count < perNotify; channel++) {
+            if (pending & (1ull << channel)) {
+                payload[channel / 8] |= 1 << (channel % 8);
+                putU32(payload + CHANNEL_MASK_LEN + count * 4, (uint32_t)values[channel]);
+                count++;
+            }
+        }
+        BLEManager::getInstance().updateChannels(payload, CHANNEL_MASK_LEN + count * 4);
+    }
+}
+
+// ============================================================================
+// Persistence
+// ============================================================================
+
+// saveCounter writes the main value, every other channel and the replica's
+// two totals
+static_assert(CONFIG_TXN_MAX_ENTRIES >= COUNTER_CHANNELS + 2,
+              "CONFIG_TXN_MAX_ENTRIES must hold a full counter save");
+
 void CounterApp::saveCounter() {
     if (config) {
-        config->setInt(CONFIG_COUNTER_VALUE, counterValue);
-        config->save();
+        ConfigStore& store = ConfigStore::getInstance();
+        portENTER_CRITICAL(&channelMux);
+        uint64_t changed = persistMask;
+        persistMask = 0;
+        int32_t values[COUNTER_CHANNELS];
+        memcpy(values, channelValues, sizeof(values));
+        portEXIT_CRITICAL(&channelMux);
+
+        store.beginTransaction();
+        store.setInt(CONFIG_COUNTER_VALUE, values[COUNTER_CHANNEL_MAIN]);
+        for (uint8_t channel = 1; channel < COUNTER_CHANNELS; channel++) {
+            if (changed & (1ull << channel)) {
+                char key[32];
+                snprintf(key, sizeof(key), "%s.%u.value", CONFIG_CHANNELS_PREFIX, channel);
+                store.setInt(key, values[channel]);
+            }
+        }
+#if REPLICATION_ENABLED
+        CounterReplica::getInstance().stage(store);
+#endif
+        store.commit();
+    }
+}
+
+void CounterApp::loadChannels() {
+    for (uint8_t channel = 0; channel < COUNTER_CHANNELS; channel++) {
+        char key[32];
+        snprintf(key, sizeof(key), "%s.%u.name", CONFIG_CHANNELS_PREFIX, channel);
+        std::string name = config->getString(key, "");
+
+        if (name.empty()) {
+            if (channel == COUNTER_CHANNEL_MAIN) {
+                name = "counter";
+            } else if (channel == COUNTER_CHANNEL_DENIED) {
+                name = "denied";
+            } else {
+                snprintf(key, sizeof(key), "ch%u", channel);
+                name = key;
+            }
+        }
+        strncpy(channelNames[channel], name.c_str(), COUNTER_CHANNEL_NAME_LEN - 1);
+        channelNames[channel][COUNTER_CHANNEL_NAME_LEN - 1] = '\0';
+
+        if (channel != COUNTER_CHANNEL_MAIN) {
+            snprintf(key, sizeof(key), "%s.%u.value", CONFIG_CHANNELS_PREFIX, channel);
+            channelValues[channel] = config->getInt(key, 0);
+        }
     }
 }
 
@@ -193,9 +871,21 @@ void CounterApp::loadCounter() {
     }
 }
 
+// saveDevices writes mac, timestamp and valid per device plus the version;
+// clearAllDevices writes valid for every slot plus the version
+static_assert(CONFIG_TXN_MAX_ENTRIES >= 3 * MAX_REGISTERED_DEVICES + 1,
+              "CONFIG_TXN_MAX_ENTRIES must hold a full registry save");
+
 void CounterApp::saveDevices() {
     if (!config) return;
 
+    // Pairing exit saves from the app loop while the BLE task or USB may be
+    // editing the registry
+    Lock lock;
+
+    ConfigStore& store = ConfigStore::getInstance();
+    store.beginTransaction();
+
     for (size_t i = 0; i < registeredDeviceCount; i++) {
         char key[32];
 
@@ -206,24 +896,38 @@ void CounterApp::saveDevices() {
                  registeredDevices[i].macAddress[0], registeredDevices[i].macAddress[1],
                  registeredDevices[i].macAddress[2], registeredDevices[i].macAddress[3],
                  registeredDevices[i].macAddress[4], registeredDevices[i].macAddress[5]);
-        config->setString(key, macStr);
+        store.setString(key, macStr);
 
         // Save timestamp
         snprintf(key, sizeof(key), "%s.%zu.timestamp", CONFIG_DEVICES_PREFIX, i);
-        config->setInt(key, registeredDevices[i].registeredTimestamp);
+        store.setInt(key, registeredDevices[i].registeredTimestamp);
 
         // Save valid flag
         snprintf(key, sizeof(key), "%s.%zu.valid", CONFIG_DEVICES_PREFIX, i);
-        config->setBool(key, registeredDevices[i].isValid);
+        store.setBool(key, registeredDevices[i].isValid);
     }
 
-    config->save();
+    // Invalidate slots left over from a larger registry
+    for (size_t i = registeredDeviceCount; i < MAX_REGISTERED_DEVICES; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "%s.%zu.valid", CONFIG_DEVICES_PREFIX, i);
+        store.setBool(key, false);
+    }
+
+    store.setInt(CONFIG_REGISTRY_VERSION, registryVersion);
+
+    store.commit();
 }
 
 void CounterApp::loadDevices() {
     if (!config) return;
 
-    registeredDeviceCount = 0;
+    registryVersion = config->getInt(CONFIG_REGISTRY_VERSION, 0);
+    registeredDeviceCount = readStoredDevices(registeredDevices);
+}
+
+size_t CounterApp::readStoredDevices(RegisteredDevice* devices) {
+    size_t count = 0;
 
     for (size_t i = 0; i < MAX_REGISTERED_DEVICES; i++) {
         char key[32];
@@ -246,15 +950,17 @@ void CounterApp::loadDevices() {
         if (sscanf(macStr.c_str(), "%02X:%02X:%02X:%02X:%02X:%02X",
                    &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) == 6) {
             for (int j = 0; j < 6; j++) {
-                registeredDevices[registeredDeviceCount].macAddress[j] = (uint8_t)mac[j];
+                devices[count].macAddress[j] = (uint8_t)mac[j];
             }
 
             // Load timestamp
             snprintf(key, sizeof(key), "%s.%zu.timestamp", CONFIG_DEVICES_PREFIX, i);
-            registeredDevices[registeredDeviceCount].registeredTimestamp = config->getInt(key, 0);
+            devices[count].registeredTimestamp = config->getInt(key, 0);
 
-            registeredDevices[registeredDeviceCount].isValid = true;
-            registeredDeviceCount++;
+            devices[count].isValid = true;
+            count++;
         }
     }
+
+    return count;
 }
@@ -3,21 +3,58 @@
 
 #include "../config.h"
 #include "../ble/ble_manager.h"
+#include "state_bus.h"
+#include "timer_wheel.h"
 #include "config/IConfig.h"
-#include "logger/Logger.h"
+#include "../diag/log_ring.h"
 
-class CounterApp : public BLEManagerCallbacks {
+enum class AccessDenial : uint8_t;
+
+class CounterApp : public BLEManagerCallbacks, public StateObserver {
 public:
     static CounterApp& getInstance();
 
-    bool begin(IConfig* config, Logger* log);
+    // Serialises the registry and the main counter between the tasks that
+    // change them: BLE callbacks, the USB control task and the app loop.
+    // The methods below take it themselves; hold one across a check and
+    // the write that depends on it (a version check and applyRegistryDiff),
+    // or while walking getRegisteredDevices(). Recursive.
+    class Lock {
+    public:
+        Lock();
+        ~Lock();
+    };
+
+    bool begin(IConfig* config, LogRing* log);
+
+    // Warm boot: restore counter and registry from the RTC snapshot instead
+    // of flash. Returns false if there is no valid snapshot; call begin().
+    bool beginFromSnapshot(IConfig* config, LogRing* log);
+    bool needsReconcile() const { return reconcilePending; }
+    void reconcileWithStorage();
 
     // Counter operations
     void increment();
     void decrement();
+    void add(int32_t delta);
     void setValue(int32_t value);
     int32_t getValue() const { return counterValue; }
 
+    // Replication mode: a merge from peers changed the shared total
+    void applyReplicatedValue();
+
+    // Counter table. Channel COUNTER_CHANNEL_MAIN is the counter above; the
+    // others take the same path minus history and replication. Returns
+    // false for a channel out of range.
+    bool addToChannel(uint8_t channel, int32_t delta);
+    bool setChannel(uint8_t channel, int32_t value);
+    int32_t getChannel(uint8_t channel) const {
+        return channel < COUNTER_CHANNELS ? channelValues[channel] : 0;
+    }
+    const char* getChannelName(uint8_t channel) const {
+        return channel < COUNTER_CHANNELS ? channelNames[channel] : "";
+    }
+
     // Registered devices management
     void registerDevice(uint8_t* macAddress);
     void clearAllDevices();
@@ -27,16 +64,39 @@ public:
     // Check if a device is registered
     bool isDeviceRegistered(uint8_t* macAddress);
 
+    // Registered and, if it has an access schedule, inside a window right now
+    bool isDeviceAllowed(uint8_t* macAddress);
+
+    // Bulk registry sync: removes then adds, applied all-or-nothing with a
+    // single flush. Returns false (and leaves the registry untouched) if the
+    // result would exceed MAX_REGISTERED_DEVICES.
+    bool applyRegistryDiff(const uint8_t adds[][6], size_t addCount,
+                           const uint8_t removes[][6], size_t removeCount);
+    uint32_t getRegistryVersion() const { return registryVersion; }
+    uint32_t getRegistryHash() const;
+
     // BLE callback implementations
     void onDeviceConnected(uint8_t* macAddress) override;
     void onDeviceDisconnected() override;
     void onCounterRead(int32_t& value) override;
     void onCounterWrite(int32_t value) override;
+    void onPairingModeEnter() override;
     void onPairingModeExit() override;
+    void onGateCommand(uint8_t command, int64_t eventTimeUs) override;
+    void onRegistryCommand(const uint8_t* data, size_t length) override;
+    void onHistoryQuery(const uint8_t* data, size_t length) override;
+    bool onDiagnosticsRequest() override;
+    bool onChannelsRead() override;
+    size_t getChannelsPage(uint8_t page, uint8_t* out, size_t capacity) override;
+    void onChannelRead(uint8_t channel, int32_t& value) override;
+    void onChannelsWrite(const uint8_t* ops, size_t count) override;
 
     // Proximity detection
     bool isConnectedDeviceNearby() const { return deviceNearby; }
 
+    // Coalesced changes from the state bus: pushes to GATT, schedules persistence
+    void onStateChanged(uint32_t fields, uint32_t version) override;
+
 private:
     CounterApp();
     ~CounterApp();
@@ -45,18 +105,48 @@ private:
     CounterApp(const CounterApp&) = delete;
     CounterApp& operator=(const CounterApp&) = delete;
 
-    int32_t counterValue;
+    // One contiguous table; counterValue is its main channel
+    int32_t channelValues[COUNTER_CHANNELS];
+    int32_t& counterValue;
+    char channelNames[COUNTER_CHANNELS][COUNTER_CHANNEL_NAME_LEN];
+
+    // Channels changed since the last notify and since the last save (any task)
+    uint64_t notifyMask;
+    uint64_t persistMask;
+
     bool deviceNearby;
+    uint8_t nearbyMac[6];   // the device deviceNearby refers to
     RegisteredDevice registeredDevices[MAX_REGISTERED_DEVICES];
     size_t registeredDeviceCount;
+    // A diff's result or the flash copy, built here rather than on a task stack
+    RegisteredDevice scratchDevices[MAX_REGISTERED_DEVICES];
+    uint32_t registryVersion;
+    bool reconcilePending;
+    TimerWheel::Timer persistTimer;
     IConfig* config;
-    Logger* logger;
+    LogRing* logger;
+
+    SemaphoreHandle_t stateMutex;
+    StaticSemaphore_t stateMutexBuffer;
 
     // Helper functions
+    void subscribeToState();
     void saveCounter();
+    void channelChanged(uint8_t channel);
+    void notifyChannels();
+    void loadChannels();
+    void denyAccess(AccessDenial reason);
+    void markNearby(const uint8_t* macAddress);
+    void applyDelta(int32_t delta);
+    void syncReplicatedValue();
     void loadCounter();
     void saveDevices();
     void loadDevices();
+    size_t readStoredDevices(RegisteredDevice* devices);
+    void resolveSchedules();
+    void updateSnapshot();
+    void updateRegistrySnapshot();
+    static uint32_t hashRegistry(const RegisteredDevice* devices, size_t count);
 };
 
 #endif // COUNTER_APP_H
@@ -0,0 +1,513 @@
+#include "counter_history.h"
+#include "../ble/ble_manager.h"
+#include "../diag/heap_guard.h"
+#include <LittleFS.h>
+#include <time.h>
+
+// Fixed file: header, then the raw, minute and hour rings slot by slot
+static const uint32_t HISTORY_MAGIC = 0x48495331;   // "HIS1"
+
+struct HistoryFileHeader {
+    uint32_t magic;
+    uint16_t rawLength;
+    uint16_t minuteLength;
+    uint16_t hourLength;
+    uint16_t reserved;
+    uint32_t rawTotal;
+    uint32_t minuteTotal;
+    uint32_t hourTotal;
+};
+
+// resolution, flags, count, baseTime u32, baseValue i32
+static const size_t CHUNK_HEADER_LEN = 11;
+static const size_t CHUNK_MAX_LEN = 244;
+static const size_t RAW_RECORD_MAX_LEN = 2 * 5;
+static const size_t BUCKET_RECORD_MAX_LEN = 5 * 5;
+static const size_t QUERY_LEN = 9;
+
+// Changes are recorded from the BLE task and the app loop
+static portMUX_TYPE historyMux = portMUX_INITIALIZER_UNLOCKED;
+
+static size_t writeVarint(uint8_t* out, uint32_t value) {
+    size_t length = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[length++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return length;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static void putU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// Copies slots [from, to) of a ring out to the file one at a time, each
+// under the lock, so a concurrent record() never tears a slot
+static bool writeSlots(File& file, uint32_t base, const void* slots, size_t slotSize,
+                       size_t length, uint32_t from, uint32_t to) {
+    uint8_t slot[32];
+    for (uint32_t seq = from; seq < to; seq++) {
+        size_t index = seq % length;
+        portENTER_CRITICAL(&historyMux);
+        memcpy(slot, (const uint8_t*)slots + index * slotSize, slotSize);
+        portEXIT_CRITICAL(&historyMux);
+
+        if (!file.seek(base + index * slotSize) || file.write(slot, slotSize) != slotSize) {
+            return false;
+        }
+    }
+    return true;
+}
+
+CounterHistory& CounterHistory::getInstance() {
+    static CounterHistory instance;
+    return instance;
+}
+
+CounterHistory::CounterHistory()
+    : logger(nullptr)
+    , ready(false)
+    , lastValue(0)
+    , hasLastValue(false)
+    , unstamped(0)
+    , flushedRaw(0)
+    , flushedMinutes(0)
+    , flushedHours(0)
+    , dirty(false)
+    , flushTimer([](void* arg) { static_cast<CounterHistory*>(arg)->flush(); }, this)
+    , queryPending(false)
+    , streaming(false)
+    , cursor(0)
+    , queriesServed(0)
+    , streamTimer([](void* arg) { static_cast<CounterHistory*>(arg)->streamChunks(); }, this) {
+    memset(&raw, 0, sizeof(raw));
+    memset(&minutes, 0, sizeof(minutes));
+    memset(&hours, 0, sizeof(hours));
+    memset(&pendingQuery, 0, sizeof(pendingQuery));
+    memset(&query, 0, sizeof(query));
+}
+
+bool CounterHistory::begin(LogRing* log) {
+    if (!log) {
+        return false;
+    }
+
+    logger = log;
+    if (!load()) {
+        return false;
+    }
+
+    ready = true;
+    TimerWheel::getInstance().arm(flushTimer, HISTORY_FLUSH_MS, HISTORY_FLUSH_MS);
+
+    logger->log("Counter history: %u changes, %u minutes, %u hours restored",
+        (unsigned)(raw.total - raw.oldest()), (unsigned)(minutes.total - minutes.oldest()),
+        (unsigned)(hours.total - hours.oldest()));
+    return true;
+}
+
+void CounterHistory::report() {
+    if (!logger || !ready) {
+        return;
+    }
+
+    logger->log("History: %u/%u raw, %u/%u minute, %u/%u hour slots, %u queries, %u unstamped changes",
+        (unsigned)(raw.total - raw.oldest()), HISTORY_RAW_LEN,
+        (unsigned)(minutes.total - minutes.oldest()), HISTORY_MINUTE_LEN,
+        (unsigned)(hours.total - hours.oldest()), HISTORY_HOUR_LEN,
+        queriesServed, unstamped);
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+void CounterHistory::record(int32_t value) {
+    if (!ready) {
+        return;
+    }
+
+    time_t now = time(nullptr);
+
+    portENTER_CRITICAL(&historyMux);
+    int32_t previous = hasLastValue ? lastValue : value;
+    lastValue = value;
+    hasLastValue = true;
+
+    if (now < TIME_MIN_VALID_EPOCH) {
+        unstamped++;
+        portEXIT_CRITICAL(&historyMux);
+        return;
+    }
+
+    // Keep the series ordered if the clock is stepped back by a resync
+    uint32_t t = (uint32_t)now;
+    if (raw.total && t < raw.at(raw.total - 1).time) {
+        t = raw.at(raw.total - 1).time;
+    }
+
+    Point& point = raw.at(raw.total);
+    point.time = t;
+    point.value = value;
+    raw.total++;
+
+    rollup(minutes, t - t % 60, previous, value);
+    rollup(hours, t - t % 3600, previous, value);
+    dirty = true;
+    portEXIT_CRITICAL(&historyMux);
+}
+
+template <size_t N>
+void CounterHistory::rollup(Ring<Bucket, N>& ring, uint32_t start, int32_t previous, int32_t value) {
+    if (ring.total) {
+        Bucket& current = ring.at(ring.total - 1);
+        if (start <= current.start) {
+            if (value < current.min) {
+                current.min = value;
+            }
+            if (value > current.max) {
+                current.max = value;
+            }
+            current.sum += value - previous;
+            current.close = value;
+            return;
+        }
+    }
+
+    // The bucket spans the value it opened on as well as the new one
+    Bucket& bucket = ring.at(ring.total);
+    bucket.start = start;
+    bucket.min = previous < value ? previous : value;
+    bucket.max = previous > value ? previous : value;
+    bucket.sum = value - previous;
+    bucket.close = value;
+    ring.total++;
+}
+
+// ============================================================================
+// Persistence
+// ============================================================================
+
+static const uint32_t RAW_BASE = sizeof(HistoryFileHeader);
+
+bool CounterHistory::load() {
+    const uint32_t minuteBase = RAW_BASE + sizeof(raw.slots);
+    const uint32_t hourBase = minuteBase + sizeof(minutes.slots);
+    const uint32_t fileSize = hourBase + sizeof(hours.slots);
+
+    HistoryFileHeader header;
+    File file = LittleFS.open(HISTORY_PATH, "r");
+    bool valid = file && file.size() == fileSize &&
+                 file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == HISTORY_MAGIC &&
+                 header.rawLength == HISTORY_RAW_LEN &&
+                 header.minuteLength == HISTORY_MINUTE_LEN &&
+                 header.hourLength == HISTORY_HOUR_LEN &&
+                 file.read((uint8_t*)raw.slots, sizeof(raw.slots)) == sizeof(raw.slots) &&
+                 file.read((uint8_t*)minutes.slots, sizeof(minutes.slots)) == sizeof(minutes.slots) &&
+                 file.read((uint8_t*)hours.slots, sizeof(hours.slots)) == sizeof(hours.slots);
+    if (file) {
+        file.close();
+    }
+
+    if (valid) {
+        raw.total = flushedRaw = header.rawTotal;
+        minutes.total = flushedMinutes = header.minuteTotal;
+        hours.total = flushedHours = header.hourTotal;
+        if (raw.total) {
+            lastValue = raw.at(raw.total - 1).value;
+            hasLastValue = true;
+        }
+        return true;
+    }
+
+    // Allocate the whole file up front so flushes only overwrite slots
+    memset(&raw, 0, sizeof(raw));
+    memset(&minutes, 0, sizeof(minutes));
+    memset(&hours, 0, sizeof(hours));
+    memset(&header, 0, sizeof(header));
+    header.magic = HISTORY_MAGIC;
+    header.rawLength = HISTORY_RAW_LEN;
+    header.minuteLength = HISTORY_MINUTE_LEN;
+    header.hourLength = HISTORY_HOUR_LEN;
+
+    file = LittleFS.open(HISTORY_PATH, "w");
+    if (!file) {
+        logger->log("ERROR: Cannot create counter history %s", HISTORY_PATH);
+        return false;
+    }
+
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t*)raw.slots, sizeof(raw.slots)) == sizeof(raw.slots) &&
+              file.write((const uint8_t*)minutes.slots, sizeof(minutes.slots)) == sizeof(minutes.slots) &&
+              file.write((const uint8_t*)hours.slots, sizeof(hours.slots)) == sizeof(hours.slots);
+    file.close();
+
+    if (!ok) {
+        logger->log("ERROR: Counter history write failed (filesystem full?)");
+        return false;
+    }
+    return true;
+}
+
+void CounterHistory::flush() {
+    if (!dirty) {
+        return;
+    }
+
+    portENTER_CRITICAL(&historyMux);
+    dirty = false;
+    uint32_t rawTotal = raw.total;
+    uint32_t minuteTotal = minutes.total;
+    uint32_t hourTotal = hours.total;
+    portEXIT_CRITICAL(&historyMux);
+
+    // The newest bucket already on flash may have been updated in place
+    uint32_t rawFrom = flushedRaw > raw.oldest() ? flushedRaw : raw.oldest();
+    uint32_t minuteFrom = flushedMinutes > minutes.oldest() ? flushedMinutes - 1 : minutes.oldest();
+    uint32_t hourFrom = flushedHours > hours.oldest() ? flushedHours - 1 : hours.oldest();
+
+    const uint32_t minuteBase = RAW_BASE + sizeof(raw.slots);
+    const uint32_t hourBase = minuteBase + sizeof(minutes.slots);
+
+    File file;
+    {
+        // Opening a file allocates its handle; flushes are periodic
+        HeapGuard::Allow fileHandle;
+        file = LittleFS.open(HISTORY_PATH, "r+");
+    }
+    if (!file) {
+        dirty = true;
+        return;
+    }
+
+    // Slots first, then the header that makes them part of the series
+    HistoryFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HISTORY_MAGIC;
+    header.rawLength = HISTORY_RAW_LEN;
+    header.minuteLength = HISTORY_MINUTE_LEN;
+    header.hourLength = HISTORY_HOUR_LEN;
+    header.rawTotal = rawTotal;
+    header.minuteTotal = minuteTotal;
+    header.hourTotal = hourTotal;
+
+    bool ok = writeSlots(file, RAW_BASE, raw.slots, sizeof(Point), HISTORY_RAW_LEN, rawFrom, rawTotal) &&
+              writeSlots(file, minuteBase, minutes.slots, sizeof(Bucket), HISTORY_MINUTE_LEN,
+                         minuteFrom, minuteTotal) &&
+              writeSlots(file, hourBase, hours.slots, sizeof(Bucket), HISTORY_HOUR_LEN, hourFrom, hourTotal) &&
+              file.seek(0) &&
+              file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    file.close();
+
+    if (!ok) {
+        logger->log("ERROR: Counter history flush failed");
+        dirty = true;
+        return;
+    }
+
+    flushedRaw = rawTotal;
+    flushedMinutes = minuteTotal;
+    flushedHours = hourTotal;
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+
+void CounterHistory::handleQuery(const uint8_t* data, size_t length) {
+    Query request;
+    if (length == QUERY_LEN && data[0] <= HOUR) {
+        request.resolution = data[0];
+        request.from = getU32(data + 1);
+        request.to = getU32(data + 5);
+    } else {
+        // Answered with FLAG_ERROR from the app loop
+        request.resolution = 0xFF;
+        request.from = 0;
+        request.to = 0;
+    }
+
+    portENTER_CRITICAL(&historyMux);
+    pendingQuery = request;
+    queryPending = true;
+    portEXIT_CRITICAL(&historyMux);
+
+    TimerWheel::getInstance().arm(streamTimer, 0);
+}
+
+void CounterHistory::cancelQuery() {
+    queryPending = false;
+    streaming = false;
+}
+
+void CounterHistory::startStream() {
+    portENTER_CRITICAL(&historyMux);
+    query = pendingQuery;
+    queryPending = false;
+    portEXIT_CRITICAL(&historyMux);
+
+    size_t recordMax = query.resolution == RAW ? RAW_RECORD_MAX_LEN : BUCKET_RECORD_MAX_LEN;
+    if (query.resolution > HOUR ||
+        BLEManager::getInstance().getMaxNotifyPayload() < CHUNK_HEADER_LEN + recordMax) {
+        // Malformed, or the MTU was never raised above the default
+        uint8_t error[CHUNK_HEADER_LEN];
+        memset(error, 0, sizeof(error));
+        error[0] = query.resolution;
+        error[1] = FLAG_ERROR;
+        BLEManager::getInstance().sendHistoryData(error, sizeof(error));
+        streaming = false;
+        return;
+    }
+
+    if (query.to == 0) {
+        query.to = UINT32_MAX;
+    }
+    cursor = firstAtOrAfter(query.from);
+    streaming = true;
+    queriesServed++;
+}
+
+void CounterHistory::streamChunks() {
+    if (queryPending) {
+        startStream();
+    }
+
+    for (int i = 0; i < HISTORY_CHUNKS_PER_TICK && streaming; i++) {
+        streaming = sendChunk();
+    }
+
+    // Yield to the rest of the loop between bursts
+    if (streaming) {
+        TimerWheel::getInstance().arm(streamTimer, 0);
+    }
+}
+
+bool CounterHistory::readEntry(uint32_t seq, Bucket& out) {
+    bool found = false;
+
+    portENTER_CRITICAL(&historyMux);
+    if (query.resolution == RAW) {
+        if (seq >= raw.oldest() && seq < raw.total) {
+            const Point& point = raw.at(seq);
+            out.start = point.time;
+            out.min = out.max = out.close = point.value;
+            out.sum = 0;
+            found = true;
+        }
+    } else if (query.resolution == MINUTE) {
+        if (seq >= minutes.oldest() && seq < minutes.total) {
+            out = minutes.at(seq);
+            found = true;
+        }
+    } else if (seq >= hours.oldest() && seq < hours.total) {
+        out = hours.at(seq);
+        found = true;
+    }
+    portEXIT_CRITICAL(&historyMux);
+
+    return found;
+}
+
+uint32_t CounterHistory::firstAtOrAfter(uint32_t from) {
+    uint32_t low;
+    uint32_t high;
+    portENTER_CRITICAL(&historyMux);
+    if (query.resolution == RAW) {
+        low = raw.oldest();
+        high = raw.total;
+    } else if (query.resolution == MINUTE) {
+        low = minutes.oldest();
+        high = minutes.total;
+    } else {
+        low = hours.oldest();
+        high = hours.total;
+    }
+    portEXIT_CRITICAL(&historyMux);
+
+    // Entries are in time order, so bisect on their start
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        Bucket entry;
+        if (readEntry(mid, entry) && entry.start < from) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+bool CounterHistory::sendChunk() {
+    uint8_t chunk[CHUNK_MAX_LEN];
+    size_t capacity = BLEManager::getInstance().getMaxNotifyPayload();
+    if (capacity > sizeof(chunk)) {
+        capacity = sizeof(chunk);
+    }
+
+    uint32_t unit = query.resolution == HOUR ? 3600 : (query.resolution == MINUTE ? 60 : 1);
+    size_t recordMax = query.resolution == RAW ? RAW_RECORD_MAX_LEN : BUCKET_RECORD_MAX_LEN;
+    uint32_t previousTime = 0;
+    int32_t previousClose = 0;
+    size_t position = CHUNK_HEADER_LEN;
+    uint8_t count = 0;
+    bool done = false;
+
+    memset(chunk, 0, CHUNK_HEADER_LEN);
+    while (count < 255 && position + recordMax <= capacity) {
+        Bucket entry;
+        if (!readEntry(cursor, entry)) {
+            // Overwritten while streaming: carry on from the oldest kept
+            uint32_t oldest = firstAtOrAfter(0);
+            if (cursor < oldest) {
+                cursor = oldest;
+                continue;
+            }
+            done = true;
+            break;
+        }
+        if (entry.start > query.to) {
+            done = true;
+            break;
+        }
+
+        if (count == 0) {
+            putU32(chunk + 3, entry.start);
+            putU32(chunk + 7, (uint32_t)entry.close);
+            previousTime = entry.start;
+            previousClose = entry.close;
+        }
+
+        position += writeVarint(chunk + position, (entry.start - previousTime) / unit);
+        position += writeVarint(chunk + position, zigzag(entry.close - previousClose));
+        if (query.resolution != RAW) {
+            position += writeVarint(chunk + position, (uint32_t)(entry.close - entry.min));
+            position += writeVarint(chunk + position, (uint32_t)(entry.max - entry.close));
+            position += writeVarint(chunk + position, zigzag(entry.sum));
+        }
+
+        previousTime = entry.start;
+        previousClose = entry.close;
+        cursor++;
+        count++;
+    }
+
+    chunk[0] = query.resolution;
+    chunk[1] = done ? FLAG_LAST : 0;
+    chunk[2] = count;
+    BLEManager::getInstance().sendHistoryData(chunk, position);
+
+    return !done;
+}
@@ -0,0 +1,132 @@
+#ifndef COUNTER_HISTORY_H
+#define COUNTER_HISTORY_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "../diag/log_ring.h"
+#include "timer_wheel.h"
+
+/**
+ * Time series of counter changes with per-minute and per-hour rollups.
+ *
+ * Every change lands in a ring of raw points (time, value) and updates the
+ * current minute and hour buckets (min, max, net change, closing value) in
+ * place, so recording is O(1) whatever the history length. A bucket is
+ * only opened for an interval that has a change. Times are wall-clock
+ * seconds; changes made before the clock is set are not recorded. The
+ * rings are copied to HISTORY_PATH, where they changed, every
+ * HISTORY_FLUSH_MS, and restored at boot.
+ *
+ * Query, written to the history characteristic (little-endian):
+ *   resolution u8 (0 raw, 1 minute, 2 hour), from u32, to u32 (0: now)
+ * Answer, streamed oldest first as notifications, each one standalone:
+ *   resolution u8, flags u8, count u8, baseTime u32, baseValue i32,
+ *   then count records, each relative to the one before it (the first to
+ *   the base), as varints:
+ *     raw:     dt (s), value delta (zigzag)
+ *     buckets: dt (buckets), close delta (zigzag), close - min, max - close,
+ *              net change (zigzag)
+ * flags: FLAG_LAST on the final notification, FLAG_ERROR (alone, count 0)
+ * for a malformed query.
+ */
+class CounterHistory {
+public:
+    enum Resolution : uint8_t {
+        RAW    = 0,
+        MINUTE = 1,
+        HOUR   = 2
+    };
+
+    static const uint8_t FLAG_LAST = 0x01;
+    static const uint8_t FLAG_ERROR = 0x80;
+
+    static CounterHistory& getInstance();
+
+    // Restores the rings from flash and starts the flush timer
+    bool begin(LogRing* log);
+
+    // Any task
+    void record(int32_t value);
+
+    // Any task; replaces a query still streaming
+    void handleQuery(const uint8_t* data, size_t length);
+    void cancelQuery();
+
+    void report();
+
+private:
+    CounterHistory();
+
+    // Prevent copying
+    CounterHistory(const CounterHistory&) = delete;
+    CounterHistory& operator=(const CounterHistory&) = delete;
+
+    struct Point {
+        uint32_t time;
+        int32_t value;
+    };
+
+    struct Bucket {
+        uint32_t start;
+        int32_t min;
+        int32_t max;
+        int32_t sum;
+        int32_t close;
+    };
+
+    // Slot seq % N holds the seq-th entry ever pushed; the newest is total - 1
+    template <typename T, size_t N>
+    struct Ring {
+        T slots[N];
+        uint32_t total;
+
+        T& at(uint32_t seq) { return slots[seq % N]; }
+        uint32_t oldest() const { return total > N ? total - (uint32_t)N : 0; }
+    };
+
+    struct Query {
+        uint8_t resolution;
+        uint32_t from;
+        uint32_t to;
+    };
+
+    LogRing* logger;
+    bool ready;
+
+    Ring<Point, HISTORY_RAW_LEN> raw;
+    Ring<Bucket, HISTORY_MINUTE_LEN> minutes;
+    Ring<Bucket, HISTORY_HOUR_LEN> hours;
+    int32_t lastValue;
+    bool hasLastValue;
+    uint32_t unstamped;
+
+    // Totals already on flash; the slot before each may have changed since
+    uint32_t flushedRaw;
+    uint32_t flushedMinutes;
+    uint32_t flushedHours;
+    bool dirty;
+    TimerWheel::Timer flushTimer;
+
+    // Streaming (app loop); the request is handed over from the BLE task
+    Query pendingQuery;
+    volatile bool queryPending;
+    Query query;
+    volatile bool streaming;
+    uint32_t cursor;
+    uint32_t queriesServed;
+    TimerWheel::Timer streamTimer;
+
+    template <size_t N>
+    static void rollup(Ring<Bucket, N>& ring, uint32_t start, int32_t previous, int32_t value);
+
+    void flush();
+    bool load();
+
+    void startStream();
+    void streamChunks();
+    bool sendChunk();
+    uint32_t firstAtOrAfter(uint32_t from);
+    bool readEntry(uint32_t seq, Bucket& out);
+};
+
+#endif // COUNTER_HISTORY_H
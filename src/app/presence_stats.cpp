@@ -0,0 +1,361 @@
+#include "presence_stats.h"
+#include "../diag/heap_guard.h"
+#include <LittleFS.h>
+#include <esp_timer.h>
+#include <time.h>
+
+// Fixed file: header, then PRESENCE_MAX_DEVICES records
+static const uint32_t PRESENCE_MAGIC = 0x50525331;  // "PRS1"
+
+struct PresenceFileHeader {
+    uint32_t magic;
+    uint16_t slotCount;
+    uint16_t recordSize;
+};
+
+// Transitions come from the BLE task, flushes from the app loop
+static portMUX_TYPE presenceMux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool isEmpty(const uint8_t* macAddress) {
+    for (int i = 0; i < 6; i++) {
+        if (macAddress[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PresenceStats& PresenceStats::getInstance() {
+    static PresenceStats instance;
+    return instance;
+}
+
+PresenceStats::PresenceStats()
+    : logger(nullptr)
+    , ready(false)
+    , visitsTotal(0)
+    , flushes(0)
+    , flushTimer([](void* arg) { static_cast<PresenceStats*>(arg)->flush(); }, this) {
+    memset(slots, 0, sizeof(slots));
+}
+
+bool PresenceStats::begin(LogRing* log) {
+    if (!log) {
+        return false;
+    }
+
+    logger = log;
+    if (!load()) {
+        return false;
+    }
+
+    ready = true;
+    TimerWheel::getInstance().arm(flushTimer, PRESENCE_FLUSH_MS, PRESENCE_FLUSH_MS);
+
+    size_t known = 0;
+    for (const Slot& slot : slots) {
+        if (!isEmpty(slot.record.macAddress)) {
+            known++;
+        }
+    }
+    logger->log("Presence: %zu devices restored", known);
+    return true;
+}
+
+void PresenceStats::report() {
+    if (!logger || !ready) {
+        return;
+    }
+
+    size_t known = 0;
+    size_t present = 0;
+    portENTER_CRITICAL(&presenceMux);
+    for (const Slot& slot : slots) {
+        if (!isEmpty(slot.record.macAddress)) {
+            known++;
+        }
+        if (slot.present) {
+            present++;
+        }
+    }
+    portEXIT_CRITICAL(&presenceMux);
+
+    logger->log("Presence: %zu/%d devices, %zu present, %u visits since boot, %u flushes",
+        known, PRESENCE_MAX_DEVICES, present, visitsTotal, flushes);
+}
+
+// ============================================================================
+// Transitions
+// ============================================================================
+
+void PresenceStats::arrive(const uint8_t* macAddress) {
+    if (!ready) {
+        return;
+    }
+
+    int64_t nowUs = esp_timer_get_time();
+    time_t now = time(nullptr);
+
+    portENTER_CRITICAL(&presenceMux);
+    Slot* slot = find(macAddress);
+    if (!slot) {
+        slot = claim(macAddress);
+    }
+    if (slot && !slot->present) {
+        bool revisit = slot->departedUs &&
+                       nowUs - slot->departedUs < (int64_t)PRESENCE_REVISIT_MS * 1000;
+        if (!revisit) {
+            if (slot->record.visits < UINT16_MAX) {
+                slot->record.visits++;
+            }
+            visitsTotal++;
+        }
+        slot->present = true;
+        slot->arrivedUs = nowUs;
+        stamp(*slot, now, nowUs);
+    }
+    portEXIT_CRITICAL(&presenceMux);
+}
+
+void PresenceStats::depart(const uint8_t* macAddress) {
+    if (!ready) {
+        return;
+    }
+
+    int64_t nowUs = esp_timer_get_time();
+    time_t now = time(nullptr);
+
+    portENTER_CRITICAL(&presenceMux);
+    Slot* slot = find(macAddress);
+    if (slot && slot->present) {
+        slot->record.dwellSeconds += (uint32_t)((nowUs - slot->arrivedUs + 500000) / 1000000);
+        slot->present = false;
+        slot->departedUs = nowUs;
+        stamp(*slot, now, nowUs);
+    }
+    portEXIT_CRITICAL(&presenceMux);
+}
+
+// Caller holds presenceMux
+PresenceStats::Slot* PresenceStats::find(const uint8_t* macAddress) {
+    for (Slot& slot : slots) {
+        if (memcmp(slot.record.macAddress, macAddress, 6) == 0) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+// Caller holds presenceMux. An empty slot, or else the one seen least
+// recently; a device present now or waiting for the clock keeps its slot.
+PresenceStats::Slot* PresenceStats::claim(const uint8_t* macAddress) {
+    Slot* victim = nullptr;
+    for (Slot& slot : slots) {
+        if (isEmpty(slot.record.macAddress)) {
+            victim = &slot;
+            break;
+        }
+        if (!slot.present && !slot.unstampedUs &&
+            (!victim || slot.record.lastSeen < victim->record.lastSeen)) {
+            victim = &slot;
+        }
+    }
+
+    if (victim) {
+        memset(victim, 0, sizeof(*victim));
+        memcpy(victim->record.macAddress, macAddress, 6);
+        victim->dirty = true;
+    }
+    return victim;
+}
+
+// Caller holds presenceMux
+void PresenceStats::stamp(Slot& slot, time_t now, int64_t nowUs) {
+    if (now >= TIME_MIN_VALID_EPOCH) {
+        slot.record.lastSeen = (uint32_t)now;
+        slot.unstampedUs = 0;
+    } else {
+        slot.unstampedUs = nowUs;
+    }
+    slot.dirty = true;
+}
+
+// Caller holds presenceMux
+void PresenceStats::resolveUnstamped(time_t now, int64_t nowUs) {
+    if (now < TIME_MIN_VALID_EPOCH) {
+        return;
+    }
+
+    for (Slot& slot : slots) {
+        if (slot.unstampedUs) {
+            slot.record.lastSeen = (uint32_t)(now - (nowUs - slot.unstampedUs) / 1000000);
+            slot.unstampedUs = 0;
+            slot.dirty = true;
+        }
+    }
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+
+size_t PresenceStats::snapshot(Entry* out, size_t start, size_t max) {
+    int64_t nowUs = esp_timer_get_time();
+    time_t now = time(nullptr);
+    size_t count = 0;
+
+    portENTER_CRITICAL(&presenceMux);
+    resolveUnstamped(now, nowUs);
+    for (const Slot& slot : slots) {
+        if (isEmpty(slot.record.macAddress)) {
+            continue;
+        }
+        if (count >= start && count - start < max) {
+            Entry& entry = out[count - start];
+            memcpy(entry.macAddress, slot.record.macAddress, 6);
+            entry.visits = slot.record.visits;
+            entry.lastSeen = slot.record.lastSeen;
+            entry.dwellSeconds = slot.record.dwellSeconds;
+            entry.present = slot.present;
+            if (slot.present) {
+                entry.dwellSeconds += (uint32_t)((nowUs - slot.arrivedUs) / 1000000);
+                if (now >= TIME_MIN_VALID_EPOCH) {
+                    entry.lastSeen = (uint32_t)now;
+                }
+            }
+        }
+        count++;
+    }
+    portEXIT_CRITICAL(&presenceMux);
+
+    return count;
+}
+
+size_t PresenceStats::evictOlderThan(uint32_t cutoff, uint8_t evicted[][6], size_t max) {
+    int64_t nowUs = esp_timer_get_time();
+    time_t now = time(nullptr);
+    size_t count = 0;
+
+    portENTER_CRITICAL(&presenceMux);
+    resolveUnstamped(now, nowUs);
+    for (Slot& slot : slots) {
+        if (count >= max) {
+            break;
+        }
+        if (isEmpty(slot.record.macAddress) || slot.present || slot.unstampedUs ||
+            !slot.record.lastSeen || slot.record.lastSeen >= cutoff) {
+            continue;
+        }
+        memcpy(evicted[count++], slot.record.macAddress, 6);
+        memset(&slot, 0, sizeof(slot));
+        slot.dirty = true;
+    }
+    portEXIT_CRITICAL(&presenceMux);
+
+    return count;
+}
+
+// ============================================================================
+// Persistence
+// ============================================================================
+
+bool PresenceStats::load() {
+    const size_t fileSize = sizeof(PresenceFileHeader) + PRESENCE_MAX_DEVICES * sizeof(Record);
+
+    PresenceFileHeader header;
+    File file = LittleFS.open(PRESENCE_PATH, "r");
+    bool valid = file && file.size() == fileSize &&
+                 file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == PRESENCE_MAGIC &&
+                 header.slotCount == PRESENCE_MAX_DEVICES &&
+                 header.recordSize == sizeof(Record);
+    for (size_t i = 0; valid && i < PRESENCE_MAX_DEVICES; i++) {
+        valid = file.read((uint8_t*)&slots[i].record, sizeof(Record)) == sizeof(Record);
+    }
+    if (file) {
+        file.close();
+    }
+
+    if (valid) {
+        return true;
+    }
+
+    // Allocate the whole file up front so flushes only overwrite records
+    memset(slots, 0, sizeof(slots));
+    header.magic = PRESENCE_MAGIC;
+    header.slotCount = PRESENCE_MAX_DEVICES;
+    header.recordSize = sizeof(Record);
+
+    file = LittleFS.open(PRESENCE_PATH, "w");
+    if (!file) {
+        logger->log("ERROR: Cannot create presence table %s", PRESENCE_PATH);
+        return false;
+    }
+
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    for (size_t i = 0; ok && i < PRESENCE_MAX_DEVICES; i++) {
+        ok = file.write((const uint8_t*)&slots[i].record, sizeof(Record)) == sizeof(Record);
+    }
+    file.close();
+
+    if (!ok) {
+        logger->log("ERROR: Presence table write failed (filesystem full?)");
+        return false;
+    }
+    return true;
+}
+
+void PresenceStats::flush() {
+    int64_t nowUs = esp_timer_get_time();
+    time_t now = time(nullptr);
+
+    portENTER_CRITICAL(&presenceMux);
+    resolveUnstamped(now, nowUs);
+    portEXIT_CRITICAL(&presenceMux);
+
+    // One slot at a time, so the table never has to be copied onto the
+    // stack; the file is only opened once something has changed
+    File file;
+    bool ok = true;
+    size_t written = 0;
+    for (size_t i = 0; ok && i < PRESENCE_MAX_DEVICES; i++) {
+        Record record;
+        portENTER_CRITICAL(&presenceMux);
+        bool changed = slots[i].dirty;
+        if (changed) {
+            record = slots[i].record;
+            slots[i].dirty = false;
+        }
+        portEXIT_CRITICAL(&presenceMux);
+        if (!changed) {
+            continue;
+        }
+
+        if (!file) {
+            // Opening a file allocates its handle; flushes are periodic
+            HeapGuard::Allow fileHandle;
+            file = LittleFS.open(PRESENCE_PATH, "r+");
+        }
+        ok = file &&
+             file.seek(sizeof(PresenceFileHeader) + i * sizeof(Record)) &&
+             file.write((const uint8_t*)&record, sizeof(Record)) == sizeof(Record);
+        if (!ok) {
+            portENTER_CRITICAL(&presenceMux);
+            slots[i].dirty = true;
+            portEXIT_CRITICAL(&presenceMux);
+        }
+        written++;
+    }
+    if (file) {
+        file.close();
+    }
+
+    if (!ok) {
+        // Slots after the failed one are still dirty; the next flush retries
+        logger->log("ERROR: Presence table flush failed");
+        return;
+    }
+    if (written) {
+        flushes++;
+    }
+}
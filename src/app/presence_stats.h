@@ -0,0 +1,93 @@
+#ifndef PRESENCE_STATS_H
+#define PRESENCE_STATS_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "../diag/log_ring.h"
+#include "timer_wheel.h"
+
+/**
+ * Per-device presence: last seen, visit count and total dwell time.
+ *
+ * arrive() and depart() update the table in RAM on every proximity change.
+ * A return within PRESENCE_REVISIT_MS continues the visit instead of
+ * starting a new one. Dwell time is measured on the monotonic clock.
+ * Last-seen is wall-clock seconds. A change made before the clock is set
+ * is back-dated once it is.
+ *
+ * Changed entries are written to PRESENCE_PATH every PRESENCE_FLUSH_MS,
+ * one file write per flush, so churn costs RAM updates rather than flash
+ * writes. A visit still open at a reset loses its dwell time.
+ */
+class PresenceStats {
+public:
+    // One device as reported over GATT (dwell and last-seen include a visit
+    // in progress)
+    struct Entry {
+        uint8_t macAddress[6];
+        uint16_t visits;
+        uint32_t lastSeen;      // epoch seconds, 0 if never stamped
+        uint32_t dwellSeconds;
+        bool present;
+    };
+
+    static PresenceStats& getInstance();
+
+    // Restores the table from flash and starts the flush timer
+    bool begin(LogRing* log);
+
+    // Any task
+    void arrive(const uint8_t* macAddress);
+    void depart(const uint8_t* macAddress);
+
+    // Copies up to max entries, skipping the first start; returns how many
+    // there are in all
+    size_t snapshot(Entry* out, size_t start, size_t max);
+
+    // Drops entries not seen since cutoff (epoch seconds) and returns their
+    // MACs; devices present now or never stamped are kept
+    size_t evictOlderThan(uint32_t cutoff, uint8_t evicted[][6], size_t max);
+
+    void report();
+
+private:
+    PresenceStats();
+
+    // Prevent copying
+    PresenceStats(const PresenceStats&) = delete;
+    PresenceStats& operator=(const PresenceStats&) = delete;
+
+    // The part kept on flash; an all-zero MAC is an empty slot
+    struct Record {
+        uint8_t macAddress[6];
+        uint16_t visits;
+        uint32_t lastSeen;
+        uint32_t dwellSeconds;
+    };
+
+    struct Slot {
+        Record record;
+        int64_t arrivedUs;      // visit start, while present
+        int64_t departedUs;     // for PRESENCE_REVISIT_MS
+        int64_t unstampedUs;    // seen before the clock was set
+        bool present;
+        bool dirty;
+    };
+
+    LogRing* logger;
+    bool ready;
+    Slot slots[PRESENCE_MAX_DEVICES];
+    uint32_t visitsTotal;
+    uint32_t flushes;
+    TimerWheel::Timer flushTimer;
+
+    Slot* find(const uint8_t* macAddress);
+    Slot* claim(const uint8_t* macAddress);
+    void stamp(Slot& slot, time_t now, int64_t nowUs);
+    void resolveUnstamped(time_t now, int64_t nowUs);
+
+    void flush();
+    bool load();
+};
+
+#endif // PRESENCE_STATS_H
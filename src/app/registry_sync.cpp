@@ -0,0 +1,481 @@
+#include "registry_sync.h"
+#include "counter_app.h"
+#include "presence_stats.h"
+#include "../ble/ble_manager.h"
+#include <esp_system.h>
+#include <mbedtls/md.h>
+#include <time.h>
+
+// Response header: opcode + status
+static const size_t RESPONSE_HEADER_LEN = 2;
+// Export chunk header: opcode, status, total u16, start u16, n u8
+static const size_t EXPORT_HEADER_LEN = 7;
+// Presence record: mac[6], visits u16, lastSeen u32, dwellSeconds u32, flags u8
+static const size_t PRESENCE_RECORD_LEN = 17;
+// Largest notification: ATT_MTU tops out at 517, less the 3-byte header
+static const size_t MAX_NOTIFY_PAYLOAD = 514;
+static const size_t MAX_EXPORT_PER_CHUNK = (MAX_NOTIFY_PAYLOAD - EXPORT_HEADER_LEN) / 6;
+static const size_t MAX_PRESENCE_PER_CHUNK = (MAX_NOTIFY_PAYLOAD - EXPORT_HEADER_LEN) / PRESENCE_RECORD_LEN;
+
+static void putU16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+}
+
+static void putU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static portMUX_TYPE streamMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t getU32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+RegistrySync& RegistrySync::getInstance() {
+    static RegistrySync instance;
+    return instance;
+}
+
+RegistrySync::RegistrySync()
+    : logger(nullptr)
+    , enabled(false)
+    , authenticated(false)
+    , challengeIssued(false)
+    , txnOpen(false)
+    , txnBaseVersion(0)
+    , txnAddCount(0)
+    , txnRemoveCount(0)
+    , streamPending(0)
+    , streamOpcode(0)
+    , streamStart(0)
+    , streamTimer([](void* arg) { static_cast<RegistrySync*>(arg)->streamChunk(); }, this) {
+    memset(adminKey, 0, sizeof(adminKey));
+    memset(nonce, 0, sizeof(nonce));
+}
+
+bool RegistrySync::begin(IConfig* config, LogRing* log) {
+    if (!log || !config) {
+        return false;
+    }
+
+    logger = log;
+
+    std::string keyHex = config->getString(CONFIG_REGISTRY_ADMIN_KEY, "");
+    if (keyHex.empty()) {
+        logger->log("Registry sync disabled (no admin key configured)");
+        enabled = false;
+        return true;
+    }
+
+    if (keyHex.length() != REGISTRY_ADMIN_KEY_LEN * 2) {
+        logger->log("ERROR: Registry admin key must be %d hex characters", REGISTRY_ADMIN_KEY_LEN * 2);
+        enabled = false;
+        return true;
+    }
+
+    for (size_t i = 0; i < REGISTRY_ADMIN_KEY_LEN; i++) {
+        int hi = hexNibble(keyHex[i * 2]);
+        int lo = hexNibble(keyHex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
+            logger->log("ERROR: Registry admin key is not valid hex");
+            enabled = false;
+            return true;
+        }
+        adminKey[i] = (uint8_t)((hi << 4) | lo);
+    }
+
+    enabled = true;
+    logger->log("Registry sync enabled");
+    return true;
+}
+
+void RegistrySync::resetSession() {
+    authenticated = false;
+    challengeIssued = false;
+    txnOpen = false;
+    txnAddCount = 0;
+    txnRemoveCount = 0;
+    memset(nonce, 0, sizeof(nonce));
+
+    portENTER_CRITICAL(&streamMux);
+    streamPending = 0;
+    streamOpcode = 0;
+    portEXIT_CRITICAL(&streamMux);
+}
+
+void RegistrySync::handleCommand(const uint8_t* data, size_t length) {
+    if (!data || length == 0) {
+        return;
+    }
+
+    uint8_t opcode = data[0];
+    const uint8_t* payload = data + 1;
+    size_t payloadLength = length - 1;
+
+    if (!enabled) {
+        sendStatus(opcode, STATUS_DISABLED);
+        return;
+    }
+
+    switch (opcode) {
+        case OP_AUTH_CHALLENGE:
+            handleAuthChallenge();
+            return;
+        case OP_AUTH_RESPONSE:
+            handleAuthResponse(payload, payloadLength);
+            return;
+        default:
+            break;
+    }
+
+    if (!authenticated) {
+        logger->log("UNAUTHORIZED: Registry command 0x%02X without admin session", opcode);
+        sendStatus(opcode, STATUS_NOT_AUTHORIZED);
+        return;
+    }
+
+    switch (opcode) {
+        case OP_STATUS:
+            sendRegistrySummary(opcode, STATUS_OK);
+            break;
+        case OP_EXPORT:
+        case OP_PRESENCE:
+            requestStream(opcode);
+            break;
+        case OP_TXN_BEGIN:
+            handleTxnBegin(payload, payloadLength);
+            break;
+        case OP_TXN_ADD:
+        case OP_TXN_REMOVE:
+            handleTxnStage(opcode, payload, payloadLength);
+            break;
+        case OP_TXN_COMMIT:
+            handleTxnCommit();
+            break;
+        case OP_TXN_ABORT:
+            txnOpen = false;
+            txnAddCount = 0;
+            txnRemoveCount = 0;
+            sendStatus(opcode, STATUS_OK);
+            break;
+        case OP_EVICT_STALE:
+            handleEvictStale(payload, payloadLength);
+            break;
+        default:
+            sendStatus(opcode, STATUS_BAD_REQUEST);
+            break;
+    }
+}
+
+void RegistrySync::handleAuthChallenge() {
+    esp_fill_random(nonce, sizeof(nonce));
+    challengeIssued = true;
+    authenticated = false;
+
+    uint8_t response[RESPONSE_HEADER_LEN + REGISTRY_NONCE_LEN];
+    response[0] = OP_AUTH_CHALLENGE;
+    response[1] = STATUS_OK;
+    memcpy(response + RESPONSE_HEADER_LEN, nonce, sizeof(nonce));
+    BLEManager::getInstance().sendRegistryResponse(response, sizeof(response));
+}
+
+void RegistrySync::handleAuthResponse(const uint8_t* payload, size_t length) {
+    if (!challengeIssued || length != REGISTRY_AUTH_MAC_LEN) {
+        sendStatus(OP_AUTH_RESPONSE, STATUS_BAD_REQUEST);
+        return;
+    }
+
+    // A nonce is only good for one attempt
+    challengeIssued = false;
+
+    uint8_t expected[32];
+    const mbedtls_md_info_t* md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    if (!md || mbedtls_md_hmac(md, adminKey, sizeof(adminKey), nonce, sizeof(nonce), expected) != 0) {
+        sendStatus(OP_AUTH_RESPONSE, STATUS_BAD_REQUEST);
+        return;
+    }
+
+    // Constant-time compare
+    uint8_t diff = 0;
+    for (size_t i = 0; i < REGISTRY_AUTH_MAC_LEN; i++) {
+        diff |= expected[i] ^ payload[i];
+    }
+
+    if (diff != 0) {
+        logger->log("UNAUTHORIZED: Registry admin authentication failed");
+        sendStatus(OP_AUTH_RESPONSE, STATUS_NOT_AUTHORIZED);
+        return;
+    }
+
+    authenticated = true;
+    logger->log("Registry admin session authenticated");
+    sendStatus(OP_AUTH_RESPONSE, STATUS_OK);
+}
+
+void RegistrySync::requestStream(uint8_t opcode) {
+    // Replaces an answer still being sent
+    portENTER_CRITICAL(&streamMux);
+    streamPending = opcode;
+    portEXIT_CRITICAL(&streamMux);
+
+    TimerWheel::getInstance().arm(streamTimer, 0);
+}
+
+void RegistrySync::streamChunk() {
+    portENTER_CRITICAL(&streamMux);
+    if (streamPending != 0) {
+        streamOpcode = streamPending;
+        streamPending = 0;
+        streamStart = 0;
+    }
+    uint8_t opcode = streamOpcode;
+    portEXIT_CRITICAL(&streamMux);
+
+    if (opcode == 0) {
+        return;
+    }
+
+    bool more = (opcode == OP_EXPORT) ? sendExportChunk() : sendPresenceChunk();
+    if (more) {
+        TimerWheel::getInstance().arm(streamTimer, REGISTRY_CHUNK_INTERVAL_MS);
+        return;
+    }
+
+    // A new request may have landed while this chunk was sent
+    portENTER_CRITICAL(&streamMux);
+    if (streamOpcode == opcode && streamPending == 0) {
+        streamOpcode = 0;
+    }
+    portEXIT_CRITICAL(&streamMux);
+}
+
+bool RegistrySync::sendExportChunk() {
+    size_t maxPayload = BLEManager::getInstance().getMaxNotifyPayload();
+    size_t perChunk = maxPayload > EXPORT_HEADER_LEN ? (maxPayload - EXPORT_HEADER_LEN) / 6 : 0;
+    if (perChunk == 0) {
+        sendStatus(OP_EXPORT, STATUS_BAD_REQUEST);
+        return false;
+    }
+    if (perChunk > MAX_EXPORT_PER_CHUNK) {
+        perChunk = MAX_EXPORT_PER_CHUNK;
+    }
+
+    CounterApp& app = CounterApp::getInstance();
+    CounterApp::Lock lock;
+    const RegisteredDevice* devices = app.getRegisteredDevices();
+    size_t total = app.getRegisteredDeviceCount();
+
+    // The first chunk always goes out so an empty registry is still answered
+    size_t n = total > streamStart ? total - streamStart : 0;
+    if (n > perChunk) {
+        n = perChunk;
+    }
+
+    uint8_t chunk[EXPORT_HEADER_LEN + MAX_EXPORT_PER_CHUNK * 6];
+    chunk[0] = OP_EXPORT;
+    chunk[1] = STATUS_OK;
+    putU16(chunk + 2, (uint16_t)total);
+    putU16(chunk + 4, (uint16_t)streamStart);
+    chunk[6] = (uint8_t)n;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(chunk + EXPORT_HEADER_LEN + i * 6, devices[streamStart + i].macAddress, 6);
+    }
+
+    BLEManager::getInstance().sendRegistryResponse(chunk, EXPORT_HEADER_LEN + n * 6);
+    streamStart += n;
+
+    if (n == 0 || streamStart >= total) {
+        logger->log("Registry exported: %zu devices", total);
+        return false;
+    }
+    return true;
+}
+
+bool RegistrySync::sendPresenceChunk() {
+    size_t maxPayload = BLEManager::getInstance().getMaxNotifyPayload();
+    size_t perChunk = maxPayload > EXPORT_HEADER_LEN ? (maxPayload - EXPORT_HEADER_LEN) / PRESENCE_RECORD_LEN : 0;
+    if (perChunk == 0) {
+        sendStatus(OP_PRESENCE, STATUS_BAD_REQUEST);
+        return false;
+    }
+    if (perChunk > MAX_PRESENCE_PER_CHUNK) {
+        perChunk = MAX_PRESENCE_PER_CHUNK;
+    }
+
+    // One page of the table per chunk; an entry added or evicted between
+    // chunks can shift the rest by one
+    PresenceStats::Entry entries[MAX_PRESENCE_PER_CHUNK];
+    uint8_t chunk[EXPORT_HEADER_LEN + MAX_PRESENCE_PER_CHUNK * PRESENCE_RECORD_LEN];
+
+    size_t total = PresenceStats::getInstance().snapshot(entries, streamStart, perChunk);
+    size_t n = total > streamStart ? total - streamStart : 0;
+    if (n > perChunk) {
+        n = perChunk;
+    }
+
+    chunk[0] = OP_PRESENCE;
+    chunk[1] = STATUS_OK;
+    putU16(chunk + 2, (uint16_t)total);
+    putU16(chunk + 4, (uint16_t)streamStart);
+    chunk[6] = (uint8_t)n;
+    for (size_t i = 0; i < n; i++) {
+        const PresenceStats::Entry& entry = entries[i];
+        uint8_t* record = chunk + EXPORT_HEADER_LEN + i * PRESENCE_RECORD_LEN;
+        memcpy(record, entry.macAddress, 6);
+        putU16(record + 6, entry.visits);
+        putU32(record + 8, entry.lastSeen);
+        putU32(record + 12, entry.dwellSeconds);
+        record[16] = entry.present ? 0x01 : 0x00;
+    }
+
+    BLEManager::getInstance().sendRegistryResponse(chunk, EXPORT_HEADER_LEN + n * PRESENCE_RECORD_LEN);
+    streamStart += n;
+
+    return n > 0 && streamStart < total;
+}
+
+void RegistrySync::handleTxnBegin(const uint8_t* payload, size_t length) {
+    if (length != 4) {
+        sendStatus(OP_TXN_BEGIN, STATUS_BAD_REQUEST);
+        return;
+    }
+
+    txnBaseVersion = getU32(payload);
+    if (txnBaseVersion != CounterApp::getInstance().getRegistryVersion()) {
+        sendRegistrySummary(OP_TXN_BEGIN, STATUS_VERSION_CONFLICT);
+        return;
+    }
+
+    txnOpen = true;
+    txnAddCount = 0;
+    txnRemoveCount = 0;
+    sendStatus(OP_TXN_BEGIN, STATUS_OK);
+}
+
+void RegistrySync::handleTxnStage(uint8_t opcode, const uint8_t* payload, size_t length) {
+    if (!txnOpen) {
+        sendStatus(opcode, STATUS_NO_TRANSACTION);
+        return;
+    }
+
+    if (length == 0 || length % 6 != 0) {
+        sendStatus(opcode, STATUS_BAD_REQUEST);
+        return;
+    }
+
+    size_t entries = length / 6;
+    size_t& count = (opcode == OP_TXN_ADD) ? txnAddCount : txnRemoveCount;
+    uint8_t (*staged)[6] = (opcode == OP_TXN_ADD) ? txnAdds : txnRemoves;
+
+    if (count + entries > REGISTRY_TXN_MAX_OPS) {
+        sendStagedCount(opcode, STATUS_CAPACITY);
+        return;
+    }
+
+    memcpy(staged[count], payload, length);
+    count += entries;
+    sendStagedCount(opcode, STATUS_OK);
+}
+
+void RegistrySync::handleTxnCommit() {
+    if (!txnOpen) {
+        sendStatus(OP_TXN_COMMIT, STATUS_NO_TRANSACTION);
+        return;
+    }
+
+    CounterApp& app = CounterApp::getInstance();
+    txnOpen = false;
+
+    // Something else (pairing, clear, USB) changed the registry
+    // mid-transaction; held through the apply so nothing can in between
+    CounterApp::Lock lock;
+    if (app.getRegistryVersion() != txnBaseVersion) {
+        txnAddCount = 0;
+        txnRemoveCount = 0;
+        sendRegistrySummary(OP_TXN_COMMIT, STATUS_VERSION_CONFLICT);
+        return;
+    }
+
+    bool applied = app.applyRegistryDiff(txnAdds, txnAddCount, txnRemoves, txnRemoveCount);
+
+    logger->log("Registry transaction %s: +%zu -%zu",
+        applied ? "committed" : "rejected", txnAddCount, txnRemoveCount);
+
+    txnAddCount = 0;
+    txnRemoveCount = 0;
+    sendRegistrySummary(OP_TXN_COMMIT, applied ? STATUS_OK : STATUS_CAPACITY);
+}
+
+void RegistrySync::handleEvictStale(const uint8_t* payload, size_t length) {
+    if (length != 4) {
+        sendStatus(OP_EVICT_STALE, STATUS_BAD_REQUEST);
+        return;
+    }
+
+    // Last-seen is wall-clock, so without it nothing can be called stale
+    time_t now = time(nullptr);
+    if (now < TIME_MIN_VALID_EPOCH) {
+        sendStatus(OP_EVICT_STALE, STATUS_NO_CLOCK);
+        return;
+    }
+
+    uint32_t maxAge = getU32(payload);
+    uint32_t cutoff = (uint32_t)now > maxAge ? (uint32_t)now - maxAge : 0;
+
+    size_t evictedCount = PresenceStats::getInstance().evictOlderThan(cutoff, evicted, PRESENCE_MAX_DEVICES);
+
+    // Only touch the registry (and its version) if a registered device went;
+    // the registered ones are packed to the front in place
+    CounterApp& app = CounterApp::getInstance();
+    CounterApp::Lock lock;
+    size_t removeCount = 0;
+    for (size_t i = 0; i < evictedCount; i++) {
+        if (app.isDeviceRegistered(evicted[i])) {
+            memmove(evicted[removeCount++], evicted[i], 6);
+        }
+    }
+    if (removeCount) {
+        app.applyRegistryDiff(nullptr, 0, evicted, removeCount);
+    }
+
+    logger->log("Evicted %zu devices not seen for %us (%zu registered)",
+        evictedCount, maxAge, removeCount);
+    sendRegistrySummary(OP_EVICT_STALE, STATUS_OK);
+}
+
+void RegistrySync::sendStatus(uint8_t opcode, uint8_t status) {
+    uint8_t response[RESPONSE_HEADER_LEN] = { opcode, status };
+    BLEManager::getInstance().sendRegistryResponse(response, sizeof(response));
+}
+
+void RegistrySync::sendRegistrySummary(uint8_t opcode, uint8_t status) {
+    CounterApp& app = CounterApp::getInstance();
+    CounterApp::Lock lock;
+
+    uint8_t response[RESPONSE_HEADER_LEN + 10];
+    response[0] = opcode;
+    response[1] = status;
+    putU32(response + 2, app.getRegistryVersion());
+    putU32(response + 6, app.getRegistryHash());
+    putU16(response + 10, (uint16_t)app.getRegisteredDeviceCount());
+    BLEManager::getInstance().sendRegistryResponse(response, sizeof(response));
+}
+
+void RegistrySync::sendStagedCount(uint8_t opcode, uint8_t status) {
+    uint8_t response[RESPONSE_HEADER_LEN + 2];
+    response[0] = opcode;
+    response[1] = status;
+    putU16(response + 2, (uint16_t)(txnAddCount + txnRemoveCount));
+    BLEManager::getInstance().sendRegistryResponse(response, sizeof(response));
+}
@@ -0,0 +1,131 @@
+#ifndef REGISTRY_SYNC_H
+#define REGISTRY_SYNC_H
+
+#include "../config.h"
+#include "config/IConfig.h"
+#include "../diag/log_ring.h"
+#include "timer_wheel.h"
+
+/**
+ * Registry import/export protocol for the admin characteristic.
+ *
+ * Every request is a single write whose first byte is the opcode; every
+ * response is a notification echoing that opcode followed by a status byte.
+ * Multi-byte integers are little-endian.
+ *
+ *   AUTH_CHALLENGE  ()                    -> nonce[16]
+ *   AUTH_RESPONSE   (hmac[16])            -> ()
+ *   STATUS          ()                    -> version u32, hash u32, count u16
+ *   EXPORT          ()                    -> one notify per chunk:
+ *                                            total u16, start u16, n u8, n x mac[6]
+ *   TXN_BEGIN       (baseVersion u32)     -> ()
+ *   TXN_ADD         (n x mac[6])          -> staged u16
+ *   TXN_REMOVE      (n x mac[6])          -> staged u16
+ *   TXN_COMMIT      ()                    -> version u32, hash u32, count u16
+ *   TXN_ABORT       ()                    -> ()
+ *   PRESENCE        ()                    -> one notify per chunk:
+ *                                            total u16, start u16, n u8, n x
+ *                                            (mac[6], visits u16, lastSeen u32,
+ *                                             dwellSeconds u32, flags u8)
+ *   EVICT_STALE     (maxAgeSeconds u32)   -> version u32, hash u32, count u16
+ *
+ * EXPORT and PRESENCE chunks are sent from the app loop, one every
+ * REGISTRY_CHUNK_INTERVAL_MS, so a large registry doesn't flood the link. Each
+ * chunk carries its own total; an edit between chunks changes it.
+ *
+ * PRESENCE flags bit 0 marks a device that is present now. EVICT_STALE drops
+ * the presence entries not seen within maxAgeSeconds and unregisters those
+ * devices; devices never seen since presence tracking started are kept.
+ *
+ * hmac = first 16 bytes of HMAC-SHA256(adminKey, nonce). Everything except
+ * AUTH_* requires an authenticated session, which lasts until disconnect.
+ */
+class RegistrySync {
+public:
+    enum Opcode : uint8_t {
+        OP_AUTH_CHALLENGE = 0x01,
+        OP_AUTH_RESPONSE  = 0x02,
+        OP_STATUS         = 0x03,
+        OP_EXPORT         = 0x04,
+        OP_TXN_BEGIN      = 0x05,
+        OP_TXN_ADD        = 0x06,
+        OP_TXN_REMOVE     = 0x07,
+        OP_TXN_COMMIT     = 0x08,
+        OP_TXN_ABORT      = 0x09,
+        OP_PRESENCE       = 0x0A,
+        OP_EVICT_STALE    = 0x0B
+    };
+
+    enum Status : uint8_t {
+        STATUS_OK               = 0x00,
+        STATUS_NOT_AUTHORIZED   = 0x01,
+        STATUS_BAD_REQUEST      = 0x02,
+        STATUS_NO_TRANSACTION   = 0x03,
+        STATUS_VERSION_CONFLICT = 0x04,
+        STATUS_CAPACITY         = 0x05,
+        STATUS_DISABLED         = 0x06,
+        STATUS_NO_CLOCK         = 0x07
+    };
+
+    static RegistrySync& getInstance();
+
+    bool begin(IConfig* config, LogRing* log);
+
+    // Handle one request written to the admin characteristic
+    void handleCommand(const uint8_t* data, size_t length);
+
+    // Drop authentication, any open transaction and any chunked answer still
+    // being sent (on connect/disconnect)
+    void resetSession();
+
+private:
+    RegistrySync();
+
+    // Prevent copying
+    RegistrySync(const RegistrySync&) = delete;
+    RegistrySync& operator=(const RegistrySync&) = delete;
+
+    LogRing* logger;
+    bool enabled;
+    uint8_t adminKey[REGISTRY_ADMIN_KEY_LEN];
+
+    // Session state
+    bool authenticated;
+    bool challengeIssued;
+    uint8_t nonce[REGISTRY_NONCE_LEN];
+
+    // Staged transaction
+    bool txnOpen;
+    uint32_t txnBaseVersion;
+    uint8_t txnAdds[REGISTRY_TXN_MAX_OPS][6];
+    size_t txnAddCount;
+    uint8_t txnRemoves[REGISTRY_TXN_MAX_OPS][6];
+    size_t txnRemoveCount;
+
+    // EVICT_STALE results; too big for the BLE task's stack
+    uint8_t evicted[PRESENCE_MAX_DEVICES][6];
+
+    // Chunked EXPORT/PRESENCE answer: requested on the BLE task, sent from
+    // the app loop. Opcodes are 0 when nothing is pending or streaming.
+    volatile uint8_t streamPending;
+    volatile uint8_t streamOpcode;
+    size_t streamStart;
+    TimerWheel::Timer streamTimer;
+
+    void handleAuthChallenge();
+    void handleAuthResponse(const uint8_t* payload, size_t length);
+    void requestStream(uint8_t opcode);
+    void streamChunk();
+    bool sendExportChunk();
+    bool sendPresenceChunk();
+    void handleTxnBegin(const uint8_t* payload, size_t length);
+    void handleTxnStage(uint8_t opcode, const uint8_t* payload, size_t length);
+    void handleTxnCommit();
+    void handleEvictStale(const uint8_t* payload, size_t length);
+
+    void sendStatus(uint8_t opcode, uint8_t status);
+    void sendRegistrySummary(uint8_t opcode, uint8_t status);
+    void sendStagedCount(uint8_t opcode, uint8_t status);
+};
+
+#endif // REGISTRY_SYNC_H
@@ -0,0 +1,103 @@
+#include "state_bus.h"
+#include "timer_wheel.h"
+
+// Serialises subscribe() calls; readers only load subscriptionCount
+static portMUX_TYPE subscribeMux = portMUX_INITIALIZER_UNLOCKED;
+
+StateBus& StateBus::getInstance() {
+    static StateBus instance;
+    return instance;
+}
+
+StateBus::StateBus()
+    : subscriptionCount(0)
+    , version(0)
+    , deliveriesInFlight(0) {
+}
+
+bool StateBus::subscribe(StateObserver* observer, uint32_t fields, Delivery delivery) {
+    if (!observer) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&subscribeMux);
+    size_t index = subscriptionCount.load(std::memory_order_relaxed);
+    if (index >= STATE_MAX_OBSERVERS) {
+        portEXIT_CRITICAL(&subscribeMux);
+        return false;
+    }
+
+    Subscription& sub = subscriptions[index];
+    sub.observer = observer;
+    sub.fields.store(fields);
+    sub.delivery = delivery;
+    sub.pending.store(0, std::memory_order_relaxed);
+
+    // Publish the slot only once it is filled in
+    subscriptionCount.store(index + 1, std::memory_order_release);
+    portEXIT_CRITICAL(&subscribeMux);
+    return true;
+}
+
+void StateBus::unsubscribe(StateObserver* observer) {
+    size_t count = subscriptionCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; i++) {
+        Subscription& sub = subscriptions[i];
+        if (sub.observer == observer) {
+            sub.fields.store(0);
+            sub.pending.store(0);
+        }
+    }
+
+    // A delivery that read the fields before they were cleared may still be
+    // calling the observer; wait it out
+    while (deliveriesInFlight.load() != 0) {
+        vTaskDelay(1);
+    }
+}
+
+void StateBus::publish(uint32_t fields) {
+    uint32_t current = version.fetch_add(1, std::memory_order_relaxed) + 1;
+    bool deferred = false;
+
+    deliveriesInFlight.fetch_add(1);
+    size_t count = subscriptionCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; i++) {
+        Subscription& sub = subscriptions[i];
+        uint32_t matched = fields & sub.fields.load();
+        if (!matched) {
+            continue;
+        }
+
+        if (sub.delivery == Delivery::IMMEDIATE) {
+            sub.observer->onStateChanged(matched, current);
+        } else {
+            sub.pending.fetch_or(matched, std::memory_order_relaxed);
+            deferred = true;
+        }
+    }
+    deliveriesInFlight.fetch_sub(1);
+
+    // Make sure the loop doesn't sleep on pending changes
+    if (deferred) {
+        TimerWheel::getInstance().wake();
+    }
+}
+
+void StateBus::dispatch() {
+    deliveriesInFlight.fetch_add(1);
+    size_t count = subscriptionCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; i++) {
+        Subscription& sub = subscriptions[i];
+        if (sub.delivery != Delivery::APP_LOOP) {
+            continue;
+        }
+
+        // A publish racing unsubscribe() can still set pending
+        uint32_t changed = sub.pending.exchange(0, std::memory_order_relaxed) & sub.fields.load();
+        if (changed) {
+            sub.observer->onStateChanged(changed, getVersion());
+        }
+    }
+    deliveriesInFlight.fetch_sub(1);
+}
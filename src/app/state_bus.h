@@ -0,0 +1,85 @@
+#ifndef STATE_BUS_H
+#define STATE_BUS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "../config.h"
+
+/**
+ * Receives app state changes. `fields` is the set of StateBus::Field bits
+ * that changed since the last delivery; `version` is the bus version at
+ * delivery time, so an observer can tell when changes were coalesced.
+ * Observers read current values from the owning singletons.
+ */
+class StateObserver {
+public:
+    virtual ~StateObserver() {}
+    virtual void onStateChanged(uint32_t fields, uint32_t version) = 0;
+};
+
+/**
+ * Push-based state change propagation.
+ *
+ * State owners publish() the fields they changed; each subscriber gets the
+ * fields it registered for. IMMEDIATE observers are called on the
+ * publishing task and must only do non-blocking work (e.g. wake a task).
+ * APP_LOOP observers have their changes OR-ed into a pending mask and
+ * delivered once per loop iteration from dispatch(), so a burst of
+ * changes becomes one callback. subscribe() may run on any task, but
+ * subscribe during setup where possible; an observer that is destroyed
+ * must unsubscribe first.
+ */
+class StateBus {
+public:
+    enum Field : uint32_t {
+        COUNTER    = 1u << 0,
+        REGISTRY   = 1u << 1,
+        PROXIMITY  = 1u << 2,
+        CONNECTION = 1u << 3,
+        PAIRING    = 1u << 4,
+        CHANNELS   = 1u << 5,
+        ALL        = 0x3F
+    };
+
+    enum class Delivery : uint8_t {
+        IMMEDIATE,
+        APP_LOOP
+    };
+
+    static StateBus& getInstance();
+
+    bool subscribe(StateObserver* observer, uint32_t fields, Delivery delivery);
+
+    // Stops delivery to observer. Returns once no publish() or dispatch()
+    // can still be calling it, so the observer may then be destroyed. The
+    // slot is not reused.
+    void unsubscribe(StateObserver* observer);
+
+    void publish(uint32_t fields);
+
+    // Delivers coalesced changes to APP_LOOP observers; call from the app loop
+    void dispatch();
+
+    uint32_t getVersion() const { return version.load(std::memory_order_relaxed); }
+
+private:
+    StateBus();
+
+    // Prevent copying
+    StateBus(const StateBus&) = delete;
+    StateBus& operator=(const StateBus&) = delete;
+
+    struct Subscription {
+        StateObserver* observer;
+        std::atomic<uint32_t> fields;   // 0 once unsubscribed
+        Delivery delivery;
+        std::atomic<uint32_t> pending;
+    };
+
+    Subscription subscriptions[STATE_MAX_OBSERVERS];
+    std::atomic<size_t> subscriptionCount;   // slots below it are filled in
+    std::atomic<uint32_t> version;
+    std::atomic<uint32_t> deliveriesInFlight;   // publish()/dispatch() calls running
+};
+
+#endif // STATE_BUS_H
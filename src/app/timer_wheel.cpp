@@ -0,0 +1,201 @@
+#include "timer_wheel.h"
+#include <esp_timer.h>
+
+static portMUX_TYPE wheelMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Deadlines past the top level's range are parked in its furthest slot
+static const uint32_t WHEEL_RANGE = 1u << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS);
+
+TimerWheel& TimerWheel::getInstance() {
+    static TimerWheel instance;
+    return instance;
+}
+
+TimerWheel::TimerWheel()
+    : currentTick(nowTick())
+    , ownerTask(nullptr) {
+    memset(wheel, 0, sizeof(wheel));
+}
+
+void TimerWheel::begin() {
+    ownerTask = xTaskGetCurrentTaskHandle();
+}
+
+uint32_t TimerWheel::nowTick() {
+    // esp_timer is 64-bit, so ticks only wrap after ~500 days (and wrap safely)
+    return (uint32_t)(esp_timer_get_time() / (TIMER_WHEEL_TICK_MS * 1000LL));
+}
+
+// ============================================================================
+// Arm / Cancel
+// ============================================================================
+
+void TimerWheel::arm(Timer& timer, uint32_t delayMs, uint32_t periodMs) {
+    uint32_t ticks = (delayMs + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+    uint32_t periodTicks = (periodMs + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+
+    portENTER_CRITICAL(&wheelMux);
+    if (timer.slot) {
+        unlink(timer);
+    }
+    timer.expires = nowTick() + (ticks ? ticks : 1);
+    timer.periodTicks = periodMs ? (periodTicks ? periodTicks : 1) : 0;
+    link(timer);
+    portEXIT_CRITICAL(&wheelMux);
+
+    // The owner may be asleep past this deadline
+    if (ownerTask && xTaskGetCurrentTaskHandle() != ownerTask) {
+        wake();
+    }
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    portENTER_CRITICAL(&wheelMux);
+    if (timer.slot) {
+        unlink(timer);
+    }
+    portEXIT_CRITICAL(&wheelMux);
+}
+
+void TimerWheel::link(Timer& timer) {
+    uint32_t delta = timer.expires - currentTick;
+    uint32_t at = timer.expires;
+    if (delta >= WHEEL_RANGE) {
+        at = currentTick + WHEEL_RANGE - 1;
+        delta = WHEEL_RANGE - 1;
+    }
+
+    uint32_t level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= (1u << ((level + 1) * TIMER_WHEEL_SLOT_BITS))) {
+        level++;
+    }
+
+    Timer** slot = &wheel[level][(at >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK];
+    timer.slot = slot;
+    timer.prev = nullptr;
+    timer.next = *slot;
+    if (*slot) {
+        (*slot)->prev = &timer;
+    }
+    *slot = &timer;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    if (timer.prev) {
+        timer.prev->next = timer.next;
+    } else {
+        *timer.slot = timer.next;
+    }
+    if (timer.next) {
+        timer.next->prev = timer.prev;
+    }
+    timer.prev = nullptr;
+    timer.next = nullptr;
+    timer.slot = nullptr;
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+void TimerWheel::cascade(uint32_t level) {
+    Timer** slot = &wheel[level][(currentTick >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK];
+    Timer* timer = *slot;
+    *slot = nullptr;
+
+    while (timer) {
+        Timer* next = timer->next;
+        link(*timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::dispatch() {
+    uint32_t target = nowTick();
+
+    while (true) {
+        portENTER_CRITICAL(&wheelMux);
+        if ((int32_t)(target - currentTick) <= 0) {
+            portEXIT_CRITICAL(&wheelMux);
+            break;
+        }
+        currentTick++;
+
+        // When a level wraps, pull the matching slot of the level above
+        // down; top level first so a timer can fall through several levels
+        for (uint32_t level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((currentTick & ((1u << (level * TIMER_WHEEL_SLOT_BITS)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+
+        // Callbacks run unlocked, so they may arm or cancel timers
+        Timer** slot = &wheel[0][currentTick & SLOT_MASK];
+        while (*slot) {
+            Timer* timer = *slot;
+            unlink(*timer);
+
+            if (timer->periodTicks) {
+                // After a long stall, skip missed periods rather than firing a burst
+                timer->expires = currentTick + timer->periodTicks;
+                if ((int32_t)(timer->expires - target) <= 0) {
+                    timer->expires = target + timer->periodTicks;
+                }
+                link(*timer);
+            }
+
+            Callback callback = timer->callback;
+            void* arg = timer->arg;
+            portEXIT_CRITICAL(&wheelMux);
+            callback(arg);
+            portENTER_CRITICAL(&wheelMux);
+        }
+        portEXIT_CRITICAL(&wheelMux);
+    }
+}
+
+// ============================================================================
+// Sleep
+// ============================================================================
+
+uint32_t TimerWheel::ticksToNextDeadline() {
+    for (uint32_t i = 1; i < SLOTS; i++) {
+        if (wheel[0][(currentTick + i) & SLOT_MASK]) {
+            return i;
+        }
+    }
+
+    // Nothing on the lowest level; wake for the next cascade
+    return SLOTS - (currentTick & SLOT_MASK);
+}
+
+uint32_t TimerWheel::sleep(uint32_t maxMs) {
+    if (!ownerTask) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&wheelMux);
+    uint32_t deadline = currentTick + ticksToNextDeadline();
+    portEXIT_CRITICAL(&wheelMux);
+
+    int32_t ticksLeft = (int32_t)(deadline - nowTick());
+    if (ticksLeft <= 0) {
+        return 0;
+    }
+
+    uint32_t waitMs = ticksLeft * TIMER_WHEEL_TICK_MS;
+    if (waitMs > maxMs) {
+        waitMs = maxMs;
+    }
+
+    int64_t start = esp_timer_get_time();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+    return (uint32_t)(esp_timer_get_time() - start);
+}
+
+void TimerWheel::wake() {
+    if (ownerTask) {
+        xTaskNotifyGive(ownerTask);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <Arduino.h>
+#include "../config.h"
+
+/**
+ * Hierarchical timer wheel for app-level timeouts.
+ *
+ * Timers are owned by their users (no allocation) and linked into one of
+ * TIMER_WHEEL_LEVELS rings of 2^TIMER_WHEEL_SLOT_BITS slots; far timers
+ * cascade down a level as the wheel turns. Arm and cancel are O(1) and
+ * safe from any task (not from ISRs). Callbacks run on the task that
+ * called begin() - the app loop - from dispatch(), so they may use the
+ * logger and app state freely.
+ */
+class TimerWheel {
+public:
+    using Callback = void (*)(void* arg);
+
+    class Timer {
+    public:
+        explicit Timer(Callback cb, void* arg = nullptr)
+            : prev(nullptr), next(nullptr), slot(nullptr), expires(0), periodTicks(0),
+              callback(cb), arg(arg) {}
+
+        bool isArmed() const { return slot != nullptr; }
+
+    private:
+        friend class TimerWheel;
+
+        Timer* prev;
+        Timer* next;
+        Timer** slot;
+        uint32_t expires;
+        uint32_t periodTicks;
+        Callback callback;
+        void* arg;
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    };
+
+    static TimerWheel& getInstance();
+
+    // Binds dispatch (and sleep) to the calling task
+    void begin();
+
+    // (Re)arms a timer; periodMs of 0 makes it one-shot
+    void arm(Timer& timer, uint32_t delayMs, uint32_t periodMs = 0);
+    void cancel(Timer& timer);
+
+    // Runs every callback that is due; call from the bound task
+    void dispatch();
+
+    // Blocks until the next deadline, wake() or maxMs, whichever comes
+    // first; returns the time actually slept (us)
+    uint32_t sleep(uint32_t maxMs);
+
+    void wake();
+
+private:
+    TimerWheel();
+
+    // Prevent copying
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    static const uint32_t SLOTS = 1u << TIMER_WHEEL_SLOT_BITS;
+    static const uint32_t SLOT_MASK = SLOTS - 1;
+
+    Timer* wheel[TIMER_WHEEL_LEVELS][SLOTS];
+    uint32_t currentTick;
+    TaskHandle_t ownerTask;
+
+    static uint32_t nowTick();
+
+    void link(Timer& timer);
+    void unlink(Timer& timer);
+    void cascade(uint32_t level);
+    uint32_t ticksToNextDeadline();
+};
+
+#endif // TIMER_WHEEL_H
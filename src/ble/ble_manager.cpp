@@ -1,6 +1,36 @@
 #include "ble_manager.h"
-#include "logger/Logger.h"
+#include "../diag/log_ring.h"
+#include "../diag/boot_trace.h"
+#include "../diag/metrics.h"
+#include "../diag/heap_guard.h"
+#include "../diag/task_profiler.h"
+#include "../diag/event_trace.h"
+#include "../diag/input_trace.h"
 #include <esp_gap_ble_api.h>
+#include <esp_gatts_api.h>
+#include <esp_timer.h>
+
+// ============================================================================
+// Characteristic Values
+// ============================================================================
+
+// BLECharacteristic::setValue() builds a new std::string on every call. A
+// value of unchanged length is overwritten in place instead, so only a
+// change of length (page switch, different snapshot layout) allocates.
+static void storeValue(BLECharacteristic* characteristic, const uint8_t* data, size_t length) {
+    if (characteristic->getLength() == length) {
+        memcpy(characteristic->getData(), data, length);
+        return;
+    }
+
+    HeapGuard::Allow resize;
+    characteristic->setValue(const_cast<uint8_t*>(data), length);
+}
+
+// Zeroes the value in place, keeping its length
+static void clearValue(BLECharacteristic* characteristic) {
+    memset(characteristic->getData(), 0, characteristic->getLength());
+}
 
 // ============================================================================
 // Server Callbacks
@@ -13,36 +43,45 @@ private:
 public:
     ServerCallbacks(BLEManager* mgr) : manager(mgr) {}
 
-    void onConnect(BLEServer* pServer) override {
-        // Get connected device MAC address first
-        std::map<uint16_t, conn_status_t> connections = pServer->getPeerDevices(false);
-        if (!connections.empty()) {
-            auto it = connections.begin();
-            BLEClient* pClient = static_cast<BLEClient*>(it->second.peer_device);
-            if (pClient) {
-                BLEAddress addr = pClient->getPeerAddress();
-                memcpy(manager->connectedDeviceMAC, addr.getNative(), 6);
-
-                // Mark as connected and notify the app
-                manager->deviceConnected = true;
-
-                if (manager->appCallbacks) {
-                    manager->appCallbacks->onDeviceConnected(manager->connectedDeviceMAC);
-                }
-            }
+    // The param overload carries the peer address and conn_id directly, so
+    // there is no need to copy the server's peer map on every connect
+    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+        manager->lastConnectTimeUs = esp_timer_get_time();
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("onConnect");
+        Metrics::increment(Metrics::Counter::BLE_CONNECTS);
+
+        memcpy(manager->connectedDeviceMAC, param->connect.remote_bda, 6);
+        manager->connId = param->connect.conn_id;
+
+        // Every peer starts with a full allowance
+        manager->rateLimiter.reset(millis());
+        manager->abuseDisconnectPending = false;
+        EventTrace::record(EventTrace::Type::CONNECT, EventTrace::Target::NONE, param->connect.remote_bda, 6);
+
+        // Mark as connected and notify the app
+        manager->deviceConnected = true;
+        Metrics::setGauge(Metrics::Gauge::CONNECTED, 1);
+
+        if (manager->appCallbacks) {
+            manager->appCallbacks->onDeviceConnected(manager->connectedDeviceMAC);
         }
     }
 
     void onDisconnect(BLEServer* pServer) override {
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("onDisconnect");
         manager->deviceConnected = false;
+        Metrics::increment(Metrics::Counter::BLE_DISCONNECTS);
+        EventTrace::record(EventTrace::Type::DISCONNECT);
+        Metrics::setGauge(Metrics::Gauge::CONNECTED, 0);
 
         if (manager->appCallbacks) {
             manager->appCallbacks->onDeviceDisconnected();
         }
 
-        // Restart advertising
-        delay(500);
-        manager->startAdvertising();
+        // Restart advertising from the app loop once the stack has settled
+        TimerWheel::getInstance().arm(manager->advertisingRestartTimer, ADVERTISING_RESTART_DELAY_MS);
     }
 };
 
@@ -58,11 +97,25 @@ public:
     CounterCharacteristicCallbacks(BLEManager* mgr) : manager(mgr) {}
 
     void onRead(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("counter read");
+        Metrics::ScopedTimer timer(Metrics::Histogram::GATT_READ_US);
+        Metrics::increment(Metrics::Counter::GATT_READS);
+
         // Check if device is connected
         if (!manager->deviceConnected) {
             return;
         }
 
+        // Over the limit there is no registry scan, so the peer gets zero
+        // rather than the live value the app keeps in the characteristic
+        if (!manager->admit(GattRateLimiter::Op::READ)) {
+            int32_t value = 0;
+            pCharacteristic->setValue(value);
+            return;
+        }
+        EventTrace::record(EventTrace::Type::GATT_READ, EventTrace::Target::COUNTER);
+
         if (manager->appCallbacks) {
             int32_t value = 0;
             manager->appCallbacks->onCounterRead(value);
@@ -73,16 +126,26 @@ public:
     }
 
     void onWrite(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("counter write");
+        Metrics::ScopedTimer timer(Metrics::Histogram::GATT_WRITE_US);
+        Metrics::increment(Metrics::Counter::GATT_WRITES);
+
         // Check if device is connected
         if (!manager->deviceConnected) {
             return;
         }
 
-        std::string value = pCharacteristic->getValue();
+        if (!manager->admit(GattRateLimiter::Op::WRITE)) {
+            return;
+        }
+        EventTrace::record(EventTrace::Type::GATT_WRITE, EventTrace::Target::COUNTER,
+                           pCharacteristic->getData(), pCharacteristic->getLength());
 
-        if (value.length() == sizeof(int32_t)) {
+        // Read in place; getValue() would copy into a new std::string
+        if (pCharacteristic->getLength() == sizeof(int32_t)) {
             int32_t counterValue;
-            memcpy(&counterValue, value.data(), sizeof(int32_t));
+            memcpy(&counterValue, pCharacteristic->getData(), sizeof(int32_t));
 
             if (manager->appCallbacks) {
                 manager->appCallbacks->onCounterWrite(counterValue);
@@ -91,6 +154,328 @@ public:
     }
 };
 
+// ============================================================================
+// Registry Characteristic Callbacks
+// ============================================================================
+
+class RegistryCharacteristicCallbacks : public BLECharacteristicCallbacks {
+private:
+    BLEManager* manager;
+
+public:
+    RegistryCharacteristicCallbacks(BLEManager* mgr) : manager(mgr) {}
+
+    void onWrite(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("registry write");
+        Metrics::ScopedTimer timer(Metrics::Histogram::GATT_WRITE_US);
+        Metrics::increment(Metrics::Counter::GATT_WRITES);
+
+        if (!manager->deviceConnected || !manager->appCallbacks) {
+            return;
+        }
+
+        if (!manager->admit(GattRateLimiter::Op::ADMIN)) {
+            return;
+        }
+        EventTrace::record(EventTrace::Type::GATT_WRITE, EventTrace::Target::REGISTRY,
+                           pCharacteristic->getData(), pCharacteristic->getLength());
+
+        manager->appCallbacks->onRegistryCommand(pCharacteristic->getData(), pCharacteristic->getLength());
+    }
+};
+
+// ============================================================================
+// Gate Characteristic Callbacks
+// ============================================================================
+
+class GateCharacteristicCallbacks : public BLECharacteristicCallbacks {
+private:
+    BLEManager* manager;
+
+public:
+    GateCharacteristicCallbacks(BLEManager* mgr) : manager(mgr) {}
+
+    void onWrite(BLECharacteristic* pCharacteristic) override {
+        int64_t eventTimeUs = esp_timer_get_time();
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("gate write");
+        Metrics::increment(Metrics::Counter::GATT_WRITES);
+
+        if (!manager->deviceConnected || !manager->appCallbacks) {
+            return;
+        }
+
+        if (pCharacteristic->getLength() != 1) {
+            return;
+        }
+
+        if (!manager->admit(GattRateLimiter::Op::WRITE)) {
+            return;
+        }
+        EventTrace::record(EventTrace::Type::GATT_WRITE, EventTrace::Target::GATE,
+                           pCharacteristic->getData(), 1);
+
+        manager->appCallbacks->onGateCommand(pCharacteristic->getData()[0], eventTimeUs);
+    }
+};
+
+// ============================================================================
+// Diagnostics Characteristic Callbacks
+// ============================================================================
+
+class DiagnosticsCharacteristicCallbacks : public BLECharacteristicCallbacks {
+private:
+    BLEManager* manager;
+    // Snapshot buffer lives here rather than on the BTC task stack; a
+    // snapshot of the same length is copied into the value in place
+    uint8_t buffer[DIAG_SNAPSHOT_MAX_LEN];
+    volatile uint8_t page;
+
+public:
+    DiagnosticsCharacteristicCallbacks(BLEManager* mgr) : manager(mgr), page(DIAG_PAGE_METRICS) {}
+
+    // A one-byte write selects which page the next read returns
+    void onWrite(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        Metrics::increment(Metrics::Counter::GATT_WRITES);
+
+        if (!manager->deviceConnected || !manager->appCallbacks) {
+            return;
+        }
+
+        if (pCharacteristic->getLength() != 1 || !manager->admit(GattRateLimiter::Op::ADMIN)) {
+            return;
+        }
+
+        if (!manager->appCallbacks->onDiagnosticsRequest()) {
+            return;
+        }
+
+        uint8_t requested = pCharacteristic->getData()[0];
+        if (requested == DIAG_PAGE_METRICS || requested == DIAG_PAGE_TASKS) {
+            page = requested;
+        }
+    }
+
+    void onRead(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        Metrics::ScopedTimer timer(Metrics::Histogram::GATT_READ_US);
+        Metrics::increment(Metrics::Counter::GATT_READS);
+
+        if (!manager->deviceConnected || !manager->appCallbacks) {
+            return;
+        }
+
+        // Snapshots are the most expensive read; over the limit the previous
+        // one is served again
+        if (!manager->admit(GattRateLimiter::Op::ADMIN)) {
+            return;
+        }
+
+        // The last snapshot must not reach a peer that may not see it
+        if (!manager->appCallbacks->onDiagnosticsRequest()) {
+            clearValue(pCharacteristic);
+            return;
+        }
+
+        size_t length;
+        if (page == DIAG_PAGE_TASKS) {
+            length = TaskProfiler::getInstance().snapshot(buffer, sizeof(buffer));
+        } else {
+            HeapGuard::report(nullptr);
+            length = Metrics::snapshot(buffer, sizeof(buffer));
+        }
+        storeValue(pCharacteristic, buffer, length);
+    }
+};
+
+// ============================================================================
+// History Characteristic Callbacks
+// ============================================================================
+
+class HistoryCharacteristicCallbacks : public BLECharacteristicCallbacks {
+private:
+    BLEManager* manager;
+
+public:
+    HistoryCharacteristicCallbacks(BLEManager* mgr) : manager(mgr) {}
+
+    // The answer is streamed from the app loop, not from this callback
+    void onWrite(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("history write");
+        Metrics::increment(Metrics::Counter::GATT_WRITES);
+
+        if (!manager->deviceConnected || !manager->appCallbacks) {
+            return;
+        }
+
+        // A query can turn into dozens of notifications
+        if (!manager->admit(GattRateLimiter::Op::ADMIN)) {
+            return;
+        }
+
+        manager->appCallbacks->onHistoryQuery(pCharacteristic->getData(), pCharacteristic->getLength());
+    }
+};
+
+// ============================================================================
+// Channels Characteristic Callbacks
+// ============================================================================
+
+static_assert(COUNTER_CHANNELS * 4 <= 512, "Channel values must fit one attribute value");
+
+class ChannelsCharacteristicCallbacks : public BLECharacteristicCallbacks {
+private:
+    BLEManager* manager;
+    // Page buffer lives here rather than on the BTC task stack; 512 is the
+    // ATT limit on an attribute value
+    uint8_t buffer[512];
+
+    // Zeroes the value in place and leaves it for the next admitted read to rebuild
+    void refuse(BLECharacteristic* pCharacteristic) {
+        xSemaphoreTake(manager->valueMutex, portMAX_DELAY);
+        clearValue(pCharacteristic);
+        manager->channelsStale = true;
+        xSemaphoreGive(manager->valueMutex);
+    }
+
+public:
+    ChannelsCharacteristicCallbacks(BLEManager* mgr) : manager(mgr) {}
+
+    // The whole table in one read; past the MTU the stack answers the
+    // follow-up blob reads from this same value. The app loop keeps the
+    // values page in the value (updateChannelsValue), so an admitted read
+    // copies nothing. The page is only rebuilt here after a page switch or
+    // a refused read.
+    void onRead(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("channels read");
+        Metrics::ScopedTimer timer(Metrics::Histogram::CHANNELS_READ_US);
+        Metrics::increment(Metrics::Counter::GATT_READS);
+
+        if (!manager->deviceConnected || !manager->appCallbacks) {
+            return;
+        }
+
+        // Over the limit there is no registry scan, so the live values
+        // must not be served either
+        if (!manager->admit(GattRateLimiter::Op::READ)) {
+            refuse(pCharacteristic);
+            return;
+        }
+        EventTrace::record(EventTrace::Type::GATT_READ, EventTrace::Target::CHANNELS);
+
+        if (!manager->appCallbacks->onChannelsRead()) {
+            refuse(pCharacteristic);
+            return;
+        }
+
+        if (manager->channelsStale) {
+            size_t length = manager->appCallbacks->getChannelsPage(manager->channelsPage, buffer, sizeof(buffer));
+            xSemaphoreTake(manager->valueMutex, portMAX_DELAY);
+            storeValue(pCharacteristic, buffer, length);
+            manager->channelsStale = false;
+            xSemaphoreGive(manager->valueMutex);
+        }
+    }
+
+    // One byte selects the page; anything else is a list of channel ops
+    void onWrite(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        TaskProfiler::StallCheck stallCheck("channels write");
+        Metrics::ScopedTimer timer(Metrics::Histogram::GATT_WRITE_US);
+        Metrics::increment(Metrics::Counter::GATT_WRITES);
+
+        if (!manager->deviceConnected || !manager->appCallbacks) {
+            return;
+        }
+
+        size_t length = pCharacteristic->getLength();
+        const uint8_t* data = pCharacteristic->getData();
+
+        if (length == 1) {
+            if (data[0] == CHANNELS_PAGE_VALUES || data[0] == CHANNELS_PAGE_NAMES) {
+                xSemaphoreTake(manager->valueMutex, portMAX_DELAY);
+                manager->channelsPage = data[0];
+                manager->channelsStale = true;
+                xSemaphoreGive(manager->valueMutex);
+            }
+            return;
+        }
+
+        if (length == 0 || length % CHANNEL_OP_LEN != 0) {
+            return;
+        }
+
+        if (!manager->admit(GattRateLimiter::Op::WRITE)) {
+            return;
+        }
+        EventTrace::record(EventTrace::Type::GATT_WRITE, EventTrace::Target::CHANNELS, data, length);
+
+        manager->appCallbacks->onChannelsWrite(data, length / CHANNEL_OP_LEN);
+    }
+};
+
+#if CHANNEL_BENCH_ENABLED
+// ============================================================================
+// Channel Bench Callbacks (one read-only characteristic per channel)
+// ============================================================================
+
+class ChannelBenchCallbacks : public BLECharacteristicCallbacks {
+private:
+    BLEManager* manager;
+    uint8_t channel;
+
+public:
+    ChannelBenchCallbacks() : manager(nullptr), channel(0) {}
+
+    void bind(BLEManager* mgr, uint8_t index) {
+        manager = mgr;
+        channel = index;
+    }
+
+    void onRead(BLECharacteristic* pCharacteristic) override {
+        HeapGuard::Scope heapScope;
+        Metrics::ScopedTimer timer(Metrics::Histogram::CHANNEL_SINGLE_READ_US);
+        Metrics::increment(Metrics::Counter::GATT_READS);
+
+        if (!manager->deviceConnected || !manager->appCallbacks) {
+            return;
+        }
+
+        int32_t value = 0;
+        if (!manager->admit(GattRateLimiter::Op::READ)) {
+            pCharacteristic->setValue(value);
+            return;
+        }
+
+        manager->appCallbacks->onChannelRead(channel, value);
+        pCharacteristic->setValue(value);
+    }
+};
+#endif
+
+// ============================================================================
+// GATT UUIDs (parsed and validated at compile time)
+// ============================================================================
+
+static constexpr GattSchema::Uuid APP_SERVICE_UUID = GattSchema::uuid128(SERVICE_UUID);
+static constexpr GattSchema::Uuid COUNTER_UUID = GattSchema::uuid128(COUNTER_CHAR_UUID);
+static constexpr GattSchema::Uuid PROXIMITY_UUID = GattSchema::uuid128(PROXIMITY_CHAR_UUID);
+static constexpr GattSchema::Uuid DEVICE_NAME_UUID = GattSchema::uuid128(DEVICE_NAME_CHAR_UUID);
+static constexpr GattSchema::Uuid REGISTRY_UUID = GattSchema::uuid128(REGISTRY_CHAR_UUID);
+static constexpr GattSchema::Uuid GATE_UUID = GattSchema::uuid128(GATE_CHAR_UUID);
+static constexpr GattSchema::Uuid DIAG_UUID = GattSchema::uuid128(DIAG_CHAR_UUID);
+static constexpr GattSchema::Uuid HISTORY_UUID = GattSchema::uuid128(HISTORY_CHAR_UUID);
+static constexpr GattSchema::Uuid CHANNELS_UUID = GattSchema::uuid128(CHANNELS_CHAR_UUID);
+#if CHANNEL_BENCH_ENABLED
+static constexpr GattSchema::Uuid CHANNEL_BENCH_UUID = GattSchema::uuid128(CHANNEL_BENCH_SERVICE_UUID);
+#endif
+static constexpr GattSchema::Uuid BATTERY_SERVICE = GattSchema::uuid16(BATTERY_SERVICE_UUID);
+static constexpr GattSchema::Uuid BATTERY_LEVEL_UUID = GattSchema::uuid16(BATTERY_LEVEL_CHAR_UUID);
+
 // ============================================================================
 // BLEManager Implementation
 // ============================================================================
@@ -106,10 +491,35 @@ BLEManager::BLEManager()
     , counterCharacteristic(nullptr)
     , proximityCharacteristic(nullptr)
     , deviceNameCharacteristic(nullptr)
+    , registryCharacteristic(nullptr)
+    , gateCharacteristic(nullptr)
+    , diagnosticsCharacteristic(nullptr)
+    , historyCharacteristic(nullptr)
+    , channelsCharacteristic(nullptr)
+    , batteryService(nullptr)
+    , batteryLevelCharacteristic(nullptr)
+#if CHANNEL_BENCH_ENABLED
+    , channelBenchService(nullptr)
+#endif
     , initialized(false)
     , deviceConnected(false)
     , pairingMode(false)
-    , pairingModeStartTime(0)
+    , lastConnectTimeUs(0)
+    , connId(0)
+    , gattsIf(ESP_GATT_IF_NONE)
+    , advertisingIntervalMs(BLE_ADV_INTERVAL_MS)
+    , channelsPage(CHANNELS_PAGE_VALUES)
+    , channelsStale(true)
+    , valueMutex(nullptr)
+    , abuseDisconnectPending(false)
+    , pairingTimer([](void* arg) {
+          BLEManager* manager = static_cast<BLEManager*>(arg);
+          manager->logger->log("Pairing mode timeout");
+          manager->exitPairingMode();
+      }, this)
+    , advertisingRestartTimer([](void* arg) {
+          static_cast<BLEManager*>(arg)->startAdvertising();
+      }, this)
     , appCallbacks(nullptr)
     , logger(nullptr) {
     memset(pairingPassword, 0, sizeof(pairingPassword));
@@ -122,7 +532,16 @@ BLEManager::~BLEManager() {
     }
 }
 
-bool BLEManager::begin(BLEManagerCallbacks* callbacks, Logger* log) {
+bool BLEManager::begin(BLEManagerCallbacks* callbacks, LogRing* log) {
+    if (!initStack(callbacks, log)) {
+        return false;
+    }
+
+    startAdvertising();
+    return true;
+}
+
+bool BLEManager::initStack(BLEManagerCallbacks* callbacks, LogRing* log) {
     if (!log) {
         return false;
     }
@@ -136,6 +555,12 @@ bool BLEManager::begin(BLEManagerCallbacks* callbacks, Logger* log) {
 
     appCallbacks = callbacks;
 
+    valueMutex = xSemaphoreCreateMutex();
+    if (!valueMutex) {
+        logger->log("ERROR: BLE value mutex creation failed");
+        return false;
+    }
+
     logger->log("\n====================================");
     logger->log("BLE INITIALIZATION STARTING");
     logger->log("====================================");
@@ -150,27 +575,37 @@ bool BLEManager::begin(BLEManagerCallbacks* callbacks, Logger* log) {
 
     // Create BLE Server
     logger->log("Creating BLE Server...");
+    BLEDevice::setCustomGattsHandler(onGattsEvent);
     server = BLEDevice::createServer();
-    server->setCallbacks(new ServerCallbacks(this));
+    // Callback objects and descriptors live in static storage: they exist
+    // for the life of the program and should not come from the heap
+    static ServerCallbacks serverCallbacks(this);
+    server->setCallbacks(&serverCallbacks);
+
+    // Services and characteristics, in one pass from the GATT table
+    if (!registerGattTable()) {
+        logger->log("ERROR: GATT table registration failed");
+        return false;
+    }
+
+    // The advertising payload is set once: addServiceUUID() appends to a
+    // vector, so doing it on every restart would grow it after boot
+    BLEAdvertising* advertising = BLEDevice::getAdvertising();
+    advertising->addServiceUUID(GattSchema::toBLEUUID(APP_SERVICE_UUID));
 
-    // Create BLE Service
-    logger->log("Creating BLE Service with UUID: %s", SERVICE_UUID);
-    service = server->createService(SERVICE_UUID);
+    // Enable scan response for device name
+    advertising->setScanResponse(true);
 
-    // Setup characteristics
-    logger->log("Setting up BLE characteristics...");
-    setupCharacteristics();
+    // Set advertising parameters for better iOS compatibility
+    advertising->setMinPreferred(0x06);  // Minimum connection interval
+    advertising->setMaxPreferred(0x12);  // Maximum connection interval (was duplicate setMinPreferred)
 
-    // Start the service
-    logger->log("Starting BLE service...");
-    service->start();
+    // Explicitly set device as connectable and discoverable
+    advertising->setAdvertisementType(ADV_TYPE_IND);
 
-    // Mark as initialized BEFORE starting advertising (advertising checks this flag)
+    // Advertising checks this flag
     initialized = true;
 
-    // Start advertising
-    startAdvertising();
-
     logger->log("\n====================================");
     logger->log("BLE INITIALIZATION COMPLETE");
     logger->log("====================================");
@@ -180,36 +615,107 @@ bool BLEManager::begin(BLEManagerCallbacks* callbacks, Logger* log) {
     return true;
 }
 
-void BLEManager::setupCharacteristics() {
-    // Counter characteristic (Read/Write/Notify)
-    logger->log("  - Counter Characteristic: %s", COUNTER_CHAR_UUID);
-    counterCharacteristic = service->createCharacteristic(
-        COUNTER_CHAR_UUID,
-        BLECharacteristic::PROPERTY_READ |
-        BLECharacteristic::PROPERTY_WRITE |
-        BLECharacteristic::PROPERTY_NOTIFY
-    );
-    counterCharacteristic->addDescriptor(new BLE2902());
-    counterCharacteristic->setCallbacks(new CounterCharacteristicCallbacks(this));
-
-    // Proximity characteristic (Read/Notify)
-    logger->log("  - Proximity Characteristic: %s", PROXIMITY_CHAR_UUID);
-    proximityCharacteristic = service->createCharacteristic(
-        PROXIMITY_CHAR_UUID,
-        BLECharacteristic::PROPERTY_READ |
-        BLECharacteristic::PROPERTY_NOTIFY
-    );
-    proximityCharacteristic->addDescriptor(new BLE2902());
-
-    // Device name characteristic (Read)
-    logger->log("  - Device Name Characteristic: %s", DEVICE_NAME_CHAR_UUID);
-    deviceNameCharacteristic = service->createCharacteristic(
-        DEVICE_NAME_CHAR_UUID,
-        BLECharacteristic::PROPERTY_READ
-    );
+bool BLEManager::registerGattTable() {
+    // Static for the same reason as the server callbacks
+    static BLE2902 counterCccd;
+    static BLE2902 proximityCccd;
+    static BLE2902 registryCccd;
+    static BLE2902 historyCccd;
+    static BLE2902 channelsCccd;
+    static CounterCharacteristicCallbacks counterCallbacks(this);
+    static RegistryCharacteristicCallbacks registryCallbacks(this);
+    static GateCharacteristicCallbacks gateCallbacks(this);
+    static DiagnosticsCharacteristicCallbacks diagnosticsCallbacks(this);
+    static HistoryCharacteristicCallbacks historyCallbacks(this);
+    static ChannelsCharacteristicCallbacks channelsCallbacks(this);
+
+    const GattSchema::Characteristic appCharacteristics[] = {
+        { COUNTER_UUID,
+          BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY,
+          &counterCallbacks, &counterCccd, &counterCharacteristic },
+        { PROXIMITY_UUID,
+          BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY,
+          nullptr, &proximityCccd, &proximityCharacteristic },
+        { DEVICE_NAME_UUID,
+          BLECharacteristic::PROPERTY_READ,
+          nullptr, nullptr, &deviceNameCharacteristic },
+        // Registry admin: commands are written, responses notified
+        { REGISTRY_UUID,
+          BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY,
+          &registryCallbacks, &registryCccd, &registryCharacteristic },
+        { GATE_UUID,
+          BLECharacteristic::PROPERTY_WRITE,
+          &gateCallbacks, nullptr, &gateCharacteristic },
+        // Diagnostics: a one-byte write selects the page the next read returns
+        { DIAG_UUID,
+          BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE,
+          &diagnosticsCallbacks, nullptr, &diagnosticsCharacteristic },
+        // Counter history: a query is written, the answer notified in chunks
+        { HISTORY_UUID,
+          BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY,
+          &historyCallbacks, &historyCccd, &historyCharacteristic },
+        // Counter table: bulk read, per-channel ops written, changes notified
+        { CHANNELS_UUID,
+          BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY,
+          &channelsCallbacks, &channelsCccd, &channelsCharacteristic },
+    };
+
+#if SENSORS_ENABLED
+    static BLE2902 batteryCccd;
+
+    // Standard Battery Service so phones show the level without a custom app
+    const GattSchema::Characteristic batteryCharacteristics[] = {
+        { BATTERY_LEVEL_UUID,
+          BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY,
+          nullptr, &batteryCccd, &batteryLevelCharacteristic },
+    };
+#endif
+
+#if CHANNEL_BENCH_ENABLED
+    // Channel n is the service UUID with n + 1 in its last byte
+    static ChannelBenchCallbacks benchCallbacks[COUNTER_CHANNELS];
+    GattSchema::Characteristic benchCharacteristics[COUNTER_CHANNELS];
+    for (uint8_t channel = 0; channel < COUNTER_CHANNELS; channel++) {
+        benchCallbacks[channel].bind(this, channel);
+        GattSchema::Characteristic& characteristic = benchCharacteristics[channel];
+        characteristic.uuid = CHANNEL_BENCH_UUID;
+        characteristic.uuid.bytes[15] = (uint8_t)(CHANNEL_BENCH_UUID.bytes[15] + channel + 1);
+        characteristic.properties = BLECharacteristic::PROPERTY_READ;
+        characteristic.callbacks = &benchCallbacks[channel];
+        characteristic.cccd = nullptr;
+        characteristic.handle = nullptr;
+    }
+#endif
+
+    const GattSchema::Service services[] = {
+        { APP_SERVICE_UUID, appCharacteristics,
+          sizeof(appCharacteristics) / sizeof(appCharacteristics[0]), &service },
+#if SENSORS_ENABLED
+        { BATTERY_SERVICE, batteryCharacteristics,
+          sizeof(batteryCharacteristics) / sizeof(batteryCharacteristics[0]), &batteryService },
+#endif
+#if CHANNEL_BENCH_ENABLED
+        { CHANNEL_BENCH_UUID, benchCharacteristics, COUNTER_CHANNELS, &channelBenchService },
+#endif
+    };
+    const size_t serviceCount = sizeof(services) / sizeof(services[0]);
+
+    int64_t startUs = esp_timer_get_time();
+    size_t registered = GattSchema::registerServices(server, services, serviceCount);
+    uint32_t elapsedUs = (uint32_t)(esp_timer_get_time() - startUs);
+    if (!registered) {
+        return false;
+    }
+
     deviceNameCharacteristic->setValue(BLE_DEVICE_NAME);
+    if (batteryLevelCharacteristic) {
+        uint8_t level = 0;
+        batteryLevelCharacteristic->setValue(&level, 1);
+    }
 
-    logger->log("All characteristics configured successfully");
+    logger->log("GATT: %u services, %u characteristics registered in %lu us",
+        (unsigned)serviceCount, (unsigned)registered, (unsigned long)elapsedUs);
+    return true;
 }
 
 void BLEManager::startAdvertising() {
@@ -222,25 +728,13 @@ void BLEManager::startAdvertising() {
 
     BLEAdvertising* advertising = BLEDevice::getAdvertising();
 
-    // Add service UUID to advertising data
-    advertising->addServiceUUID(SERVICE_UUID);
-    logger->log("Service UUID: %s", SERVICE_UUID);
-
-    // Enable scan response for device name
-    advertising->setScanResponse(true);
-
-    // Set advertising parameters for better iOS compatibility
-    advertising->setMinPreferred(0x06);  // Minimum connection interval
-    advertising->setMaxPreferred(0x12);  // Maximum connection interval (was duplicate setMinPreferred)
-
     // Set advertising interval (in 0.625ms units, so 160 = 100ms)
-    advertising->setMinInterval(160);
-    advertising->setMaxInterval(160);
-
-    // Explicitly set device as connectable and discoverable
-    advertising->setAdvertisementType(ADV_TYPE_IND);
+    uint16_t intervalUnits = advertisingIntervalMs * 8 / 5;
+    advertising->setMinInterval(intervalUnits);
+    advertising->setMaxInterval(intervalUnits);
 
     BLEDevice::startAdvertising();
+    BootTrace::mark("advertising");
 
     logger->log("BLE Advertising Configuration:");
     logger->log("  Device Name: %s", BLE_DEVICE_NAME);
@@ -260,15 +754,41 @@ void BLEManager::stopAdvertising() {
     logger->log("BLE advertising stopped");
 }
 
+void BLEManager::setAdvertisingInterval(uint32_t intervalMs) {
+    if (intervalMs == advertisingIntervalMs) {
+        return;
+    }
+
+    advertisingIntervalMs = intervalMs;
+    if (!initialized || deviceConnected) {
+        return;
+    }
+
+    // Only the interval changes; the advertising payload is already set up
+    uint16_t intervalUnits = advertisingIntervalMs * 8 / 5;
+    BLEAdvertising* advertising = BLEDevice::getAdvertising();
+    advertising->stop();
+    advertising->setMinInterval(intervalUnits);
+    advertising->setMaxInterval(intervalUnits);
+    advertising->start();
+
+    logger->log("Advertising interval now %u ms", advertisingIntervalMs);
+}
+
 void BLEManager::enterPairingMode() {
     pairingMode = true;
-    pairingModeStartTime = millis();
     generatePairingPassword();
+    TimerWheel::getInstance().arm(pairingTimer, PAIRING_MODE_TIMEOUT_MS);
 
     logger->log("Entered pairing mode with password: %s", pairingPassword);
+
+    if (appCallbacks) {
+        appCallbacks->onPairingModeEnter();
+    }
 }
 
 void BLEManager::exitPairingMode() {
+    TimerWheel::getInstance().cancel(pairingTimer);
     pairingMode = false;
     memset(pairingPassword, 0, sizeof(pairingPassword));
 
@@ -292,18 +812,62 @@ void BLEManager::getConnectedDeviceMAC(uint8_t* macAddress) {
     memcpy(macAddress, connectedDeviceMAC, 6);
 }
 
+void BLEManager::replayConnection(const uint8_t* macAddress) {
+    lastConnectTimeUs = esp_timer_get_time();
+    memcpy(connectedDeviceMAC, macAddress, 6);
+    deviceConnected = true;
+
+    if (appCallbacks) {
+        appCallbacks->onDeviceConnected(connectedDeviceMAC);
+    }
+}
+
+void BLEManager::replayDisconnection() {
+    deviceConnected = false;
+
+    if (appCallbacks) {
+        appCallbacks->onDeviceDisconnected();
+    }
+}
+
+bool BLEManager::admit(GattRateLimiter::Op op) {
+#if RATE_LIMIT_ENABLED
+    GattRateLimiter::Verdict verdict = rateLimiter.check(op, millis());
+    if (verdict == GattRateLimiter::Verdict::ALLOW) {
+        return true;
+    }
+
+    Metrics::increment(Metrics::Counter::GATT_THROTTLED);
+
+    if (verdict == GattRateLimiter::Verdict::DISCONNECT && !abuseDisconnectPending) {
+        abuseDisconnectPending = true;
+        Metrics::increment(Metrics::Counter::GATT_ABUSE_DISCONNECTS);
+        logger->log("GATT: %02X:%02X:%02X:%02X:%02X:%02X keeps exceeding rate limits "
+                    "(dropped %lu reads, %lu writes, %lu admin), disconnecting",
+            connectedDeviceMAC[0], connectedDeviceMAC[1], connectedDeviceMAC[2],
+            connectedDeviceMAC[3], connectedDeviceMAC[4], connectedDeviceMAC[5],
+            (unsigned long)rateLimiter.getDropped(GattRateLimiter::Op::READ),
+            (unsigned long)rateLimiter.getDropped(GattRateLimiter::Op::WRITE),
+            (unsigned long)rateLimiter.getDropped(GattRateLimiter::Op::ADMIN));
+        server->disconnect(connId);
+    }
+    return false;
+#else
+    return true;
+#endif
+}
+
 void BLEManager::disconnectDevice() {
     if (!initialized || !server) {
         return;
     }
 
-    logger->log("Disconnecting device...");
-
-    // Get all connected peers and disconnect them
-    std::map<uint16_t, conn_status_t> connections = server->getPeerDevices(false);
-    for (auto& conn : connections) {
-        server->disconnect(conn.first);
+    if (!deviceConnected) {
+        return;
     }
+
+    logger->log("Disconnecting device...");
+    server->disconnect(connId);
 }
 
 void BLEManager::updateProximityStatus(bool isNearby) {
@@ -313,10 +877,7 @@ void BLEManager::updateProximityStatus(bool isNearby) {
 
     uint8_t value = isNearby ? 1 : 0;
     proximityCharacteristic->setValue(&value, 1);
-
-    if (deviceConnected) {
-        proximityCharacteristic->notify();
-    }
+    notifyPeer(proximityCharacteristic, &value, 1);
 }
 
 void BLEManager::updateCounterValue(int32_t value) {
@@ -325,10 +886,95 @@ void BLEManager::updateCounterValue(int32_t value) {
     }
 
     counterCharacteristic->setValue(value);
+    notifyPeer(counterCharacteristic, reinterpret_cast<const uint8_t*>(&value), sizeof(value));
+    InputTrace::notifyQueued();
+}
+
+void BLEManager::updateChannels(const uint8_t* data, size_t length) {
+    if (!initialized || !channelsCharacteristic) {
+        return;
+    }
+
+    notifyPeer(channelsCharacteristic, data, length);
+}
 
-    if (deviceConnected) {
-        counterCharacteristic->notify();
+void BLEManager::updateChannelsValue(const uint8_t* data, size_t length) {
+    if (!initialized || !channelsCharacteristic) {
+        return;
+    }
+
+    // In place only; the BLE task sizes the value when it rebuilds a page
+    xSemaphoreTake(valueMutex, portMAX_DELAY);
+    if (!channelsStale && channelsPage == CHANNELS_PAGE_VALUES &&
+        channelsCharacteristic->getLength() == length) {
+        memcpy(channelsCharacteristic->getData(), data, length);
+    }
+    xSemaphoreGive(valueMutex);
+}
+
+void BLEManager::updateBatteryLevel(uint8_t percent) {
+    if (!initialized || !batteryLevelCharacteristic) {
+        return;
+    }
+
+    batteryLevelCharacteristic->setValue(&percent, 1);
+    notifyPeer(batteryLevelCharacteristic, &percent, 1);
+}
+
+void BLEManager::sendRegistryResponse(const uint8_t* data, size_t length) {
+    if (!initialized || !registryCharacteristic) {
+        return;
+    }
+
+    notifyPeer(registryCharacteristic, data, length);
+}
+
+void BLEManager::sendHistoryData(const uint8_t* data, size_t length) {
+    if (!initialized || !historyCharacteristic) {
+        return;
     }
+
+    notifyPeer(historyCharacteristic, data, length);
+}
+
+// BLECharacteristic::notify() copies the server's peer map and the value
+// into new containers on every call. The app has one peer, so this sends
+// straight to it from the caller's buffer and leaves the value alone.
+void BLEManager::notifyPeer(BLECharacteristic* characteristic, const uint8_t* data, size_t length) {
+    if (!deviceConnected || gattsIf == ESP_GATT_IF_NONE) {
+        return;
+    }
+
+    // The same check notify() makes: nothing goes out until the peer subscribes
+    BLE2902* cccd = static_cast<BLE2902*>(characteristic->getDescriptorByUUID((uint16_t)0x2902));
+    if (cccd && !cccd->getNotifications()) {
+        return;
+    }
+
+    esp_err_t err = esp_ble_gatts_send_indicate(gattsIf, connId, characteristic->getHandle(),
+                                                length, const_cast<uint8_t*>(data), false);
+    Metrics::increment(err == ESP_OK ? Metrics::Counter::NOTIFY_SENT : Metrics::Counter::NOTIFY_FAILED);
+}
+
+// Runs after the wrapper has handled each GATTS event; it is only here to
+// learn the interface notifications go out on
+void BLEManager::onGattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf,
+                              esp_ble_gatts_cb_param_t* param) {
+    if (event == ESP_GATTS_CONNECT_EVT) {
+        getInstance().gattsIf = gattsIf;
+    }
+}
+
+size_t BLEManager::getMaxNotifyPayload() {
+    // ATT notification header is 3 bytes; default MTU is 23
+    uint16_t mtu = 23;
+    if (initialized && server && deviceConnected) {
+        uint16_t peerMtu = server->getPeerMTU(server->getConnId());
+        if (peerMtu > mtu) {
+            mtu = peerMtu;
+        }
+    }
+    return mtu - 3;
 }
 
 bool BLEManager::isDeviceAuthorized(uint8_t* macAddress, const RegisteredDevice devices[], size_t count) {
@@ -355,31 +1001,19 @@ void BLEManager::clearAllBonds() {
     logger->log("Clearing all BLE bonds...");
 
     // Remove all bonded devices from ESP32's security database
-    int deviceCount = esp_ble_get_bond_device_num();
-    if (deviceCount > 0) {
-        esp_ble_bond_dev_t* bondedDevices = (esp_ble_bond_dev_t*)malloc(sizeof(esp_ble_bond_dev_t) * deviceCount);
-        if (bondedDevices) {
-            esp_ble_get_bond_device_list(&deviceCount, bondedDevices);
-            for (int i = 0; i < deviceCount; i++) {
-                esp_ble_remove_bond_device(bondedDevices[i].bd_addr);
-                logger->log("Removed bond: %02X:%02X:%02X:%02X:%02X:%02X",
-                    bondedDevices[i].bd_addr[0], bondedDevices[i].bd_addr[1],
-                    bondedDevices[i].bd_addr[2], bondedDevices[i].bd_addr[3],
-                    bondedDevices[i].bd_addr[4], bondedDevices[i].bd_addr[5]);
-            }
-            free(bondedDevices);
+    static esp_ble_bond_dev_t bondedDevices[BLE_MAX_BONDS];
+
+    int deviceCount = BLE_MAX_BONDS;
+    if (esp_ble_get_bond_device_num() > 0) {
+        esp_ble_get_bond_device_list(&deviceCount, bondedDevices);
+        for (int i = 0; i < deviceCount; i++) {
+            esp_ble_remove_bond_device(bondedDevices[i].bd_addr);
+            logger->log("Removed bond: %02X:%02X:%02X:%02X:%02X:%02X",
+                bondedDevices[i].bd_addr[0], bondedDevices[i].bd_addr[1],
+                bondedDevices[i].bd_addr[2], bondedDevices[i].bd_addr[3],
+                bondedDevices[i].bd_addr[4], bondedDevices[i].bd_addr[5]);
         }
     }
 
     logger->log("All BLE bonds cleared");
 }
-
-void BLEManager::update() {
-    // Check pairing mode timeout
-    if (pairingMode) {
-        if (millis() - pairingModeStartTime >= PAIRING_MODE_TIMEOUT_MS) {
-            logger->log("Pairing mode timeout");
-            exitPairingMode();
-        }
-    }
-}
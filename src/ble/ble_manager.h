@@ -7,7 +7,10 @@
 #include <BLEUtils.h>
 #include <BLE2902.h>
 #include <BLEClient.h>
-#include "logger/Logger.h"
+#include "../diag/log_ring.h"
+#include "../app/timer_wheel.h"
+#include "gatt_schema.h"
+#include "gatt_rate_limiter.h"
 
 // Forward declarations
 class BLEManagerCallbacks {
@@ -16,20 +19,42 @@ public:
     virtual void onDeviceDisconnected() = 0;
     virtual void onCounterRead(int32_t& value) = 0;
     virtual void onCounterWrite(int32_t value) = 0;
+    virtual void onPairingModeEnter() = 0;
     virtual void onPairingModeExit() = 0;
+    virtual void onGateCommand(uint8_t command, int64_t eventTimeUs) = 0;
+    virtual void onRegistryCommand(const uint8_t* data, size_t length) = 0;
+    virtual void onHistoryQuery(const uint8_t* data, size_t length) = 0;
+
+    // Diagnostics characteristic: false refuses the connected peer
+    virtual bool onDiagnosticsRequest() = 0;
+
+    // Channels characteristic: onChannelsRead() returns false to refuse the
+    // connected peer; getChannelsPage() fills out with a page and returns its
+    // length; ops are CHANNEL_OP_LEN bytes each
+    virtual bool onChannelsRead() = 0;
+    virtual size_t getChannelsPage(uint8_t page, uint8_t* out, size_t capacity) = 0;
+    virtual void onChannelRead(uint8_t channel, int32_t& value) = 0;
+    virtual void onChannelsWrite(const uint8_t* ops, size_t count) = 0;
 };
 
 class BLEManager {
 public:
     static BLEManager& getInstance();
 
-    // Initialize BLE stack
-    bool begin(BLEManagerCallbacks* callbacks, Logger* log);
+    // Initialize BLE stack and start advertising
+    bool begin(BLEManagerCallbacks* callbacks, LogRing* log);
+
+    // Initialize BLE stack and GATT table without advertising, so boot can
+    // hold connections off until the app state is loaded
+    bool initStack(BLEManagerCallbacks* callbacks, LogRing* log);
 
     // Start/stop advertising
     void startAdvertising();
     void stopAdvertising();
 
+    // Changes the advertising interval, restarting advertising if it is running
+    void setAdvertisingInterval(uint32_t intervalMs);
+
     // Pairing mode
     void enterPairingMode();
     void exitPairingMode();
@@ -39,11 +64,29 @@ public:
     // Connection status
     bool isDeviceConnected() const { return deviceConnected; }
     void getConnectedDeviceMAC(uint8_t* macAddress);
+    int64_t getLastConnectTimeUs() const { return lastConnectTimeUs; }
     void disconnectDevice();
 
     // Update characteristics
     void updateProximityStatus(bool isNearby);
     void updateCounterValue(int32_t value);
+    void updateBatteryLevel(uint8_t percent);
+
+    // Channels characteristic: notify changed channels (mask + values), and
+    // keep the values page that reads are answered from current
+    void updateChannels(const uint8_t* data, size_t length);
+    void updateChannelsValue(const uint8_t* data, size_t length);
+
+    // Registry admin characteristic: notify a response to the connected peer
+    void sendRegistryResponse(const uint8_t* data, size_t length);
+    size_t getMaxNotifyPayload();
+
+    // History characteristic: notify one chunk of a query's answer
+    void sendHistoryData(const uint8_t* data, size_t length);
+
+    // Event replay: stands in for the stack's connect/disconnect callbacks
+    void replayConnection(const uint8_t* macAddress);
+    void replayDisconnection();
 
     // Check if device is authorized (registered)
     bool isDeviceAuthorized(uint8_t* macAddress, const RegisteredDevice devices[], size_t count);
@@ -51,9 +94,6 @@ public:
     // Clear all BLE bonding information
     void clearAllBonds();
 
-    // Loop update (for pairing mode timeout)
-    void update();
-
 private:
     BLEManager();
     ~BLEManager();
@@ -68,28 +108,71 @@ private:
     BLECharacteristic* counterCharacteristic;
     BLECharacteristic* proximityCharacteristic;
     BLECharacteristic* deviceNameCharacteristic;
+    BLECharacteristic* registryCharacteristic;
+    BLECharacteristic* gateCharacteristic;
+    BLECharacteristic* diagnosticsCharacteristic;
+    BLECharacteristic* historyCharacteristic;
+    BLECharacteristic* channelsCharacteristic;
+    BLEService* batteryService;
+    BLECharacteristic* batteryLevelCharacteristic;
+#if CHANNEL_BENCH_ENABLED
+    BLEService* channelBenchService;
+#endif
 
     // State
     bool initialized;
     bool deviceConnected;
     bool pairingMode;
     char pairingPassword[7];  // 6 digits + null terminator
-    unsigned long pairingModeStartTime;
     uint8_t connectedDeviceMAC[6];
+    int64_t lastConnectTimeUs;
+    uint16_t connId;
+    esp_gatt_if_t gattsIf;   // learned on the first connect
+    uint32_t advertisingIntervalMs;
+
+    // Channels value: the selected page, and whether the value must be
+    // rebuilt before it is served. valueMutex keeps the app loop's in-place
+    // updates off a value the BLE task is resizing.
+    volatile uint8_t channelsPage;
+    volatile bool channelsStale;
+    SemaphoreHandle_t valueMutex;
+
+    // Admission control for the current connection (BLE task only)
+    GattRateLimiter rateLimiter;
+    bool abuseDisconnectPending;
+
+    // Timers (dispatched on the app loop)
+    TimerWheel::Timer pairingTimer;
+    TimerWheel::Timer advertisingRestartTimer;
 
     // Callbacks
     BLEManagerCallbacks* appCallbacks;
 
     // Logger
-    Logger* logger;
+    LogRing* logger;
 
     // Helper functions
     void generatePairingPassword();
-    void setupCharacteristics();
+    bool registerGattTable();
+
+    // Notifies the connected peer without touching the characteristic value
+    void notifyPeer(BLECharacteristic* characteristic, const uint8_t* data, size_t length);
+    static void onGattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf,
+                             esp_ble_gatts_cb_param_t* param);
+
+    // Charges one operation to the connected peer; false means drop it.
+    // Disconnects a peer that keeps flooding.
+    bool admit(GattRateLimiter::Op op);
 
     // Internal callback classes
     friend class ServerCallbacks;
     friend class CounterCharacteristicCallbacks;
+    friend class RegistryCharacteristicCallbacks;
+    friend class GateCharacteristicCallbacks;
+    friend class DiagnosticsCharacteristicCallbacks;
+    friend class HistoryCharacteristicCallbacks;
+    friend class ChannelsCharacteristicCallbacks;
+    friend class ChannelBenchCallbacks;
 };
 
 #endif // BLE_MANAGER_H
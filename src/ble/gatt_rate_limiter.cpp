@@ -0,0 +1,74 @@
+#include "gatt_rate_limiter.h"
+#include <string.h>
+
+// ============================================================================
+// TokenBucket
+// ============================================================================
+
+TokenBucket::TokenBucket()
+    : milliTokens(0)
+    , capacity(0)
+    , rate(0)
+    , maxElapsedMs(0)
+    , lastMs(0) {
+}
+
+void TokenBucket::configure(uint32_t ratePerSecond, uint32_t burst) {
+    rate = ratePerSecond;
+    capacity = burst * 1000;
+    maxElapsedMs = rate ? capacity / rate + 1 : 0;
+}
+
+void TokenBucket::reset(uint32_t nowMs) {
+    milliTokens = capacity;
+    lastMs = nowMs;
+}
+
+bool TokenBucket::take(uint32_t nowMs) {
+    // Clamped so the product cannot overflow; anything longer refills fully
+    uint32_t elapsed = nowMs - lastMs;
+    if (elapsed > maxElapsedMs) {
+        elapsed = maxElapsedMs;
+    }
+    lastMs = nowMs;
+
+    milliTokens += elapsed * rate;
+    if (milliTokens > capacity) {
+        milliTokens = capacity;
+    }
+
+    if (milliTokens < 1000) {
+        return false;
+    }
+    milliTokens -= 1000;
+    return true;
+}
+
+// ============================================================================
+// GattRateLimiter
+// ============================================================================
+
+GattRateLimiter::GattRateLimiter() {
+    buckets[(size_t)Op::READ].configure(RATE_LIMIT_READ_PER_S, RATE_LIMIT_READ_BURST);
+    buckets[(size_t)Op::WRITE].configure(RATE_LIMIT_WRITE_PER_S, RATE_LIMIT_WRITE_BURST);
+    buckets[(size_t)Op::ADMIN].configure(RATE_LIMIT_ADMIN_PER_S, RATE_LIMIT_ADMIN_BURST);
+    strikes.configure(RATE_LIMIT_STRIKES_FORGIVEN_PER_S, RATE_LIMIT_STRIKES);
+    memset(dropped, 0, sizeof(dropped));
+}
+
+void GattRateLimiter::reset(uint32_t nowMs) {
+    for (size_t i = 0; i < (size_t)Op::COUNT; i++) {
+        buckets[i].reset(nowMs);
+    }
+    strikes.reset(nowMs);
+    memset(dropped, 0, sizeof(dropped));
+}
+
+GattRateLimiter::Verdict GattRateLimiter::check(Op op, uint32_t nowMs) {
+    if (buckets[(size_t)op].take(nowMs)) {
+        return Verdict::ALLOW;
+    }
+
+    dropped[(size_t)op]++;
+    return strikes.take(nowMs) ? Verdict::DROP : Verdict::DISCONNECT;
+}
@@ -0,0 +1,74 @@
+#ifndef GATT_RATE_LIMITER_H
+#define GATT_RATE_LIMITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../config.h"
+
+/**
+ * Token bucket counted in thousandths of a token and refilled lazily from
+ * the time passed to take(), so a check is a few integer operations and
+ * needs no timer.
+ */
+class TokenBucket {
+public:
+    TokenBucket();
+
+    void configure(uint32_t ratePerSecond, uint32_t burst);
+
+    // Full bucket as of nowMs
+    void reset(uint32_t nowMs);
+
+    // Takes one token if available
+    bool take(uint32_t nowMs);
+
+private:
+    uint32_t milliTokens;
+    uint32_t capacity;      // burst * 1000
+    uint32_t rate;          // tokens/s == milli-tokens/ms
+    uint32_t maxElapsedMs;  // refill time from empty to full
+    uint32_t lastMs;
+};
+
+/**
+ * Per-connection GATT admission control.
+ *
+ * One bucket per operation class (RATE_LIMIT_* in config.h) bounds how
+ * often a peer can make the server do work; a further bucket absorbs
+ * violations, so occasional bursts over the limit are only dropped while
+ * a peer that keeps flooding is told to disconnect. reset() on every
+ * connect gives each peer a fresh allowance.
+ *
+ * Plain C++ with no platform calls, so it can be exercised off-target.
+ * Callers serialize access (the BLE task does).
+ */
+class GattRateLimiter {
+public:
+    enum class Op : uint8_t {
+        READ,    // counter reads
+        WRITE,   // counter and gate writes
+        ADMIN,   // registry commands, diagnostics
+        COUNT
+    };
+
+    enum class Verdict : uint8_t {
+        ALLOW,
+        DROP,
+        DISCONNECT
+    };
+
+    GattRateLimiter();
+
+    void reset(uint32_t nowMs);
+
+    Verdict check(Op op, uint32_t nowMs);
+
+    uint32_t getDropped(Op op) const { return dropped[(size_t)op]; }
+
+private:
+    TokenBucket buckets[(size_t)Op::COUNT];
+    TokenBucket strikes;
+    uint32_t dropped[(size_t)Op::COUNT];
+};
+
+#endif // GATT_RATE_LIMITER_H
@@ -0,0 +1,45 @@
+#include "gatt_schema.h"
+
+uint32_t GattSchema::handleCount(const Service& service) {
+    uint32_t handles = 1;
+    for (size_t i = 0; i < service.count; i++) {
+        handles += 2 + (service.characteristics[i].cccd ? 1 : 0);
+    }
+    return handles;
+}
+
+size_t GattSchema::registerServices(BLEServer* server, const Service* services, size_t count) {
+    size_t registered = 0;
+
+    for (size_t s = 0; s < count; s++) {
+        const Service& def = services[s];
+        BLEService* service = server->createService(toBLEUUID(def.uuid), handleCount(def));
+        if (!service) {
+            return 0;
+        }
+
+        for (size_t c = 0; c < def.count; c++) {
+            const Characteristic& charDef = def.characteristics[c];
+            BLECharacteristic* characteristic =
+                service->createCharacteristic(toBLEUUID(charDef.uuid), charDef.properties);
+
+            if (charDef.cccd) {
+                characteristic->addDescriptor(charDef.cccd);
+            }
+            if (charDef.callbacks) {
+                characteristic->setCallbacks(charDef.callbacks);
+            }
+            if (charDef.handle) {
+                *charDef.handle = characteristic;
+            }
+            registered++;
+        }
+
+        service->start();
+        if (def.handle) {
+            *def.handle = service;
+        }
+    }
+
+    return registered;
+}
@@ -0,0 +1,108 @@
+#ifndef GATT_SCHEMA_H
+#define GATT_SCHEMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+
+/**
+ * Declarative GATT table.
+ *
+ * UUID strings are parsed into binary at compile time: uuid128() used in
+ * a constexpr initializer turns a malformed UUID into a build error, and
+ * nothing is parsed at startup. Services list their characteristics
+ * (UUID, properties, callbacks, optional CCCD and where to store the
+ * created handle); registerServices() creates the whole table in one
+ * pass, sizing each service's attribute handles from its contents.
+ *
+ * Written for C++11 constexpr (single-expression functions), which is
+ * what the Arduino core builds with.
+ */
+class GattSchema {
+public:
+    struct Uuid {
+        uint8_t bytes[16];   // textual order, most significant byte first
+        uint16_t short16;    // non-zero for Bluetooth SIG 16-bit UUIDs
+    };
+
+    struct Characteristic {
+        Uuid uuid;
+        uint32_t properties;
+        BLECharacteristicCallbacks* callbacks;   // may be null
+        BLEDescriptor* cccd;                     // null unless it notifies/indicates
+        BLECharacteristic** handle;              // receives the created characteristic; may be null
+    };
+
+    struct Service {
+        Uuid uuid;
+        const Characteristic* characteristics;
+        size_t count;
+        BLEService** handle;
+    };
+
+    static constexpr Uuid uuid128(const char* s) {
+        return wellFormed(s, 0)
+            ? Uuid{{ byteAt(s, 0), byteAt(s, 1), byteAt(s, 2), byteAt(s, 3),
+                     byteAt(s, 4), byteAt(s, 5), byteAt(s, 6), byteAt(s, 7),
+                     byteAt(s, 8), byteAt(s, 9), byteAt(s, 10), byteAt(s, 11),
+                     byteAt(s, 12), byteAt(s, 13), byteAt(s, 14), byteAt(s, 15) }, 0 }
+            : malformedUuid();
+    }
+
+    // SIG UUID expanded onto the Bluetooth base UUID
+    static constexpr Uuid uuid16(uint16_t value) {
+        return Uuid{{ 0x00, 0x00, (uint8_t)(value >> 8), (uint8_t)value, 0x00, 0x00, 0x10, 0x00,
+                      0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB }, value };
+    }
+
+    static BLEUUID toBLEUUID(const Uuid& uuid) {
+        return uuid.short16 ? BLEUUID(uuid.short16)
+                            : BLEUUID(const_cast<uint8_t*>(uuid.bytes), sizeof(uuid.bytes), true);
+    }
+
+    // Service declaration, plus declaration and value per characteristic,
+    // plus its CCCD
+    static uint32_t handleCount(const Service& service);
+
+    // Creates and starts every service; returns the number of characteristics
+    // registered, or 0 if the stack refused a service
+    static size_t registerServices(BLEServer* server, const Service* services, size_t count);
+
+private:
+    // Deliberately not constexpr: reaching this while evaluating a
+    // constexpr UUID stops the build
+    static Uuid malformedUuid() {
+        return Uuid();
+    }
+
+    static constexpr int hexDigit(char c) {
+        return (c >= '0' && c <= '9') ? c - '0'
+             : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+             : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+             : -1;
+    }
+
+    static constexpr bool isDashPosition(size_t pos) {
+        return pos == 8 || pos == 13 || pos == 18 || pos == 23;
+    }
+
+    // 8-4-4-4-12 hex digits, exactly 36 characters
+    static constexpr bool wellFormed(const char* s, size_t pos) {
+        return pos == 36 ? s[36] == '\0'
+             : s[pos] != '\0' &&
+               (isDashPosition(pos) ? s[pos] == '-' : hexDigit(s[pos]) >= 0) &&
+               wellFormed(s, pos + 1);
+    }
+
+    // Character offset of byte i, skipping the dashes before it
+    static constexpr size_t charOffset(size_t i) {
+        return 2 * i + (i >= 4) + (i >= 6) + (i >= 8) + (i >= 10);
+    }
+
+    static constexpr uint8_t byteAt(const char* s, size_t i) {
+        return (uint8_t)((hexDigit(s[charOffset(i)]) << 4) | hexDigit(s[charOffset(i) + 1]));
+    }
+};
+
+#endif // GATT_SCHEMA_H
@@ -4,6 +4,17 @@
 #include <Arduino.h>
 #include "boards/BoardProfiles.h"
 
+// ============================================================================
+// BUILD PROFILE
+// ============================================================================
+
+// Set per environment in platformio.ini alongside the feature switches
+// below (HAS_DISPLAY, HAS_BUTTONS, SENSORS_ENABLED, TELEMETRY_ENABLED);
+// shown in the boot timeline so boot logs from different images compare
+#ifndef BUILD_PROFILE
+#define BUILD_PROFILE           "full"
+#endif
+
 // ============================================================================
 // BUTTON CONFIGURATION
 // ============================================================================
@@ -11,6 +22,22 @@
 #define BUTTON_DEBOUNCE_MS      50
 #define LONG_PRESS_DURATION_MS  3000  // 3 seconds for pairing mode / clear
 
+// Fast input path: GPIO interrupts and a small input task act on the
+// release edge, with no multi-click wait; 0 uses the framework's
+// ButtonHandler instead
+#ifndef FAST_INPUT_ENABLED
+#define FAST_INPUT_ENABLED      1
+#endif
+#define INPUT_EVENT_RING_LEN    8
+#define INPUT_TASK_STACK        2048
+
+// Input latency trace: the last INPUT_TRACE_LEN presses are kept for the
+// percentile report; a press still waiting on a stage after
+// INPUT_TRACE_TIMEOUT_MS is dropped from it
+#define INPUT_TRACE_LEN         64
+#define INPUT_TRACE_OPEN_MAX    8
+#define INPUT_TRACE_TIMEOUT_MS  1000
+
 // ============================================================================
 // BLE CONFIGURATION
 // ============================================================================
@@ -25,6 +52,15 @@
 #define COUNTER_CHAR_UUID       "beb5483e-36e1-4688-b7f5-ea07361b26a8"
 #define PROXIMITY_CHAR_UUID     "cba1d466-344c-4be3-ab3f-189f80dd7518"
 #define DEVICE_NAME_CHAR_UUID   "d8de624e-140f-4a22-8594-e2216b84a5f2"
+#define REGISTRY_CHAR_UUID      "7d3c9a52-6b1e-4f0d-9e2a-5c8b41f7a3d6"
+#define GATE_CHAR_UUID          "e2c56db5-dffb-48d2-b060-d0f5a71096e0"
+#define DIAG_CHAR_UUID          "3b8e6f21-90c4-4d7a-a5e1-2f6c0d9b8e47"
+#define HISTORY_CHAR_UUID       "a9f3c1e8-5d27-4b6a-8c0e-71d4b2f96a35"
+#define CHANNELS_CHAR_UUID      "5c0d7e93-2a4f-4b81-9e6d-c3f8a1b20457"
+
+// Standard Battery Service and Battery Level (16-bit SIG UUIDs)
+#define BATTERY_SERVICE_UUID    0x180F
+#define BATTERY_LEVEL_CHAR_UUID 0x2A19
 
 // BLE advertising interval (milliseconds)
 #define BLE_ADV_INTERVAL_MS     100
@@ -32,8 +68,185 @@
 // Pairing mode timeout (milliseconds)
 #define PAIRING_MODE_TIMEOUT_MS 60000  // 1 minute
 
-// Maximum registered devices
-#define MAX_REGISTERED_DEVICES  10
+// Delay before advertising restarts after a disconnect (milliseconds)
+#define ADVERTISING_RESTART_DELAY_MS    500
+
+// Maximum registered devices. Bulk import, export, presence, schedules,
+// the RTC snapshot and config transactions are all sized from this.
+#define MAX_REGISTERED_DEVICES  200
+
+// Size of the static bond list used when clearing bonds (CONFIG_BT_SMP_MAX_BONDS)
+#define BLE_MAX_BONDS           15
+
+// ============================================================================
+// GATT RATE LIMITING
+// ============================================================================
+
+// Per connection and operation class: sustained operations per second and
+// burst size. Over-limit operations are dropped: reads return the last
+// value without doing any work, and writes are ignored.
+#define RATE_LIMIT_ENABLED          1
+#define RATE_LIMIT_READ_PER_S       20
+#define RATE_LIMIT_READ_BURST       10
+#define RATE_LIMIT_WRITE_PER_S      10
+#define RATE_LIMIT_WRITE_BURST      5
+#define RATE_LIMIT_ADMIN_PER_S      10
+#define RATE_LIMIT_ADMIN_BURST      16
+
+// A peer is disconnected once it has been dropped more than this many times
+// faster than they are forgiven
+#define RATE_LIMIT_STRIKES                  20
+#define RATE_LIMIT_STRIKES_FORGIVEN_PER_S   2
+
+// ============================================================================
+// REGISTRY SYNC CONFIGURATION (admin characteristic)
+// ============================================================================
+
+// Shared admin key length (bytes). The key is stored hex-encoded in config;
+// an empty key disables the admin characteristic entirely.
+#define REGISTRY_ADMIN_KEY_LEN      16
+
+// Challenge nonce and HMAC-SHA256 response lengths (bytes)
+#define REGISTRY_NONCE_LEN          16
+#define REGISTRY_AUTH_MAC_LEN       16
+
+// Maximum add + remove entries staged in a single import transaction
+#define REGISTRY_TXN_MAX_OPS        (MAX_REGISTERED_DEVICES * 2)
+
+// EXPORT and PRESENCE answers are sent one chunk per this interval (ms)
+#ifndef REGISTRY_CHUNK_INTERVAL_MS
+#define REGISTRY_CHUNK_INTERVAL_MS  30
+#endif
+
+// ============================================================================
+// ACCESS SCHEDULE CONFIGURATION
+// ============================================================================
+
+// Weekly windows per device, compiled to one bit per slot per day; the
+// day is split into 24 * 60 / SCHEDULE_SLOT_MINUTES slots
+#define SCHEDULE_MAX                8
+#define SCHEDULE_SLOT_MINUTES       15
+#define SCHEDULE_MAX_MEMBERS        MAX_REGISTERED_DEVICES
+#define SCHEDULE_MAX_HOLIDAYS       32
+
+// How often the current day and slot are re-read from the system clock
+#define SCHEDULE_CLOCK_MS           10000
+
+// Scheduled devices while the clock has not been set (no time sync yet):
+// 0 refuses them, 1 lets them in as if they had no schedule
+#ifndef SCHEDULE_ALLOW_WITHOUT_TIME
+#define SCHEDULE_ALLOW_WITHOUT_TIME 0
+#endif
+
+// Anything before this is an unsynced clock
+#define TIME_MIN_VALID_EPOCH        1600000000
+
+// ============================================================================
+// COUNTER HISTORY CONFIGURATION
+// ============================================================================
+
+// Rings of recent changes and of per-minute and per-hour rollups. Only
+// intervals with a change take a slot, so a quiet day costs little.
+#define HISTORY_RAW_LEN             128
+#define HISTORY_MINUTE_LEN          360
+#define HISTORY_HOUR_LEN            168
+
+// Flash copy, rewritten where it changed at most this often
+#define HISTORY_PATH                "/history.bin"
+#define HISTORY_FLUSH_MS            300000
+
+// A query is streamed from the app loop this many notifications at a time
+#define HISTORY_CHUNKS_PER_TICK     4
+
+// ============================================================================
+// COUNTER CHANNELS CONFIGURATION
+// ============================================================================
+
+// Fixed table of named counters. Channel 0 is the main counter (counter
+// characteristic, display, history, replication); at most 64 channels.
+#ifndef COUNTER_CHANNELS
+#define COUNTER_CHANNELS            8
+#endif
+#define COUNTER_CHANNEL_NAME_LEN    16
+#define COUNTER_CHANNEL_MAIN        0
+
+// Channel bumped on every refused connect, read, write or gate command
+#define COUNTER_CHANNEL_DENIED      1
+
+// Channels characteristic: a one-byte write selects what reads return
+#define CHANNELS_PAGE_VALUES        0x00
+#define CHANNELS_PAGE_NAMES         0x01
+
+// Per-channel operations written to it: op u8, channel u8, operand i32
+#define CHANNEL_OP_ADD              0x01
+#define CHANNEL_OP_SET              0x02
+#define CHANNEL_OP_LEN              6
+
+// Bench build: also expose every channel as its own read-only
+// characteristic in a second service, to time against the bulk read
+#ifndef CHANNEL_BENCH_ENABLED
+#define CHANNEL_BENCH_ENABLED       0
+#endif
+#define CHANNEL_BENCH_SERVICE_UUID  "5c0d7e93-2a4f-4b81-9e6d-c3f8a1b20400"
+
+// ============================================================================
+// PRESENCE ANALYTICS CONFIGURATION
+// ============================================================================
+
+// Per-device last-seen, visit count and dwell time. When the table is full,
+// the device seen least recently gives up its slot.
+#define PRESENCE_MAX_DEVICES        MAX_REGISTERED_DEVICES
+
+// A device that comes back within this long of leaving is still on the
+// same visit (reconnects, brief dropouts)
+#define PRESENCE_REVISIT_MS         60000
+
+// Changed entries are written to flash together at most this often
+#define PRESENCE_PATH               "/presence.bin"
+#define PRESENCE_FLUSH_MS           600000
+
+// ============================================================================
+// USB CONTROL CONFIGURATION
+// ============================================================================
+
+// Binary request/response protocol on the native USB CDC port, alongside
+// the text log. USB_CONTROL_READ_ONLY refuses registry and counter
+// changes, for images whose USB port is reachable by the public.
+#ifndef USB_CONTROL_ENABLED
+#define USB_CONTROL_ENABLED         1
+#endif
+#ifndef USB_CONTROL_READ_ONLY
+#define USB_CONTROL_READ_ONLY       0
+#endif
+
+// Largest request or response payload (bytes, before framing); a whole
+// registry replace or dump fits in one
+#define CONTROL_MAX_PAYLOAD         (16 + REGISTRY_TXN_MAX_OPS * 6)
+
+// The port is polled every ACTIVE ms while requests are coming in, and
+// every IDLE ms once it has been quiet for IDLE_AFTER ms
+#define USB_CONTROL_ACTIVE_POLL_MS  1
+#define USB_CONTROL_IDLE_POLL_MS    50
+#define USB_CONTROL_IDLE_AFTER_MS   1000
+#define USB_CONTROL_TASK_STACK      6144
+
+// Log text per LOG_EXPORT response
+#define USB_LOG_CHUNK_BYTES         512
+
+// ============================================================================
+// GATE RELAY CONFIGURATION
+// ============================================================================
+
+#define RELAY_ENABLED           1
+#define PIN_RELAY               13
+#define RELAY_ACTIVE_HIGH       true
+
+// Pulse length and minimum time between pulse starts (milliseconds)
+#define RELAY_PULSE_MS          500
+#define RELAY_LOCKOUT_MS        2000
+
+// Gate characteristic commands
+#define GATE_COMMAND_OPEN       0x01
 
 // ============================================================================
 // STORAGE CONFIGURATION (using framework's LittleFSConfig)
@@ -41,19 +254,323 @@
 
 // Config keys for storage
 #define CONFIG_COUNTER_VALUE    "counter.value"
+#define CONFIG_CHANNELS_PREFIX  "channels"
 #define CONFIG_DEVICES_PREFIX   "devices"
+#define CONFIG_REGISTRY_VERSION "devices.version"
+#define CONFIG_REGISTRY_ADMIN_KEY "registry.adminKey"
+#define CONFIG_SCHEDULES_PREFIX "schedules"
+#define CONFIG_SCHEDULE_HOLIDAYS "schedules.holidays"
+#define CONFIG_MQTT_HOST        "mqtt.host"
+#define CONFIG_MQTT_PORT        "mqtt.port"
+#define CONFIG_MQTT_USER        "mqtt.user"
+#define CONFIG_MQTT_PASSWORD    "mqtt.password"
+#define CONFIG_MQTT_PREFIX      "mqtt.prefix"
+#define CONFIG_REPLICATION_GROUP  "replication.group"
+#define CONFIG_REPLICATION_P      "replication.p"
+#define CONFIG_REPLICATION_N      "replication.n"
+#define CONFIG_REPLICATION_SEEDED "replication.seeded"
+
+// Config file written by the framework's LittleFSConfig
+#define CONFIG_FILE_PATH        "/config.json"
+
+// Transaction staging limits (ConfigStore), sized from the transactions the
+// app actually writes. The registry save is the largest: mac, timestamp and
+// valid per device, plus the version. The longest key is
+// "devices.<n>.timestamp" and the only staged string is a MAC address.
+#define CONFIG_TXN_MAX_ENTRIES  (3 * MAX_REGISTERED_DEVICES + 1)
+#define CONFIG_TXN_KEY_LEN      24
+#define CONFIG_TXN_STRING_LEN   18
+
+// Counter is persisted once it has been stable this long (coalesces bursts
+// of presses or writes into one flash write)
+#define COUNTER_PERSIST_DELAY_MS    2000
+
+// Background flush task
+#define CONFIG_FLUSH_DEBOUNCE_MS    50
+#define CONFIG_FLUSH_TASK_STACK     6144
+#define CONFIG_FLUSH_TASK_PRIORITY  TASK_PRIORITY_PERSIST
+#define CONFIG_FLUSH_TASK_CORE      CORE_PERSIST
 
 // ============================================================================
 // DISPLAY CONFIGURATION
 // ============================================================================
 
-// Display update interval (milliseconds)
+// Module task tick (milliseconds); the counter screen itself redraws on
+// state changes rather than on this interval
 #define DISPLAY_UPDATE_INTERVAL_MS  500
 
+// CounterModule: the framework module task only runs setup() and then
+// parks; drawing happens on a render task pinned to CORE_RENDER
+#define COUNTER_MODULE_TASK_STACK   2048
+#define RENDER_TASK_STACK           4096
+
+// ============================================================================
+// DIAGNOSTICS CONFIGURATION
+// ============================================================================
+
+// Maximum named phases recorded in the boot timeline
+#define BOOT_TRACE_MAX_MARKS    16
+
+// Recent log lines kept in RAM for export; longer lines are cut
+#define LOG_RING_BYTES          8192
+#define LOG_LINE_MAX            160
+
+// Periodic metrics dump to serial (0 disables)
+#define METRICS_DUMP_INTERVAL_MS    60000
+
+// Diagnostics characteristic snapshot buffer (ATT values top out at 512)
+#define DIAG_SNAPSHOT_MAX_LEN   512
+
+// Diagnostics page selector (one-byte write before a read)
+#define DIAG_PAGE_METRICS       0x00
+#define DIAG_PAGE_TASKS         0x01
+
+// Heap guard: OFF, COUNT (report steady-state allocations) or STRICT
+// (abort on any allocation after boot on the app loop or in a BLE
+// callback, outside a HeapGuard::Allow)
+#define HEAP_GUARD_MODE_OFF     0
+#define HEAP_GUARD_MODE_COUNT   1
+#define HEAP_GUARD_MODE_STRICT  2
+#ifndef HEAP_GUARD_MODE
+#define HEAP_GUARD_MODE         HEAP_GUARD_MODE_COUNT
+#endif
+#define HEAP_GUARD_MAX_SCOPES   8
+
+// Task profiler: sampling period, stall threshold and table sizes
+#define PROFILER_SAMPLE_INTERVAL_MS     1000
+#define PROFILER_STALL_THRESHOLD_MS     100
+#define PROFILER_MAX_TASKS              24
+#define PROFILER_TASK_NAME_LEN          12
+#define PROFILER_MAX_PENDING_STALLS     8
+#define PROFILER_TASK_STACK             3072
+#define PROFILER_TASK_PRIORITY          3
+
+// Jitter benchmark: alternates display-idle and full-rate redraw phases and
+// logs GATT read service time for each (build the jitter-bench env)
+#ifndef JITTER_BENCH_ENABLED
+#define JITTER_BENCH_ENABLED        0
+#endif
+#define JITTER_BENCH_PHASE_MS       30000
+
+// Input capture for reproducing field problems (build the trace-record and
+// trace-replay envs): 0 off, 1 records inputs to EVENT_TRACE_PATH, 2 replays
+// that trace against the app at boot
+#ifndef EVENT_TRACE_MODE
+#define EVENT_TRACE_MODE            0
+#endif
+#define EVENT_TRACE_PATH            "/trace.bin"
+#define EVENT_TRACE_MAX_BYTES       65536
+#define EVENT_TRACE_RING_LEN        16
+// A whole ATT value, so registry and channel writes replay intact; the ring
+// is allocated only in trace builds
+#define EVENT_TRACE_MAX_PAYLOAD     512
+#define EVENT_TRACE_FLUSH_MS        1000
+
+// Replay pace as a multiple of the recorded pace; 0 replays back to back,
+// EVENT_TRACE_REPLAY_BATCH events per loop iteration
+#ifndef EVENT_TRACE_REPLAY_SPEED
+#define EVENT_TRACE_REPLAY_SPEED    1
+#endif
+#define EVENT_TRACE_REPLAY_BATCH    16
+
+// ============================================================================
+// POWER MANAGEMENT CONFIGURATION
+// ============================================================================
+
+#define POWER_MANAGEMENT_ENABLED    1
+
+// Inactivity before the backlight dims, and before the panel blanks and
+// the CPU drops into its idle policy (milliseconds)
+#define POWER_DIM_TIMEOUT_MS        30000
+#define POWER_IDLE_TIMEOUT_MS       120000
+
+// Backlight duty (0-255) on the panel's PWM channel
+#define BACKLIGHT_FULL              255
+#define BACKLIGHT_DIM               40
+
+// CPU frequency bounds (MHz); idle also enables automatic light sleep when
+// the core is built with tickless idle. BLE needs at least 80 MHz when
+// frequency scaling is unavailable.
+#define POWER_ACTIVE_MAX_MHZ        240
+#define POWER_ACTIVE_MIN_MHZ        80
+#define POWER_IDLE_MAX_MHZ          80
+#define POWER_IDLE_MIN_MHZ          40
+
+// Idle advertising interval and app loop wake-up cap (milliseconds)
+#define POWER_IDLE_ADV_INTERVAL_MS      1000
+#define POWER_IDLE_LOOP_MAX_SLEEP_MS    1000
+
+// Rough supply current per state for the energy estimate (mA); measure
+// the actual board and adjust
+#define POWER_EST_ACTIVE_MA         90
+#define POWER_EST_DIMMED_MA         60
+#define POWER_EST_IDLE_MA           15
+
+// ============================================================================
+// SENSOR CONFIGURATION
+// ============================================================================
+
+// Battery voltage (PIN_BAT_VOLT) and ambient light (PIN_LDR) are sampled
+// by the ADC's DMA controller; the sensor task only wakes per DMA frame
+#ifndef SENSORS_ENABLED
+#define SENSORS_ENABLED             1
+#endif
+
+// Conversions per second across both channels (the S3 minimum is ~611),
+// conversions per DMA frame, and the driver's ring buffer in frames
+#define SENSOR_SAMPLE_RATE_HZ       1000
+#define SENSOR_FRAME_SAMPLES        100
+#define SENSOR_BUFFER_FRAMES        4
+
+// Frame means go through a first-order IIR filter with this shift
+// (time constant of 2^shift frames); readings are reported at this interval
+#define SENSOR_FILTER_SHIFT         4
+#define SENSOR_REPORT_INTERVAL_MS   1000
+
+// While the power manager is idle the ADC is stopped, since a running DMA
+// conversion holds the APB clock and keeps the chip out of light sleep;
+// it is restarted for one frame at this interval to keep the battery level
+// current
+#define SENSOR_IDLE_BURST_INTERVAL_MS  60000
+
+#define SENSOR_TASK_STACK           3072
+
+// The board's battery divider halves the cell voltage
+#define BATTERY_DIVIDER_RATIO       2
+
+// Ambient light: divider voltage at darkness and full brightness (mV), and
+// the lowest automatic backlight duty
+#define AMBIENT_DARK_MV             100
+#define AMBIENT_BRIGHT_MV           2500
+#define BACKLIGHT_AUTO_MIN          60
+
+// ============================================================================
+// TELEMETRY CONFIGURATION
+// ============================================================================
+
+// 0 compiles the MQTT bridge (and its PubSubClient dependency) out
+#ifndef TELEMETRY_ENABLED
+#define TELEMETRY_ENABLED           1
+#endif
+
+// MQTT bridge defaults (broker host comes from mqtt.host in config.json)
+#define MQTT_DEFAULT_PORT           1883
+#define MQTT_DEFAULT_PREFIX         "ble-access"
+#define MQTT_TOPIC_LEN              80
+#define MQTT_KEEPALIVE_S            30
+#define MQTT_SOCKET_TIMEOUT_S       5
+
+// Events waiting for the bridge task; a batch closes at this many events,
+// when it would exceed a spool slot, or this long after its first event
+#define MQTT_EVENT_RING_LEN         32
+#define MQTT_BATCH_MAX_EVENTS       16
+#define MQTT_BATCH_WINDOW_MS        5000
+
+// Offline spool: fixed ring of batches in flash (8 KB)
+#define MQTT_SPOOL_PATH             "/mqtt_spool.bin"
+#define MQTT_SPOOL_SLOTS            32
+#define MQTT_SPOOL_SLOT_BYTES       256
+
+// After reconnecting, spooled batches go out one per interval
+#define MQTT_DRAIN_INTERVAL_MS      250
+
+// Reconnect backoff doubles from min to max
+#define MQTT_RECONNECT_MIN_MS       2000
+#define MQTT_RECONNECT_MAX_MS       60000
+
+#define MQTT_TASK_POLL_MS           100
+#define MQTT_TASK_STACK             6144
+
+// ============================================================================
+// REPLICATION CONFIGURATION
+// ============================================================================
+
+// Share one counter across gates (PN-counter gossiped over ESP-NOW). Gates
+// only merge frames from the same replication.group in config.json.
+#ifndef REPLICATION_ENABLED
+#define REPLICATION_ENABLED         0
+#endif
+#define REPLICATION_DEFAULT_GROUP   1
+#define REPLICATION_MAX_NODES       32
+
+// Frame budget: a frame carries at most this many node entries, so its
+// size is bounded no matter how many gates there are (ESP-NOW max is 250)
+#define REPLICATION_MAX_FRAME           250
+#define REPLICATION_ENTRIES_PER_FRAME   12
+
+// Local changes go out after this delay; a full anti-entropy round runs at
+// the gossip interval; answers to a booting peer are spread over the jitter
+#define REPLICATION_PUSH_DELAY_MS       100
+#define REPLICATION_GOSSIP_MS           2000
+#define REPLICATION_SYNC_JITTER_MS      300
+
+#define REPLICATION_RX_QUEUE_LEN        8
+
+// ============================================================================
+// TIMER CONFIGURATION
+// ============================================================================
+
+// Timer wheel resolution and geometry: 3 levels of 64 slots at 10 ms cover
+// about 43 minutes before long timers are re-parked
+#define TIMER_WHEEL_TICK_MS         10
+#define TIMER_WHEEL_SLOT_BITS       6
+#define TIMER_WHEEL_LEVELS          3
+
+// Longest the app loop sleeps between iterations when no timer is due, so
+// the framework's own loop work still runs regularly
+#define LOOP_MAX_SLEEP_MS           50
+
+// ============================================================================
+// TASK PLACEMENT
+// ============================================================================
+
+// Core 0 carries the BLE host (Bluedroid is pinned there by the core's
+// sdkconfig) and the esp_timer task that ends relay pulses, so GATT
+// callbacks and gate actuation never wait behind app work. Core 1 runs
+// the Arduino loop task, display rendering, flash persistence, sensor
+// sampling, button input, the MQTT bridge and the USB control channel.
+#define CORE_BLE                    0
+#define CORE_APP                    1   // CONFIG_ARDUINO_RUNNING_CORE
+#define CORE_RENDER                 1
+#define CORE_PERSIST                1
+#define CORE_SENSOR                 1
+#define CORE_TELEMETRY              1
+#define CORE_INPUT                  1
+#define CORE_CONTROL                1
+
+// Bluedroid tasks run at 19+ and esp_timer at 22. On core 1, rendering
+// and persistence share the loop task's priority so a long frame or a
+// flash write time-slices with the loop instead of starving it.
+#define TASK_PRIORITY_RENDER        1
+#define TASK_PRIORITY_PERSIST       1
+#define TASK_PRIORITY_SENSOR        1
+#define TASK_PRIORITY_TELEMETRY     1
+#define TASK_PRIORITY_CONTROL       1
+
+// The input task only debounces and queues, so it may preempt the loop
+// and a frame in progress
+#define TASK_PRIORITY_INPUT         2
+
+// ============================================================================
+// BOOT CONFIGURATION
+// ============================================================================
+
+// Bring up the BLE stack on its own core while config and display load
+#define BOOT_PARALLEL_ENABLED       1
+#define BOOT_BLE_CORE               CORE_BLE
+
+#define BOOT_MAX_STAGES             8
+#define BOOT_STAGE_TASK_STACK       8192
+#define BOOT_STAGE_TASK_PRIORITY    5
+#define BOOT_STAGE_TIMEOUT_MS       10000
+
 // ============================================================================
 // SYSTEM STATE CONFIGURATION
 // ============================================================================
 
+// State change subscribers (display, GATT, storage, telemetry)
+#define STATE_MAX_OBSERVERS     6
+
 enum class SystemState {
     INITIALIZING,
     NORMAL,
@@ -69,8 +586,9 @@ struct RegisteredDevice {
     uint8_t macAddress[6];
     uint32_t registeredTimestamp;
     bool isValid;
+    uint8_t schedule;   // AccessSchedule index, 0 = no schedule
 
-    RegisteredDevice() : registeredTimestamp(0), isValid(false) {
+    RegisteredDevice() : registeredTimestamp(0), isValid(false), schedule(0) {
         memset(macAddress, 0, 6);
     }
 };
@@ -0,0 +1,192 @@
+#include "control_protocol.h"
+#include <string.h>
+
+// CRC-32 a nibble at a time: 64 bytes of table instead of 1 KB
+static const uint32_t CRC_NIBBLES[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+ControlProtocol::ControlProtocol()
+    : transport(nullptr)
+    , handler(nullptr)
+    , handlerArg(nullptr)
+    , rxLength(0)
+    , rxOverrun(false)
+    , framesIn(0)
+    , framesOut(0)
+    , badFrames(0) {
+    memset(rxFrame, 0, sizeof(rxFrame));
+    memset(decoded, 0, sizeof(decoded));
+    memset(txPayload, 0, sizeof(txPayload));
+    memset(txFrame, 0, sizeof(txFrame));
+}
+
+void ControlProtocol::begin(ControlTransport* t, Handler h, void* arg) {
+    transport = t;
+    handler = h;
+    handlerArg = arg;
+    rxLength = 0;
+    rxOverrun = false;
+}
+
+bool ControlProtocol::poll() {
+    if (!transport) {
+        return false;
+    }
+
+    bool received = false;
+    uint8_t chunk[64];
+    size_t n;
+    while ((n = transport->read(chunk, sizeof(chunk))) > 0) {
+        received = true;
+        for (size_t i = 0; i < n; i++) {
+            uint8_t byte = chunk[i];
+            if (byte != 0) {
+                if (rxLength < sizeof(rxFrame)) {
+                    rxFrame[rxLength++] = byte;
+                } else {
+                    rxOverrun = true;
+                }
+                continue;
+            }
+
+            // Delimiter: back-to-back ones are just idle
+            if (rxOverrun) {
+                badFrames++;
+            } else if (rxLength) {
+                handleFrame();
+            }
+            rxLength = 0;
+            rxOverrun = false;
+        }
+    }
+    return received;
+}
+
+void ControlProtocol::handleFrame() {
+    size_t length = cobsDecode(rxFrame, rxLength, decoded, sizeof(decoded));
+    if (length < REQUEST_HEADER_LEN + CRC_LEN) {
+        badFrames++;
+        return;
+    }
+
+    length -= CRC_LEN;
+    const uint8_t* crc = decoded + length;
+    uint32_t expected = (uint32_t)crc[0] | ((uint32_t)crc[1] << 8) |
+                        ((uint32_t)crc[2] << 16) | ((uint32_t)crc[3] << 24);
+    if (crc32(decoded, length) != expected) {
+        badFrames++;
+        return;
+    }
+
+    // Our own responses looped back are not requests
+    if (decoded[1] & RESPONSE_FLAG) {
+        return;
+    }
+
+    framesIn++;
+    if (handler) {
+        Request request;
+        request.seq = decoded[0];
+        request.opcode = decoded[1];
+        request.body = decoded + REQUEST_HEADER_LEN;
+        request.length = length - REQUEST_HEADER_LEN;
+        handler(handlerArg, *this, request);
+    }
+}
+
+bool ControlProtocol::respond(const Request& request, uint8_t status, const uint8_t* body, size_t length) {
+    if (!transport || length > MAX_BODY) {
+        return false;
+    }
+
+    txPayload[0] = request.seq;
+    txPayload[1] = request.opcode | RESPONSE_FLAG;
+    txPayload[2] = status;
+    if (length) {
+        memcpy(txPayload + RESPONSE_HEADER_LEN, body, length);
+    }
+
+    size_t payloadLength = RESPONSE_HEADER_LEN + length;
+    uint32_t crc = crc32(txPayload, payloadLength);
+    txPayload[payloadLength++] = crc & 0xFF;
+    txPayload[payloadLength++] = (crc >> 8) & 0xFF;
+    txPayload[payloadLength++] = (crc >> 16) & 0xFF;
+    txPayload[payloadLength++] = (crc >> 24) & 0xFF;
+
+    txFrame[0] = 0;
+    size_t frameLength = 1 + cobsEncode(txPayload, payloadLength, txFrame + 1);
+    txFrame[frameLength++] = 0;
+
+    framesOut++;
+    return transport->write(txFrame, frameLength) == frameLength;
+}
+
+// ============================================================================
+// Encoding
+// ============================================================================
+
+size_t ControlProtocol::cobsEncode(const uint8_t* data, size_t length, uint8_t* out) {
+    size_t codeIndex = 0;
+    size_t outLength = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == 0) {
+            out[codeIndex] = code;
+            code = 1;
+            codeIndex = outLength++;
+            continue;
+        }
+
+        out[outLength++] = data[i];
+        if (++code == 0xFF) {
+            out[codeIndex] = code;
+            code = 1;
+            codeIndex = outLength++;
+        }
+    }
+
+    out[codeIndex] = code;
+    return outLength;
+}
+
+size_t ControlProtocol::cobsDecode(const uint8_t* data, size_t length, uint8_t* out, size_t capacity) {
+    size_t in = 0;
+    size_t outLength = 0;
+
+    while (in < length) {
+        uint8_t code = data[in++];
+        if (code == 0) {
+            return 0;
+        }
+
+        for (uint8_t i = 1; i < code; i++) {
+            if (in >= length || data[in] == 0 || outLength >= capacity) {
+                return 0;
+            }
+            out[outLength++] = data[in++];
+        }
+
+        // Every block but a full one ends in a zero, except the last
+        if (code != 0xFF && in < length) {
+            if (outLength >= capacity) {
+                return 0;
+            }
+            out[outLength++] = 0;
+        }
+    }
+
+    return outLength;
+}
+
+uint32_t ControlProtocol::crc32(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ CRC_NIBBLES[crc & 0x0F];
+        crc = (crc >> 4) ^ CRC_NIBBLES[crc & 0x0F];
+    }
+    return ~crc;
+}
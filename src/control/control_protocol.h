@@ -0,0 +1,122 @@
+#ifndef CONTROL_PROTOCOL_H
+#define CONTROL_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../config.h"
+
+/**
+ * Byte stream the control protocol runs over.
+ */
+class ControlTransport {
+public:
+    virtual ~ControlTransport() {}
+
+    // Never blocks; returns 0 when nothing is waiting
+    virtual size_t read(uint8_t* buffer, size_t capacity) = 0;
+
+    // Writes the whole buffer in one call, so another writer on the same
+    // port (the text log) can't split a frame
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+};
+
+/**
+ * Framed binary request/response protocol.
+ *
+ * A frame is 0x00, COBS(payload, CRC-32 of payload, little-endian), 0x00.
+ * COBS leaves no zero bytes inside a frame, so frames can share a port
+ * with text: the reader splits on 0x00 and treats anything that doesn't
+ * decode with a good CRC as text. The leading 0x00 ends any text line in
+ * progress, so a frame never starts with text stuck to its front.
+ *
+ *   request:  seq u8, opcode u8, body
+ *   response: seq u8, opcode | 0x80, status u8, body
+ *
+ * A response echoes the request's seq. A long answer comes as several
+ * responses, all but the last with STATUS_MORE. Multi-byte integers are
+ * little-endian. The opcodes themselves belong to the handler.
+ *
+ * Plain C++ with no platform calls, so it can be run off-target against
+ * a fake transport (e.g. one end of a pty).
+ */
+class ControlProtocol {
+public:
+    enum Status : uint8_t {
+        STATUS_OK               = 0x00,
+        STATUS_MORE             = 0x01,
+        STATUS_BAD_REQUEST      = 0x10,
+        STATUS_UNKNOWN_OPCODE   = 0x11,
+        STATUS_VERSION_CONFLICT = 0x12,
+        STATUS_CAPACITY         = 0x13,
+        STATUS_READ_ONLY        = 0x14
+    };
+
+    static const uint8_t RESPONSE_FLAG = 0x80;
+    static const size_t REQUEST_HEADER_LEN = 2;
+    static const size_t RESPONSE_HEADER_LEN = 3;
+    static const size_t CRC_LEN = 4;
+
+    // Most a response body can carry
+    static const size_t MAX_BODY = CONTROL_MAX_PAYLOAD - RESPONSE_HEADER_LEN;
+
+    struct Request {
+        uint8_t seq;
+        uint8_t opcode;
+        const uint8_t* body;
+        size_t length;
+    };
+
+    using Handler = void (*)(void* arg, ControlProtocol& protocol, const Request& request);
+
+    ControlProtocol();
+
+    void begin(ControlTransport* transport, Handler handler, void* arg);
+
+    // Reads what is waiting and handles every complete frame in it.
+    // Returns true if any byte arrived.
+    bool poll();
+
+    // One response frame for request; false if the transport took less
+    bool respond(const Request& request, uint8_t status, const uint8_t* body, size_t length);
+
+    uint32_t getFramesIn() const { return framesIn; }
+    uint32_t getFramesOut() const { return framesOut; }
+    uint32_t getBadFrames() const { return badFrames; }
+
+    // COBS over length bytes; out needs length + length / 254 + 1 bytes.
+    // Returns the encoded length.
+    static size_t cobsEncode(const uint8_t* data, size_t length, uint8_t* out);
+
+    // Returns the decoded length, or 0 if the input is not valid COBS or
+    // won't fit capacity
+    static size_t cobsDecode(const uint8_t* data, size_t length, uint8_t* out, size_t capacity);
+
+    // CRC-32 (IEEE 802.3), as in zlib
+    static uint32_t crc32(const uint8_t* data, size_t length);
+
+private:
+    // Framed size of the largest payload: delimiters, COBS overhead, CRC
+    static const size_t MAX_FRAME =
+        2 + (CONTROL_MAX_PAYLOAD + CRC_LEN) + (CONTROL_MAX_PAYLOAD + CRC_LEN) / 254 + 1;
+
+    ControlTransport* transport;
+    Handler handler;
+    void* handlerArg;
+
+    // Encoded bytes since the last delimiter
+    uint8_t rxFrame[MAX_FRAME];
+    size_t rxLength;
+    bool rxOverrun;
+
+    uint8_t decoded[CONTROL_MAX_PAYLOAD + CRC_LEN];
+    uint8_t txPayload[CONTROL_MAX_PAYLOAD + CRC_LEN];
+    uint8_t txFrame[MAX_FRAME];
+
+    uint32_t framesIn;
+    uint32_t framesOut;
+    uint32_t badFrames;
+
+    void handleFrame();
+};
+
+#endif // CONTROL_PROTOCOL_H
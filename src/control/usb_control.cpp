@@ -0,0 +1,339 @@
+#include "usb_control.h"
+#include "../app/counter_app.h"
+#include "../diag/metrics.h"
+#include "../diag/task_profiler.h"
+
+static const size_t APPLY_HEADER_LEN = 9;
+static const size_t SUMMARY_LEN = 10;
+static const size_t LOG_OFFSET_LEN = 4;
+
+static_assert(SUMMARY_LEN + MAX_REGISTERED_DEVICES * 6 <= ControlProtocol::MAX_BODY,
+              "REGISTRY_DUMP must fit one response");
+static_assert(LOG_OFFSET_LEN + USB_LOG_CHUNK_BYTES <= ControlProtocol::MAX_BODY,
+              "USB_LOG_CHUNK_BYTES must fit one response");
+
+static void putU16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+}
+
+static void putU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static uint16_t getU16(const uint8_t* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+UsbControl& UsbControl::getInstance() {
+    static UsbControl instance;
+    return instance;
+}
+
+UsbControl::UsbControl()
+    : logger(nullptr)
+    , task(nullptr)
+    , requestsRefused(0) {
+    memset(response, 0, sizeof(response));
+}
+
+bool UsbControl::begin(LogRing* log) {
+    if (!log) {
+        return false;
+    }
+    logger = log;
+
+#if USB_CONTROL_ENABLED
+    protocol.begin(&transport, onRequest, this);
+
+    if (xTaskCreatePinnedToCore(taskEntry, "Control", USB_CONTROL_TASK_STACK, this,
+                                TASK_PRIORITY_CONTROL, &task, CORE_CONTROL) != pdPASS) {
+        logger->log("ERROR: USB control task failed to start");
+        return false;
+    }
+
+    logger->log("USB control: protocol v%u on the CDC port%s",
+        PROTOCOL_VERSION, USB_CONTROL_READ_ONLY ? ", read-only" : "");
+#endif
+    return true;
+}
+
+void UsbControl::report() {
+    if (!logger || !task) {
+        return;
+    }
+
+    logger->log("USB control: %lu requests, %lu bad frames, %lu refused, %lu log bytes",
+        (unsigned long)protocol.getFramesIn(), (unsigned long)protocol.getBadFrames(),
+        (unsigned long)requestsRefused, (unsigned long)logger->written());
+}
+
+// ============================================================================
+// Control Task
+// ============================================================================
+
+size_t UsbControl::SerialTransport::read(uint8_t* buffer, size_t capacity) {
+    int available = Serial.available();
+    if (available <= 0) {
+        return 0;
+    }
+    return Serial.read(buffer, (size_t)available < capacity ? (size_t)available : capacity);
+}
+
+size_t UsbControl::SerialTransport::write(const uint8_t* data, size_t length) {
+    // One write holds the port's TX lock, so a log line can't land mid-frame
+    return Serial.write(data, length);
+}
+
+void UsbControl::taskEntry(void* param) {
+    static_cast<UsbControl*>(param)->run();
+}
+
+void UsbControl::run() {
+    uint32_t lastActiveMs = millis();
+
+    while (true) {
+        if (protocol.poll()) {
+            lastActiveMs = millis();
+        }
+
+        // Stay quick through a burst of requests, then back off
+        bool idle = millis() - lastActiveMs >= USB_CONTROL_IDLE_AFTER_MS;
+        vTaskDelay(pdMS_TO_TICKS(idle ? USB_CONTROL_IDLE_POLL_MS : USB_CONTROL_ACTIVE_POLL_MS));
+    }
+}
+
+// ============================================================================
+// Requests
+// ============================================================================
+
+void UsbControl::onRequest(void* arg, ControlProtocol& protocol, const ControlProtocol::Request& request) {
+    static_cast<UsbControl*>(arg)->handle(request);
+}
+
+void UsbControl::handle(const ControlProtocol::Request& request) {
+    bool mutating = request.opcode == OP_REGISTRY_APPLY ||
+                    request.opcode == OP_COUNTER_ADD ||
+                    request.opcode == OP_COUNTER_SET;
+    if (USB_CONTROL_READ_ONLY && mutating) {
+        requestsRefused++;
+        protocol.respond(request, ControlProtocol::STATUS_READ_ONLY, nullptr, 0);
+        return;
+    }
+
+    switch (request.opcode) {
+        case OP_PING:
+            handlePing(request);
+            break;
+        case OP_REGISTRY_DUMP:
+            handleRegistryDump(request);
+            break;
+        case OP_REGISTRY_APPLY:
+            handleRegistryApply(request);
+            break;
+        case OP_COUNTER_GET:
+        case OP_COUNTER_ADD:
+        case OP_COUNTER_SET:
+            handleCounter(request);
+            break;
+        case OP_CHANNELS_DUMP:
+            handleChannelsDump(request);
+            break;
+        case OP_METRICS:
+            handleMetrics(request);
+            break;
+        case OP_LOG_EXPORT:
+            handleLogExport(request);
+            break;
+        default:
+            protocol.respond(request, ControlProtocol::STATUS_UNKNOWN_OPCODE, nullptr, 0);
+            break;
+    }
+}
+
+void UsbControl::handlePing(const ControlProtocol::Request& request) {
+    response[0] = PROTOCOL_VERSION;
+    putU16(response + 1, CONTROL_MAX_PAYLOAD);
+    response[3] = COUNTER_CHANNELS;
+    response[4] = USB_CONTROL_READ_ONLY;
+    putU32(response + 5, millis());
+    protocol.respond(request, ControlProtocol::STATUS_OK, response, 9);
+}
+
+void UsbControl::sendRegistrySummary(const ControlProtocol::Request& request, uint8_t status) {
+    CounterApp& app = CounterApp::getInstance();
+    {
+        CounterApp::Lock lock;
+        putU32(response, app.getRegistryVersion());
+        putU32(response + 4, app.getRegistryHash());
+        putU16(response + 8, (uint16_t)app.getRegisteredDeviceCount());
+    }
+    protocol.respond(request, status, response, SUMMARY_LEN);
+}
+
+void UsbControl::handleRegistryDump(const ControlProtocol::Request& request) {
+    CounterApp& app = CounterApp::getInstance();
+    size_t count;
+    {
+        CounterApp::Lock lock;
+        const RegisteredDevice* devices = app.getRegisteredDevices();
+        count = app.getRegisteredDeviceCount();
+
+        putU32(response, app.getRegistryVersion());
+        putU32(response + 4, app.getRegistryHash());
+        putU16(response + 8, (uint16_t)count);
+        for (size_t i = 0; i < count; i++) {
+            memcpy(response + SUMMARY_LEN + i * 6, devices[i].macAddress, 6);
+        }
+    }
+    protocol.respond(request, ControlProtocol::STATUS_OK, response, SUMMARY_LEN + count * 6);
+}
+
+void UsbControl::handleRegistryApply(const ControlProtocol::Request& request) {
+    if (request.length < APPLY_HEADER_LEN) {
+        protocol.respond(request, ControlProtocol::STATUS_BAD_REQUEST, nullptr, 0);
+        return;
+    }
+
+    uint32_t baseVersion = getU32(request.body);
+    bool replace = request.body[4] & APPLY_REPLACE;
+    size_t addCount = getU16(request.body + 5);
+    size_t removeCount = getU16(request.body + 7);
+    if (request.length != APPLY_HEADER_LEN + (addCount + removeCount) * 6 ||
+        (replace && removeCount)) {
+        protocol.respond(request, ControlProtocol::STATUS_BAD_REQUEST, nullptr, 0);
+        return;
+    }
+    if (addCount > MAX_REGISTERED_DEVICES || removeCount > MAX_REGISTERED_DEVICES) {
+        sendRegistrySummary(request, ControlProtocol::STATUS_CAPACITY);
+        return;
+    }
+
+    CounterApp& app = CounterApp::getInstance();
+
+    // Same optimistic check as a GATT registry transaction, held through the
+    // apply so a BLE commit or pairing can't land in between
+    CounterApp::Lock lock;
+    if (app.getRegistryVersion() != baseVersion) {
+        sendRegistrySummary(request, ControlProtocol::STATUS_VERSION_CONFLICT);
+        return;
+    }
+
+    const uint8_t (*adds)[6] = reinterpret_cast<const uint8_t (*)[6]>(request.body + APPLY_HEADER_LEN);
+    const uint8_t (*removes)[6] = adds + addCount;
+
+    // Replace: remove everything registered now, then add
+    if (replace) {
+        const RegisteredDevice* devices = app.getRegisteredDevices();
+        removeCount = app.getRegisteredDeviceCount();
+        for (size_t i = 0; i < removeCount; i++) {
+            memcpy(replaceScratch[i], devices[i].macAddress, 6);
+        }
+        removes = replaceScratch;
+    }
+
+    bool applied = app.applyRegistryDiff(adds, addCount, removes, removeCount);
+    logger->log("Registry %s over USB: +%zu -%zu%s",
+        applied ? "applied" : "rejected", addCount, removeCount, replace ? " (replace)" : "");
+
+    sendRegistrySummary(request, applied ? ControlProtocol::STATUS_OK : ControlProtocol::STATUS_CAPACITY);
+}
+
+void UsbControl::handleCounter(const ControlProtocol::Request& request) {
+    size_t expected = request.opcode == OP_COUNTER_GET ? 1 : 5;
+    if (request.length != expected || request.body[0] >= COUNTER_CHANNELS) {
+        protocol.respond(request, ControlProtocol::STATUS_BAD_REQUEST, nullptr, 0);
+        return;
+    }
+
+    CounterApp& app = CounterApp::getInstance();
+    uint8_t channel = request.body[0];
+    if (request.opcode == OP_COUNTER_ADD) {
+        app.addToChannel(channel, (int32_t)getU32(request.body + 1));
+    } else if (request.opcode == OP_COUNTER_SET) {
+        app.setChannel(channel, (int32_t)getU32(request.body + 1));
+    }
+
+    response[0] = channel;
+    putU32(response + 1, (uint32_t)app.getChannel(channel));
+    protocol.respond(request, ControlProtocol::STATUS_OK, response, 5);
+}
+
+void UsbControl::handleChannelsDump(const ControlProtocol::Request& request) {
+    CounterApp& app = CounterApp::getInstance();
+    size_t length = 1;
+    uint8_t count = 0;
+
+    // A table too big for one response is cut at a whole channel
+    for (uint8_t channel = 0; channel < COUNTER_CHANNELS; channel++) {
+        const char* name = app.getChannelName(channel);
+        size_t nameLength = strlen(name) + 1;
+        if (length + 4 + nameLength > sizeof(response)) {
+            break;
+        }
+        putU32(response + length, (uint32_t)app.getChannel(channel));
+        memcpy(response + length + 4, name, nameLength);
+        length += 4 + nameLength;
+        count++;
+    }
+
+    response[0] = count;
+    protocol.respond(request, ControlProtocol::STATUS_OK, response, length);
+}
+
+void UsbControl::handleMetrics(const ControlProtocol::Request& request) {
+    if (request.length != 1 || request.body[0] > 1) {
+        protocol.respond(request, ControlProtocol::STATUS_BAD_REQUEST, nullptr, 0);
+        return;
+    }
+
+    size_t length = request.body[0] == 0 ? Metrics::snapshot(response, sizeof(response))
+                                         : TaskProfiler::getInstance().snapshot(response, sizeof(response));
+    if (!length) {
+        protocol.respond(request, ControlProtocol::STATUS_CAPACITY, nullptr, 0);
+        return;
+    }
+    protocol.respond(request, ControlProtocol::STATUS_OK, response, length);
+}
+
+// ============================================================================
+// Log Export
+// ============================================================================
+
+void UsbControl::handleLogExport(const ControlProtocol::Request& request) {
+    if (request.length != 4) {
+        protocol.respond(request, ControlProtocol::STATUS_BAD_REQUEST, nullptr, 0);
+        return;
+    }
+
+    uint32_t offset = getU32(request.body);
+
+    // Export up to what was logged when the request arrived, so a busy log
+    // can't keep the export going
+    uint32_t end = logger->written();
+
+    // Past the end means the host's offset is from before a reboot
+    if (offset > end) {
+        offset = 0;
+    }
+
+    while (true) {
+        // Skips whatever the ring has overwritten, even mid-export
+        size_t n = logger->read(offset, end, (char*)response + LOG_OFFSET_LEN, USB_LOG_CHUNK_BYTES);
+
+        bool last = offset + n >= end;
+        putU32(response, offset);
+        if (!protocol.respond(request, last ? ControlProtocol::STATUS_OK : ControlProtocol::STATUS_MORE,
+                              response, LOG_OFFSET_LEN + n) || last) {
+            return;
+        }
+        offset += n;
+    }
+}
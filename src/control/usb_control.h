@@ -0,0 +1,102 @@
+#ifndef USB_CONTROL_H
+#define USB_CONTROL_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "../diag/log_ring.h"
+#include "control_protocol.h"
+
+/**
+ * Host control channel on the native USB CDC port.
+ *
+ * Runs ControlProtocol over Serial alongside the text log, on its own task
+ * so a slow or absent host never holds up the app loop. The port is polled
+ * every USB_CONTROL_ACTIVE_POLL_MS while requests are arriving and backs off
+ * to USB_CONTROL_IDLE_POLL_MS once it goes quiet. Requests are handled on
+ * that task, the same way GATT callbacks are handled on the BLE task, and
+ * take CounterApp::Lock around registry and counter changes.
+ *
+ *   PING            ()                          -> protocol u8, maxPayload u16,
+ *                                                  channels u8, readOnly u8, uptimeMs u32
+ *   REGISTRY_DUMP   ()                          -> version u32, hash u32, count u16,
+ *                                                  count x mac[6]
+ *   REGISTRY_APPLY  (baseVersion u32, flags u8, -> version u32, hash u32, count u16
+ *                    adds u16, removes u16,
+ *                    adds x mac[6], removes x mac[6])
+ *   COUNTER_GET     (channel u8)                -> channel u8, value i32
+ *   COUNTER_ADD     (channel u8, delta i32)     -> channel u8, value i32
+ *   COUNTER_SET     (channel u8, value i32)     -> channel u8, value i32
+ *   CHANNELS_DUMP   ()                          -> count u8, count x (value i32, name\0)
+ *   METRICS         (page u8)                   -> page 0: Metrics snapshot,
+ *                                                  page 1: TaskProfiler snapshot
+ *   LOG_EXPORT      (from u32)                  -> one response per chunk:
+ *                                                  offset u32, text
+ *
+ * REGISTRY_APPLY flags bit 0 replaces the whole registry with the adds.
+ * LOG_EXPORT reads the LogRing: offsets count bytes logged since boot, and
+ * the last chunk's offset plus its length is where the next export should
+ * start. Anyone with the cable is trusted: with USB_CONTROL_READ_ONLY set,
+ * the mutating requests answer STATUS_READ_ONLY.
+ */
+class UsbControl {
+public:
+    enum Opcode : uint8_t {
+        OP_PING           = 0x01,
+        OP_REGISTRY_DUMP  = 0x10,
+        OP_REGISTRY_APPLY = 0x11,
+        OP_COUNTER_GET    = 0x20,
+        OP_COUNTER_ADD    = 0x21,
+        OP_COUNTER_SET    = 0x22,
+        OP_CHANNELS_DUMP  = 0x23,
+        OP_METRICS        = 0x30,
+        OP_LOG_EXPORT     = 0x40
+    };
+
+    static const uint8_t PROTOCOL_VERSION = 1;
+    static const uint8_t APPLY_REPLACE = 0x01;
+
+    static UsbControl& getInstance();
+
+    bool begin(LogRing* log);
+
+    void report();
+
+private:
+    UsbControl();
+
+    // Prevent copying
+    UsbControl(const UsbControl&) = delete;
+    UsbControl& operator=(const UsbControl&) = delete;
+
+    class SerialTransport : public ControlTransport {
+    public:
+        size_t read(uint8_t* buffer, size_t capacity) override;
+        size_t write(const uint8_t* data, size_t length) override;
+    };
+
+    LogRing* logger;
+    TaskHandle_t task;
+    SerialTransport transport;
+    ControlProtocol protocol;
+    uint8_t response[ControlProtocol::MAX_BODY];
+
+    // A replace's removes: everything registered now
+    uint8_t replaceScratch[MAX_REGISTERED_DEVICES][6];
+    uint32_t requestsRefused;
+
+    static void taskEntry(void* param);
+    void run();
+
+    static void onRequest(void* arg, ControlProtocol& protocol, const ControlProtocol::Request& request);
+    void handle(const ControlProtocol::Request& request);
+    void handlePing(const ControlProtocol::Request& request);
+    void handleRegistryDump(const ControlProtocol::Request& request);
+    void handleRegistryApply(const ControlProtocol::Request& request);
+    void handleCounter(const ControlProtocol::Request& request);
+    void handleChannelsDump(const ControlProtocol::Request& request);
+    void handleMetrics(const ControlProtocol::Request& request);
+    void handleLogExport(const ControlProtocol::Request& request);
+    void sendRegistrySummary(const ControlProtocol::Request& request, uint8_t status);
+};
+
+#endif // USB_CONTROL_H
@@ -0,0 +1,49 @@
+#include "boot_trace.h"
+#include <esp_timer.h>
+
+BootTrace::Mark BootTrace::marks[BOOT_TRACE_MAX_MARKS];
+size_t BootTrace::markCount = 0;
+bool BootTrace::closed = false;
+
+// Boot stages can mark from both cores
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+void BootTrace::mark(const char* phase) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&traceMux);
+    if (!closed && markCount < BOOT_TRACE_MAX_MARKS) {
+        marks[markCount].phase = phase;
+        marks[markCount].timestampUs = now;
+        markCount++;
+    }
+    portEXIT_CRITICAL(&traceMux);
+}
+
+int64_t BootTrace::timeOf(const char* phase) {
+    for (size_t i = 0; i < markCount; i++) {
+        if (strcmp(marks[i].phase, phase) == 0) {
+            return marks[i].timestampUs;
+        }
+    }
+    return 0;
+}
+
+void BootTrace::dump(LogRing* logger) {
+    closed = true;
+
+    if (!logger) {
+        return;
+    }
+
+    logger->log("=== Boot timeline (%s) ===", BUILD_PROFILE);
+
+    int64_t previous = 0;
+    for (size_t i = 0; i < markCount; i++) {
+        logger->log("  %-20s at %7lld us  (+%lld us)",
+            marks[i].phase, marks[i].timestampUs, marks[i].timestampUs - previous);
+        previous = marks[i].timestampUs;
+    }
+
+    logger->log("=====================");
+}
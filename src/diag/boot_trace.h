@@ -0,0 +1,33 @@
+#ifndef BOOT_TRACE_H
+#define BOOT_TRACE_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "log_ring.h"
+
+/**
+ * Boot timeline: records named phase marks (microseconds since reset)
+ * during startup and dumps them with per-phase durations once boot is done.
+ * Marks made after dump() are ignored, so steady-state callers (e.g. a
+ * re-advertise after disconnect) can mark unconditionally.
+ */
+class BootTrace {
+public:
+    static void mark(const char* phase);
+    static void dump(LogRing* logger);
+
+    // Time of the first mark with this name, or 0 if it never happened
+    static int64_t timeOf(const char* phase);
+
+private:
+    struct Mark {
+        const char* phase;
+        int64_t timestampUs;
+    };
+
+    static Mark marks[BOOT_TRACE_MAX_MARKS];
+    static size_t markCount;
+    static bool closed;
+};
+
+#endif // BOOT_TRACE_H
@@ -0,0 +1,400 @@
+#include "event_trace.h"
+#include "metrics.h"
+#include "../app/counter_app.h"
+#include "../gate/relay_controller.h"
+#include <LittleFS.h>
+#include <esp_timer.h>
+
+static const char* const TYPE_NAMES[] = {
+    "", "connect", "disconnect", "read", "write", "click", "long press"
+};
+
+static_assert(sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]) == (size_t)EventTrace::Type::COUNT,
+              "TYPE_NAMES out of sync");
+
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Open for the whole recording or replay; only touched from the app loop
+static File traceFile;
+
+class TraceFileSource : public TraceSource {
+public:
+    size_t read(uint8_t* buffer, size_t length) override {
+        return traceFile.read(buffer, length);
+    }
+};
+
+static TraceFileSource traceSource;
+static TraceReader traceReader(traceSource);
+
+LogRing* EventTrace::logger = nullptr;
+volatile bool EventTrace::recording = false;
+bool EventTrace::replaying = false;
+
+EventTrace::Entry* EventTrace::ring = nullptr;
+size_t EventTrace::ringHead = 0;
+size_t EventTrace::ringTail = 0;
+volatile uint32_t EventTrace::droppedRecords = 0;
+int64_t EventTrace::lastRecordUs = 0;
+uint32_t EventTrace::bytesWritten = 0;
+uint32_t EventTrace::lastFlushMs = 0;
+
+EventTrace::ButtonHandler EventTrace::buttonHandler = nullptr;
+void* EventTrace::buttonHandlerArg = nullptr;
+TimerWheel::Timer EventTrace::replayTimer(EventTrace::onReplayTimer);
+EventTrace::Entry EventTrace::pending;
+bool EventTrace::pendingValid = false;
+int64_t EventTrace::replayStartUs = 0;
+uint64_t EventTrace::totalLagUs = 0;
+uint32_t EventTrace::maxLagUs = 0;
+EventTrace::TypeStats EventTrace::stats[(size_t)EventTrace::Type::COUNT];
+uint32_t EventTrace::startNotifies = 0;
+uint32_t EventTrace::startFlushes = 0;
+
+void EventTrace::begin(LogRing* log, ButtonHandler buttons, void* buttonsArg) {
+    logger = log;
+    buttonHandler = buttons;
+    buttonHandlerArg = buttonsArg;
+
+#if EVENT_TRACE_MODE == 1
+    startRecording();
+#elif EVENT_TRACE_MODE == 2
+    startReplay();
+#endif
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+bool EventTrace::startRecording() {
+    // Allocated here, before the heap is sealed, and only in trace builds
+    ring = new Entry[EVENT_TRACE_RING_LEN];
+
+    traceFile = LittleFS.open(EVENT_TRACE_PATH, "w");
+    if (!traceFile) {
+        logger->log("ERROR: Cannot create event trace %s", EVENT_TRACE_PATH);
+        return false;
+    }
+
+    // Starting state, so a replay begins where this recording did
+    CounterApp& app = CounterApp::getInstance();
+    CounterApp::Lock lock;
+    TraceCodec::Header start;
+    start.counter = app.getValue();
+    start.pairing = BLEManager::getInstance().isInPairingMode();
+    start.deviceCount = (uint16_t)app.getRegisteredDeviceCount();
+    uint8_t header[TraceCodec::HEADER_LEN];
+    TraceCodec::encodeHeader(start, header);
+
+    bool ok = traceFile.write(header, sizeof(header)) == sizeof(header);
+    const RegisteredDevice* devices = app.getRegisteredDevices();
+    for (size_t i = 0; ok && i < start.deviceCount; i++) {
+        ok = traceFile.write(devices[i].macAddress, 6) == 6;
+    }
+    if (!ok) {
+        logger->log("ERROR: Event trace write failed");
+        traceFile.close();
+        return false;
+    }
+
+    bytesWritten = traceFile.position();
+    lastRecordUs = esp_timer_get_time();
+    lastFlushMs = millis();
+    recording = true;
+
+    logger->log("Event trace: recording to %s (counter %d, %u devices, up to %u bytes)",
+        EVENT_TRACE_PATH, start.counter, start.deviceCount, EVENT_TRACE_MAX_BYTES);
+    return true;
+}
+
+void EventTrace::append(Type type, Target target, const uint8_t* data, size_t length) {
+    int64_t now = esp_timer_get_time();
+    if (length > 0xFFFF) {
+        length = 0xFFFF;
+    }
+
+    bool full = false;
+
+    portENTER_CRITICAL(&ringMux);
+    size_t next = (ringHead + 1) % EVENT_TRACE_RING_LEN;
+    if (next == ringTail) {
+        full = true;
+    } else {
+        Entry& entry = ring[ringHead];
+        entry.timeUs = now;
+        entry.type = type;
+        entry.target = target;
+        entry.length = (uint16_t)length;
+        if (length) {
+            memcpy(entry.data, data, TraceCodec::storedLength(length));
+        }
+        ringHead = next;
+    }
+    portEXIT_CRITICAL(&ringMux);
+
+    if (full) {
+        droppedRecords++;
+    }
+}
+
+void EventTrace::update() {
+    if (!recording) {
+        return;
+    }
+
+    uint8_t buffer[TraceCodec::MAX_RECORD_BYTES];
+    while (true) {
+        Entry entry;
+        bool available = false;
+
+        portENTER_CRITICAL(&ringMux);
+        if (ringTail != ringHead) {
+            entry = ring[ringTail];
+            ringTail = (ringTail + 1) % EVENT_TRACE_RING_LEN;
+            available = true;
+        }
+        portEXIT_CRITICAL(&ringMux);
+
+        if (!available) {
+            break;
+        }
+
+        size_t length = TraceCodec::encode(entry, lastRecordUs, buffer);
+        if (bytesWritten + length > EVENT_TRACE_MAX_BYTES ||
+            traceFile.write(buffer, length) != length) {
+            recording = false;
+            traceFile.close();
+            logger->log("Event trace: stopped at %lu bytes (%s), %lu records dropped",
+                (unsigned long)bytesWritten,
+                bytesWritten + length > EVENT_TRACE_MAX_BYTES ? "size limit" : "write failed",
+                (unsigned long)droppedRecords);
+            return;
+        }
+        bytesWritten += length;
+    }
+
+    // Bounded loss on power cut without a flash write per event
+    if (millis() - lastFlushMs >= EVENT_TRACE_FLUSH_MS) {
+        traceFile.flush();
+        lastFlushMs = millis();
+    }
+}
+
+// ============================================================================
+// Replay
+// ============================================================================
+
+bool EventTrace::startReplay() {
+    traceFile = LittleFS.open(EVENT_TRACE_PATH, "r");
+    uint8_t header[TraceCodec::HEADER_LEN];
+    TraceCodec::Header start;
+    bool valid = traceFile && traceFile.read(header, sizeof(header)) == sizeof(header) &&
+                 TraceCodec::decodeHeader(header, start) &&
+                 start.deviceCount <= MAX_REGISTERED_DEVICES;
+    if (!valid) {
+        logger->log("ERROR: No valid event trace at %s", EVENT_TRACE_PATH);
+        if (traceFile) {
+            traceFile.close();
+        }
+        return false;
+    }
+
+    // Replay builds only, and before the heap is sealed: a full registry
+    // is too big for the loop task's stack
+    uint8_t (*adds)[6] = new uint8_t[MAX_REGISTERED_DEVICES][6];
+    uint8_t (*removes)[6] = new uint8_t[MAX_REGISTERED_DEVICES][6];
+    if (traceFile.read(&adds[0][0], (size_t)start.deviceCount * 6) != (size_t)start.deviceCount * 6) {
+        logger->log("ERROR: Event trace header truncated");
+        traceFile.close();
+        delete[] adds;
+        delete[] removes;
+        return false;
+    }
+
+    // Same starting state as the recording: counter, registry, pairing mode
+    CounterApp& app = CounterApp::getInstance();
+    {
+        CounterApp::Lock lock;
+        const RegisteredDevice* devices = app.getRegisteredDevices();
+        size_t removeCount = app.getRegisteredDeviceCount();
+        for (size_t i = 0; i < removeCount; i++) {
+            memcpy(removes[i], devices[i].macAddress, 6);
+        }
+        app.applyRegistryDiff(adds, start.deviceCount, removes, removeCount);
+    }
+    delete[] adds;
+    delete[] removes;
+
+    app.setValue(start.counter);
+
+    BLEManager& ble = BLEManager::getInstance();
+    if (start.pairing && !ble.isInPairingMode()) {
+        ble.enterPairingMode();
+    } else if (!start.pairing && ble.isInPairingMode()) {
+        ble.exitPairingMode();
+    }
+
+    // No real peers and no gate pulses while the trace drives the app
+    ble.stopAdvertising();
+    RelayController::getInstance().setDryRun(true);
+
+    memset(stats, 0, sizeof(stats));
+    traceReader.reset();
+    Metrics::reset(Metrics::Histogram::REPLAY_EVENT_US);
+    startNotifies = Metrics::getCounter(Metrics::Counter::NOTIFY_SENT);
+    startFlushes = Metrics::getCounter(Metrics::Counter::CONFIG_FLUSHES);
+    totalLagUs = 0;
+    maxLagUs = 0;
+    replayStartUs = esp_timer_get_time();
+    replaying = true;
+
+    logger->log("Event trace: replaying %s at pace x%u (0: back to back), counter %d, %u devices",
+        EVENT_TRACE_PATH, EVENT_TRACE_REPLAY_SPEED, start.counter, start.deviceCount);
+
+    pendingValid = readNext();
+    TimerWheel::getInstance().arm(replayTimer, 0);
+    return true;
+}
+
+bool EventTrace::readNext() {
+    if (traceReader.next(pending)) {
+        return true;
+    }
+    if (traceReader.isCorrupt()) {
+        logger->log("ERROR: Event trace corrupt at %lu ms", (unsigned long)(traceReader.getTimeUs() / 1000));
+    }
+    return false;
+}
+
+void EventTrace::onReplayTimer(void* arg) {
+#if EVENT_TRACE_REPLAY_SPEED
+    while (pendingValid) {
+        // Virtual clock: trace time scaled onto the time since replay start
+        int64_t now = esp_timer_get_time();
+        int64_t dueUs = replayStartUs + pending.timeUs / EVENT_TRACE_REPLAY_SPEED;
+        if (dueUs > now) {
+            uint32_t delayMs = (uint32_t)((dueUs - now + 999) / 1000);
+            TimerWheel::getInstance().arm(replayTimer, delayMs);
+            return;
+        }
+
+        uint32_t lag = (uint32_t)(now - dueUs);
+        totalLagUs += lag;
+        if (lag > maxLagUs) {
+            maxLagUs = lag;
+        }
+
+        dispatch(pending);
+        pendingValid = readNext();
+    }
+#else
+    // Back to back, yielding to the loop between batches
+    for (size_t i = 0; pendingValid && i < EVENT_TRACE_REPLAY_BATCH; i++) {
+        dispatch(pending);
+        pendingValid = readNext();
+    }
+    if (pendingValid) {
+        TimerWheel::getInstance().arm(replayTimer, 0);
+        return;
+    }
+#endif
+
+    finishReplay();
+}
+
+void EventTrace::dispatch(const Entry& entry) {
+    CounterApp& app = CounterApp::getInstance();
+    int64_t startUs = esp_timer_get_time();
+
+    switch (entry.type) {
+        case Type::CONNECT:
+            BLEManager::getInstance().replayConnection(entry.data);
+            break;
+        case Type::DISCONNECT:
+            BLEManager::getInstance().replayDisconnection();
+            break;
+        case Type::GATT_READ:
+            if (entry.target == Target::CHANNELS) {
+                app.onChannelsRead();
+            } else {
+                int32_t value;
+                app.onCounterRead(value);
+            }
+            break;
+        case Type::GATT_WRITE:
+            if (entry.target == Target::COUNTER && entry.length == sizeof(int32_t)) {
+                int32_t value;
+                memcpy(&value, entry.data, sizeof(value));
+                app.onCounterWrite(value);
+            } else if (entry.target == Target::GATE && entry.length == 1) {
+                app.onGateCommand(entry.data[0], startUs);
+            } else if (entry.target == Target::REGISTRY) {
+                app.onRegistryCommand(entry.data, entry.length);
+            } else if (entry.target == Target::CHANNELS) {
+                app.onChannelsWrite(entry.data, entry.length / CHANNEL_OP_LEN);
+            }
+            break;
+        case Type::BUTTON_CLICK:
+        case Type::BUTTON_LONG_PRESS:
+            if (buttonHandler) {
+                buttonHandler(buttonHandlerArg, entry.data[0], entry.type == Type::BUTTON_LONG_PRESS);
+            }
+            break;
+        default:
+            break;
+    }
+
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - startUs);
+    Metrics::record(Metrics::Histogram::REPLAY_EVENT_US, elapsed);
+    TypeStats& typeStats = stats[(size_t)entry.type];
+    typeStats.count++;
+    typeStats.totalUs += elapsed;
+    if (elapsed > typeStats.maxUs) {
+        typeStats.maxUs = elapsed;
+    }
+}
+
+void EventTrace::finishReplay() {
+    traceFile.close();
+    replaying = false;
+
+    uint32_t wallMs = (uint32_t)((esp_timer_get_time() - replayStartUs) / 1000);
+    const Metrics::Histogram events = Metrics::Histogram::REPLAY_EVENT_US;
+    uint32_t count = Metrics::getCount(events);
+
+    logger->log("=== Event replay ===");
+    logger->log("  %lu events in %lu ms (trace spans %lu ms), %lu events/s",
+        (unsigned long)count, (unsigned long)wallMs, (unsigned long)(traceReader.getTimeUs() / 1000),
+        (unsigned long)(wallMs ? (uint64_t)count * 1000 / wallMs : count));
+    logger->log("  handler p50<=%u p90<=%u p99<=%u max=%u us",
+        Metrics::percentile(events, 50), Metrics::percentile(events, 90),
+        Metrics::percentile(events, 99), Metrics::getMax(events));
+    for (size_t i = 1; i < (size_t)Type::COUNT; i++) {
+        if (stats[i].count) {
+            logger->log("  %-11s n=%-6lu mean=%lu max=%lu us", TYPE_NAMES[i],
+                (unsigned long)stats[i].count,
+                (unsigned long)(stats[i].totalUs / stats[i].count),
+                (unsigned long)stats[i].maxUs);
+        }
+    }
+    if (traceReader.getTruncatedSkipped()) {
+        logger->log("  %lu writes longer than %u bytes skipped (recorded truncated)",
+            (unsigned long)traceReader.getTruncatedSkipped(), EVENT_TRACE_MAX_PAYLOAD);
+    }
+#if EVENT_TRACE_REPLAY_SPEED
+    logger->log("  dispatch lag mean=%lu max=%lu us",
+        (unsigned long)(count ? totalLagUs / count : 0), (unsigned long)maxLagUs);
+#endif
+    logger->log("  %lu notifies, %lu config flushes; counter ended at %d",
+        (unsigned long)(Metrics::getCounter(Metrics::Counter::NOTIFY_SENT) - startNotifies),
+        (unsigned long)(Metrics::getCounter(Metrics::Counter::CONFIG_FLUSHES) - startFlushes),
+        CounterApp::getInstance().getValue());
+    logger->log("====================");
+
+    if (BLEManager::getInstance().isDeviceConnected()) {
+        BLEManager::getInstance().replayDisconnection();
+    }
+    RelayController::getInstance().setDryRun(false);
+    BLEManager::getInstance().startAdvertising();
+}
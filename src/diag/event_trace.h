@@ -0,0 +1,97 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "log_ring.h"
+#include "../app/timer_wheel.h"
+#include "trace_codec.h"
+
+/**
+ * Input capture and deterministic replay.
+ *
+ * Recording (EVENT_TRACE_MODE 1): the inputs that reach the app - BLE
+ * connects with the peer MAC, disconnects, counter reads and writes, gate
+ * and registry writes, button clicks and long presses - are timestamped
+ * into a small RAM ring from whatever task sees them, and update() appends
+ * them to EVENT_TRACE_PATH. The file starts with the counter, registry and
+ * pairing state, so a replay starts from the same place. The file format is
+ * TraceCodec's; a write longer than EVENT_TRACE_MAX_PAYLOAD keeps only its
+ * first bytes and is skipped (and counted) on replay.
+ *
+ * Replay (EVENT_TRACE_MODE 2): restores the header state and feeds every
+ * record back through CounterApp and BLEManager on a virtual clock, at
+ * EVENT_TRACE_REPLAY_SPEED times the recorded pace (0: back to back). The
+ * relay is put in dry-run mode and advertising is stopped for the run.
+ * Handler time, dispatch lag and throughput are logged at the end.
+ */
+class EventTrace {
+public:
+    using Type = TraceCodec::Type;
+    using Target = TraceCodec::Target;
+
+    // Replays a button event the way the input handler would act on it
+    using ButtonHandler = void (*)(void* arg, uint8_t button, bool longPress);
+
+    // Starts recording or replaying, depending on EVENT_TRACE_MODE
+    static void begin(LogRing* logger, ButtonHandler buttons, void* buttonsArg);
+
+    // Any task; never blocks. Records are dropped (and counted) if the ring is full.
+    static void record(Type type, Target target = Target::NONE,
+                       const uint8_t* data = nullptr, size_t length = 0) {
+        if (recording) {
+            append(type, target, data, length);
+        }
+    }
+
+    static bool isReplaying() { return replaying; }
+
+    // Writes recorded events out to flash; call from the app loop
+    static void update();
+
+private:
+    using Entry = TraceCodec::Record;
+
+    struct TypeStats {
+        uint32_t count;
+        uint64_t totalUs;
+        uint32_t maxUs;
+    };
+
+    static LogRing* logger;
+    static volatile bool recording;
+    static bool replaying;
+
+    // Recording
+    static Entry* ring;
+    static size_t ringHead;
+    static size_t ringTail;
+    static volatile uint32_t droppedRecords;
+    static int64_t lastRecordUs;
+    static uint32_t bytesWritten;
+    static uint32_t lastFlushMs;
+
+    // Replay
+    static ButtonHandler buttonHandler;
+    static void* buttonHandlerArg;
+    static TimerWheel::Timer replayTimer;
+    static Entry pending;
+    static bool pendingValid;
+    static int64_t replayStartUs;
+    static uint64_t totalLagUs;
+    static uint32_t maxLagUs;
+    static TypeStats stats[(size_t)Type::COUNT];
+    static uint32_t startNotifies;
+    static uint32_t startFlushes;
+
+    static void append(Type type, Target target, const uint8_t* data, size_t length);
+    static bool startRecording();
+
+    static bool startReplay();
+    static bool readNext();
+    static void dispatch(const Entry& entry);
+    static void onReplayTimer(void* arg);
+    static void finishReplay();
+};
+
+#endif // EVENT_TRACE_H
@@ -0,0 +1,204 @@
+#include "heap_guard.h"
+#include "metrics.h"
+#include <esp_heap_caps.h>
+#include <esp_rom_sys.h>
+#include <new>
+
+volatile bool HeapGuard::sealed = false;
+volatile uint32_t HeapGuard::postSealAllocations = 0;
+volatile uint32_t HeapGuard::allowed = 0;
+volatile uint32_t HeapGuard::violations = 0;
+void* HeapGuard::lastViolationCaller = nullptr;
+size_t HeapGuard::lastViolationSize = 0;
+
+// The task that sealed the heap; guarded from then on
+static TaskHandle_t sealedTask = nullptr;
+
+// Tasks currently inside a Scope or an Allow, with the nesting depth of each
+static TaskHandle_t scopeTasks[HEAP_GUARD_MAX_SCOPES];
+static uint8_t scopeDepth[HEAP_GUARD_MAX_SCOPES];
+static uint8_t allowDepth[HEAP_GUARD_MAX_SCOPES];
+static portMUX_TYPE scopeMux = portMUX_INITIALIZER_UNLOCKED;
+
+void HeapGuard::seal() {
+    sealedTask = xTaskGetCurrentTaskHandle();
+    postSealAllocations = 0;
+    allowed = 0;
+    sealed = true;
+}
+
+// Slot of the current task, taking a free one if it has none; -1 when the
+// table is full. Call inside scopeMux.
+static int acquireSlot() {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int freeSlot = -1;
+    for (int i = 0; i < HEAP_GUARD_MAX_SCOPES; i++) {
+        bool inUse = scopeDepth[i] || allowDepth[i];
+        if (inUse && scopeTasks[i] == task) {
+            return i;
+        }
+        if (!inUse && freeSlot < 0) {
+            freeSlot = i;
+        }
+    }
+    if (freeSlot >= 0) {
+        scopeTasks[freeSlot] = task;
+    }
+    return freeSlot;
+}
+
+HeapGuard::Scope::Scope() : slot(-1) {
+#if HEAP_GUARD_MODE != HEAP_GUARD_MODE_OFF
+    portENTER_CRITICAL(&scopeMux);
+    slot = acquireSlot();
+    if (slot >= 0) {
+        scopeDepth[slot]++;
+    }
+    portEXIT_CRITICAL(&scopeMux);
+#endif
+}
+
+HeapGuard::Scope::~Scope() {
+    if (slot < 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&scopeMux);
+    scopeDepth[slot]--;
+    portEXIT_CRITICAL(&scopeMux);
+}
+
+HeapGuard::Allow::Allow() : slot(-1) {
+#if HEAP_GUARD_MODE != HEAP_GUARD_MODE_OFF
+    portENTER_CRITICAL(&scopeMux);
+    slot = acquireSlot();
+    if (slot >= 0) {
+        allowDepth[slot]++;
+    }
+    portEXIT_CRITICAL(&scopeMux);
+#endif
+}
+
+HeapGuard::Allow::~Allow() {
+    if (slot < 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&scopeMux);
+    allowDepth[slot]--;
+    portEXIT_CRITICAL(&scopeMux);
+}
+
+void HeapGuard::onAllocate(size_t size, void* caller) {
+    if (!sealed) {
+        return;
+    }
+
+    postSealAllocations++;
+
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    bool guarded = task == sealedTask;
+    for (int i = 0; i < HEAP_GUARD_MAX_SCOPES; i++) {
+        if (scopeTasks[i] != task) {
+            continue;
+        }
+        if (allowDepth[i]) {
+            allowed++;
+            return;
+        }
+        if (scopeDepth[i]) {
+            guarded = true;
+        }
+    }
+
+    if (!guarded) {
+        return;
+    }
+
+    violations++;
+    lastViolationCaller = caller;
+    lastViolationSize = size;
+    Metrics::increment(Metrics::Counter::HEAP_VIOLATIONS);
+
+#if HEAP_GUARD_MODE == HEAP_GUARD_MODE_STRICT
+    // No logger here: it may allocate, and we are inside operator new
+    esp_rom_printf("HeapGuard: %u byte allocation on a guarded task after boot, caller %p\n",
+        (unsigned)size, caller);
+    abort();
+#endif
+}
+
+void HeapGuard::report(LogRing* logger) {
+    size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t minFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    Metrics::setGauge(Metrics::Gauge::FREE_HEAP, (int32_t)freeHeap);
+    Metrics::setGauge(Metrics::Gauge::MIN_FREE_HEAP, (int32_t)minFree);
+    Metrics::setGauge(Metrics::Gauge::LARGEST_FREE_BLOCK, (int32_t)largest);
+
+    if (!logger) {
+        return;
+    }
+
+    logger->log("Heap: free %u, low-water %u, largest block %u", freeHeap, minFree, largest);
+
+#if HEAP_GUARD_MODE != HEAP_GUARD_MODE_OFF
+    logger->log("HeapGuard: %u allocations since boot, %u allow-listed, %u in steady-state paths",
+        postSealAllocations, allowed, violations);
+    if (violations) {
+        logger->log("HeapGuard: last violation %u bytes from %p", lastViolationSize, lastViolationCaller);
+    }
+#endif
+}
+
+// ============================================================================
+// operator new hook
+// ============================================================================
+
+#if HEAP_GUARD_MODE != HEAP_GUARD_MODE_OFF
+
+static void* guardedAlloc(size_t size, void* caller) {
+    HeapGuard::onAllocate(size, caller);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size) {
+    return guardedAlloc(size, __builtin_return_address(0));
+}
+
+void* operator new[](size_t size) {
+    return guardedAlloc(size, __builtin_return_address(0));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    HeapGuard::onAllocate(size, __builtin_return_address(0));
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    HeapGuard::onAllocate(size, __builtin_return_address(0));
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "log_ring.h"
+
+/**
+ * Steady-state heap discipline.
+ *
+ * All app objects that need long-lived storage get it at init; after
+ * seal() (end of boot) the steady-state paths are expected to allocate
+ * nothing. With HEAP_GUARD_MODE enabled, global operator new is hooked and
+ * every C++ allocation after seal() is counted. One on a guarded task is a
+ * violation: the task that called seal() (the app loop) for the rest of
+ * the run, and any task while it is inside a HeapGuard::Scope (every BLE
+ * callback into the app opens one). HeapGuard::Allow is the allow-list: it
+ * marks the few places that may allocate on a guarded task, and those
+ * allocations are counted separately. In HEAP_GUARD_MODE_STRICT a
+ * violation prints the caller and aborts, which is the test mode for
+ * catching regressions on hardware.
+ *
+ * Bluedroid's own C allocations (osi_malloc) are not visible here. Nor is
+ * the Arduino BLE wrapper's bookkeeping outside our callbacks (its peer
+ * map, and the std::string copies it makes of values over 15 bytes when
+ * answering reads and taking writes), which can't be changed from here.
+ */
+class HeapGuard {
+public:
+    static void seal();
+    static bool isSealed() { return sealed; }
+
+    static uint32_t allocationsSinceSeal() { return postSealAllocations; }
+    static uint32_t allowedCount() { return allowed; }
+    static uint32_t violationCount() { return violations; }
+
+    // Heap low-water mark, largest free block and guard counters
+    static void report(LogRing* logger);
+
+    // Marks a steady-state region on the current task
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+
+    private:
+        int slot;
+    };
+
+    // Permits allocations on the current task, guarded or not. Each use is
+    // an entry in the allow-list and says why it can't avoid the heap.
+    class Allow {
+    public:
+        Allow();
+        ~Allow();
+
+    private:
+        int slot;
+    };
+
+    // Called from the operator new hook
+    static void onAllocate(size_t size, void* caller);
+
+private:
+    static volatile bool sealed;
+    static volatile uint32_t postSealAllocations;
+    static volatile uint32_t allowed;
+    static volatile uint32_t violations;
+    static void* lastViolationCaller;
+    static size_t lastViolationSize;
+};
+
+#endif // HEAP_GUARD_H
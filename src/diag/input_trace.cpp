@@ -0,0 +1,140 @@
+#include "input_trace.h"
+#include <esp_timer.h>
+
+// Without a panel a trace is complete once the notify is out
+static const uint8_t STAGES_REQUIRED = HAS_DISPLAY ? 0x0F : 0x07;
+
+static const char* const STAGE_NAMES[InputTrace::STAGE_COUNT] = {
+    "debounce", "apply", "notify", "frame"
+};
+
+// The render task stamps frames while the app loop stamps the rest
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+InputTrace::Trace InputTrace::open[INPUT_TRACE_OPEN_MAX];
+size_t InputTrace::openCount = 0;
+InputTrace::Trace InputTrace::finished[INPUT_TRACE_LEN];
+size_t InputTrace::finishedHead = 0;
+size_t InputTrace::finishedCount = 0;
+uint32_t InputTrace::timedOut = 0;
+
+void InputTrace::decided(int64_t edgeUs, int64_t decidedUs) {
+    portENTER_CRITICAL(&traceMux);
+    retire(decidedUs);
+    if (openCount < INPUT_TRACE_OPEN_MAX) {
+        Trace& trace = open[openCount++];
+        memset(&trace, 0, sizeof(trace));
+        trace.edgeUs = edgeUs;
+        trace.stageUs[DEBOUNCE] = (uint32_t)(decidedUs - edgeUs);
+        trace.reached = 1 << DEBOUNCE;
+    }
+    portEXIT_CRITICAL(&traceMux);
+}
+
+void InputTrace::applied() {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&traceMux);
+    for (size_t i = 0; i < openCount; i++) {
+        Trace& trace = open[i];
+        if (!(trace.reached & (1 << APPLY))) {
+            trace.appliedUs = now;
+            trace.stageUs[APPLY] = (uint32_t)(now - trace.edgeUs);
+            trace.reached |= 1 << APPLY;
+        }
+    }
+    portEXIT_CRITICAL(&traceMux);
+}
+
+void InputTrace::notifyQueued() {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&traceMux);
+    stamp(NOTIFY, now, now);
+    portEXIT_CRITICAL(&traceMux);
+}
+
+void InputTrace::framePushed(int64_t frameStartUs) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&traceMux);
+    stamp(FRAME, now, frameStartUs);
+    portEXIT_CRITICAL(&traceMux);
+}
+
+// Caller holds traceMux. Only changes applied by notAfterUs count: a frame
+// that started drawing before the change doesn't show it.
+void InputTrace::stamp(Stage stage, int64_t nowUs, int64_t notAfterUs) {
+    if (!openCount) {
+        return;
+    }
+
+    for (size_t i = 0; i < openCount; i++) {
+        Trace& trace = open[i];
+        if ((trace.reached & (1 << APPLY)) && !(trace.reached & (1 << stage)) &&
+            trace.appliedUs <= notAfterUs) {
+            trace.stageUs[stage] = (uint32_t)(nowUs - trace.edgeUs);
+            trace.reached |= 1 << stage;
+        }
+    }
+    retire(nowUs);
+}
+
+// Caller holds traceMux
+void InputTrace::retire(int64_t nowUs) {
+    size_t kept = 0;
+    for (size_t i = 0; i < openCount; i++) {
+        Trace& trace = open[i];
+        if (trace.reached == STAGES_REQUIRED) {
+            finished[finishedHead] = trace;
+            finishedHead = (finishedHead + 1) % INPUT_TRACE_LEN;
+            if (finishedCount < INPUT_TRACE_LEN) {
+                finishedCount++;
+            }
+        } else if (nowUs - trace.edgeUs > (int64_t)INPUT_TRACE_TIMEOUT_MS * 1000) {
+            timedOut++;
+        } else {
+            open[kept++] = trace;
+        }
+    }
+    openCount = kept;
+}
+
+void InputTrace::report(LogRing* logger) {
+    if (!logger || !finishedCount) {
+        return;
+    }
+
+    logger->log("Input latency from GPIO edge, last %u presses (%u timed out):",
+        (unsigned)finishedCount, timedOut);
+
+    uint32_t values[INPUT_TRACE_LEN];
+    for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+        if (!(STAGES_REQUIRED & (1 << stage))) {
+            continue;
+        }
+
+        portENTER_CRITICAL(&traceMux);
+        size_t count = finishedCount;
+        for (size_t i = 0; i < count; i++) {
+            values[i] = finished[i].stageUs[stage];
+        }
+        portEXIT_CRITICAL(&traceMux);
+
+        // Insertion sort: at most INPUT_TRACE_LEN values, a few times a minute
+        for (size_t i = 1; i < count; i++) {
+            uint32_t value = values[i];
+            size_t j = i;
+            while (j > 0 && values[j - 1] > value) {
+                values[j] = values[j - 1];
+                j--;
+            }
+            values[j] = value;
+        }
+
+        // Nearest-rank percentiles
+        logger->log("  %-8s p50 %lu p90 %lu p99 %lu max %lu us", STAGE_NAMES[stage],
+            (unsigned long)values[(count * 50 + 99) / 100 - 1],
+            (unsigned long)values[(count * 90 + 99) / 100 - 1],
+            (unsigned long)values[(count * 99 + 99) / 100 - 1],
+            (unsigned long)values[count - 1]);
+    }
+}
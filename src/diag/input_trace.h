@@ -0,0 +1,62 @@
+#ifndef INPUT_TRACE_H
+#define INPUT_TRACE_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "log_ring.h"
+
+/**
+ * Button-to-output latency, stage by stage.
+ *
+ * Each counted press is timed from its GPIO edge to the debounce decision,
+ * to the change reaching CounterApp, to the counter notify being queued
+ * and to the first display frame pushed after the change. Presses applied
+ * together share the later stages. Finished traces go into a ring of the
+ * last INPUT_TRACE_LEN, and report() logs exact percentiles per stage.
+ *
+ * Stages are stamped from the app loop and (FRAME) the render task.
+ */
+class InputTrace {
+public:
+    enum Stage : uint8_t {
+        DEBOUNCE,
+        APPLY,
+        NOTIFY,
+        FRAME,
+        STAGE_COUNT
+    };
+
+    // A press decided at decidedUs joins the change being applied
+    static void decided(int64_t edgeUs, int64_t decidedUs);
+
+    // The pending presses reached CounterApp
+    static void applied();
+
+    // The counter notify went out (or would have, with nobody connected)
+    static void notifyQueued();
+
+    // A frame started at frameStartUs was pushed to the panel
+    static void framePushed(int64_t frameStartUs);
+
+    static void report(LogRing* logger);
+
+private:
+    struct Trace {
+        int64_t edgeUs;
+        int64_t appliedUs;
+        uint32_t stageUs[STAGE_COUNT];
+        uint8_t reached;
+    };
+
+    static Trace open[INPUT_TRACE_OPEN_MAX];
+    static size_t openCount;
+    static Trace finished[INPUT_TRACE_LEN];
+    static size_t finishedHead;
+    static size_t finishedCount;
+    static uint32_t timedOut;
+
+    static void stamp(Stage stage, int64_t nowUs, int64_t notAfterUs);
+    static void retire(int64_t nowUs);
+};
+
+#endif // INPUT_TRACE_H
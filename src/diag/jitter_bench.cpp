@@ -0,0 +1,59 @@
+#include "jitter_bench.h"
+#include "metrics.h"
+
+LogRing* JitterBench::logger = nullptr;
+bool JitterBench::active = false;
+volatile JitterBench::Phase JitterBench::currentPhase = JitterBench::Phase::DISPLAY_IDLE;
+TimerWheel::Timer JitterBench::phaseTimer(JitterBench::onPhaseEnd);
+uint32_t JitterBench::phaseStartStalls = 0;
+uint32_t JitterBench::phaseStartFrames = 0;
+
+static const char* phaseName(JitterBench::Phase phase) {
+    return phase == JitterBench::Phase::FULL_RATE ? "full-rate redraw" : "display idle";
+}
+
+void JitterBench::begin(LogRing* log) {
+#if JITTER_BENCH_ENABLED
+    logger = log;
+    active = true;
+
+    if (logger) {
+        logger->log("Jitter bench: %u ms phases, poll the Counter characteristic to measure",
+            JITTER_BENCH_PHASE_MS);
+    }
+    startPhase(Phase::DISPLAY_IDLE);
+    TimerWheel::getInstance().arm(phaseTimer, JITTER_BENCH_PHASE_MS, JITTER_BENCH_PHASE_MS);
+#endif
+}
+
+void JitterBench::onPhaseEnd(void* arg) {
+    reportPhase();
+    startPhase(currentPhase == Phase::DISPLAY_IDLE ? Phase::FULL_RATE : Phase::DISPLAY_IDLE);
+}
+
+void JitterBench::startPhase(Phase phase) {
+    Metrics::reset(Metrics::Histogram::GATT_READ_US);
+    Metrics::reset(Metrics::Histogram::DISPLAY_FRAME_US);
+    phaseStartStalls = Metrics::getCounter(Metrics::Counter::STALLS);
+    phaseStartFrames = Metrics::getCounter(Metrics::Counter::DISPLAY_FRAMES);
+    currentPhase = phase;
+}
+
+void JitterBench::reportPhase() {
+    if (!logger) {
+        return;
+    }
+
+    const Metrics::Histogram reads = Metrics::Histogram::GATT_READ_US;
+    const Metrics::Histogram frames = Metrics::Histogram::DISPLAY_FRAME_US;
+
+    logger->log("Jitter bench [%s]: %u frames, frame p50<=%u p99<=%u us, %u stalls",
+        phaseName(currentPhase),
+        Metrics::getCounter(Metrics::Counter::DISPLAY_FRAMES) - phaseStartFrames,
+        Metrics::percentile(frames, 50), Metrics::percentile(frames, 99),
+        Metrics::getCounter(Metrics::Counter::STALLS) - phaseStartStalls);
+    logger->log("Jitter bench [%s]: %u GATT reads, p50<=%u p90<=%u p99<=%u max=%u us",
+        phaseName(currentPhase), Metrics::getCount(reads),
+        Metrics::percentile(reads, 50), Metrics::percentile(reads, 90),
+        Metrics::percentile(reads, 99), Metrics::getMax(reads));
+}
@@ -0,0 +1,45 @@
+#ifndef JITTER_BENCH_H
+#define JITTER_BENCH_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "log_ring.h"
+#include "../app/timer_wheel.h"
+
+/**
+ * GATT response-time benchmark under display load.
+ *
+ * Alternates JITTER_BENCH_PHASE_MS phases with the display idle and with
+ * the render task redrawing as fast as it can. At the end of each phase
+ * the GATT read service-time percentiles, frame times and stall count
+ * are logged, then the histograms are cleared for the next phase. Drive
+ * it by polling the Counter characteristic from any client.
+ *
+ * Only active when built with JITTER_BENCH_ENABLED.
+ */
+class JitterBench {
+public:
+    enum class Phase : uint8_t {
+        DISPLAY_IDLE,
+        FULL_RATE
+    };
+
+    static void begin(LogRing* logger);
+
+    static bool isActive() { return active; }
+    static Phase phase() { return currentPhase; }
+
+private:
+    static LogRing* logger;
+    static bool active;
+    static volatile Phase currentPhase;
+    static TimerWheel::Timer phaseTimer;
+    static uint32_t phaseStartStalls;
+    static uint32_t phaseStartFrames;
+
+    static void startPhase(Phase phase);
+    static void reportPhase();
+    static void onPhaseEnd(void* arg);
+};
+
+#endif // JITTER_BENCH_H
@@ -0,0 +1,77 @@
+#include "log_ring.h"
+#include "logger/Logger.h"
+#include <stdarg.h>
+
+// Lines come from any task, exports from the control task
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+LogRing& LogRing::getInstance() {
+    static LogRing instance;
+    return instance;
+}
+
+LogRing::LogRing()
+    : writeOffset(0) {
+    memset(ring, 0, sizeof(ring));
+}
+
+void LogRing::log(const char* format, ...) {
+    // One spare byte so the newline goes into the ring with its line
+    char line[LOG_LINE_MAX + 1];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, LOG_LINE_MAX, format, args);
+    va_end(args);
+
+    if (length < 0) {
+        return;
+    }
+
+    size_t kept = (size_t)length < LOG_LINE_MAX ? (size_t)length : LOG_LINE_MAX - 1;
+    line[kept] = '\n';
+    append(line, kept + 1);
+    line[kept] = '\0';
+
+    Logger::getInstance().log("%s", line);
+}
+
+uint32_t LogRing::written() const {
+    portENTER_CRITICAL(&ringMux);
+    uint32_t offset = writeOffset;
+    portEXIT_CRITICAL(&ringMux);
+    return offset;
+}
+
+size_t LogRing::read(uint32_t& offset, uint32_t end, char* out, size_t capacity) const {
+    portENTER_CRITICAL(&ringMux);
+    uint32_t oldest = writeOffset > LOG_RING_BYTES ? writeOffset - LOG_RING_BYTES : 0;
+    if (offset < oldest) {
+        offset = oldest;
+    }
+    if (end > writeOffset) {
+        end = writeOffset;
+    }
+    if (offset > end) {
+        offset = end;
+    }
+
+    size_t n = end - offset;
+    if (n > capacity) {
+        n = capacity;
+    }
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ring[(offset + i) % LOG_RING_BYTES];
+    }
+    portEXIT_CRITICAL(&ringMux);
+
+    return n;
+}
+
+void LogRing::append(const char* text, size_t length) {
+    portENTER_CRITICAL(&ringMux);
+    for (size_t i = 0; i < length; i++) {
+        ring[(writeOffset + i) % LOG_RING_BYTES] = text[i];
+    }
+    writeOffset += length;
+    portEXIT_CRITICAL(&ringMux);
+}
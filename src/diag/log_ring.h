@@ -0,0 +1,42 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <Arduino.h>
+#include "../config.h"
+
+/**
+ * Log sink for the app's modules: formats each line, keeps the most recent
+ * LOG_RING_BYTES of text in a ring and passes the line on to the framework
+ * Logger, which prints it to serial as before.
+ *
+ * Offsets count bytes logged since boot, so a reader can ask for "everything
+ * after offset N" and tell from the returned offset how much the ring has
+ * overwritten in between. Lines can come from any task.
+ */
+class LogRing {
+public:
+    static LogRing& getInstance();
+
+    void log(const char* format, ...);
+
+    // Offset of the next byte to be logged
+    uint32_t written() const;
+
+    // Copies up to capacity bytes from offset, but not past end. An offset
+    // the ring has already overwritten is moved up to the oldest byte held.
+    size_t read(uint32_t& offset, uint32_t end, char* out, size_t capacity) const;
+
+private:
+    LogRing();
+
+    // Prevent copying
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    char ring[LOG_RING_BYTES];
+    uint32_t writeOffset;
+
+    void append(const char* text, size_t length);
+};
+
+#endif // LOG_RING_H
@@ -0,0 +1,167 @@
+#include "metrics.h"
+
+// Static storage is zero-initialized, which is the reset state for every slot
+std::atomic<uint32_t> Metrics::counters[(size_t)Metrics::Counter::COUNT];
+std::atomic<int32_t> Metrics::gauges[(size_t)Metrics::Gauge::COUNT];
+Metrics::HistogramData Metrics::histograms[(size_t)Metrics::Histogram::COUNT];
+
+// Snapshot layout version; bump when the enums or encoding change
+static const uint8_t SNAPSHOT_VERSION = 3;
+static const size_t SNAPSHOT_HEADER_LEN = 8;
+static const size_t SNAPSHOT_LEN = SNAPSHOT_HEADER_LEN +
+                                   (size_t)Metrics::Counter::COUNT * 4 +
+                                   (size_t)Metrics::Gauge::COUNT * 4 +
+                                   (size_t)Metrics::Histogram::COUNT * (8 + Metrics::HISTOGRAM_BUCKETS * 2);
+
+static const char* const COUNTER_NAMES[] = {
+    "ble.connects", "ble.disconnects", "gatt.reads", "gatt.writes",
+    "notify.sent", "notify.failed", "config.flushes", "display.frames",
+    "relay.pulses", "heap.violations", "stalls", "gatt.throttled",
+    "gatt.kicked"
+};
+
+static const char* const GAUGE_NAMES[] = {
+    "ble.connected", "registry.devices", "heap.free", "heap.minFree",
+    "heap.largestBlock"
+};
+
+static const char* const HISTOGRAM_NAMES[] = {
+    "gatt.read", "gatt.write", "config.flush", "display.frame", "relay.latency",
+    "loop.iteration", "replay.event", "channels.read", "channel.read"
+};
+
+static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == (size_t)Metrics::Counter::COUNT,
+              "COUNTER_NAMES out of sync");
+static_assert(sizeof(GAUGE_NAMES) / sizeof(GAUGE_NAMES[0]) == (size_t)Metrics::Gauge::COUNT,
+              "GAUGE_NAMES out of sync");
+static_assert(sizeof(HISTOGRAM_NAMES) / sizeof(HISTOGRAM_NAMES[0]) == (size_t)Metrics::Histogram::COUNT,
+              "HISTOGRAM_NAMES out of sync");
+
+// Read in one go from the diagnostics characteristic (version 3 is exactly 512)
+static_assert(SNAPSHOT_LEN <= DIAG_SNAPSHOT_MAX_LEN,
+              "Metrics snapshot no longer fits DIAG_SNAPSHOT_MAX_LEN; drop a metric or page it");
+
+static uint8_t* putU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+    return out + 4;
+}
+
+static uint8_t* putU16Saturated(uint8_t* out, uint32_t value) {
+    if (value > 0xFFFF) {
+        value = 0xFFFF;
+    }
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    return out + 2;
+}
+
+uint32_t Metrics::getCounter(Counter c) {
+    return counters[(size_t)c].load(std::memory_order_relaxed);
+}
+
+int32_t Metrics::getGauge(Gauge g) {
+    return gauges[(size_t)g].load(std::memory_order_relaxed);
+}
+
+uint32_t Metrics::getCount(Histogram h) {
+    return histograms[(size_t)h].count.load(std::memory_order_relaxed);
+}
+
+uint32_t Metrics::getMax(Histogram h) {
+    return histograms[(size_t)h].maxUs.load(std::memory_order_relaxed);
+}
+
+uint32_t Metrics::percentile(Histogram h, uint32_t pct) {
+    const HistogramData& data = histograms[(size_t)h];
+    uint32_t total = data.count.load(std::memory_order_relaxed);
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = ((uint64_t)total * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += data.buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return i == 0 ? 0 : (1u << i) - 1;
+        }
+    }
+    return data.maxUs.load(std::memory_order_relaxed);
+}
+
+void Metrics::reset(Histogram h) {
+    HistogramData& data = histograms[(size_t)h];
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        data.buckets[i].store(0, std::memory_order_relaxed);
+    }
+    data.count.store(0, std::memory_order_relaxed);
+    data.maxUs.store(0, std::memory_order_relaxed);
+}
+
+size_t Metrics::snapshotSize() {
+    return SNAPSHOT_LEN;
+}
+
+size_t Metrics::snapshot(uint8_t* out, size_t capacity) {
+    size_t size = snapshotSize();
+    if (!out || capacity < size) {
+        return 0;
+    }
+
+    // Header: version, counter/gauge/histogram/bucket counts, uptime (ms)
+    uint8_t* p = out;
+    *p++ = SNAPSHOT_VERSION;
+    *p++ = (uint8_t)Counter::COUNT;
+    *p++ = (uint8_t)Gauge::COUNT;
+    *p++ = (uint8_t)Histogram::COUNT;
+    p = putU32(p, millis());
+
+    for (size_t i = 0; i < (size_t)Counter::COUNT; i++) {
+        p = putU32(p, counters[i].load(std::memory_order_relaxed));
+    }
+    for (size_t i = 0; i < (size_t)Gauge::COUNT; i++) {
+        p = putU32(p, (uint32_t)gauges[i].load(std::memory_order_relaxed));
+    }
+    for (size_t i = 0; i < (size_t)Histogram::COUNT; i++) {
+        const HistogramData& data = histograms[i];
+        p = putU32(p, data.count.load(std::memory_order_relaxed));
+        p = putU32(p, data.maxUs.load(std::memory_order_relaxed));
+        // Bucket counts saturate at 65535 to keep the snapshot within one ATT value
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            p = putU16Saturated(p, data.buckets[b].load(std::memory_order_relaxed));
+        }
+    }
+
+    return p - out;
+}
+
+void Metrics::dump(LogRing* logger) {
+    if (!logger) {
+        return;
+    }
+
+    logger->log("=== Metrics (uptime %lu ms) ===", millis());
+
+    for (size_t i = 0; i < (size_t)Counter::COUNT; i++) {
+        logger->log("  %-18s %u", COUNTER_NAMES[i], counters[i].load(std::memory_order_relaxed));
+    }
+    for (size_t i = 0; i < (size_t)Gauge::COUNT; i++) {
+        logger->log("  %-18s %d", GAUGE_NAMES[i], gauges[i].load(std::memory_order_relaxed));
+    }
+    for (size_t i = 0; i < (size_t)Histogram::COUNT; i++) {
+        const HistogramData& data = histograms[i];
+        uint32_t count = data.count.load(std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        Histogram h = (Histogram)i;
+        logger->log("  %-18s n=%u p50<=%u p90<=%u p99<=%u max=%u us",
+            HISTOGRAM_NAMES[i], count, percentile(h, 50), percentile(h, 90),
+            percentile(h, 99), data.maxUs.load(std::memory_order_relaxed));
+    }
+
+    logger->log("================================");
+}
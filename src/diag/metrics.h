@@ -0,0 +1,124 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "../config.h"
+#include "log_ring.h"
+
+/**
+ * Process-wide metrics: counters, gauges and log2 latency histograms.
+ *
+ * Every slot is a std::atomic updated with relaxed ordering, so recording
+ * from BLE callbacks, timers and the app loop needs no locks and costs a
+ * few atomic adds. Metric sets are fixed at compile time by the enums
+ * below; the binary snapshot layout follows enum order.
+ */
+class Metrics {
+public:
+    enum class Counter : uint8_t {
+        BLE_CONNECTS,
+        BLE_DISCONNECTS,
+        GATT_READS,
+        GATT_WRITES,
+        NOTIFY_SENT,
+        NOTIFY_FAILED,
+        CONFIG_FLUSHES,
+        DISPLAY_FRAMES,
+        RELAY_PULSES,
+        HEAP_VIOLATIONS,
+        STALLS,
+        GATT_THROTTLED,
+        GATT_ABUSE_DISCONNECTS,
+        COUNT
+    };
+
+    enum class Gauge : uint8_t {
+        CONNECTED,
+        REGISTERED_DEVICES,
+        FREE_HEAP,
+        MIN_FREE_HEAP,
+        LARGEST_FREE_BLOCK,
+        COUNT
+    };
+
+    enum class Histogram : uint8_t {
+        GATT_READ_US,
+        GATT_WRITE_US,
+        CONFIG_FLUSH_US,
+        DISPLAY_FRAME_US,
+        RELAY_LATENCY_US,
+        LOOP_ITERATION_US,
+        REPLAY_EVENT_US,
+        CHANNELS_READ_US,
+        CHANNEL_SINGLE_READ_US,
+        COUNT
+    };
+
+    // Bucket i holds samples in [2^(i-1), 2^i) us; the last bucket is open-ended
+    static const size_t HISTOGRAM_BUCKETS = 20;
+
+    static void increment(Counter c, uint32_t n = 1) {
+        counters[(size_t)c].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    static void setGauge(Gauge g, int32_t value) {
+        gauges[(size_t)g].store(value, std::memory_order_relaxed);
+    }
+
+    static void record(Histogram h, uint32_t us) {
+        HistogramData& data = histograms[(size_t)h];
+        size_t bucket = us ? 32 - __builtin_clz(us) : 0;
+        if (bucket >= HISTOGRAM_BUCKETS) {
+            bucket = HISTOGRAM_BUCKETS - 1;
+        }
+        data.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        data.count.fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t previous = data.maxUs.load(std::memory_order_relaxed);
+        while (us > previous &&
+               !data.maxUs.compare_exchange_weak(previous, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    static uint32_t getCounter(Counter c);
+    static int32_t getGauge(Gauge g);
+    static uint32_t getCount(Histogram h);
+    static uint32_t getMax(Histogram h);
+
+    // Upper bound (us) of the bucket holding the given percentile (0-100)
+    static uint32_t percentile(Histogram h, uint32_t pct);
+
+    // Clears one histogram; samples racing with the reset may be lost
+    static void reset(Histogram h);
+
+    // Compact little-endian snapshot; returns bytes written or 0 if it won't fit
+    static size_t snapshot(uint8_t* out, size_t capacity);
+    static size_t snapshotSize();
+
+    static void dump(LogRing* logger);
+
+    // Times a scope into a histogram
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Histogram h) : histogram(h), start(micros()) {}
+        ~ScopedTimer() { record(histogram, micros() - start); }
+
+    private:
+        Histogram histogram;
+        unsigned long start;
+    };
+
+private:
+    struct HistogramData {
+        std::atomic<uint32_t> buckets[HISTOGRAM_BUCKETS];
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> maxUs;
+    };
+
+    static std::atomic<uint32_t> counters[(size_t)Counter::COUNT];
+    static std::atomic<int32_t> gauges[(size_t)Gauge::COUNT];
+    static HistogramData histograms[(size_t)Histogram::COUNT];
+};
+
+#endif // METRICS_H
@@ -0,0 +1,308 @@
+#include "task_profiler.h"
+#include "metrics.h"
+#include <string.h>
+
+// Task table page layout version for the diagnostics characteristic
+static const uint8_t SNAPSHOT_VERSION = 1;
+static const size_t SNAPSHOT_HEADER_LEN = 14;
+static const size_t SNAPSHOT_TASK_LEN = PROFILER_TASK_NAME_LEN + 6;
+
+// Sentinel for CPU share when run-time stats are not compiled into FreeRTOS
+static const uint16_t CPU_UNKNOWN = 0xFFFF;
+
+static portMUX_TYPE profilerMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Sampler scratch; only touched from the sampler task
+static TaskStatus_t taskStatus[PROFILER_MAX_TASKS];
+static TaskProfiler::TaskInfo sampled[PROFILER_MAX_TASKS];
+
+TaskProfiler& TaskProfiler::getInstance() {
+    static TaskProfiler instance;
+    return instance;
+}
+
+TaskProfiler::TaskProfiler()
+    : logger(nullptr)
+    , samplerTask(nullptr)
+    , taskCount(0)
+    , previousCount(0)
+    , previousTotal(0)
+    , stallHead(0)
+    , stallTail(0)
+    , droppedStalls(0)
+    , lastLoopUs(0) {
+}
+
+bool TaskProfiler::begin(LogRing* log) {
+    logger = log;
+
+#if !configUSE_TRACE_FACILITY
+    if (logger) {
+        logger->log("ERROR: Task profiler needs configUSE_TRACE_FACILITY");
+    }
+    return false;
+#else
+#if !configGENERATE_RUN_TIME_STATS
+    if (logger) {
+        logger->log("Task profiler: run-time stats disabled, reporting stacks only");
+    }
+#endif
+
+    if (xTaskCreate(samplerTaskEntry, "Profiler", PROFILER_TASK_STACK, this,
+                    PROFILER_TASK_PRIORITY, &samplerTask) != pdPASS) {
+        if (logger) {
+            logger->log("ERROR: Failed to create profiler task");
+        }
+        return false;
+    }
+
+    if (logger) {
+        logger->log("Task profiler started (%u ms window, %u ms stall threshold)",
+            PROFILER_SAMPLE_INTERVAL_MS, PROFILER_STALL_THRESHOLD_MS);
+    }
+    return true;
+#endif
+}
+
+// ============================================================================
+// Stall Detection
+// ============================================================================
+
+void TaskProfiler::loopTick() {
+    unsigned long now = micros();
+    if (lastLoopUs != 0) {
+        uint32_t elapsed = now - lastLoopUs;
+        Metrics::record(Metrics::Histogram::LOOP_ITERATION_US, elapsed);
+        if (elapsed > PROFILER_STALL_THRESHOLD_MS * 1000UL) {
+            reportStall("loop", pcTaskGetName(nullptr), elapsed);
+        }
+    }
+    lastLoopUs = now;
+}
+
+TaskProfiler::StallCheck::~StallCheck() {
+    uint32_t elapsed = micros() - start;
+    if (elapsed > PROFILER_STALL_THRESHOLD_MS * 1000UL) {
+        TaskProfiler::getInstance().reportStall(where, pcTaskGetName(nullptr), elapsed);
+    }
+}
+
+void TaskProfiler::reportStall(const char* where, const char* task, uint32_t durationUs) {
+    Metrics::increment(Metrics::Counter::STALLS);
+
+    // Callers may be BLE or timer tasks; queue for the app loop to log
+    portENTER_CRITICAL(&profilerMux);
+    size_t next = (stallHead + 1) % PROFILER_MAX_PENDING_STALLS;
+    if (next == stallTail) {
+        droppedStalls++;
+    } else {
+        Stall& stall = stalls[stallHead];
+        stall.where = where;
+        strncpy(stall.task, task ? task : "?", sizeof(stall.task) - 1);
+        stall.task[sizeof(stall.task) - 1] = '\0';
+        stall.durationUs = durationUs;
+        stallHead = next;
+    }
+    portEXIT_CRITICAL(&profilerMux);
+}
+
+void TaskProfiler::update() {
+    while (true) {
+        Stall stall;
+
+        portENTER_CRITICAL(&profilerMux);
+        if (stallTail == stallHead) {
+            portEXIT_CRITICAL(&profilerMux);
+            break;
+        }
+        stall = stalls[stallTail];
+        stallTail = (stallTail + 1) % PROFILER_MAX_PENDING_STALLS;
+        portEXIT_CRITICAL(&profilerMux);
+
+        if (logger) {
+            logger->log("STALL: %s blocked %lu ms on task %s",
+                stall.where, stall.durationUs / 1000, stall.task);
+        }
+    }
+
+    if (droppedStalls && logger) {
+        logger->log("STALL: %u further stalls not logged", droppedStalls);
+        droppedStalls = 0;
+    }
+}
+
+// ============================================================================
+// Sampling
+// ============================================================================
+
+void TaskProfiler::samplerTaskEntry(void* param) {
+    TaskProfiler* self = static_cast<TaskProfiler*>(param);
+    const TickType_t period = pdMS_TO_TICKS(PROFILER_SAMPLE_INTERVAL_MS);
+    TickType_t lastWake = xTaskGetTickCount();
+
+    while (true) {
+        TickType_t due = lastWake + period;
+        vTaskDelayUntil(&lastWake, period);
+        TickType_t late = xTaskGetTickCount() - due;
+        self->sample(pdTICKS_TO_MS(late));
+    }
+}
+
+void TaskProfiler::sample(uint32_t wakeLatenessMs) {
+#if configUSE_TRACE_FACILITY
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(taskStatus, PROFILER_MAX_TASKS, &total);
+    if (count == 0) {
+        // More tasks than PROFILER_MAX_TASKS; keep the previous table
+        return;
+    }
+
+#if configGENERATE_RUN_TIME_STATS
+    // Run-time counters tick per core, the total is wall time
+    uint64_t window = (uint64_t)(total - previousTotal) * portNUM_PROCESSORS;
+#endif
+    const TaskInfo* busiest = nullptr;
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& status = taskStatus[i];
+        TaskInfo& info = sampled[i];
+
+        strncpy(info.name, status.pcTaskName, sizeof(info.name) - 1);
+        info.name[sizeof(info.name) - 1] = '\0';
+        info.priority = (uint8_t)status.uxCurrentPriority;
+        info.stackFreeBytes = status.usStackHighWaterMark * sizeof(StackType_t);
+#if configTASKLIST_INCLUDE_COREID
+        info.core = status.xCoreID == tskNO_AFFINITY ? -1 : (int8_t)status.xCoreID;
+#else
+        info.core = -1;
+#endif
+
+#if configGENERATE_RUN_TIME_STATS
+        info.cpuPermille = 0;
+        for (size_t p = 0; p < previousCount; p++) {
+            if (previousIds[p] == status.xTaskNumber) {
+                uint32_t used = status.ulRunTimeCounter - previousRuntime[p];
+                if (window > 0 && previousTotal != 0) {
+                    info.cpuPermille = (uint16_t)((uint64_t)used * 1000 / window);
+                }
+                break;
+            }
+        }
+
+        if (strncmp(info.name, "IDLE", 4) != 0 &&
+            (!busiest || info.cpuPermille > busiest->cpuPermille)) {
+            busiest = &info;
+        }
+#else
+        info.cpuPermille = CPU_UNKNOWN;
+#endif
+    }
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        previousIds[i] = taskStatus[i].xTaskNumber;
+        previousRuntime[i] = taskStatus[i].ulRunTimeCounter;
+    }
+    previousCount = count;
+    previousTotal = total;
+
+    portENTER_CRITICAL(&profilerMux);
+    memcpy(tasks, sampled, count * sizeof(TaskInfo));
+    taskCount = count;
+    portEXIT_CRITICAL(&profilerMux);
+
+    // Waking late at this priority means something above us held the CPU
+    if (wakeLatenessMs > PROFILER_STALL_THRESHOLD_MS) {
+        reportStall("profiler wake-up", busiest ? busiest->name : nullptr, wakeLatenessMs * 1000);
+    }
+#endif
+}
+
+// ============================================================================
+// Export
+// ============================================================================
+
+static uint8_t* putU16(uint8_t* out, uint32_t value) {
+    if (value > 0xFFFF) {
+        value = 0xFFFF;
+    }
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    return out + 2;
+}
+
+static uint8_t* putU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+    return out + 4;
+}
+
+size_t TaskProfiler::snapshot(uint8_t* out, size_t capacity) {
+    if (!out || capacity < SNAPSHOT_HEADER_LEN) {
+        return 0;
+    }
+
+    // Header: version, task count, loop p50/p99 (us), stall count
+    uint8_t* p = out;
+    uint8_t* countField = p + 1;
+    *p++ = SNAPSHOT_VERSION;
+    *p++ = 0;
+    p = putU32(p, Metrics::percentile(Metrics::Histogram::LOOP_ITERATION_US, 50));
+    p = putU32(p, Metrics::percentile(Metrics::Histogram::LOOP_ITERATION_US, 99));
+    p = putU32(p, Metrics::getCounter(Metrics::Counter::STALLS));
+
+    // Per task: name, core (-1 unpinned), priority, CPU permille, free stack bytes
+    uint8_t written = 0;
+    portENTER_CRITICAL(&profilerMux);
+    for (size_t i = 0; i < taskCount; i++) {
+        if ((size_t)(p - out) + SNAPSHOT_TASK_LEN > capacity) {
+            break;
+        }
+        const TaskInfo& info = tasks[i];
+        memcpy(p, info.name, PROFILER_TASK_NAME_LEN);
+        p += PROFILER_TASK_NAME_LEN;
+        *p++ = (uint8_t)info.core;
+        *p++ = info.priority;
+        p = putU16(p, info.cpuPermille);
+        p = putU16(p, info.stackFreeBytes);
+        written++;
+    }
+    portEXIT_CRITICAL(&profilerMux);
+
+    *countField = written;
+    return p - out;
+}
+
+void TaskProfiler::dump() {
+    if (!logger) {
+        return;
+    }
+
+    static TaskInfo copy[PROFILER_MAX_TASKS];
+    size_t count;
+
+    portENTER_CRITICAL(&profilerMux);
+    count = taskCount;
+    memcpy(copy, tasks, count * sizeof(TaskInfo));
+    portEXIT_CRITICAL(&profilerMux);
+
+    logger->log("=== Tasks (%u) ===", count);
+    logger->log("  %-12s core prio   cpu  stack", "name");
+    for (size_t i = 0; i < count; i++) {
+        const TaskInfo& info = copy[i];
+        if (info.cpuPermille == CPU_UNKNOWN) {
+            logger->log("  %-12s %4d %4u     -  %5u",
+                info.name, info.core, info.priority, info.stackFreeBytes);
+        } else {
+            logger->log("  %-12s %4d %4u %3u.%u%% %5u",
+                info.name, info.core, info.priority,
+                info.cpuPermille / 10, info.cpuPermille % 10, info.stackFreeBytes);
+        }
+    }
+    logger->log("  loop p50<=%u p99<=%u us, %u stalls",
+        Metrics::percentile(Metrics::Histogram::LOOP_ITERATION_US, 50),
+        Metrics::percentile(Metrics::Histogram::LOOP_ITERATION_US, 99),
+        Metrics::getCounter(Metrics::Counter::STALLS));
+    logger->log("==================");
+}
@@ -0,0 +1,99 @@
+#ifndef TASK_PROFILER_H
+#define TASK_PROFILER_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "log_ring.h"
+
+/**
+ * Sampling task profiler and stall detector.
+ *
+ * A small task wakes every PROFILER_SAMPLE_INTERVAL_MS and diffs FreeRTOS
+ * run-time counters to get per-task CPU share, alongside stack high-water
+ * marks. Stalls are detected three ways:
+ *   - an app loop iteration longer than PROFILER_STALL_THRESHOLD_MS
+ *   - the sampler waking late (a higher-priority task hogged the CPU);
+ *     the busiest task in that window is blamed
+ *   - a StallCheck scope (e.g. a BLE callback) running over the threshold
+ * Stalls are queued without logging and reported from the app loop.
+ */
+class TaskProfiler {
+public:
+    struct TaskInfo {
+        char name[PROFILER_TASK_NAME_LEN];
+        int8_t core;             // -1 when not pinned
+        uint8_t priority;
+        uint16_t cpuPermille;    // share of total CPU time over the last window
+        uint32_t stackFreeBytes; // high-water mark
+    };
+
+    static TaskProfiler& getInstance();
+
+    bool begin(LogRing* log);
+
+    // Call once per app loop iteration; times the interval since the last call
+    void loopTick();
+
+    // Excludes time the loop spent deliberately asleep from the current iteration
+    void excludeIdle(uint32_t us) { lastLoopUs += us; }
+
+    // Report deferred stalls; call from the app loop
+    void update();
+
+    void dump();
+
+    // Compact task table for the diagnostics characteristic
+    size_t snapshot(uint8_t* out, size_t capacity);
+
+    // Flags the enclosing scope as a stall if it runs over the threshold
+    class StallCheck {
+    public:
+        explicit StallCheck(const char* where) : where(where), start(micros()) {}
+        ~StallCheck();
+
+    private:
+        const char* where;
+        unsigned long start;
+    };
+
+    void reportStall(const char* where, const char* task, uint32_t durationUs);
+
+private:
+    TaskProfiler();
+
+    // Prevent copying
+    TaskProfiler(const TaskProfiler&) = delete;
+    TaskProfiler& operator=(const TaskProfiler&) = delete;
+
+    struct Stall {
+        const char* where;
+        char task[PROFILER_TASK_NAME_LEN];
+        uint32_t durationUs;
+    };
+
+    LogRing* logger;
+    TaskHandle_t samplerTask;
+
+    // Published results of the last sample (guarded by a spinlock)
+    TaskInfo tasks[PROFILER_MAX_TASKS];
+    size_t taskCount;
+
+    // Previous run-time counters, matched by task number
+    UBaseType_t previousIds[PROFILER_MAX_TASKS];
+    uint32_t previousRuntime[PROFILER_MAX_TASKS];
+    size_t previousCount;
+    uint32_t previousTotal;
+
+    // Deferred stall ring
+    Stall stalls[PROFILER_MAX_PENDING_STALLS];
+    volatile size_t stallHead;
+    size_t stallTail;
+    volatile uint32_t droppedStalls;
+
+    unsigned long lastLoopUs;
+
+    void sample(uint32_t wakeLatenessMs);
+    static void samplerTaskEntry(void* param);
+};
+
+#endif // TASK_PROFILER_H
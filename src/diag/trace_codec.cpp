@@ -0,0 +1,147 @@
+#include "trace_codec.h"
+#include <string.h>
+
+static_assert(EVENT_TRACE_MAX_PAYLOAD <= 0xFFFF, "GATT_WRITE lengths are u16");
+
+// ============================================================================
+// Encoding
+// ============================================================================
+
+size_t TraceCodec::storedLength(size_t length) {
+    return length < EVENT_TRACE_MAX_PAYLOAD ? length : EVENT_TRACE_MAX_PAYLOAD;
+}
+
+void TraceCodec::encodeHeader(const Header& header, uint8_t* out) {
+    uint32_t magic = MAGIC;
+    memcpy(out, &magic, 4);
+    memcpy(out + 4, &header.counter, 4);
+    out[8] = header.pairing ? 1 : 0;
+    memcpy(out + 9, &header.deviceCount, 2);
+}
+
+bool TraceCodec::decodeHeader(const uint8_t* in, Header& header) {
+    uint32_t magic;
+    memcpy(&magic, in, 4);
+    if (magic != MAGIC) {
+        return false;
+    }
+    memcpy(&header.counter, in + 4, 4);
+    header.pairing = in[8] != 0;
+    memcpy(&header.deviceCount, in + 9, 2);
+    return true;
+}
+
+size_t TraceCodec::encode(const Record& record, int64_t& previousUs, uint8_t* out) {
+    size_t n = 0;
+    out[n++] = (uint8_t)record.type | ((uint8_t)record.target << 4);
+
+    uint64_t dt = record.timeUs > previousUs ? (uint64_t)(record.timeUs - previousUs) : 0;
+    previousUs = record.timeUs;
+    do {
+        out[n++] = (uint8_t)(dt & 0x7F) | (dt > 0x7F ? 0x80 : 0);
+        dt >>= 7;
+    } while (dt);
+
+    switch (record.type) {
+        case Type::CONNECT:
+            memcpy(out + n, record.data, 6);
+            n += 6;
+            break;
+        case Type::GATT_WRITE: {
+            size_t stored = storedLength(record.length);
+            out[n++] = record.length & 0xFF;
+            out[n++] = record.length >> 8;
+            memcpy(out + n, record.data, stored);
+            n += stored;
+            break;
+        }
+        case Type::BUTTON_CLICK:
+        case Type::BUTTON_LONG_PRESS:
+            out[n++] = record.data[0];
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+TraceReader::TraceReader(TraceSource& source)
+    : source(source)
+    , timeUs(0)
+    , corrupt(false)
+    , truncatedSkipped(0) {
+}
+
+void TraceReader::reset() {
+    timeUs = 0;
+    corrupt = false;
+    truncatedSkipped = 0;
+}
+
+bool TraceReader::next(TraceCodec::Record& record) {
+    while (decode(record)) {
+        // Only the head of this write was recorded
+        if (record.type == TraceCodec::Type::GATT_WRITE && record.length > EVENT_TRACE_MAX_PAYLOAD) {
+            truncatedSkipped++;
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TraceReader::decode(TraceCodec::Record& record) {
+    uint8_t byte;
+    if (source.read(&byte, 1) != 1) {
+        return false;
+    }
+    record.type = (TraceCodec::Type)(byte & 0x0F);
+    record.target = (TraceCodec::Target)(byte >> 4);
+    if (record.type == (TraceCodec::Type)0 || record.type >= TraceCodec::Type::COUNT) {
+        corrupt = true;
+        return false;
+    }
+
+    uint64_t dt = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (source.read(&byte, 1) != 1) {
+            return false;
+        }
+        dt |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    timeUs += (int64_t)dt;
+    record.timeUs = timeUs;
+
+    size_t length = 0;
+    switch (record.type) {
+        case TraceCodec::Type::CONNECT:
+            length = 6;
+            break;
+        case TraceCodec::Type::GATT_WRITE: {
+            uint8_t prefix[2];
+            if (source.read(prefix, 2) != 2) {
+                return false;
+            }
+            record.length = prefix[0] | (prefix[1] << 8);
+            length = TraceCodec::storedLength(record.length);
+            break;
+        }
+        case TraceCodec::Type::BUTTON_CLICK:
+        case TraceCodec::Type::BUTTON_LONG_PRESS:
+            length = 1;
+            break;
+        default:
+            break;
+    }
+    if (record.type != TraceCodec::Type::GATT_WRITE) {
+        record.length = (uint16_t)length;
+    }
+    return source.read(record.data, length) == length;
+}
@@ -0,0 +1,121 @@
+#ifndef TRACE_CODEC_H
+#define TRACE_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../config.h"
+
+/**
+ * Event trace file format, shared by EventTrace's recorder and replayer.
+ *
+ * Layout (little-endian):
+ *   header:  magic u32, counter i32, pairing u8, count u16, count x mac[6]
+ *   record:  type u8 (low nibble) | target << 4, dt varint (us since the
+ *            previous record), then per type: mac[6] for CONNECT,
+ *            length u16 + bytes for GATT_WRITE, button u8 for BUTTON_*
+ *
+ * GATT_WRITE stores the length that was written but at most
+ * EVENT_TRACE_MAX_PAYLOAD bytes of it. TraceReader skips such a truncated
+ * write, since a cut-off registry or channel write would not do the same
+ * thing, and counts how many it skipped.
+ *
+ * Plain C++ with no platform calls, so a recorded trace can be decoded and
+ * replayed off-target from a buffer.
+ */
+class TraceCodec {
+public:
+    enum class Type : uint8_t {
+        CONNECT = 1,
+        DISCONNECT,
+        GATT_READ,
+        GATT_WRITE,
+        BUTTON_CLICK,
+        BUTTON_LONG_PRESS,
+        COUNT
+    };
+
+    enum class Target : uint8_t {
+        NONE,
+        COUNTER,
+        GATE,
+        REGISTRY,
+        CHANNELS
+    };
+
+    struct Record {
+        int64_t timeUs;
+        Type type;
+        Target target;
+        uint16_t length;    // as written; data holds at most EVENT_TRACE_MAX_PAYLOAD
+        uint8_t data[EVENT_TRACE_MAX_PAYLOAD];
+    };
+
+    // Starting state; the MACs follow the header in the file
+    struct Header {
+        int32_t counter;
+        bool pairing;
+        uint16_t deviceCount;
+    };
+
+    // Bump MAGIC when the header or record layout changes ("ETR3")
+    static const uint32_t MAGIC = 0x33525445;
+    static const size_t HEADER_LEN = 4 + 4 + 1 + 2;
+
+    // Largest encoded record: type, 10-byte varint, length u16, payload
+    static const size_t MAX_RECORD_BYTES = 1 + 10 + 2 + EVENT_TRACE_MAX_PAYLOAD;
+
+    // Bytes of a write of this length that a record holds
+    static size_t storedLength(size_t length);
+
+    static void encodeHeader(const Header& header, uint8_t* out);
+
+    // False if the magic doesn't match
+    static bool decodeHeader(const uint8_t* in, Header& header);
+
+    // Encodes the time relative to previousUs, which is moved up to the
+    // record's time; out must hold MAX_RECORD_BYTES
+    static size_t encode(const Record& record, int64_t& previousUs, uint8_t* out);
+};
+
+/**
+ * Byte source a trace is decoded from (the trace file on the device).
+ */
+class TraceSource {
+public:
+    virtual ~TraceSource() {}
+
+    // Returns fewer than length bytes only at the end of the trace
+    virtual size_t read(uint8_t* buffer, size_t length) = 0;
+};
+
+/**
+ * Decodes the records after the header, in order, with times rebuilt from
+ * the deltas. Truncated writes are skipped here, so every record next()
+ * returns can be replayed as recorded.
+ */
+class TraceReader {
+public:
+    explicit TraceReader(TraceSource& source);
+
+    // Starts again at the first record; the source must be positioned there
+    void reset();
+
+    // False at the end of the trace or on a corrupt record
+    bool next(TraceCodec::Record& record);
+
+    bool isCorrupt() const { return corrupt; }
+    uint32_t getTruncatedSkipped() const { return truncatedSkipped; }
+
+    // Trace time of the last record read, skipped ones included
+    int64_t getTimeUs() const { return timeUs; }
+
+private:
+    TraceSource& source;
+    int64_t timeUs;
+    bool corrupt;
+    uint32_t truncatedSkipped;
+
+    bool decode(TraceCodec::Record& record);
+};
+
+#endif // TRACE_CODEC_H
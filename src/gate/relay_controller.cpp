@@ -0,0 +1,121 @@
+#include "relay_controller.h"
+#include "../diag/metrics.h"
+#include "../telemetry/mqtt_bridge.h"
+
+static const char* sourceName(RelaySource source) {
+    switch (source) {
+        case RelaySource::AUTHORIZED_CONNECT: return "authorized connect";
+        case RelaySource::GATE_COMMAND:       return "gate command";
+        case RelaySource::BUTTON:             return "button";
+    }
+    return "unknown";
+}
+
+RelayController& RelayController::getInstance() {
+    static RelayController instance;
+    return instance;
+}
+
+RelayController::RelayController()
+    : logger(nullptr)
+    , initialized(false)
+    , pulse(driver, RELAY_PULSE_MS, RELAY_LOCKOUT_MS)
+    , pulseCount(0)
+    , lockoutRejects(0)
+    , lastLatencyUs(0)
+    , lastSource(RelaySource::AUTHORIZED_CONNECT)
+    , reportedPulses(0)
+    , reportedRejects(0) {
+}
+
+bool RelayController::begin(LogRing* log) {
+    if (!log) {
+        return false;
+    }
+
+    logger = log;
+
+#if RELAY_ENABLED
+    if (initialized) {
+        return true;
+    }
+
+    if (!pulse.begin()) {
+        logger->log("ERROR: Relay pulse timer creation failed");
+        return false;
+    }
+
+    initialized = true;
+    logger->log("Relay on GPIO %d: pulse %d ms, lockout %d ms", PIN_RELAY, RELAY_PULSE_MS, RELAY_LOCKOUT_MS);
+#else
+    logger->log("Relay output disabled");
+#endif
+
+    return true;
+}
+
+bool RelayController::trigger(RelaySource source, int64_t eventTimeUs) {
+    if (!initialized) {
+        return false;
+    }
+
+    int64_t now;
+    if (!pulse.trigger(now)) {
+        lockoutRejects++;
+        return false;
+    }
+
+    uint32_t elapsed = (uint32_t)(now - eventTimeUs);
+    Metrics::record(Metrics::Histogram::RELAY_LATENCY_US, elapsed);
+    Metrics::increment(Metrics::Counter::RELAY_PULSES);
+    lastLatencyUs = elapsed;
+    lastSource = source;
+    pulseCount++;
+
+    return true;
+}
+
+// ============================================================================
+// GPIO and esp_timer
+// ============================================================================
+
+bool RelayController::GpioDriver::begin(PulseEndCallback onPulseEnd, void* arg) {
+    setOutput(false);
+    pinMode(PIN_RELAY, OUTPUT);
+
+    esp_timer_create_args_t args = {};
+    args.callback = onPulseEnd;
+    args.arg = arg;
+    args.name = "relay";
+    return esp_timer_create(&args, &timer) == ESP_OK;
+}
+
+void RelayController::GpioDriver::setOutput(bool on) {
+    digitalWrite(PIN_RELAY, (on == RELAY_ACTIVE_HIGH) ? HIGH : LOW);
+}
+
+void RelayController::GpioDriver::startPulseTimer(uint64_t delayUs) {
+    esp_timer_start_once(timer, delayUs);
+}
+
+void RelayController::update() {
+    if (!initialized) {
+        return;
+    }
+
+    uint32_t pulses = pulseCount;
+    if (pulses != reportedPulses) {
+        logger->log("Relay pulsed by %s (event to GPIO: %u us, total pulses: %u)%s",
+            sourceName(lastSource), lastLatencyUs, pulses, pulse.isDryRun() ? " [dry run]" : "");
+        if (!pulse.isDryRun()) {
+            MqttBridge::getInstance().record(TelemetryEvent::ACCESS_GRANTED, (int32_t)lastSource);
+        }
+        reportedPulses = pulses;
+    }
+
+    uint32_t rejects = lockoutRejects;
+    if (rejects != reportedRejects) {
+        logger->log("Relay trigger ignored during lockout (%u total)", rejects);
+        reportedRejects = rejects;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef RELAY_CONTROLLER_H
+#define RELAY_CONTROLLER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "../config.h"
+#include "../diag/log_ring.h"
+#include "relay_pulse.h"
+
+enum class RelaySource : uint8_t {
+    AUTHORIZED_CONNECT,
+    GATE_COMMAND,
+    BUTTON
+};
+
+/**
+ * Gate relay output.
+ *
+ * trigger() is the fast path: it is safe to call straight from BLE
+ * callbacks, drives the GPIO immediately and hands the pulse end to an
+ * esp_timer, so actuation never waits on the loop, display or logging.
+ * After a pulse starts, further triggers are ignored for the lockout time
+ * (RelayPulse; the GPIO and timer sit behind RelayDriver).
+ * Event-to-GPIO latency goes to Metrics::Histogram::RELAY_LATENCY_US;
+ * logging of what happened is deferred to update() on the app loop.
+ */
+class RelayController {
+public:
+    static RelayController& getInstance();
+
+    bool begin(LogRing* log);
+
+    // eventTimeUs: esp_timer_get_time() when the triggering event arrived
+    bool trigger(RelaySource source, int64_t eventTimeUs);
+
+    bool isActive() const { return pulse.isActive(); }
+
+    // Dry run keeps timing, lockout and metrics but never drives the GPIO
+    // (event replay)
+    void setDryRun(bool enabled) { pulse.setDryRun(enabled); }
+    bool isLockedOut() const { return pulse.isLockedOut(); }
+
+    // Deferred logging of pulses and rejected triggers (app loop)
+    void update();
+
+private:
+    RelayController();
+
+    // Prevent copying
+    RelayController(const RelayController&) = delete;
+    RelayController& operator=(const RelayController&) = delete;
+
+    class GpioDriver : public RelayDriver {
+    public:
+        GpioDriver() : timer(nullptr) {}
+        bool begin(PulseEndCallback onPulseEnd, void* arg) override;
+        void setOutput(bool on) override;
+        int64_t nowUs() override { return esp_timer_get_time(); }
+        void startPulseTimer(uint64_t delayUs) override;
+    private:
+        esp_timer_handle_t timer;
+    };
+
+    LogRing* logger;
+    bool initialized;
+    GpioDriver driver;
+    RelayPulse pulse;
+
+    // Written on the fast path, drained by update()
+    volatile uint32_t pulseCount;
+    volatile uint32_t lockoutRejects;
+    volatile uint32_t lastLatencyUs;
+    volatile RelaySource lastSource;
+    uint32_t reportedPulses;
+    uint32_t reportedRejects;
+};
+
+#endif // RELAY_CONTROLLER_H
@@ -0,0 +1,56 @@
+#include "relay_pulse.h"
+
+RelayPulse::RelayPulse(RelayDriver& driver, uint32_t pulseMs, uint32_t lockoutMs)
+    : driver(driver)
+    , pulseUs((int64_t)pulseMs * 1000)
+    , lockoutUs((int64_t)lockoutMs * 1000)
+    , mux(portMUX_INITIALIZER_UNLOCKED)
+    , active(false)
+    , dryRun(false)
+    , lastPulseStartUs(0) {
+}
+
+bool RelayPulse::begin() {
+    return driver.begin(pulseEndCallback, this);
+}
+
+bool RelayPulse::isLockedOut() const {
+    return lastPulseStartUs != 0 && driver.nowUs() - lastPulseStartUs < lockoutUs;
+}
+
+bool RelayPulse::trigger(int64_t& startUs) {
+    portENTER_CRITICAL(&mux);
+    int64_t now = driver.nowUs();
+    bool locked = active || (lastPulseStartUs != 0 && now - lastPulseStartUs < lockoutUs);
+    if (!locked) {
+        setOutput(true);
+        active = true;
+        lastPulseStartUs = now;
+    }
+    portEXIT_CRITICAL(&mux);
+
+    if (locked) {
+        return false;
+    }
+
+    // Pulse end runs from the driver's timer, independent of the caller
+    driver.startPulseTimer((uint64_t)pulseUs);
+    startUs = now;
+    return true;
+}
+
+void RelayPulse::pulseEndCallback(void* arg) {
+    RelayPulse* pulse = static_cast<RelayPulse*>(arg);
+
+    portENTER_CRITICAL(&pulse->mux);
+    pulse->setOutput(false);
+    pulse->active = false;
+    portEXIT_CRITICAL(&pulse->mux);
+}
+
+void RelayPulse::setOutput(bool on) {
+    if (dryRun && on) {
+        return;
+    }
+    driver.setOutput(on);
+}
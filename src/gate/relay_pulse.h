@@ -0,0 +1,62 @@
+#ifndef RELAY_PULSE_H
+#define RELAY_PULSE_H
+
+#include <Arduino.h>
+
+/**
+ * Output, clock and one-shot timer a RelayPulse drives. The firmware
+ * implementation is a GPIO plus an esp_timer (RelayController); host tests
+ * plug in a fake with a manual clock.
+ */
+class RelayDriver {
+public:
+    typedef void (*PulseEndCallback)(void* arg);
+
+    virtual ~RelayDriver() {}
+
+    // Drives the output off and sets up the timer that calls onPulseEnd
+    virtual bool begin(PulseEndCallback onPulseEnd, void* arg) = 0;
+    virtual void setOutput(bool on) = 0;
+    virtual int64_t nowUs() = 0;
+    virtual void startPulseTimer(uint64_t delayUs) = 0;
+};
+
+/**
+ * Pulse and lockout timing for the gate relay.
+ *
+ * trigger() turns the output on and arms the driver's timer to turn it off
+ * pulseMs later. Further triggers are refused while the pulse runs and
+ * until lockoutMs after it started. Safe to call from any task; the pulse
+ * end runs from the driver's timer.
+ */
+class RelayPulse {
+public:
+    RelayPulse(RelayDriver& driver, uint32_t pulseMs, uint32_t lockoutMs);
+
+    bool begin();
+
+    // Returns false if refused; on success startUs is when the output went on
+    bool trigger(int64_t& startUs);
+
+    bool isActive() const { return active; }
+    bool isLockedOut() const;
+
+    // Dry run keeps timing and lockout but never turns the output on
+    void setDryRun(bool enabled) { dryRun = enabled; }
+    bool isDryRun() const { return dryRun; }
+
+private:
+    RelayDriver& driver;
+    const int64_t pulseUs;
+    const int64_t lockoutUs;
+    portMUX_TYPE mux;
+
+    volatile bool active;
+    volatile bool dryRun;
+    volatile int64_t lastPulseStartUs;
+
+    void setOutput(bool on);
+    static void pulseEndCallback(void* arg);
+};
+
+#endif // RELAY_PULSE_H
@@ -5,52 +5,100 @@
 #include <Arduino.h>
 #include "CounterModule.h"
 #include "logger/Logger.h"
+#include "../config.h"
+#include "../diag/metrics.h"
+#include "../diag/jitter_bench.h"
+#include "../diag/input_trace.h"
+#include <esp_timer.h>
 
 CounterModule::CounterModule(Logger* logger)
-    : Module("CounterModule", logger, 4096, 2), lastUpdateTime(0) {
+    : Module("CounterModule", logger, COUNTER_MODULE_TASK_STACK, TASK_PRIORITY_RENDER), renderTask(nullptr) {
 }
 
 CounterModule::~CounterModule() {
+    // Stop the bus from notifying a task that is about to go away
+    StateBus::getInstance().unsubscribe(this);
+    if (renderTask) {
+        vTaskDelete(renderTask);
+    }
 }
 
 void CounterModule::setup() {
     _logger->log("CounterModule: Module setup");
 
-    if (region) {
-        region->clear(TFT_BLACK);
-        draw();
-        region->refresh();
+    if (!region) {
+        return;
+    }
+
+    // The framework doesn't let a module choose its core, so drawing runs on
+    // a render task of our own, pinned away from the BLE host
+    if (xTaskCreatePinnedToCore(renderTaskEntry, "Render", RENDER_TASK_STACK, this,
+                                TASK_PRIORITY_RENDER, &renderTask, CORE_RENDER) != pdPASS) {
+        _logger->log("ERROR: CounterModule failed to start render task");
+        renderTask = nullptr;
+        return;
     }
 
-    lastUpdateTime = millis();
+    // Only the main counter is drawn, so other channels don't cost a frame
+    StateBus::getInstance().subscribe(this, StateBus::ALL & ~StateBus::CHANNELS,
+                                      StateBus::Delivery::IMMEDIATE);
 }
 
 void CounterModule::loop() {
-    if (!region) {
-        return;
-    }
+    // Everything on screen is driven by StateBus, so the framework task has
+    // nothing left to do once setup() has started the render task; park it
+    // rather than waking it on a timer
+    vTaskSuspend(nullptr);
+}
 
-    unsigned long currentTime = millis();
-    if (currentTime - lastUpdateTime > 500) {
-        draw();
-        lastUpdateTime = currentTime;
-        region->refresh();
+void CounterModule::handleEvent(const ModuleEvent& event) {
+    // Timer ticks used to force a redraw; state changes now cover every field
+}
+
+void CounterModule::onStateChanged(uint32_t fields, uint32_t version) {
+    if (renderTask) {
+        xTaskNotifyGive(renderTask);
     }
 }
 
-void CounterModule::handleEvent(const ModuleEvent& event) {
-    switch (event.type) {
-        case ModuleEventType::TIMER_TICK:
+// ============================================================================
+// Render Task
+// ============================================================================
+
+void CounterModule::renderTaskEntry(void* param) {
+    static_cast<CounterModule*>(param)->renderLoop();
+}
+
+void CounterModule::renderLoop() {
+    region->clear(TFT_BLACK);
+    draw();
+
+    while (true) {
+#if JITTER_BENCH_ENABLED
+        if (JitterBench::phase() == JitterBench::Phase::FULL_RATE) {
             draw();
-            break;
-        default:
-            break;
+            // One tick so the idle task still runs on this core
+            vTaskDelay(1);
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(DISPLAY_UPDATE_INTERVAL_MS));
+        }
+        continue;
+#endif
+
+        // Sleep until something on screen changes; notifications that land
+        // mid-frame coalesce into the next one
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        draw();
     }
 }
 
 void CounterModule::draw() {
     if (!region) return;
 
+    Metrics::ScopedTimer timer(Metrics::Histogram::DISPLAY_FRAME_US);
+    Metrics::increment(Metrics::Counter::DISPLAY_FRAMES);
+    int64_t frameStartUs = esp_timer_get_time();
+
     region->clear(TFT_BLACK);
 
     int16_t x = 10;
@@ -107,6 +155,7 @@ void CounterModule::draw() {
     }
 
     region->refresh();
+    InputTrace::framePushed(frameStartUs);
 }
 
 #endif
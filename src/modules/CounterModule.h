@@ -7,8 +7,9 @@
 #include "modules/Module.h"
 #include "../app/counter_app.h"
 #include "../ble/ble_manager.h"
+#include "../app/state_bus.h"
 
-class CounterModule : public Module {
+class CounterModule : public Module, public StateObserver {
 public:
     CounterModule(Logger* logger);
     ~CounterModule();
@@ -18,10 +19,15 @@ protected:
     void loop() override;
     void handleEvent(const ModuleEvent& event) override;
 
+    // Called on the publishing task; only wakes the render task
+    void onStateChanged(uint32_t fields, uint32_t version) override;
+
 private:
-    unsigned long lastUpdateTime;
+    TaskHandle_t renderTask;
 
     void draw();
+    void renderLoop();
+    static void renderTaskEntry(void* param);
 };
 
 #endif
@@ -0,0 +1,249 @@
+#include "power_manager.h"
+#include "../ble/ble_manager.h"
+#include "../sensors/sensor_sampler.h"
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+
+static const char* const STATE_NAMES[] = { "active", "dimmed", "idle" };
+static const uint32_t STATE_CURRENT_MA[] = {
+    POWER_EST_ACTIVE_MA, POWER_EST_DIMMED_MA, POWER_EST_IDLE_MA
+};
+
+static_assert(sizeof(STATE_NAMES) / sizeof(STATE_NAMES[0]) == (size_t)PowerState::COUNT,
+              "STATE_NAMES out of sync");
+
+PowerManager& PowerManager::getInstance() {
+    static PowerManager instance;
+    return instance;
+}
+
+PowerManager::PowerManager()
+    : logger(nullptr)
+    , state(PowerState::ACTIVE)
+    , activeBacklight(BACKLIGHT_FULL)
+    , activityPending(false)
+    , stepDownTimer([](void* arg) { static_cast<PowerManager*>(arg)->stepDown(); }, this)
+    , frequencyScaling(false)
+    , lightSleep(false)
+    , lightSleepSupported(true)
+    , stateSinceUs(0) {
+    memset(residencyUs, 0, sizeof(residencyUs));
+}
+
+bool PowerManager::begin(LogRing* log) {
+    logger = log;
+
+#if POWER_MANAGEMENT_ENABLED
+#if HAS_DISPLAY
+    // The panel driver leaves the backlight pin alone (pin_bl = -1), so the
+    // LEDC channel is ours; this takes the pin over from plain GPIO
+    ledcSetup(LCD_BL_PWM_CHANNEL, LCD_BL_PWM_FREQ, 8);
+    ledcAttachPin(PIN_LCD_BL, LCD_BL_PWM_CHANNEL);
+#endif
+
+#if HAS_BUTTONS
+    // Buttons are active low; either one wakes the chip from light sleep
+    gpio_wakeup_enable((gpio_num_t)PIN_BUTTON_1, GPIO_INTR_LOW_LEVEL);
+    gpio_wakeup_enable((gpio_num_t)PIN_BUTTON_2, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+#endif
+
+    esp_pm_config_esp32s3_t pm;
+    pm.max_freq_mhz = POWER_ACTIVE_MAX_MHZ;
+    pm.min_freq_mhz = POWER_ACTIVE_MIN_MHZ;
+    pm.light_sleep_enable = false;
+    frequencyScaling = esp_pm_configure(&pm) == ESP_OK;
+    if (!frequencyScaling) {
+        logger->log("Power: frequency scaling not in this build, using fixed CPU steps");
+    }
+
+    if (!StateBus::getInstance().subscribe(this, StateBus::ALL, StateBus::Delivery::APP_LOOP)) {
+        logger->log("ERROR: Power manager could not subscribe to state changes");
+        return false;
+    }
+
+    stateSinceUs = esp_timer_get_time();
+    setBacklight(activeBacklight);
+    TimerWheel::getInstance().arm(stepDownTimer, POWER_DIM_TIMEOUT_MS);
+
+    logger->log("Power manager started (dim after %u s, idle after %u s)",
+        POWER_DIM_TIMEOUT_MS / 1000, POWER_IDLE_TIMEOUT_MS / 1000);
+#endif
+    return true;
+}
+
+// ============================================================================
+// Activity
+// ============================================================================
+
+bool PowerManager::noteActivity() {
+    bool blanked = state == PowerState::IDLE;
+    activityPending.store(true);
+    TimerWheel::getInstance().wake();
+    return blanked;
+}
+
+void PowerManager::update() {
+    if (activityPending.exchange(false)) {
+        onActivity();
+    }
+}
+
+void PowerManager::onStateChanged(uint32_t fields, uint32_t version) {
+    onActivity();
+}
+
+void PowerManager::onActivity() {
+#if POWER_MANAGEMENT_ENABLED
+    if (state == PowerState::ACTIVE) {
+        // Still active; push the dim deadline out
+        TimerWheel::getInstance().arm(stepDownTimer, POWER_DIM_TIMEOUT_MS);
+        return;
+    }
+    enter(PowerState::ACTIVE);
+#endif
+}
+
+void PowerManager::stepDown() {
+    if (state == PowerState::ACTIVE) {
+        enter(PowerState::DIMMED);
+    } else if (state == PowerState::DIMMED) {
+        enter(PowerState::IDLE);
+    }
+}
+
+// ============================================================================
+// Transitions
+// ============================================================================
+
+void PowerManager::enter(PowerState next) {
+    if (next == state) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    residencyUs[(size_t)state] += now - stateSinceUs;
+    stateSinceUs = now;
+
+    PowerState previous = state;
+    state = next;
+
+    switch (next) {
+        case PowerState::ACTIVE:
+            setBacklight(activeBacklight);
+            if (previous == PowerState::IDLE) {
+                applyCpuPolicy(false);
+                BLEManager::getInstance().setAdvertisingInterval(BLE_ADV_INTERVAL_MS);
+                SensorSampler::getInstance().setIdle(false);
+            }
+            TimerWheel::getInstance().arm(stepDownTimer, POWER_DIM_TIMEOUT_MS);
+            break;
+
+        case PowerState::DIMMED:
+            setBacklight(dimmedBacklight());
+            TimerWheel::getInstance().arm(stepDownTimer, POWER_IDLE_TIMEOUT_MS - POWER_DIM_TIMEOUT_MS);
+            break;
+
+        case PowerState::IDLE:
+            setBacklight(0);
+            applyCpuPolicy(true);
+            BLEManager::getInstance().setAdvertisingInterval(POWER_IDLE_ADV_INTERVAL_MS);
+            // A running ADC DMA holds the APB lock and would block light sleep
+            SensorSampler::getInstance().setIdle(true);
+            break;
+
+        default:
+            break;
+    }
+
+    logger->log("Power: %s -> %s", STATE_NAMES[(size_t)previous], STATE_NAMES[(size_t)next]);
+}
+
+void PowerManager::applyCpuPolicy(bool idle) {
+    if (!frequencyScaling) {
+        setCpuFrequencyMhz(idle ? POWER_IDLE_MAX_MHZ : POWER_ACTIVE_MAX_MHZ);
+        return;
+    }
+
+    esp_pm_config_esp32s3_t pm;
+    pm.max_freq_mhz = idle ? POWER_IDLE_MAX_MHZ : POWER_ACTIVE_MAX_MHZ;
+    pm.min_freq_mhz = idle ? POWER_IDLE_MIN_MHZ : POWER_ACTIVE_MIN_MHZ;
+    pm.light_sleep_enable = idle && lightSleepSupported;
+
+    esp_err_t err = esp_pm_configure(&pm);
+    if (err != ESP_OK && pm.light_sleep_enable) {
+        // Automatic light sleep needs tickless idle in the core's sdkconfig
+        lightSleepSupported = false;
+        logger->log("Power: light sleep unavailable (%s), scaling frequency only", esp_err_to_name(err));
+        pm.light_sleep_enable = false;
+        err = esp_pm_configure(&pm);
+    }
+    if (err != ESP_OK) {
+        logger->log("ERROR: Power policy rejected: %s", esp_err_to_name(err));
+    }
+
+    lightSleep = err == ESP_OK && pm.light_sleep_enable;
+}
+
+void PowerManager::setBacklight(uint8_t duty) {
+#if HAS_DISPLAY
+    ledcWrite(LCD_BL_PWM_CHANNEL, duty);
+#endif
+}
+
+void PowerManager::setAmbientBacklight(uint8_t duty) {
+    if (duty == activeBacklight) {
+        return;
+    }
+
+    activeBacklight = duty;
+    if (state == PowerState::ACTIVE) {
+        setBacklight(activeBacklight);
+    } else if (state == PowerState::DIMMED) {
+        setBacklight(dimmedBacklight());
+    }
+}
+
+uint32_t PowerManager::loopSleepCapMs() const {
+    return state == PowerState::IDLE ? POWER_IDLE_LOOP_MAX_SLEEP_MS : LOOP_MAX_SLEEP_MS;
+}
+
+// ============================================================================
+// Residency Report
+// ============================================================================
+
+void PowerManager::report() {
+    if (!logger) {
+        return;
+    }
+
+    int64_t residency[(size_t)PowerState::COUNT];
+    memcpy(residency, residencyUs, sizeof(residency));
+    residency[(size_t)state] += esp_timer_get_time() - stateSinceUs;
+
+    int64_t total = 0;
+    uint64_t chargeUs = 0;  // mA * us
+    for (size_t i = 0; i < (size_t)PowerState::COUNT; i++) {
+        total += residency[i];
+        chargeUs += (uint64_t)residency[i] * STATE_CURRENT_MA[i];
+    }
+    if (total <= 0) {
+        return;
+    }
+
+    logger->log("=== Power (now %s) ===", STATE_NAMES[(size_t)state]);
+    for (size_t i = 0; i < (size_t)PowerState::COUNT; i++) {
+        uint32_t permille = (uint32_t)(residency[i] * 1000 / total);
+        logger->log("  %-7s %8lu s %3u.%u%%", STATE_NAMES[i],
+            (unsigned long)(residency[i] / 1000000), permille / 10, permille % 10);
+    }
+
+    // Average current from the per-state estimates, scaled to a day
+    uint32_t avgTenthsMa = (uint32_t)(chargeUs * 10 / total);
+    logger->log("  est. %u.%u mA average, %u mAh/day",
+        avgTenthsMa / 10, avgTenthsMa % 10, avgTenthsMa * 24 / 10);
+    logger->log("  CPU %u MHz, frequency scaling %s, light sleep %s",
+        getCpuFrequencyMhz(), frequencyScaling ? "on" : "off", lightSleep ? "on" : "off");
+    logger->log("======================");
+}
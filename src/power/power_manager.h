@@ -0,0 +1,82 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "../config.h"
+#include "../diag/log_ring.h"
+#include "../app/state_bus.h"
+#include "../app/timer_wheel.h"
+
+enum class PowerState : uint8_t {
+    ACTIVE,   // full backlight, full CPU
+    DIMMED,   // backlight dimmed after POWER_DIM_TIMEOUT_MS
+    IDLE,     // panel blanked, low CPU, light sleep, slow advertising
+    COUNT
+};
+
+/**
+ * Inactivity-driven power policy.
+ *
+ * Any app state change (connection, counter, pairing) or button press
+ * counts as activity and returns to ACTIVE; inactivity steps down through
+ * DIMMED to IDLE on timers. Transitions run on the app loop. Time spent in
+ * each state is accumulated for a residency and energy-per-day report.
+ */
+class PowerManager : public StateObserver {
+public:
+    static PowerManager& getInstance();
+
+    bool begin(LogRing* log);
+
+    // Any task. Returns true if the panel was blanked, i.e. the input that
+    // caused this only woke the device and should not act.
+    bool noteActivity();
+
+    // Apply pending wake-ups; call from the app loop
+    void update();
+
+    PowerState getState() const { return state; }
+
+    // Full-brightness duty from the ambient light sensor; call from the app loop
+    void setAmbientBacklight(uint8_t duty);
+
+    // How long the app loop may sleep in the current state
+    uint32_t loopSleepCapMs() const;
+
+    // Per-state residency and estimated energy per day
+    void report();
+
+    void onStateChanged(uint32_t fields, uint32_t version) override;
+
+private:
+    PowerManager();
+
+    // Prevent copying
+    PowerManager(const PowerManager&) = delete;
+    PowerManager& operator=(const PowerManager&) = delete;
+
+    LogRing* logger;
+    volatile PowerState state;
+    uint8_t activeBacklight;
+    std::atomic<bool> activityPending;
+    TimerWheel::Timer stepDownTimer;
+    bool frequencyScaling;
+    bool lightSleep;
+    bool lightSleepSupported;
+    int64_t stateSinceUs;
+    int64_t residencyUs[(size_t)PowerState::COUNT];
+
+    void onActivity();
+    void enter(PowerState next);
+    void stepDown();
+    void applyCpuPolicy(bool idle);
+    void setBacklight(uint8_t duty);
+
+    // Dimming never brightens a panel the ambient level already turned down
+    uint8_t dimmedBacklight() const {
+        return activeBacklight < BACKLIGHT_DIM ? activeBacklight : BACKLIGHT_DIM;
+    }
+};
+
+#endif // POWER_MANAGER_H
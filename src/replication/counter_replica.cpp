@@ -0,0 +1,383 @@
+#include "counter_replica.h"
+#include "../app/counter_app.h"
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_mac.h>
+#include <esp_random.h>
+
+// Frame: magic, version|flags, group u16, sender u32, entry count, then per
+// entry node u32 followed by p and n as LEB128 varints (little-endian)
+static const uint8_t FRAME_MAGIC = 0xC7;
+static const uint8_t FRAME_VERSION = 1;
+static const uint8_t FLAG_SYNC_REQUEST = 0x80;
+static const size_t FRAME_HEADER_LEN = 9;
+static const size_t ENTRY_MAX_LEN = 4 + 5 + 5;
+
+static_assert(FRAME_HEADER_LEN + REPLICATION_ENTRIES_PER_FRAME * ENTRY_MAX_LEN <= REPLICATION_MAX_FRAME,
+              "REPLICATION_ENTRIES_PER_FRAME does not fit a frame");
+static_assert(REPLICATION_MAX_FRAME <= 250, "ESP-NOW payloads are limited to 250 bytes");
+
+static const uint8_t BROADCAST_ADDRESS[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+// Counter writes over BLE add on the BLE task while the app loop merges
+static portMUX_TYPE counterMux = portMUX_INITIALIZER_UNLOCKED;
+
+static size_t writeVarint(uint8_t* out, uint32_t value) {
+    size_t length = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[length++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return length;
+}
+
+static bool readVarint(const uint8_t*& in, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && in < end; shift += 7) {
+        uint8_t byte = *in++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void writeU32(uint8_t* out, uint32_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+    out[2] = value >> 16;
+    out[3] = value >> 24;
+}
+
+static uint32_t readU32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static size_t writeEntry(uint8_t* out, const PNCounter::Entry& entry) {
+    writeU32(out, entry.node);
+    size_t length = 4;
+    length += writeVarint(out + length, entry.p);
+    length += writeVarint(out + length, entry.n);
+    return length;
+}
+
+CounterReplica& CounterReplica::getInstance() {
+    static CounterReplica instance;
+    return instance;
+}
+
+CounterReplica::CounterReplica()
+    : logger(nullptr)
+    , started(false)
+    , group(0)
+    , rxQueue(nullptr)
+    , cursor(0)
+    , syncRequested(false)
+    , pushTimer([](void* arg) { static_cast<CounterReplica*>(arg)->gossip(false); }, this)
+    , gossipTimer([](void* arg) { static_cast<CounterReplica*>(arg)->gossip(true); }, this)
+    , framesSent(0)
+    , framesReceived(0)
+    , framesRejected(0)
+    , bytesSent(0)
+    , bytesReceived(0)
+    , mergeChanges(0)
+    , rxDropped(0) {
+}
+
+int32_t CounterReplica::begin(IConfig* config, LogRing* log, int32_t currentValue) {
+    logger = log;
+
+    // Node id: low four bytes of the factory station MAC
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    uint32_t node = readU32(mac + 2);
+
+    group = (uint16_t)config->getInt(CONFIG_REPLICATION_GROUP, REPLICATION_DEFAULT_GROUP);
+
+    uint32_t p;
+    uint32_t n;
+    if (config->getBool(CONFIG_REPLICATION_SEEDED, false)) {
+        p = (uint32_t)config->getInt(CONFIG_REPLICATION_P, 0);
+        n = (uint32_t)config->getInt(CONFIG_REPLICATION_N, 0);
+    } else {
+        // First boot in replication mode: this node contributes what it
+        // counted on its own so far
+        p = currentValue > 0 ? (uint32_t)currentValue : 0;
+        n = currentValue < 0 ? (uint32_t)(-(int64_t)currentValue) : 0;
+
+        ConfigStore& store = ConfigStore::getInstance();
+        store.beginTransaction();
+        store.setInt(CONFIG_REPLICATION_P, (int)p);
+        store.setInt(CONFIG_REPLICATION_N, (int)n);
+        store.setBool(CONFIG_REPLICATION_SEEDED, true);
+        store.commit();
+    }
+
+    counter.reset(node, p, n);
+
+    logger->log("Replication: node %08lX, group %u, local +%lu/-%lu",
+        (unsigned long)node, group, (unsigned long)p, (unsigned long)n);
+
+    // Peers fill in the rest of the total once gossip starts
+    return counter.value();
+}
+
+bool CounterReplica::startGossip() {
+#if REPLICATION_ENABLED
+    rxQueue = xQueueCreate(REPLICATION_RX_QUEUE_LEN, sizeof(Frame));
+    if (!rxQueue) {
+        logger->log("ERROR: Replication queue allocation failed");
+        return false;
+    }
+
+    // ESP-NOW rides on the WiFi driver; it uses the channel of the AP the
+    // gates share
+    if (WiFi.getMode() == WIFI_OFF) {
+        WiFi.mode(WIFI_STA);
+    }
+
+    esp_err_t err = esp_now_init();
+    if (err != ESP_OK) {
+        logger->log("ERROR: ESP-NOW init failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    esp_now_register_recv_cb(onReceive);
+
+    esp_now_peer_info_t peer;
+    memset(&peer, 0, sizeof(peer));
+    memcpy(peer.peer_addr, BROADCAST_ADDRESS, 6);
+    peer.channel = 0;
+    peer.encrypt = false;
+    err = esp_now_add_peer(&peer);
+    if (err != ESP_OK) {
+        logger->log("ERROR: ESP-NOW broadcast peer failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    started = true;
+    syncRequested = true;
+    schedulePush(esp_random() % REPLICATION_SYNC_JITTER_MS);
+    TimerWheel::getInstance().arm(gossipTimer, REPLICATION_GOSSIP_MS, REPLICATION_GOSSIP_MS);
+
+    logger->log("Replication: gossiping every %u ms, %u entries per frame",
+        REPLICATION_GOSSIP_MS, REPLICATION_ENTRIES_PER_FRAME);
+#endif
+    return true;
+}
+
+int32_t CounterReplica::add(int32_t delta) {
+    portENTER_CRITICAL(&counterMux);
+    int32_t total = counter.add(delta);
+    portEXIT_CRITICAL(&counterMux);
+    if (started && delta) {
+        schedulePush(REPLICATION_PUSH_DELAY_MS);
+    }
+    return total;
+}
+
+int32_t CounterReplica::value() const {
+    portENTER_CRITICAL(&counterMux);
+    int32_t total = counter.value();
+    portEXIT_CRITICAL(&counterMux);
+    return total;
+}
+
+void CounterReplica::stage(ConfigStore& store) {
+    portENTER_CRITICAL(&counterMux);
+    PNCounter::Entry local = counter.local();
+    portEXIT_CRITICAL(&counterMux);
+
+    store.setInt(CONFIG_REPLICATION_P, (int)local.p);
+    store.setInt(CONFIG_REPLICATION_N, (int)local.n);
+}
+
+void CounterReplica::schedulePush(uint32_t delayMs) {
+    // Keep an earlier deadline; a burst of changes still goes out in one frame
+    if (!pushTimer.isArmed()) {
+        TimerWheel::getInstance().arm(pushTimer, delayMs);
+    }
+}
+
+// ============================================================================
+// Sending
+// ============================================================================
+
+size_t CounterReplica::encode(uint8_t* out, bool full) {
+    uint8_t* entryCount = out + 8;
+    out[0] = FRAME_MAGIC;
+    out[1] = FRAME_VERSION | (syncRequested ? FLAG_SYNC_REQUEST : 0);
+    out[2] = group;
+    out[3] = group >> 8;
+    writeU32(out + 4, counter.local().node);
+    *entryCount = 0;
+
+    size_t length = FRAME_HEADER_LEN;
+    bool included[REPLICATION_MAX_NODES] = {false};
+
+    // Deltas first
+    for (size_t i = 0; i < counter.size() && *entryCount < REPLICATION_ENTRIES_PER_FRAME; i++) {
+        if (!counter.isDirty(i)) {
+            continue;
+        }
+        length += writeEntry(out + length, counter.at(i));
+        counter.clearDirty(i);
+        included[i] = true;
+        (*entryCount)++;
+    }
+
+    // Anti-entropy: top up from a rotating cursor so lost deltas are repaired
+    for (size_t scanned = 0; full && scanned < counter.size() &&
+                             *entryCount < REPLICATION_ENTRIES_PER_FRAME; scanned++) {
+        size_t i = cursor;
+        cursor = (cursor + 1) % counter.size();
+        if (included[i]) {
+            continue;
+        }
+        length += writeEntry(out + length, counter.at(i));
+        (*entryCount)++;
+    }
+
+    return *entryCount ? length : 0;
+}
+
+void CounterReplica::gossip(bool full) {
+    if (!started) {
+        return;
+    }
+
+    uint8_t frame[REPLICATION_MAX_FRAME];
+    portENTER_CRITICAL(&counterMux);
+    size_t length = encode(frame, full || syncRequested);
+    bool morePending = false;
+    for (size_t i = 0; i < counter.size(); i++) {
+        morePending |= counter.isDirty(i);
+    }
+    portEXIT_CRITICAL(&counterMux);
+
+    syncRequested = false;
+    if (length == 0) {
+        return;
+    }
+
+    if (esp_now_send(BROADCAST_ADDRESS, frame, length) == ESP_OK) {
+        framesSent++;
+        bytesSent += length;
+    }
+
+    // More deltas than fit one frame (e.g. answering a sync): keep pushing
+    if (morePending) {
+        schedulePush(REPLICATION_PUSH_DELAY_MS);
+    }
+}
+
+// ============================================================================
+// Receiving
+// ============================================================================
+
+void CounterReplica::onReceive(const uint8_t* mac, const uint8_t* data, int length) {
+    // WiFi task: copy and hand off, nothing else
+    CounterReplica& self = getInstance();
+    if (length <= 0 || length > REPLICATION_MAX_FRAME || !self.rxQueue) {
+        return;
+    }
+
+    Frame frame;
+    frame.length = (uint8_t)length;
+    memcpy(frame.data, data, length);
+    if (xQueueSend(self.rxQueue, &frame, 0) != pdTRUE) {
+        self.rxDropped++;
+    }
+}
+
+void CounterReplica::update() {
+    if (!started) {
+        return;
+    }
+
+    int32_t before = value();
+
+    Frame frame;
+    while (xQueueReceive(rxQueue, &frame, 0) == pdTRUE) {
+        handleFrame(frame.data, frame.length);
+    }
+
+    // The app re-reads the total itself; a BLE add may land in between
+    if (value() != before) {
+        CounterApp::getInstance().applyReplicatedValue();
+    }
+}
+
+void CounterReplica::handleFrame(const uint8_t* data, size_t length) {
+    if (length < FRAME_HEADER_LEN || data[0] != FRAME_MAGIC ||
+        (data[1] & ~FLAG_SYNC_REQUEST) != FRAME_VERSION) {
+        framesRejected++;
+        return;
+    }
+
+    uint16_t frameGroup = data[2] | (data[3] << 8);
+    uint32_t sender = readU32(data + 4);
+    if (frameGroup != group || sender == counter.local().node) {
+        return;
+    }
+
+    framesReceived++;
+    bytesReceived += length;
+
+    const uint8_t* in = data + FRAME_HEADER_LEN;
+    const uint8_t* end = data + length;
+    for (uint8_t i = 0; i < data[8]; i++) {
+        PNCounter::Entry entry;
+        if (end - in < 4) {
+            framesRejected++;
+            return;
+        }
+        entry.node = readU32(in);
+        in += 4;
+        if (!readVarint(in, end, entry.p) || !readVarint(in, end, entry.n)) {
+            framesRejected++;
+            return;
+        }
+        portENTER_CRITICAL(&counterMux);
+        bool changed = counter.merge(entry);
+        portEXIT_CRITICAL(&counterMux);
+        if (changed) {
+            mergeChanges++;
+        }
+    }
+
+    if (data[1] & FLAG_SYNC_REQUEST) {
+        // A peer just booted: send it everything, spread out so every
+        // gate answering at once doesn't collide
+        portENTER_CRITICAL(&counterMux);
+        counter.markAllDirty();
+        portEXIT_CRITICAL(&counterMux);
+        schedulePush(esp_random() % REPLICATION_SYNC_JITTER_MS);
+    }
+}
+
+// ============================================================================
+// Report
+// ============================================================================
+
+void CounterReplica::report() {
+    if (!logger || !started) {
+        return;
+    }
+
+    logger->log("=== Replication (group %u) ===", group);
+    logger->log("  value %ld from %u nodes (%lu over capacity)",
+        (long)counter.value(), (unsigned)counter.size(), (unsigned long)counter.getOverflow());
+    for (size_t i = 0; i < counter.size(); i++) {
+        const PNCounter::Entry& entry = counter.at(i);
+        logger->log("  %08lX  +%lu  -%lu%s", (unsigned long)entry.node,
+            (unsigned long)entry.p, (unsigned long)entry.n, i == 0 ? "  (this gate)" : "");
+    }
+    logger->log("  sent %lu frames / %lu bytes, received %lu frames / %lu bytes",
+        (unsigned long)framesSent, (unsigned long)bytesSent,
+        (unsigned long)framesReceived, (unsigned long)bytesReceived);
+    logger->log("  %lu merges changed state, %lu rejected, %lu queue drops",
+        (unsigned long)mergeChanges, (unsigned long)framesRejected, (unsigned long)rxDropped);
+    logger->log("=============================");
+}
@@ -0,0 +1,91 @@
+#ifndef COUNTER_REPLICA_H
+#define COUNTER_REPLICA_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "config/IConfig.h"
+#include "../diag/log_ring.h"
+#include "../app/timer_wheel.h"
+#include "../storage/config_store.h"
+#include "pn_counter.h"
+
+/**
+ * Replicates the counter across gates with a PNCounter gossiped over
+ * ESP-NOW broadcast.
+ *
+ * Local changes are pushed shortly after they happen (coalescing bursts);
+ * a periodic round sends dirty entries first, then tops the frame up from
+ * a rotating cursor, so every frame stays under REPLICATION_ENTRIES_PER_FRAME
+ * entries however many nodes there are and lost frames are repaired by
+ * later rounds. A booting node asks its peers for a full sync. Frames from
+ * other replication groups are ignored.
+ *
+ * The receive callback only queues frames; merging, sending and the
+ * counter update happen on the app loop.
+ */
+class CounterReplica {
+public:
+    static CounterReplica& getInstance();
+
+    // Loads this node's own entry (seeding it from `currentValue` the first
+    // time replication is enabled) and returns the counter value to show
+    int32_t begin(IConfig* config, LogRing* log, int32_t currentValue);
+
+    // Brings up ESP-NOW and the gossip timers; needs WiFi started
+    bool startGossip();
+
+    // Local change; returns the new replicated value
+    int32_t add(int32_t delta);
+
+    int32_t value() const;
+
+    // Stages this node's entry into an open ConfigStore transaction
+    void stage(ConfigStore& store);
+
+    // Merges received frames; call from the app loop
+    void update();
+
+    // Node table, frame and byte counts
+    void report();
+
+private:
+    CounterReplica();
+
+    // Prevent copying
+    CounterReplica(const CounterReplica&) = delete;
+    CounterReplica& operator=(const CounterReplica&) = delete;
+
+    struct Frame {
+        uint8_t length;
+        uint8_t data[REPLICATION_MAX_FRAME];
+    };
+
+    LogRing* logger;
+    bool started;
+    uint16_t group;
+    PNCounter counter;
+    QueueHandle_t rxQueue;
+    size_t cursor;
+    bool syncRequested;
+
+    TimerWheel::Timer pushTimer;
+    TimerWheel::Timer gossipTimer;
+
+    // Counters
+    uint32_t framesSent;
+    uint32_t framesReceived;
+    uint32_t framesRejected;
+    uint32_t bytesSent;
+    uint32_t bytesReceived;
+    uint32_t mergeChanges;
+    volatile uint32_t rxDropped;
+
+    void gossip(bool full);
+    size_t encode(uint8_t* out, bool full);
+    void handleFrame(const uint8_t* data, size_t length);
+    void schedulePush(uint32_t delayMs);
+
+    static void onReceive(const uint8_t* mac, const uint8_t* data, int length);
+};
+
+#endif // COUNTER_REPLICA_H
@@ -0,0 +1,86 @@
+#include "pn_counter.h"
+#include <string.h>
+
+PNCounter::PNCounter()
+    : count(0)
+    , overflow(0) {
+    memset(entries, 0, sizeof(entries));
+    memset(dirty, 0, sizeof(dirty));
+}
+
+void PNCounter::reset(uint32_t localNode, uint32_t p, uint32_t n) {
+    memset(entries, 0, sizeof(entries));
+    memset(dirty, 0, sizeof(dirty));
+    entries[0].node = localNode;
+    entries[0].p = p;
+    entries[0].n = n;
+    dirty[0] = true;
+    count = 1;
+    overflow = 0;
+}
+
+int32_t PNCounter::add(int32_t delta) {
+    if (delta > 0) {
+        entries[0].p += (uint32_t)delta;
+    } else if (delta < 0) {
+        entries[0].n += (uint32_t)(-(int64_t)delta);
+    }
+    if (delta) {
+        dirty[0] = true;
+    }
+    return value();
+}
+
+bool PNCounter::merge(const Entry& remote) {
+    size_t i = 0;
+    while (i < count && entries[i].node != remote.node) {
+        i++;
+    }
+
+    if (i == count) {
+        if (count == REPLICATION_MAX_NODES) {
+            overflow++;
+            return false;
+        }
+        entries[count].node = remote.node;
+        entries[count].p = 0;
+        entries[count].n = 0;
+        count++;
+    }
+
+    // Nobody else may advance our own entry; a larger remote copy means a
+    // lost write here (e.g. reset before flush), so catch up to it
+    Entry& entry = entries[i];
+    bool changed = false;
+    if (remote.p > entry.p) {
+        entry.p = remote.p;
+        changed = true;
+    }
+    if (remote.n > entry.n) {
+        entry.n = remote.n;
+        changed = true;
+    }
+
+    if (changed) {
+        dirty[i] = true;
+    }
+    return changed;
+}
+
+void PNCounter::markAllDirty() {
+    for (size_t i = 0; i < count; i++) {
+        dirty[i] = true;
+    }
+}
+
+int32_t PNCounter::value() const {
+    // Unsigned sums wrap consistently, so the difference is right even
+    // once either total passes 2^32
+    uint32_t p = 0;
+    uint32_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        p += entries[i].p;
+        n += entries[i].n;
+    }
+    return (int32_t)(p - n);
+}
@@ -0,0 +1,59 @@
+#ifndef PN_COUNTER_H
+#define PN_COUNTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../config.h"
+
+/**
+ * Positive-negative counter CRDT over up to REPLICATION_MAX_NODES nodes.
+ *
+ * Each node only ever grows its own increment (p) and decrement (n)
+ * totals; the value is sum(p) - sum(n). merge() takes the per-node
+ * maximum, so applying the same entry twice, or entries in any order,
+ * gives the same result and every replica converges once it has seen
+ * every node's latest entry. Entries changed since the last gossip are
+ * flagged dirty so the encoder can send deltas first.
+ *
+ * Plain C++ with no platform calls, so it can be exercised off-target.
+ */
+class PNCounter {
+public:
+    struct Entry {
+        uint32_t node;
+        uint32_t p;
+        uint32_t n;
+    };
+
+    PNCounter();
+
+    // Starts the table with this node's own (persisted) entry
+    void reset(uint32_t localNode, uint32_t p, uint32_t n);
+
+    // Local change; returns the new value
+    int32_t add(int32_t delta);
+
+    // Returns true if the entry raised anything. Unknown nodes beyond
+    // capacity are dropped and counted.
+    bool merge(const Entry& remote);
+
+    int32_t value() const;
+
+    const Entry& local() const { return entries[0]; }
+    size_t size() const { return count; }
+    const Entry& at(size_t i) const { return entries[i]; }
+    uint32_t getOverflow() const { return overflow; }
+
+    bool isDirty(size_t i) const { return dirty[i]; }
+    void clearDirty(size_t i) { dirty[i] = false; }
+    void markAllDirty();
+
+private:
+    // entries[0] is always the local node
+    Entry entries[REPLICATION_MAX_NODES];
+    bool dirty[REPLICATION_MAX_NODES];
+    size_t count;
+    uint32_t overflow;
+};
+
+#endif // PN_COUNTER_H
@@ -0,0 +1,327 @@
+#include "sensor_sampler.h"
+#include "../ble/ble_manager.h"
+#include "../power/power_manager.h"
+#include <driver/adc.h>
+
+static const uint32_t FRAME_BYTES = SENSOR_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES;
+
+// DMA frame scratch; only touched from the sensor task
+static uint8_t frameBuffer[FRAME_BYTES];
+
+// Single-cell LiPo discharge curve under light load, highest voltage first
+struct LevelPoint {
+    uint16_t mv;
+    uint8_t level;
+};
+
+static const LevelPoint BATTERY_CURVE[] = {
+    { 4200, 100 },
+    { 4100, 90 },
+    { 4000, 80 },
+    { 3900, 65 },
+    { 3800, 50 },
+    { 3700, 35 },
+    { 3600, 20 },
+    { 3500, 10 },
+    { 3400, 5 },
+    { 3300, 0 }
+};
+
+SensorSampler& SensorSampler::getInstance() {
+    static SensorSampler instance;
+    return instance;
+}
+
+SensorSampler::SensorSampler()
+    : logger(nullptr)
+    , sensorTask(nullptr)
+    , batteryFiltered(0)
+    , ambientFiltered(0)
+    , filterPrimed(false)
+    , lastPublishUs(0)
+    , idle(false)
+    , adcRunning(false)
+    , discardFrame(false)
+    , burstActive(false)
+    , batteryMv(0)
+    , ambientMv(0)
+    , readingReady(false)
+    , frames(0)
+    , overruns(0)
+    , samples(0)
+    , processUs(0)
+    , startedUs(0)
+    , batteryLevel(0)
+    , batteryLevelKnown(false) {
+    memset(&calibration, 0, sizeof(calibration));
+}
+
+bool SensorSampler::begin(LogRing* log) {
+    logger = log;
+
+#if SENSORS_ENABLED
+    int8_t batteryChannel = digitalPinToAnalogChannel(PIN_BAT_VOLT);
+    int8_t ambientChannel = digitalPinToAnalogChannel(PIN_LDR);
+    if (batteryChannel < 0 || batteryChannel > 9 || ambientChannel < 0 || ambientChannel > 9) {
+        logger->log("ERROR: Sensor pins must be on ADC1");
+        return false;
+    }
+
+    adc_digi_init_config_t init;
+    memset(&init, 0, sizeof(init));
+    init.max_store_buf_size = FRAME_BYTES * SENSOR_BUFFER_FRAMES;
+    init.conv_num_each_intr = FRAME_BYTES;
+    init.adc1_chan_mask = BIT(batteryChannel) | BIT(ambientChannel);
+
+    esp_err_t err = adc_digi_initialize(&init);
+    if (err != ESP_OK) {
+        logger->log("ERROR: ADC DMA init failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    // Both channels alternate in one pattern at 11 dB (about 0-3.1 V)
+    static adc_digi_pattern_config_t pattern[2];
+    const int8_t channels[2] = { batteryChannel, ambientChannel };
+    for (size_t i = 0; i < 2; i++) {
+        pattern[i].atten = ADC_ATTEN_DB_11;
+        pattern[i].channel = channels[i];
+        pattern[i].unit = 0;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    adc_digi_configuration_t digi;
+    memset(&digi, 0, sizeof(digi));
+    digi.conv_limit_en = false;
+    digi.pattern_num = 2;
+    digi.adc_pattern = pattern;
+    digi.sample_freq_hz = SENSOR_SAMPLE_RATE_HZ;
+    digi.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    digi.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+
+    err = adc_digi_controller_configure(&digi);
+    if (err != ESP_OK) {
+        logger->log("ERROR: ADC DMA configure failed: %s", esp_err_to_name(err));
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    // eFuse two-point calibration when present; the result is a linear
+    // fit applied in integer arithmetic
+    esp_adc_cal_value_t source = esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11,
+                                                          ADC_WIDTH_BIT_12, 1100, &calibration);
+
+    // Started below; from then on only the sensor task starts or stops it
+    adcRunning = true;
+    if (xTaskCreatePinnedToCore(sensorTaskEntry, "Sensors", SENSOR_TASK_STACK, this,
+                                TASK_PRIORITY_SENSOR, &sensorTask, CORE_SENSOR) != pdPASS) {
+        logger->log("ERROR: Failed to create sensor task");
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    startedUs = esp_timer_get_time();
+    adc_digi_start();
+
+    logger->log("Sensors started (%u Hz DMA, %u samples/frame, calibration %s)",
+        SENSOR_SAMPLE_RATE_HZ, SENSOR_FRAME_SAMPLES,
+        source == ESP_ADC_CAL_VAL_EFUSE_TP ? "eFuse two-point" : "default");
+#endif
+    return true;
+}
+
+// ============================================================================
+// Sensor Task
+// ============================================================================
+
+void SensorSampler::sensorTaskEntry(void* param) {
+    static_cast<SensorSampler*>(param)->sensorLoop();
+}
+
+void SensorSampler::setIdle(bool enabled) {
+    if (idle.exchange(enabled) == enabled || !sensorTask) {
+        return;
+    }
+    // Cut a wait for the next burst short when leaving idle
+    xTaskNotifyGive(sensorTask);
+}
+
+void SensorSampler::waitWhileIdle() {
+    if (adcRunning) {
+        adc_digi_stop();
+        adcRunning = false;
+    }
+
+    // Woken by setIdle(false), or by the timeout for the next burst
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SENSOR_IDLE_BURST_INTERVAL_MS));
+
+    // The ring buffer can still hold conversions from before the stop, and
+    // the filter's history is stale; start over from fresh frames
+    adc_digi_start();
+    adcRunning = true;
+    discardFrame = true;
+    burstActive = true;
+    filterPrimed = false;
+    lastPublishUs = 0;
+}
+
+void SensorSampler::sensorLoop() {
+    while (true) {
+        // While idle the ADC only runs until a burst has published once
+        if (idle.load() && !burstActive) {
+            waitWhileIdle();
+        }
+
+        uint32_t length = 0;
+        esp_err_t err = adc_digi_read_bytes(frameBuffer, FRAME_BYTES, &length, ADC_MAX_DELAY);
+        if (err == ESP_ERR_INVALID_STATE) {
+            // The driver's ring buffer overflowed; what was read is still valid
+            overruns.fetch_add(1, std::memory_order_relaxed);
+        } else if (err != ESP_OK) {
+            continue;
+        }
+        if (discardFrame) {
+            discardFrame = false;
+            continue;
+        }
+
+        int64_t start = esp_timer_get_time();
+        processFrame(frameBuffer, length);
+        if (start - lastPublishUs >= SENSOR_REPORT_INTERVAL_MS * 1000LL) {
+            publish();
+            lastPublishUs = start;
+            burstActive = false;
+        }
+        processUs.fetch_add((uint32_t)(esp_timer_get_time() - start), std::memory_order_relaxed);
+    }
+}
+
+void SensorSampler::processFrame(const uint8_t* data, uint32_t length) {
+    int8_t batteryChannel = digitalPinToAnalogChannel(PIN_BAT_VOLT);
+    uint32_t batterySum = 0, batteryCount = 0;
+    uint32_t ambientSum = 0, ambientCount = 0;
+
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t* result = reinterpret_cast<const adc_digi_output_data_t*>(data + i);
+        if (result->type2.channel == (uint32_t)batteryChannel) {
+            batterySum += result->type2.data;
+            batteryCount++;
+        } else {
+            ambientSum += result->type2.data;
+            ambientCount++;
+        }
+    }
+
+    if (!batteryCount || !ambientCount) {
+        return;
+    }
+
+    uint32_t batteryMean = batterySum / batteryCount;
+    uint32_t ambientMean = ambientSum / ambientCount;
+
+    // y += x - y / 2^shift, with y kept scaled by 2^shift
+    if (!filterPrimed) {
+        batteryFiltered = batteryMean << SENSOR_FILTER_SHIFT;
+        ambientFiltered = ambientMean << SENSOR_FILTER_SHIFT;
+        filterPrimed = true;
+    } else {
+        batteryFiltered += batteryMean - (batteryFiltered >> SENSOR_FILTER_SHIFT);
+        ambientFiltered += ambientMean - (ambientFiltered >> SENSOR_FILTER_SHIFT);
+    }
+
+    frames.fetch_add(1, std::memory_order_relaxed);
+    samples.fetch_add(batteryCount + ambientCount, std::memory_order_relaxed);
+}
+
+void SensorSampler::publish() {
+    if (!filterPrimed) {
+        return;
+    }
+
+    const uint32_t half = 1u << (SENSOR_FILTER_SHIFT - 1);
+    uint32_t batteryRaw = (batteryFiltered + half) >> SENSOR_FILTER_SHIFT;
+    uint32_t ambientRaw = (ambientFiltered + half) >> SENSOR_FILTER_SHIFT;
+
+    batteryMv.store(esp_adc_cal_raw_to_voltage(batteryRaw, &calibration) * BATTERY_DIVIDER_RATIO,
+                    std::memory_order_relaxed);
+    ambientMv.store(esp_adc_cal_raw_to_voltage(ambientRaw, &calibration), std::memory_order_relaxed);
+    readingReady.store(true);
+}
+
+// ============================================================================
+// Consumers
+// ============================================================================
+
+void SensorSampler::update() {
+    if (!readingReady.exchange(false)) {
+        return;
+    }
+
+    uint8_t level = levelFromMillivolts(getBatteryMv());
+    if (!batteryLevelKnown || level != batteryLevel) {
+        batteryLevel = level;
+        batteryLevelKnown = true;
+        BLEManager::getInstance().updateBatteryLevel(level);
+    }
+
+    PowerManager::getInstance().setAmbientBacklight(backlightFromMillivolts(getAmbientMv()));
+}
+
+uint8_t SensorSampler::levelFromMillivolts(uint32_t mv) {
+    const size_t points = sizeof(BATTERY_CURVE) / sizeof(BATTERY_CURVE[0]);
+    if (mv >= BATTERY_CURVE[0].mv) {
+        return BATTERY_CURVE[0].level;
+    }
+
+    for (size_t i = 1; i < points; i++) {
+        const LevelPoint& upper = BATTERY_CURVE[i - 1];
+        const LevelPoint& lower = BATTERY_CURVE[i];
+        if (mv >= lower.mv) {
+            return lower.level + (mv - lower.mv) * (upper.level - lower.level) / (upper.mv - lower.mv);
+        }
+    }
+    return 0;
+}
+
+uint8_t SensorSampler::backlightFromMillivolts(uint32_t mv) {
+    if (mv <= AMBIENT_DARK_MV) {
+        return BACKLIGHT_AUTO_MIN;
+    }
+    if (mv >= AMBIENT_BRIGHT_MV) {
+        return BACKLIGHT_FULL;
+    }
+    return BACKLIGHT_AUTO_MIN +
+        (mv - AMBIENT_DARK_MV) * (BACKLIGHT_FULL - BACKLIGHT_AUTO_MIN) / (AMBIENT_BRIGHT_MV - AMBIENT_DARK_MV);
+}
+
+// ============================================================================
+// Report
+// ============================================================================
+
+void SensorSampler::report() {
+    if (!logger || !sensorTask) {
+        return;
+    }
+
+    // Counters cover the window since the previous report
+    int64_t now = esp_timer_get_time();
+    uint32_t windowUs = (uint32_t)(now - startedUs);
+    startedUs = now;
+    uint32_t frameCount = frames.exchange(0, std::memory_order_relaxed);
+    uint32_t sampleCount = samples.exchange(0, std::memory_order_relaxed);
+    uint32_t busyUs = processUs.exchange(0, std::memory_order_relaxed);
+
+    logger->log("=== Sensors ===");
+    logger->log("  battery %lu mV (%u%%), ambient %lu mV",
+        (unsigned long)getBatteryMv(), batteryLevel, (unsigned long)getAmbientMv());
+    logger->log("  %lu frames, %lu samples, %lu overruns",
+        (unsigned long)frameCount, (unsigned long)sampleCount,
+        (unsigned long)overruns.load(std::memory_order_relaxed));
+    if (sampleCount && windowUs) {
+        // Conversion is in hardware; this is the task's cost per result
+        logger->log("  %lu ns/sample, %lu.%02lu%% CPU",
+            (unsigned long)((uint64_t)busyUs * 1000 / sampleCount),
+            (unsigned long)((uint64_t)busyUs * 100 / windowUs),
+            (unsigned long)((uint64_t)busyUs * 10000 / windowUs % 100));
+    }
+    logger->log("===============");
+}
@@ -0,0 +1,93 @@
+#ifndef SENSOR_SAMPLER_H
+#define SENSOR_SAMPLER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_adc_cal.h>
+#include "../config.h"
+#include "../diag/log_ring.h"
+
+/**
+ * Battery and ambient light sampling on the ADC's continuous (DMA) mode.
+ *
+ * The ADC converts both channels in hardware and hands over whole frames;
+ * a sensor task averages each frame per channel and runs an integer IIR
+ * filter, then publishes calibrated millivolts every
+ * SENSOR_REPORT_INTERVAL_MS. update() on the app loop turns those into a
+ * battery level for the GATT Battery Service (sent only when it changes)
+ * and an automatic backlight duty for the power manager.
+ *
+ * While the power manager is idle the ADC is stopped and only run for a
+ * single frame every SENSOR_IDLE_BURST_INTERVAL_MS, so light sleep can
+ * engage between bursts.
+ */
+class SensorSampler {
+public:
+    static SensorSampler& getInstance();
+
+    bool begin(LogRing* log);
+
+    // Apply the latest readings; call from the app loop
+    void update();
+
+    // Stop continuous sampling while idle (power manager, any task)
+    void setIdle(bool idle);
+
+    uint32_t getBatteryMv() const { return batteryMv.load(std::memory_order_relaxed); }
+    uint32_t getAmbientMv() const { return ambientMv.load(std::memory_order_relaxed); }
+    uint8_t getBatteryLevel() const { return batteryLevel; }
+
+    // Readings, frame counts and per-sample processing cost
+    void report();
+
+private:
+    SensorSampler();
+
+    // Prevent copying
+    SensorSampler(const SensorSampler&) = delete;
+    SensorSampler& operator=(const SensorSampler&) = delete;
+
+    LogRing* logger;
+    TaskHandle_t sensorTask;
+    esp_adc_cal_characteristics_t calibration;
+
+    // Filter state in raw ADC counts, SENSOR_FILTER_SHIFT fractional bits;
+    // only touched from the sensor task
+    uint32_t batteryFiltered;
+    uint32_t ambientFiltered;
+    bool filterPrimed;
+    int64_t lastPublishUs;
+
+    // ADC run state; idle is set by setIdle(), the rest belongs to the
+    // sensor task, which is the only one that starts or stops the ADC
+    std::atomic<bool> idle;
+    bool adcRunning;
+    bool discardFrame;
+    bool burstActive;
+
+    // Published by the sensor task, consumed by update()
+    std::atomic<uint32_t> batteryMv;
+    std::atomic<uint32_t> ambientMv;
+    std::atomic<bool> readingReady;
+
+    // Cost accounting (sensor task writes, report() reads)
+    std::atomic<uint32_t> frames;
+    std::atomic<uint32_t> overruns;
+    std::atomic<uint32_t> samples;
+    std::atomic<uint32_t> processUs;
+    int64_t startedUs;
+
+    uint8_t batteryLevel;
+    bool batteryLevelKnown;
+
+    static void sensorTaskEntry(void* param);
+    void sensorLoop();
+    void waitWhileIdle();
+    void processFrame(const uint8_t* data, uint32_t length);
+    void publish();
+
+    static uint8_t levelFromMillivolts(uint32_t mv);
+    static uint8_t backlightFromMillivolts(uint32_t mv);
+};
+
+#endif // SENSOR_SAMPLER_H
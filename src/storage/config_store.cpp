@@ -0,0 +1,300 @@
+#include "config_store.h"
+#include "../diag/metrics.h"
+#include "../diag/heap_guard.h"
+#include <LittleFS.h>
+
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+ConfigStore& ConfigStore::getInstance() {
+    static ConfigStore instance;
+    return instance;
+}
+
+ConfigStore::ConfigStore()
+    : config(nullptr)
+    , logger(nullptr)
+    , txnMutex(nullptr)
+    , configMutex(nullptr)
+    , flushTask(nullptr)
+    , entries(nullptr)
+    , entryCount(0)
+    , txnOpen(false)
+    , txnFailed(false)
+    , flushPending(false) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool ConfigStore::begin(IConfig* cfg, LogRing* log) {
+    if (!log) {
+        return false;
+    }
+
+    logger = log;
+
+    if (!cfg) {
+        logger->log("ERROR: ConfigStore config is null");
+        return false;
+    }
+
+    if (config) {
+        return true;
+    }
+
+    config = cfg;
+
+    // Allocated here, before the heap is sealed; commits run on sealed tasks
+    entries = new Entry[CONFIG_TXN_MAX_ENTRIES];
+    memset(entries, 0, CONFIG_TXN_MAX_ENTRIES * sizeof(Entry));
+
+    txnMutex = xSemaphoreCreateMutex();
+    configMutex = xSemaphoreCreateMutex();
+    if (!txnMutex || !configMutex) {
+        logger->log("ERROR: ConfigStore failed to create mutexes");
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(flushTaskEntry, "ConfigFlush", CONFIG_FLUSH_TASK_STACK, this,
+                                CONFIG_FLUSH_TASK_PRIORITY, &flushTask, CONFIG_FLUSH_TASK_CORE) != pdPASS) {
+        logger->log("ERROR: ConfigStore failed to start flush task");
+        flushTask = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+// ============================================================================
+// Transactions
+// ============================================================================
+
+void ConfigStore::beginTransaction() {
+    xSemaphoreTake(txnMutex, portMAX_DELAY);
+    entryCount = 0;
+    txnOpen = true;
+    txnFailed = false;
+}
+
+void ConfigStore::setInt(const char* key, int value) {
+    Entry* entry = stage(key, EntryType::INT);
+    if (entry) {
+        entry->intValue = value;
+    }
+}
+
+void ConfigStore::setBool(const char* key, bool value) {
+    Entry* entry = stage(key, EntryType::BOOL);
+    if (entry) {
+        entry->intValue = value ? 1 : 0;
+    }
+}
+
+void ConfigStore::setString(const char* key, const char* value) {
+    if (txnOpen && strlen(value) >= CONFIG_TXN_STRING_LEN) {
+        logger->log("ERROR: Config value for '%s' too long", key);
+        txnFailed = true;
+        return;
+    }
+
+    Entry* entry = stage(key, EntryType::STRING);
+    if (entry) {
+        strcpy(entry->stringValue, value);
+    }
+}
+
+bool ConfigStore::commit() {
+    if (!txnOpen) {
+        return false;
+    }
+
+    // A partial registry or schedule is worse than the previous one
+    if (txnFailed) {
+        logger->log("ERROR: Config transaction lost a write, nothing committed");
+        abort();
+        return false;
+    }
+
+    size_t changed = 0;
+    size_t skipped = 0;
+
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    {
+        // The framework's config document allocates as values are read
+        // back and set; commits are persistence, not a per-event path
+        HeapGuard::Allow configDocument;
+        for (size_t i = 0; i < entryCount; i++) {
+            if (apply(entries[i])) {
+                changed++;
+            } else {
+                skipped++;
+            }
+        }
+    }
+    xSemaphoreGive(configMutex);
+
+    portENTER_CRITICAL(&statsMux);
+    stats.skippedWrites += skipped;
+    if (changed > 0) {
+        stats.commits++;
+    }
+    portEXIT_CRITICAL(&statsMux);
+
+    entryCount = 0;
+    txnOpen = false;
+    xSemaphoreGive(txnMutex);
+
+    if (changed == 0) {
+        return true;
+    }
+
+    flushPending = true;
+
+    if (flushTask) {
+        xTaskNotifyGive(flushTask);
+    } else {
+        flush();
+    }
+
+    return true;
+}
+
+void ConfigStore::abort() {
+    if (!txnOpen) {
+        return;
+    }
+
+    entryCount = 0;
+    txnOpen = false;
+    xSemaphoreGive(txnMutex);
+}
+
+ConfigStore::Entry* ConfigStore::stage(const char* key, EntryType type) {
+    if (!txnOpen) {
+        logger->log("ERROR: Config write to '%s' outside a transaction", key);
+        return nullptr;
+    }
+
+    if (strlen(key) >= CONFIG_TXN_KEY_LEN) {
+        logger->log("ERROR: Config key too long: %s", key);
+        txnFailed = true;
+        return nullptr;
+    }
+
+    // Last write to a key within a transaction wins
+    for (size_t i = 0; i < entryCount; i++) {
+        if (strcmp(entries[i].key, key) == 0) {
+            entries[i].type = type;
+            return &entries[i];
+        }
+    }
+
+    if (entryCount >= CONFIG_TXN_MAX_ENTRIES) {
+        logger->log("ERROR: Config transaction full, dropping '%s'", key);
+        txnFailed = true;
+        return nullptr;
+    }
+
+    Entry* entry = &entries[entryCount++];
+    strcpy(entry->key, key);
+    entry->type = type;
+    return entry;
+}
+
+bool ConfigStore::apply(const Entry& entry) {
+    switch (entry.type) {
+        case EntryType::INT:
+            if (config->getInt(entry.key, ~entry.intValue) == entry.intValue) {
+                return false;
+            }
+            config->setInt(entry.key, entry.intValue);
+            return true;
+
+        case EntryType::BOOL: {
+            bool value = entry.intValue != 0;
+            if (config->getBool(entry.key, !value) == value) {
+                return false;
+            }
+            config->setBool(entry.key, value);
+            return true;
+        }
+
+        case EntryType::STRING: {
+            // Missing keys read back as the default, so probe with two
+            // different defaults to tell "absent" from "equal"
+            if (config->getString(entry.key, "") == entry.stringValue &&
+                config->getString(entry.key, "\x01") == entry.stringValue) {
+                return false;
+            }
+            config->setString(entry.key, entry.stringValue);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ============================================================================
+// Flushing
+// ============================================================================
+
+void ConfigStore::flushNow() {
+    if (flushPending) {
+        flush();
+    }
+}
+
+void ConfigStore::flush() {
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+
+    flushPending = false;
+
+    // LittleFS commits a rewritten file atomically on close, so a power cut
+    // mid-save leaves the previous config.json intact.
+    unsigned long start = micros();
+    bool ok = config->save();
+    uint32_t elapsed = micros() - start;
+
+    xSemaphoreGive(configMutex);
+
+    uint32_t bytes = 0;
+    File file = LittleFS.open(CONFIG_FILE_PATH, "r");
+    if (file) {
+        bytes = file.size();
+        file.close();
+    }
+
+    Metrics::increment(Metrics::Counter::CONFIG_FLUSHES);
+    Metrics::record(Metrics::Histogram::CONFIG_FLUSH_US, elapsed);
+
+    portENTER_CRITICAL(&statsMux);
+    stats.flushes++;
+    stats.lastFlushUs = elapsed;
+    stats.lastBytes = bytes;
+    FlushStats snapshot = stats;
+    portEXIT_CRITICAL(&statsMux);
+
+    logger->log("Config flush %s: %u bytes in %u us (commits: %u, skipped writes: %u)",
+        ok ? "ok" : "FAILED", bytes, elapsed, snapshot.commits, snapshot.skippedWrites);
+}
+
+ConfigStore::FlushStats ConfigStore::getStats() const {
+    portENTER_CRITICAL(&statsMux);
+    FlushStats snapshot = stats;
+    portEXIT_CRITICAL(&statsMux);
+    return snapshot;
+}
+
+void ConfigStore::flushTaskEntry(void* param) {
+    ConfigStore* store = static_cast<ConfigStore*>(param);
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Let back-to-back commits coalesce into one write
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_FLUSH_DEBOUNCE_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        if (store->flushPending) {
+            store->flush();
+        }
+    }
+}
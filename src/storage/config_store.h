@@ -0,0 +1,89 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include "../config.h"
+#include "config/IConfig.h"
+#include "../diag/log_ring.h"
+
+/**
+ * Transactional write layer over the framework's IConfig.
+ *
+ * Mutations between beginTransaction() and commit() are staged in RAM.
+ * commit() applies only the values that actually differ from what the
+ * config already holds and, if anything changed, wakes a background task
+ * that performs a single save(). abort() drops the staged values.
+ * A write that cannot be staged (transaction full, key or string too long)
+ * fails the whole transaction: commit() then applies nothing and returns
+ * false. The staging table is allocated by begin(), before the heap is sealed.
+ *
+ * Transactions are owned by the calling task: beginTransaction() blocks
+ * other writers until that task commits or aborts.
+ */
+class ConfigStore {
+public:
+    struct FlushStats {
+        uint32_t commits;         // commit() calls that changed something
+        uint32_t flushes;         // save() calls actually performed
+        uint32_t skippedWrites;   // staged values equal to the stored value
+        uint32_t lastFlushUs;     // serialize + write time of the last save()
+        uint32_t lastBytes;       // size of the config file after the last save()
+    };
+
+    static ConfigStore& getInstance();
+
+    bool begin(IConfig* config, LogRing* log);
+
+    void beginTransaction();
+    void setInt(const char* key, int value);
+    void setBool(const char* key, bool value);
+    void setString(const char* key, const char* value);
+    bool commit();
+    void abort();
+
+    // Write any pending changes synchronously (e.g. before a restart)
+    void flushNow();
+
+    // Snapshot; commit() and the flush task update the counters concurrently
+    FlushStats getStats() const;
+
+private:
+    ConfigStore();
+
+    // Prevent copying
+    ConfigStore(const ConfigStore&) = delete;
+    ConfigStore& operator=(const ConfigStore&) = delete;
+
+    enum class EntryType : uint8_t { INT, BOOL, STRING };
+
+    struct Entry {
+        char key[CONFIG_TXN_KEY_LEN];
+        union {
+            int intValue;
+            char stringValue[CONFIG_TXN_STRING_LEN];
+        };
+        EntryType type;
+    };
+
+    IConfig* config;
+    LogRing* logger;
+
+    SemaphoreHandle_t txnMutex;     // held from beginTransaction() to commit()/abort()
+    SemaphoreHandle_t configMutex;  // guards IConfig between apply and save()
+    TaskHandle_t flushTask;
+
+    Entry* entries;     // CONFIG_TXN_MAX_ENTRIES, allocated in begin()
+    size_t entryCount;
+    bool txnOpen;
+    bool txnFailed;     // a write was dropped; commit() will abort
+    volatile bool flushPending;
+
+    FlushStats stats;   // guarded by statsMux
+
+    Entry* stage(const char* key, EntryType type);
+    bool apply(const Entry& entry);
+    void flush();
+
+    static void flushTaskEntry(void* param);
+};
+
+#endif // CONFIG_STORE_H
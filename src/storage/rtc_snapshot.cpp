@@ -0,0 +1,107 @@
+#include "rtc_snapshot.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+
+static const uint32_t RTC_SNAPSHOT_MAGIC = 0x42434E33;  // "BCN3"
+
+// RTC slow memory is 8 KB on the S3 and shared with the ULP and the IDF
+static_assert(sizeof(RtcSnapshotData) <= 4096, "RTC snapshot outgrew its share of RTC slow memory");
+
+RTC_NOINIT_ATTR static RtcSnapshotData rtcSnapshot;
+
+// Counter changes come from the BLE task and the app loop
+static portMUX_TYPE snapshotMux = portMUX_INITIALIZER_UNLOCKED;
+
+bool RtcSnapshot::isWarmReset() {
+    switch (esp_reset_reason()) {
+        case ESP_RST_SW:
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+        case ESP_RST_DEEPSLEEP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool RtcSnapshot::load(RtcSnapshotData& out) {
+    if (!isWarmReset()) {
+        invalidate();
+        return false;
+    }
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&rtcSnapshot);
+    if (rtcSnapshot.magic != RTC_SNAPSHOT_MAGIC ||
+        rtcSnapshot.crc != crc32(bytes, offsetof(RtcSnapshotData, crc)) ||
+        rtcSnapshot.registeredDeviceCount > MAX_REGISTERED_DEVICES ||
+        rtcSnapshot.registryCrc != crc32(&rtcSnapshot.macAddresses[0][0],
+                                         rtcSnapshot.registeredDeviceCount * 6)) {
+        invalidate();
+        return false;
+    }
+
+    rtcSnapshot.bootCount++;
+    seal();
+
+    out = rtcSnapshot;
+    return true;
+}
+
+void RtcSnapshot::storeChannels(const int32_t* channelValues) {
+    portENTER_CRITICAL(&snapshotMux);
+    memcpy(rtcSnapshot.channelValues, channelValues, sizeof(rtcSnapshot.channelValues));
+    seal();
+    portEXIT_CRITICAL(&snapshotMux);
+}
+
+void RtcSnapshot::storeRegistry(uint32_t version, uint32_t hash,
+                                const RegisteredDevice* devices, size_t count) {
+    if (count > MAX_REGISTERED_DEVICES) {
+        count = MAX_REGISTERED_DEVICES;
+    }
+
+    // Checksum the table before taking the lock; it only needs the copy
+    uint32_t registryCrc = 0;
+    for (size_t i = 0; i < count; i++) {
+        registryCrc = crc32(devices[i].macAddress, 6, registryCrc);
+    }
+
+    portENTER_CRITICAL(&snapshotMux);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(rtcSnapshot.macAddresses[i], devices[i].macAddress, 6);
+    }
+    rtcSnapshot.registryVersion = version;
+    rtcSnapshot.registryHash = hash;
+    rtcSnapshot.registeredDeviceCount = (uint16_t)count;
+    rtcSnapshot.registryCrc = registryCrc;
+    seal();
+    portEXIT_CRITICAL(&snapshotMux);
+}
+
+void RtcSnapshot::invalidate() {
+    memset(&rtcSnapshot, 0, sizeof(rtcSnapshot));
+}
+
+// Caller holds snapshotMux, or is the only task running (load at boot)
+void RtcSnapshot::seal() {
+    if (rtcSnapshot.magic != RTC_SNAPSHOT_MAGIC) {
+        rtcSnapshot.magic = RTC_SNAPSHOT_MAGIC;
+        rtcSnapshot.bootCount = 0;
+    }
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&rtcSnapshot);
+    rtcSnapshot.crc = crc32(bytes, offsetof(RtcSnapshotData, crc));
+}
+
+uint32_t RtcSnapshot::crc32(const uint8_t* bytes, size_t length, uint32_t crc) {
+    // CRC-32 (IEEE); pass the previous result to continue a running CRC
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
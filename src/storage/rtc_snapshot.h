@@ -0,0 +1,49 @@
+#ifndef RTC_SNAPSHOT_H
+#define RTC_SNAPSHOT_H
+
+#include "../config.h"
+
+/**
+ * Counter table and registry state mirrored into RTC slow memory.
+ *
+ * RTC memory survives software restarts, panics and watchdog resets but
+ * not power loss, so after a warm reset the app can come back up from this
+ * snapshot without waiting on flash. The block is only trusted if both the
+ * magic and the CRCs match.
+ *
+ * The MAC table has its own CRC, so a counter change only rewrites and
+ * checksums the small part in front of it.
+ */
+struct RtcSnapshotData {
+    uint32_t magic;
+    uint32_t bootCount;
+    int32_t channelValues[COUNTER_CHANNELS];
+    uint32_t registryVersion;
+    uint32_t registryHash;
+    uint16_t registeredDeviceCount;
+    uint8_t reserved[2];
+    uint32_t registryCrc;   // macAddresses[0, registeredDeviceCount)
+    uint32_t crc;           // everything above
+    uint8_t macAddresses[MAX_REGISTERED_DEVICES][6];
+};
+
+class RtcSnapshot {
+public:
+    // Returns true and fills `out` if the snapshot survived a warm reset
+    static bool load(RtcSnapshotData& out);
+
+    // The registry must have been stored once before the snapshot is valid
+    static void storeChannels(const int32_t* channelValues);
+    static void storeRegistry(uint32_t version, uint32_t hash,
+                              const RegisteredDevice* devices, size_t count);
+    static void invalidate();
+
+    // Warm resets are the ones that preserve RTC slow memory
+    static bool isWarmReset();
+
+private:
+    static uint32_t crc32(const uint8_t* bytes, size_t length, uint32_t crc = 0);
+    static void seal();
+};
+
+#endif // RTC_SNAPSHOT_H
@@ -0,0 +1,354 @@
+#include "mqtt_bridge.h"
+#include "../app/counter_app.h"
+#include <time.h>
+
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+#if TELEMETRY_ENABLED
+// One character per TelemetryEvent, in enum order
+static const char EVENT_CODES[] = "cpnxgdm";
+static_assert(sizeof(EVENT_CODES) - 1 == (size_t)TelemetryEvent::COUNT, "EVENT_CODES out of sync");
+
+// Closing "]}" of a batch
+static const size_t BATCH_TRAILER_LEN = 2;
+
+// Spool drain scratch; only touched from the bridge task
+static uint8_t drainBuffer[OfflineQueue::MAX_PAYLOAD];
+
+static void copyString(char* dest, size_t capacity, const std::string& value) {
+    strncpy(dest, value.c_str(), capacity - 1);
+    dest[capacity - 1] = '\0';
+}
+#endif
+
+MqttBridge& MqttBridge::getInstance() {
+    static MqttBridge instance;
+    return instance;
+}
+
+MqttBridge::MqttBridge()
+    : logger(nullptr)
+    , bridgeTask(nullptr)
+#if TELEMETRY_ENABLED
+    , client(wifiClient)
+#endif
+    , port(MQTT_DEFAULT_PORT)
+    , ringHead(0)
+    , ringTail(0)
+    , batchLength(0)
+    , batchEvents(0)
+    , batchBaseMs(0)
+    , batchSequence(0)
+    , connected(false)
+    , nextAttemptMs(0)
+    , backoffMs(MQTT_RECONNECT_MIN_MS)
+    , lastDrainMs(0)
+    , droppedEvents(0)
+    , publishedBatches(0)
+    , spooledBatches(0)
+    , drainedBatches(0)
+    , failedPublishes(0) {
+    host[0] = '\0';
+    user[0] = '\0';
+    password[0] = '\0';
+    clientId[0] = '\0';
+    eventsTopic[0] = '\0';
+    statusTopic[0] = '\0';
+}
+
+bool MqttBridge::begin(IConfig* config, LogRing* log) {
+    logger = log;
+
+#if TELEMETRY_ENABLED
+    copyString(host, sizeof(host), config->getString(CONFIG_MQTT_HOST, ""));
+    if (host[0] == '\0') {
+        logger->log("Telemetry: %s not set, MQTT bridge disabled", CONFIG_MQTT_HOST);
+        return true;
+    }
+
+    port = (uint16_t)config->getInt(CONFIG_MQTT_PORT, MQTT_DEFAULT_PORT);
+    copyString(user, sizeof(user), config->getString(CONFIG_MQTT_USER, ""));
+    copyString(password, sizeof(password), config->getString(CONFIG_MQTT_PASSWORD, ""));
+
+    char prefix[CONFIG_TXN_STRING_LEN];
+    copyString(prefix, sizeof(prefix), config->getString(CONFIG_MQTT_PREFIX, MQTT_DEFAULT_PREFIX));
+
+    // Topics and client id are keyed by the station MAC, which is stable
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    snprintf(clientId, sizeof(clientId), "ble-access-%02x%02x%02x%02x%02x%02x",
+        mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    snprintf(eventsTopic, sizeof(eventsTopic), "%s/%s/events", prefix, clientId);
+    snprintf(statusTopic, sizeof(statusTopic), "%s/%s/status", prefix, clientId);
+
+    if (!spool.begin(logger)) {
+        logger->log("ERROR: Telemetry spool unavailable, offline events will be lost");
+    }
+
+    client.setServer(host, port);
+    client.setKeepAlive(MQTT_KEEPALIVE_S);
+    client.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+    // Sized once here so publishing never reallocates after boot
+    client.setBufferSize(OfflineQueue::MAX_PAYLOAD + MQTT_TOPIC_LEN + 8);
+
+    StateBus::getInstance().subscribe(this,
+        StateBus::COUNTER | StateBus::PROXIMITY | StateBus::CONNECTION | StateBus::PAIRING,
+        StateBus::Delivery::APP_LOOP);
+
+    if (xTaskCreatePinnedToCore(bridgeTaskEntry, "Telemetry", MQTT_TASK_STACK, this,
+                                TASK_PRIORITY_TELEMETRY, &bridgeTask, CORE_TELEMETRY) != pdPASS) {
+        logger->log("ERROR: Failed to create telemetry task");
+        return false;
+    }
+
+    logger->log("Telemetry: publishing to %s:%u %s", host, port, eventsTopic);
+#endif
+    return true;
+}
+
+// ============================================================================
+// Event Capture
+// ============================================================================
+
+void MqttBridge::record(TelemetryEvent type, int32_t value) {
+    if (!bridgeTask) {
+        return;
+    }
+
+    bool full = false;
+    bool batchReady = false;
+
+    portENTER_CRITICAL(&ringMux);
+    size_t next = (ringHead + 1) % MQTT_EVENT_RING_LEN;
+    if (next == ringTail) {
+        full = true;
+    } else {
+        Event& event = ring[ringHead];
+        event.uptimeMs = millis();
+        event.type = type;
+        event.value = value;
+        ringHead = next;
+        batchReady = (ringHead + MQTT_EVENT_RING_LEN - ringTail) % MQTT_EVENT_RING_LEN >= MQTT_BATCH_MAX_EVENTS;
+    }
+    portEXIT_CRITICAL(&ringMux);
+
+    if (full) {
+        droppedEvents++;
+    } else if (batchReady) {
+        xTaskNotifyGive(bridgeTask);
+    }
+}
+
+void MqttBridge::onStateChanged(uint32_t fields, uint32_t version) {
+    // Coalesced per loop iteration, so each field reports its latest value
+    if (fields & StateBus::COUNTER) {
+        record(TelemetryEvent::COUNTER, CounterApp::getInstance().getValue());
+    }
+    if (fields & StateBus::CONNECTION) {
+        record(BLEManager::getInstance().isDeviceConnected() ? TelemetryEvent::CONNECT
+                                                             : TelemetryEvent::DISCONNECT);
+    }
+    if (fields & StateBus::PROXIMITY) {
+        record(TelemetryEvent::PRESENCE, CounterApp::getInstance().isConnectedDeviceNearby() ? 1 : 0);
+    }
+    if (fields & StateBus::PAIRING) {
+        record(TelemetryEvent::PAIRING, BLEManager::getInstance().isInPairingMode() ? 1 : 0);
+    }
+}
+
+#if TELEMETRY_ENABLED
+// ============================================================================
+// Bridge Task
+// ============================================================================
+
+void MqttBridge::bridgeTaskEntry(void* param) {
+    static_cast<MqttBridge*>(param)->bridgeLoop();
+}
+
+void MqttBridge::bridgeLoop() {
+    while (true) {
+        // Woken early when a batch fills; otherwise poll for keepalive and windows
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_TASK_POLL_MS));
+
+        uint32_t now = millis();
+        maintainConnection(now);
+        collectEvents(now);
+        drainSpool(now);
+    }
+}
+
+void MqttBridge::maintainConnection(uint32_t nowMs) {
+    if (WiFi.status() != WL_CONNECTED) {
+        if (connected) {
+            connected = false;
+            logger->log("Telemetry: WiFi down, spooling batches");
+        }
+        return;
+    }
+
+    if (client.connected()) {
+        client.loop();
+        return;
+    }
+
+    if (connected) {
+        connected = false;
+        nextAttemptMs = nowMs;
+        logger->log("Telemetry: broker connection lost (state %d)", client.state());
+    }
+
+    if ((int32_t)(nowMs - nextAttemptMs) < 0) {
+        return;
+    }
+
+    // The broker publishes the retained "offline" will if we drop off
+    bool ok = client.connect(clientId,
+                             user[0] ? user : nullptr,
+                             user[0] ? password : nullptr,
+                             statusTopic, 0, true, "offline");
+    if (!ok) {
+        logger->log("Telemetry: connect to %s:%u failed (state %d), retry in %u s",
+            host, port, client.state(), backoffMs / 1000);
+        nextAttemptMs = nowMs + backoffMs;
+        backoffMs = backoffMs * 2 > MQTT_RECONNECT_MAX_MS ? MQTT_RECONNECT_MAX_MS : backoffMs * 2;
+        return;
+    }
+
+    client.publish(statusTopic, "online", true);
+    connected = true;
+    backoffMs = MQTT_RECONNECT_MIN_MS;
+    lastDrainMs = nowMs;
+    logger->log("Telemetry: connected to %s:%u (%u batches spooled)", host, port, spool.size());
+}
+
+// ============================================================================
+// Batching
+// ============================================================================
+
+void MqttBridge::collectEvents(uint32_t nowMs) {
+    while (true) {
+        Event event;
+
+        portENTER_CRITICAL(&ringMux);
+        if (ringTail == ringHead) {
+            portEXIT_CRITICAL(&ringMux);
+            break;
+        }
+        event = ring[ringTail];
+        ringTail = (ringTail + 1) % MQTT_EVENT_RING_LEN;
+        portEXIT_CRITICAL(&ringMux);
+
+        appendEvent(event);
+    }
+
+    if (batchEvents > 0 &&
+        (batchEvents >= MQTT_BATCH_MAX_EVENTS || nowMs - batchBaseMs >= MQTT_BATCH_WINDOW_MS)) {
+        closeBatch();
+    }
+}
+
+void MqttBridge::openBatch(uint32_t baseMs) {
+    time_t now = time(nullptr);
+    batchBaseMs = baseMs;
+    batchEvents = 0;
+    batchLength = snprintf(batch, sizeof(batch), "{\"v\":1,\"seq\":%lu,\"up\":%lu,\"ts\":%ld,\"ev\":[",
+        (unsigned long)batchSequence++, (unsigned long)baseMs,
+        now >= TIME_MIN_VALID_EPOCH ? (long)now : 0L);
+}
+
+void MqttBridge::appendEvent(const Event& event) {
+    if (batchEvents >= MQTT_BATCH_MAX_EVENTS) {
+        closeBatch();
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (batchEvents == 0) {
+            openBatch(event.uptimeMs);
+        }
+
+        // [ms since batch start, type, value]
+        char item[32];
+        int length = snprintf(item, sizeof(item), "%s[%lu,\"%c\",%ld]",
+            batchEvents ? "," : "",
+            (unsigned long)(event.uptimeMs - batchBaseMs),
+            EVENT_CODES[(size_t)event.type], (long)event.value);
+
+        if (batchLength + length + BATCH_TRAILER_LEN <= OfflineQueue::MAX_PAYLOAD) {
+            memcpy(batch + batchLength, item, length);
+            batchLength += length;
+            batchEvents++;
+            return;
+        }
+
+        // Out of room; ship this batch and start the next one with this event
+        closeBatch();
+    }
+}
+
+void MqttBridge::closeBatch() {
+    if (batchEvents == 0) {
+        return;
+    }
+
+    memcpy(batch + batchLength, "]}", BATCH_TRAILER_LEN);
+    batchLength += BATCH_TRAILER_LEN;
+
+    // Live batches queue behind spooled ones so the broker sees them in order
+    bool sent = connected && spool.size() == 0 &&
+                publishBatch((const uint8_t*)batch, batchLength);
+    if (!sent) {
+        if (spool.push((const uint8_t*)batch, batchLength)) {
+            spooledBatches++;
+        }
+    }
+
+    batchLength = 0;
+    batchEvents = 0;
+}
+
+// ============================================================================
+// Publishing
+// ============================================================================
+
+void MqttBridge::drainSpool(uint32_t nowMs) {
+    if (!connected || spool.size() == 0 || nowMs - lastDrainMs < MQTT_DRAIN_INTERVAL_MS) {
+        return;
+    }
+    lastDrainMs = nowMs;
+
+    size_t length = spool.peek(drainBuffer, sizeof(drainBuffer));
+    if (length && publishBatch(drainBuffer, length)) {
+        spool.pop();
+        drainedBatches++;
+    }
+}
+
+bool MqttBridge::publishBatch(const uint8_t* data, size_t length) {
+    if (!client.publish(eventsTopic, data, length, false)) {
+        failedPublishes++;
+        return false;
+    }
+    publishedBatches++;
+    return true;
+}
+
+#endif
+
+// ============================================================================
+// Report
+// ============================================================================
+
+void MqttBridge::report() {
+    if (!logger || !bridgeTask) {
+        return;
+    }
+
+    logger->log("=== Telemetry (%s) ===", connected ? "connected" : "offline");
+    logger->log("  batches: %lu published, %lu spooled, %lu drained, %lu failed",
+        (unsigned long)publishedBatches, (unsigned long)spooledBatches,
+        (unsigned long)drainedBatches, (unsigned long)failedPublishes);
+    logger->log("  spool: %u/%u queued, %lu overwritten; %lu events dropped",
+        spool.size(), MQTT_SPOOL_SLOTS, (unsigned long)spool.getDropped(),
+        (unsigned long)droppedEvents);
+    logger->log("======================");
+}
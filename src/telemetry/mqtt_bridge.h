@@ -0,0 +1,127 @@
+#ifndef MQTT_BRIDGE_H
+#define MQTT_BRIDGE_H
+
+#include <Arduino.h>
+#include "../config.h"
+#if TELEMETRY_ENABLED
+#include <WiFi.h>
+#include <PubSubClient.h>
+#endif
+#include "config/IConfig.h"
+#include "../diag/log_ring.h"
+#include "../app/state_bus.h"
+#include "offline_queue.h"
+
+enum class TelemetryEvent : uint8_t {
+    COUNTER,          // value: counter
+    PRESENCE,         // value: 1 nearby, 0 gone
+    CONNECT,
+    DISCONNECT,
+    ACCESS_GRANTED,   // value: RelaySource
+    ACCESS_DENIED,    // value: AccessDenial
+    PAIRING,          // value: 1 entered, 0 exited
+    COUNT
+};
+
+enum class AccessDenial : uint8_t {
+    CONNECT = 1,
+    READ,
+    WRITE,
+    GATE
+};
+
+/**
+ * Publishes counter, presence and access events to an MQTT broker.
+ *
+ * record() is safe from any task and only appends to a small RAM ring.
+ * A bridge task packs events into compact JSON batches, closing a batch
+ * when it is full or MQTT_BATCH_WINDOW_MS after its first event. A closed
+ * batch is published to <prefix>/<device>/events. While offline it goes
+ * to a flash-backed OfflineQueue, which is drained one batch per
+ * MQTT_DRAIN_INTERVAL_MS after reconnecting. The bridge keeps its own
+ * PubSubClient session with a retained online/offline status topic.
+ * It stays idle unless mqtt.host is set in config.json; with
+ * TELEMETRY_ENABLED 0, record() is a no-op and no MQTT code is built.
+ */
+class MqttBridge : public StateObserver {
+public:
+    static MqttBridge& getInstance();
+
+    bool begin(IConfig* config, LogRing* log);
+
+    // Any task; never blocks. Events are dropped (and counted) if the ring is full.
+    void record(TelemetryEvent type, int32_t value = 0);
+
+    bool isConnected() const { return connected; }
+
+    // Connection, batch and spool counters
+    void report();
+
+    void onStateChanged(uint32_t fields, uint32_t version) override;
+
+private:
+    MqttBridge();
+
+    // Prevent copying
+    MqttBridge(const MqttBridge&) = delete;
+    MqttBridge& operator=(const MqttBridge&) = delete;
+
+    struct Event {
+        uint32_t uptimeMs;
+        TelemetryEvent type;
+        int32_t value;
+    };
+
+    LogRing* logger;
+    TaskHandle_t bridgeTask;
+#if TELEMETRY_ENABLED
+    WiFiClient wifiClient;
+    PubSubClient client;
+#endif
+    OfflineQueue spool;
+
+    char host[CONFIG_TXN_STRING_LEN];
+    uint16_t port;
+    char user[CONFIG_TXN_STRING_LEN];
+    char password[CONFIG_TXN_STRING_LEN];
+    char clientId[24];
+    char eventsTopic[MQTT_TOPIC_LEN];
+    char statusTopic[MQTT_TOPIC_LEN];
+
+    // Producer ring (any task), drained by the bridge task
+    Event ring[MQTT_EVENT_RING_LEN];
+    size_t ringHead;
+    size_t ringTail;
+
+    // Batch being assembled (bridge task only)
+    char batch[OfflineQueue::MAX_PAYLOAD + 1];
+    size_t batchLength;
+    size_t batchEvents;
+    uint32_t batchBaseMs;
+    uint32_t batchSequence;
+
+    // Connection state (bridge task only, except `connected`)
+    volatile bool connected;
+    uint32_t nextAttemptMs;
+    uint32_t backoffMs;
+    uint32_t lastDrainMs;
+
+    // Counters
+    volatile uint32_t droppedEvents;
+    uint32_t publishedBatches;
+    uint32_t spooledBatches;
+    uint32_t drainedBatches;
+    uint32_t failedPublishes;
+
+    static void bridgeTaskEntry(void* param);
+    void bridgeLoop();
+    void maintainConnection(uint32_t nowMs);
+    void collectEvents(uint32_t nowMs);
+    void appendEvent(const Event& event);
+    void openBatch(uint32_t baseMs);
+    void closeBatch();
+    void drainSpool(uint32_t nowMs);
+    bool publishBatch(const uint8_t* data, size_t length);
+};
+
+#endif // MQTT_BRIDGE_H
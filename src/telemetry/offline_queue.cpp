@@ -0,0 +1,146 @@
+#include "offline_queue.h"
+#include <LittleFS.h>
+
+// Bump when the slot geometry or header layout changes; a mismatch resets the file
+static const uint32_t SPOOL_MAGIC = 0x53504C00 | MQTT_SPOOL_SLOTS;
+
+OfflineQueue::OfflineQueue()
+    : logger(nullptr)
+    , ready(false) {
+    memset(&header, 0, sizeof(header));
+}
+
+bool OfflineQueue::begin(LogRing* log) {
+    logger = log;
+
+    File file = LittleFS.open(MQTT_SPOOL_PATH, "r");
+    bool valid = file && file.size() == slotOffset(MQTT_SPOOL_SLOTS) &&
+                 file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == SPOOL_MAGIC &&
+                 header.head < MQTT_SPOOL_SLOTS && header.tail < MQTT_SPOOL_SLOTS &&
+                 header.count <= MQTT_SPOOL_SLOTS;
+    if (file) {
+        file.close();
+    }
+
+    if (valid) {
+        ready = true;
+        if (header.count) {
+            logger->log("Telemetry spool: %u batches pending from before restart", header.count);
+        }
+        return true;
+    }
+
+    // Allocate the whole ring up front so later writes never extend the file
+    memset(&header, 0, sizeof(header));
+    header.magic = SPOOL_MAGIC;
+
+    file = LittleFS.open(MQTT_SPOOL_PATH, "w");
+    if (!file) {
+        logger->log("ERROR: Cannot create telemetry spool %s", MQTT_SPOOL_PATH);
+        return false;
+    }
+
+    static const uint8_t zeros[64] = {0};
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    for (uint32_t written = sizeof(header); ok && written < slotOffset(MQTT_SPOOL_SLOTS); ) {
+        uint32_t remaining = slotOffset(MQTT_SPOOL_SLOTS) - written;
+        size_t chunk = remaining < sizeof(zeros) ? remaining : sizeof(zeros);
+        ok = file.write(zeros, chunk) == chunk;
+        written += chunk;
+    }
+    file.close();
+
+    if (!ok) {
+        logger->log("ERROR: Telemetry spool write failed (filesystem full?)");
+        return false;
+    }
+
+    ready = true;
+    return true;
+}
+
+uint32_t OfflineQueue::slotOffset(uint16_t slot) {
+    return sizeof(Header) + (uint32_t)slot * MQTT_SPOOL_SLOT_BYTES;
+}
+
+bool OfflineQueue::writeHeader() {
+    File file = LittleFS.open(MQTT_SPOOL_PATH, "r+");
+    if (!file) {
+        return false;
+    }
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    file.close();
+    return ok;
+}
+
+// ============================================================================
+// Queue Operations
+// ============================================================================
+
+bool OfflineQueue::push(const uint8_t* data, size_t length) {
+    if (!ready || length == 0 || length > MAX_PAYLOAD) {
+        return false;
+    }
+
+    File file = LittleFS.open(MQTT_SPOOL_PATH, "r+");
+    if (!file) {
+        return false;
+    }
+
+    uint16_t prefix = (uint16_t)length;
+    bool ok = file.seek(slotOffset(header.head)) &&
+              file.write((const uint8_t*)&prefix, sizeof(prefix)) == sizeof(prefix) &&
+              file.write(data, length) == length;
+    file.close();
+    if (!ok) {
+        logger->log("ERROR: Telemetry spool write failed");
+        return false;
+    }
+
+    header.head = (header.head + 1) % MQTT_SPOOL_SLOTS;
+    if (header.count == MQTT_SPOOL_SLOTS) {
+        // Full: the slot just written was the oldest
+        header.tail = header.head;
+        header.dropped++;
+    } else {
+        header.count++;
+    }
+    return writeHeader();
+}
+
+size_t OfflineQueue::peek(uint8_t* out, size_t capacity) {
+    if (!ready || header.count == 0) {
+        return 0;
+    }
+
+    File file = LittleFS.open(MQTT_SPOOL_PATH, "r");
+    if (!file) {
+        return 0;
+    }
+
+    uint16_t length = 0;
+    bool ok = file.seek(slotOffset(header.tail)) &&
+              file.read((uint8_t*)&length, sizeof(length)) == sizeof(length) &&
+              length > 0 && length <= MAX_PAYLOAD && length <= capacity &&
+              file.read(out, length) == length;
+    file.close();
+
+    if (!ok) {
+        // Unreadable slot; skip it rather than wedge the drain
+        logger->log("ERROR: Dropping corrupt telemetry spool slot %u", header.tail);
+        pop();
+        return 0;
+    }
+    return length;
+}
+
+void OfflineQueue::pop() {
+    if (!ready || header.count == 0) {
+        return;
+    }
+
+    header.tail = (header.tail + 1) % MQTT_SPOOL_SLOTS;
+    header.count--;
+    writeHeader();
+}
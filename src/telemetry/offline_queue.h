@@ -0,0 +1,53 @@
+#ifndef OFFLINE_QUEUE_H
+#define OFFLINE_QUEUE_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include "../diag/log_ring.h"
+
+/**
+ * Bounded FIFO of telemetry batches in a fixed-size LittleFS file.
+ *
+ * The file is a header followed by MQTT_SPOOL_SLOTS slots of
+ * MQTT_SPOOL_SLOT_BYTES, used as a ring, so it never grows and a full
+ * queue overwrites its oldest batch. Slots are written before the header
+ * that publishes them, so a power cut loses at most the batch in flight.
+ * Contents survive reboots. Not thread-safe: owned by the bridge task.
+ */
+class OfflineQueue {
+public:
+    OfflineQueue();
+
+    bool begin(LogRing* log);
+
+    // Appends a batch, dropping the oldest when full
+    bool push(const uint8_t* data, size_t length);
+
+    // Copies the oldest batch; returns its length or 0 if empty
+    size_t peek(uint8_t* out, size_t capacity);
+    void pop();
+
+    size_t size() const { return header.count; }
+    uint32_t getDropped() const { return header.dropped; }
+
+    static const size_t MAX_PAYLOAD = MQTT_SPOOL_SLOT_BYTES - 2;
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t head;      // next slot to write
+        uint16_t tail;      // oldest queued slot
+        uint16_t count;
+        uint16_t reserved;
+        uint32_t dropped;   // batches overwritten while full
+    };
+
+    LogRing* logger;
+    bool ready;
+    Header header;
+
+    bool writeHeader();
+    static uint32_t slotOffset(uint16_t slot);
+};
+
+#endif // OFFLINE_QUEUE_H
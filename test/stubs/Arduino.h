@@ -0,0 +1,17 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Host stand-in for the few Arduino/FreeRTOS pieces the host-tested
+// sources use. Tests are single-threaded, so critical sections are no-ops.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux)  ((void)(mux))
+
+#endif // ARDUINO_H
@@ -0,0 +1,17 @@
+#ifndef BOARD_PROFILES_H
+#define BOARD_PROFILES_H
+
+// Host stand-in for the framework's board profile: the T-Display S3 pin map
+// and the feature defaults config.h expects
+
+#ifndef HAS_DISPLAY
+#define HAS_DISPLAY 1
+#endif
+
+#ifndef HAS_BUTTONS
+#define HAS_BUTTONS 1
+#endif
+
+#include "esp32s3.h"
+
+#endif // BOARD_PROFILES_H
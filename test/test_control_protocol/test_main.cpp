@@ -0,0 +1,353 @@
+#include <unity.h>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include "control/control_protocol.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+// ============================================================================
+// Pty harness
+// ============================================================================
+
+// The protocol runs on the pty master as it would on the CDC port; the test
+// plays the host tool on the slave end. Both ends are raw and non-blocking,
+// and everything runs on one thread, so the device side is polled whenever
+// the host side waits.
+class PtyTransport : public ControlTransport {
+public:
+    int fd = -1;
+
+    size_t read(uint8_t* buffer, size_t capacity) override {
+        ssize_t n = ::read(fd, buffer, capacity);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    size_t write(const uint8_t* data, size_t length) override {
+        size_t written = 0;
+        while (written < length) {
+            ssize_t n = ::write(fd, data + written, length - written);
+            if (n > 0) {
+                written += (size_t)n;
+            } else {
+                usleep(100);
+            }
+        }
+        return written;
+    }
+};
+
+static const uint8_t OP_ECHO = 0x01;
+static const uint8_t OP_STREAM = 0x02;
+static const size_t STREAM_CHUNKS = 3;
+
+static PtyTransport* device;
+static ControlProtocol* protocol;
+static int host = -1;
+static int handled;
+static Bytes hostPending;
+
+static void onRequest(void* arg, ControlProtocol& protocol, const ControlProtocol::Request& request) {
+    (void)arg;
+    handled++;
+    if (request.opcode == OP_ECHO) {
+        protocol.respond(request, ControlProtocol::STATUS_OK, request.body, request.length);
+    } else if (request.opcode == OP_STREAM) {
+        for (uint8_t i = 0; i < STREAM_CHUNKS; i++) {
+            bool last = i + 1 == STREAM_CHUNKS;
+            protocol.respond(request, last ? ControlProtocol::STATUS_OK : ControlProtocol::STATUS_MORE, &i, 1);
+        }
+    } else {
+        protocol.respond(request, ControlProtocol::STATUS_UNKNOWN_OPCODE, nullptr, 0);
+    }
+}
+
+static void makeRaw(int fd) {
+    struct termios settings;
+    tcgetattr(fd, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(fd, TCSANOW, &settings);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void setUp() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    TEST_ASSERT_TRUE(master >= 0);
+    TEST_ASSERT_EQUAL(0, grantpt(master));
+    TEST_ASSERT_EQUAL(0, unlockpt(master));
+    host = open(ptsname(master), O_RDWR | O_NOCTTY);
+    TEST_ASSERT_TRUE(host >= 0);
+    makeRaw(host);
+    makeRaw(master);
+
+    device = new PtyTransport();
+    device->fd = master;
+    protocol = new ControlProtocol();
+    protocol->begin(device, onRequest, nullptr);
+    handled = 0;
+    hostPending.clear();
+}
+
+void tearDown() {
+    delete protocol;
+    close(device->fd);
+    delete device;
+    close(host);
+}
+
+// ============================================================================
+// Host side
+// ============================================================================
+
+// Written from the format description rather than shared with the device
+// code, so an encoder bug can't hide behind a matching decoder bug
+static Bytes cobsEncode(const Bytes& data) {
+    Bytes out(1);
+    size_t codeIndex = 0;
+    uint8_t code = 1;
+    for (uint8_t byte : data) {
+        if (byte) {
+            out.push_back(byte);
+            code++;
+        }
+        if (!byte || code == 0xFF) {
+            out[codeIndex] = code;
+            code = 1;
+            codeIndex = out.size();
+            out.push_back(0);
+        }
+    }
+    out[codeIndex] = code;
+    return out;
+}
+
+static Bytes cobsDecode(const Bytes& data) {
+    Bytes out;
+    size_t i = 0;
+    while (i < data.size()) {
+        uint8_t code = data[i++];
+        for (uint8_t j = 1; j < code && i < data.size(); j++) {
+            out.push_back(data[i++]);
+        }
+        if (code != 0xFF && i < data.size()) {
+            out.push_back(0);
+        }
+    }
+    return out;
+}
+
+static void appendU32(Bytes& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+static Bytes frame(uint8_t seq, uint8_t opcode, const Bytes& body) {
+    Bytes payload = { seq, opcode };
+    payload.insert(payload.end(), body.begin(), body.end());
+    appendU32(payload, ControlProtocol::crc32(payload.data(), payload.size()));
+
+    Bytes out = { 0 };
+    Bytes encoded = cobsEncode(payload);
+    out.insert(out.end(), encoded.begin(), encoded.end());
+    out.push_back(0);
+    return out;
+}
+
+// Writes everything, polling the device whenever the pty buffer is full
+static void hostWrite(const Bytes& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(host, data.data() + written, data.size() - written);
+        if (n > 0) {
+            written += (size_t)n;
+        } else {
+            protocol->poll();
+        }
+    }
+    protocol->poll();
+}
+
+static void hostWrite(const char* text) {
+    hostWrite(Bytes(text, text + strlen(text)));
+}
+
+// Next response payload (CRC checked and stripped), or empty after a
+// quiet spell
+static Bytes hostRead() {
+    Bytes& pending = hostPending;
+    for (int idle = 0; idle < 200; ) {
+        uint8_t chunk[256];
+        ssize_t n = ::read(host, chunk, sizeof(chunk));
+        if (n > 0) {
+            pending.insert(pending.end(), chunk, chunk + n);
+        } else {
+            protocol->poll();
+            usleep(500);
+            idle++;
+        }
+
+        while (!pending.empty() && pending[0] == 0) {
+            pending.erase(pending.begin());
+        }
+        for (size_t end = 0; end < pending.size(); end++) {
+            if (pending[end] != 0) {
+                continue;
+            }
+            Bytes payload = cobsDecode(Bytes(pending.begin(), pending.begin() + end));
+            pending.erase(pending.begin(), pending.begin() + end);
+            TEST_ASSERT_TRUE(payload.size() >= ControlProtocol::RESPONSE_HEADER_LEN + ControlProtocol::CRC_LEN);
+            size_t length = payload.size() - ControlProtocol::CRC_LEN;
+            uint32_t crc = 0;
+            for (int i = 0; i < 4; i++) {
+                crc |= (uint32_t)payload[length + i] << (8 * i);
+            }
+            TEST_ASSERT_EQUAL_HEX32(ControlProtocol::crc32(payload.data(), length), crc);
+            payload.resize(length);
+            return payload;
+        }
+    }
+    return Bytes();
+}
+
+// ============================================================================
+// Encoding
+// ============================================================================
+
+static void test_crc32_matches_zlib() {
+    const char* check = "123456789";
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, ControlProtocol::crc32((const uint8_t*)check, 9));
+}
+
+static void test_cobs_round_trips_zeros_and_long_runs() {
+    Bytes data = { 0, 0, 1, 0 };
+    for (int i = 0; i < 600; i++) {
+        data.push_back((uint8_t)(i % 255 + 1));
+    }
+    data.push_back(0);
+
+    uint8_t encoded[700];
+    size_t encodedLength = ControlProtocol::cobsEncode(data.data(), data.size(), encoded);
+    Bytes expected = cobsEncode(data);
+    TEST_ASSERT_EQUAL_size_t(expected.size(), encodedLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), encoded, encodedLength);
+
+    uint8_t decoded[700];
+    size_t decodedLength = ControlProtocol::cobsDecode(encoded, encodedLength, decoded, sizeof(decoded));
+    TEST_ASSERT_EQUAL_size_t(data.size(), decodedLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data.data(), decoded, decodedLength);
+
+    // Too small an output is refused, not overrun
+    TEST_ASSERT_EQUAL_size_t(0, ControlProtocol::cobsDecode(encoded, encodedLength, decoded, 10));
+}
+
+// ============================================================================
+// Framing over the pty
+// ============================================================================
+
+static void test_request_gets_matching_response() {
+    Bytes body = { 0, 1, 0, 2, 0 };
+    hostWrite(frame(7, OP_ECHO, body));
+
+    Bytes response = hostRead();
+    TEST_ASSERT_EQUAL_size_t(ControlProtocol::RESPONSE_HEADER_LEN + body.size(), response.size());
+    TEST_ASSERT_EQUAL_UINT8(7, response[0]);
+    TEST_ASSERT_EQUAL_UINT8(OP_ECHO | ControlProtocol::RESPONSE_FLAG, response[1]);
+    TEST_ASSERT_EQUAL_UINT8(ControlProtocol::STATUS_OK, response[2]);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(body.data(), response.data() + 3, body.size());
+    TEST_ASSERT_EQUAL_UINT32(1, protocol->getFramesIn());
+}
+
+static void test_largest_request_is_accepted() {
+    Bytes body(CONTROL_MAX_PAYLOAD - ControlProtocol::REQUEST_HEADER_LEN, 0x5A);
+    body[0] = 0;
+    hostWrite(frame(1, OP_STREAM, body));
+    TEST_ASSERT_EQUAL(1, handled);
+    TEST_ASSERT_EQUAL_UINT32(0, protocol->getBadFrames());
+}
+
+static void test_text_between_frames_is_skipped() {
+    // Log lines around and between frames, as on the real port
+    hostWrite("boot: hello\r\n");
+    hostWrite(frame(1, OP_ECHO, Bytes { 0xAA }));
+    hostWrite("counter changed\r\n");
+    hostWrite(frame(2, OP_ECHO, Bytes { 0xBB }));
+
+    Bytes first = hostRead();
+    Bytes second = hostRead();
+    TEST_ASSERT_EQUAL(2, handled);
+    TEST_ASSERT_EQUAL_UINT8(1, first[0]);
+    TEST_ASSERT_EQUAL_UINT8(0xAA, first[3]);
+    TEST_ASSERT_EQUAL_UINT8(2, second[0]);
+    TEST_ASSERT_EQUAL_UINT8(0xBB, second[3]);
+    TEST_ASSERT_EQUAL_UINT32(2, protocol->getBadFrames());
+}
+
+static void test_corrupt_frame_is_dropped() {
+    Bytes bad = frame(1, OP_ECHO, Bytes { 1, 2, 3 });
+    bad[4] ^= 0x10;
+    hostWrite(bad);
+    TEST_ASSERT_EQUAL(0, handled);
+    TEST_ASSERT_EQUAL_UINT32(1, protocol->getBadFrames());
+    TEST_ASSERT_TRUE(hostRead().empty());
+
+    hostWrite(frame(2, OP_ECHO, Bytes { 4 }));
+    TEST_ASSERT_EQUAL_UINT8(2, hostRead()[0]);
+}
+
+static void test_oversized_frame_is_dropped_and_resyncs() {
+    Bytes flood(CONTROL_MAX_PAYLOAD * 2, 0x41);
+    flood.push_back(0);
+    hostWrite(flood);
+    TEST_ASSERT_EQUAL(0, handled);
+    TEST_ASSERT_EQUAL_UINT32(1, protocol->getBadFrames());
+
+    hostWrite(frame(3, OP_ECHO, Bytes { 9 }));
+    Bytes response = hostRead();
+    TEST_ASSERT_EQUAL_UINT8(3, response[0]);
+    TEST_ASSERT_EQUAL_UINT8(9, response[3]);
+}
+
+static void test_long_answer_streams_more_then_ok() {
+    hostWrite(frame(9, OP_STREAM, Bytes()));
+    for (uint8_t i = 0; i < STREAM_CHUNKS; i++) {
+        Bytes response = hostRead();
+        TEST_ASSERT_EQUAL_size_t(ControlProtocol::RESPONSE_HEADER_LEN + 1, response.size());
+        TEST_ASSERT_EQUAL_UINT8(9, response[0]);
+        TEST_ASSERT_EQUAL_UINT8(i + 1 == STREAM_CHUNKS ? ControlProtocol::STATUS_OK : ControlProtocol::STATUS_MORE,
+                                response[2]);
+        TEST_ASSERT_EQUAL_UINT8(i, response[3]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(STREAM_CHUNKS, protocol->getFramesOut());
+}
+
+static void test_unknown_opcode_is_answered() {
+    hostWrite(frame(4, 0x7E, Bytes()));
+    Bytes response = hostRead();
+    TEST_ASSERT_EQUAL_UINT8(0x7E | ControlProtocol::RESPONSE_FLAG, response[1]);
+    TEST_ASSERT_EQUAL_UINT8(ControlProtocol::STATUS_UNKNOWN_OPCODE, response[2]);
+}
+
+static void test_looped_back_response_is_not_a_request() {
+    hostWrite(frame(5, OP_ECHO | ControlProtocol::RESPONSE_FLAG, Bytes { 0 }));
+    TEST_ASSERT_EQUAL(0, handled);
+    TEST_ASSERT_EQUAL_UINT32(0, protocol->getFramesIn());
+    TEST_ASSERT_EQUAL_UINT32(0, protocol->getBadFrames());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_crc32_matches_zlib);
+    RUN_TEST(test_cobs_round_trips_zeros_and_long_runs);
+    RUN_TEST(test_request_gets_matching_response);
+    RUN_TEST(test_largest_request_is_accepted);
+    RUN_TEST(test_text_between_frames_is_skipped);
+    RUN_TEST(test_corrupt_frame_is_dropped);
+    RUN_TEST(test_oversized_frame_is_dropped_and_resyncs);
+    RUN_TEST(test_long_answer_streams_more_then_ok);
+    RUN_TEST(test_unknown_opcode_is_answered);
+    RUN_TEST(test_looped_back_response_is_not_a_request);
+    return UNITY_END();
+}
@@ -0,0 +1,224 @@
+#include <unity.h>
+#include <vector>
+#include "diag/trace_codec.h"
+
+typedef TraceCodec::Type Type;
+typedef TraceCodec::Target Target;
+
+// ============================================================================
+// Recorder and replay
+// ============================================================================
+
+// Builds a trace file the way EventTrace records one: header, MACs, then
+// each record encoded against the previous record's time
+struct Recording {
+    std::vector<uint8_t> bytes;
+    int64_t lastUs = 0;
+
+    explicit Recording(const TraceCodec::Header& header) {
+        uint8_t encoded[TraceCodec::HEADER_LEN];
+        TraceCodec::encodeHeader(header, encoded);
+        bytes.insert(bytes.end(), encoded, encoded + sizeof(encoded));
+        for (uint16_t i = 0; i < header.deviceCount; i++) {
+            uint8_t mac[6] = { 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, (uint8_t)i };
+            bytes.insert(bytes.end(), mac, mac + 6);
+        }
+    }
+
+    // length is what was written; the record keeps at most
+    // EVENT_TRACE_MAX_PAYLOAD bytes of it, as EventTrace::append does
+    void add(int64_t timeUs, Type type, Target target, const uint8_t* data, size_t length) {
+        static TraceCodec::Record record;
+        record.timeUs = timeUs;
+        record.type = type;
+        record.target = target;
+        record.length = (uint16_t)length;
+        if (length) {
+            memcpy(record.data, data, TraceCodec::storedLength(length));
+        }
+
+        uint8_t encoded[TraceCodec::MAX_RECORD_BYTES];
+        size_t n = TraceCodec::encode(record, lastUs, encoded);
+        bytes.insert(bytes.end(), encoded, encoded + n);
+    }
+};
+
+class BufferSource : public TraceSource {
+public:
+    BufferSource(const std::vector<uint8_t>& bytes, size_t offset) : bytes(bytes), offset(offset) {}
+
+    size_t read(uint8_t* buffer, size_t length) override {
+        size_t n = bytes.size() - offset < length ? bytes.size() - offset : length;
+        memcpy(buffer, bytes.data() + offset, n);
+        offset += n;
+        return n;
+    }
+
+private:
+    const std::vector<uint8_t>& bytes;
+    size_t offset;
+};
+
+// Replays a recording from just past its MACs into a list standing in for
+// CounterApp/BLEManager, the way EventTrace's replay timer drains a reader
+struct Replay {
+    BufferSource source;
+    TraceReader reader;
+    std::vector<TraceCodec::Record> dispatched;
+
+    Replay(const Recording& trace, uint16_t deviceCount)
+        : source(trace.bytes, TraceCodec::HEADER_LEN + (size_t)deviceCount * 6)
+        , reader(source) {
+        static TraceCodec::Record record;
+        while (reader.next(record)) {
+            dispatched.push_back(record);
+        }
+    }
+};
+
+static const uint8_t PEER[6] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+
+static TraceCodec::Header header(uint16_t deviceCount) {
+    TraceCodec::Header h;
+    h.counter = -42;
+    h.pairing = true;
+    h.deviceCount = deviceCount;
+    return h;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+static void test_header_round_trips() {
+    Recording trace(header(3));
+
+    TraceCodec::Header decoded;
+    TEST_ASSERT_TRUE(TraceCodec::decodeHeader(trace.bytes.data(), decoded));
+    TEST_ASSERT_EQUAL_INT32(-42, decoded.counter);
+    TEST_ASSERT_TRUE(decoded.pairing);
+    TEST_ASSERT_EQUAL_UINT16(3, decoded.deviceCount);
+    TEST_ASSERT_EQUAL_size_t(TraceCodec::HEADER_LEN + 3 * 6, trace.bytes.size());
+}
+
+static void test_header_with_old_magic_is_rejected() {
+    Recording trace(header(0));
+    trace.bytes[0] = 0x45;
+    trace.bytes[1] = 0x54;
+    trace.bytes[2] = 0x52;
+    trace.bytes[3] = 0x32;  // "ETR2"
+
+    TraceCodec::Header decoded;
+    TEST_ASSERT_FALSE(TraceCodec::decodeHeader(trace.bytes.data(), decoded));
+}
+
+static void test_records_replay_in_order_with_times() {
+    Recording trace(header(2));
+    uint8_t value[4] = { 7, 0, 0, 0 };
+    uint8_t button = 1;
+    trace.add(1000, Type::CONNECT, Target::NONE, PEER, 6);
+    trace.add(1500, Type::GATT_READ, Target::COUNTER, nullptr, 0);
+    trace.add(300000, Type::GATT_WRITE, Target::COUNTER, value, sizeof(value));
+    trace.add(20000000000LL, Type::BUTTON_LONG_PRESS, Target::NONE, &button, 1);
+    trace.add(20000000001LL, Type::DISCONNECT, Target::NONE, nullptr, 0);
+
+    Replay replay(trace, 2);
+    TEST_ASSERT_EQUAL_size_t(5, replay.dispatched.size());
+    TEST_ASSERT_FALSE(replay.reader.isCorrupt());
+    TEST_ASSERT_EQUAL_UINT32(0, replay.reader.getTruncatedSkipped());
+
+    const std::vector<TraceCodec::Record>& r = replay.dispatched;
+    TEST_ASSERT_TRUE(r[0].type == Type::CONNECT);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(PEER, r[0].data, 6);
+    TEST_ASSERT_EQUAL_INT64(1000, r[0].timeUs);
+    TEST_ASSERT_TRUE(r[1].type == Type::GATT_READ && r[1].target == Target::COUNTER);
+    TEST_ASSERT_EQUAL_INT64(1500, r[1].timeUs);
+    TEST_ASSERT_TRUE(r[2].type == Type::GATT_WRITE && r[2].target == Target::COUNTER);
+    TEST_ASSERT_EQUAL_UINT16(4, r[2].length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(value, r[2].data, 4);
+    TEST_ASSERT_TRUE(r[3].type == Type::BUTTON_LONG_PRESS);
+    TEST_ASSERT_EQUAL_UINT8(1, r[3].data[0]);
+    TEST_ASSERT_EQUAL_INT64(20000000000LL, r[3].timeUs);
+    TEST_ASSERT_TRUE(r[4].type == Type::DISCONNECT);
+    TEST_ASSERT_EQUAL_INT64(20000000001LL, replay.reader.getTimeUs());
+}
+
+static void test_truncated_write_is_skipped_and_counted() {
+    static uint8_t registry[EVENT_TRACE_MAX_PAYLOAD + 88];
+    for (size_t i = 0; i < sizeof(registry); i++) {
+        registry[i] = (uint8_t)i;
+    }
+    uint8_t gate = 1;
+
+    Recording trace(header(0));
+    trace.add(100, Type::GATT_WRITE, Target::REGISTRY, registry, sizeof(registry));
+    trace.add(200, Type::GATT_WRITE, Target::GATE, &gate, 1);
+    trace.add(300, Type::GATT_WRITE, Target::REGISTRY, registry, sizeof(registry));
+    trace.add(400, Type::DISCONNECT, Target::NONE, nullptr, 0);
+
+    Replay replay(trace, 0);
+    TEST_ASSERT_EQUAL_size_t(2, replay.dispatched.size());
+    TEST_ASSERT_EQUAL_UINT32(2, replay.reader.getTruncatedSkipped());
+    TEST_ASSERT_FALSE(replay.reader.isCorrupt());
+
+    // The records after a skipped one decode from the right place and
+    // keep their times
+    TEST_ASSERT_TRUE(replay.dispatched[0].target == Target::GATE);
+    TEST_ASSERT_EQUAL_INT64(200, replay.dispatched[0].timeUs);
+    TEST_ASSERT_TRUE(replay.dispatched[1].type == Type::DISCONNECT);
+    TEST_ASSERT_EQUAL_INT64(400, replay.dispatched[1].timeUs);
+}
+
+static void test_write_of_exactly_max_payload_replays_intact() {
+    static uint8_t registry[EVENT_TRACE_MAX_PAYLOAD];
+    for (size_t i = 0; i < sizeof(registry); i++) {
+        registry[i] = (uint8_t)(i * 7);
+    }
+
+    Recording trace(header(0));
+    trace.add(100, Type::GATT_WRITE, Target::REGISTRY, registry, sizeof(registry));
+
+    Replay replay(trace, 0);
+    TEST_ASSERT_EQUAL_size_t(1, replay.dispatched.size());
+    TEST_ASSERT_EQUAL_UINT32(0, replay.reader.getTruncatedSkipped());
+    TEST_ASSERT_EQUAL_UINT16(EVENT_TRACE_MAX_PAYLOAD, replay.dispatched[0].length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(registry, replay.dispatched[0].data, EVENT_TRACE_MAX_PAYLOAD);
+}
+
+static void test_corrupt_type_stops_replay() {
+    Recording trace(header(0));
+    trace.add(100, Type::GATT_READ, Target::COUNTER, nullptr, 0);
+    trace.bytes.push_back(0x0F);  // no such type
+    trace.add(200, Type::GATT_READ, Target::COUNTER, nullptr, 0);
+
+    Replay replay(trace, 0);
+    TEST_ASSERT_EQUAL_size_t(1, replay.dispatched.size());
+    TEST_ASSERT_TRUE(replay.reader.isCorrupt());
+}
+
+static void test_trace_cut_mid_record_ends_cleanly() {
+    uint8_t value[4] = { 1, 2, 3, 4 };
+    Recording trace(header(0));
+    trace.add(100, Type::GATT_READ, Target::COUNTER, nullptr, 0);
+    trace.add(200, Type::GATT_WRITE, Target::COUNTER, value, sizeof(value));
+    trace.bytes.resize(trace.bytes.size() - 2);  // power cut mid-write
+
+    Replay replay(trace, 0);
+    TEST_ASSERT_EQUAL_size_t(1, replay.dispatched.size());
+    TEST_ASSERT_FALSE(replay.reader.isCorrupt());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_header_round_trips);
+    RUN_TEST(test_header_with_old_magic_is_rejected);
+    RUN_TEST(test_records_replay_in_order_with_times);
+    RUN_TEST(test_truncated_write_is_skipped_and_counted);
+    RUN_TEST(test_write_of_exactly_max_payload_replays_intact);
+    RUN_TEST(test_corrupt_type_stops_replay);
+    RUN_TEST(test_trace_cut_mid_record_ends_cleanly);
+    return UNITY_END();
+}
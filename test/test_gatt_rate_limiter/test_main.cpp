@@ -0,0 +1,166 @@
+#include <unity.h>
+#include "ble/gatt_rate_limiter.h"
+
+typedef GattRateLimiter::Op Op;
+typedef GattRateLimiter::Verdict Verdict;
+
+void setUp() {}
+void tearDown() {}
+
+// ============================================================================
+// TokenBucket
+// ============================================================================
+
+static void test_bucket_starts_full_and_refills_at_rate() {
+    TokenBucket bucket;
+    bucket.configure(10, 3);
+    bucket.reset(0);
+
+    TEST_ASSERT_TRUE(bucket.take(0));
+    TEST_ASSERT_TRUE(bucket.take(0));
+    TEST_ASSERT_TRUE(bucket.take(0));
+    TEST_ASSERT_FALSE(bucket.take(0));
+
+    // One token per 100 ms at 10/s
+    TEST_ASSERT_FALSE(bucket.take(99));
+    TEST_ASSERT_TRUE(bucket.take(100));
+    TEST_ASSERT_FALSE(bucket.take(100));
+}
+
+static void test_bucket_refill_is_capped_at_burst() {
+    TokenBucket bucket;
+    bucket.configure(10, 3);
+    bucket.reset(0);
+    for (int i = 0; i < 3; i++) {
+        bucket.take(0);
+    }
+
+    // An hour idle still only refills to the burst size
+    uint32_t later = 3600u * 1000;
+    int taken = 0;
+    while (bucket.take(later)) {
+        taken++;
+    }
+    TEST_ASSERT_EQUAL(3, taken);
+}
+
+static void test_bucket_survives_millis_wrap() {
+    TokenBucket bucket;
+    bucket.configure(20, 10);
+    bucket.reset(0xFFFFFF00u);
+
+    // 20/s exactly at the configured rate across the wrap
+    for (uint32_t i = 0; i < 2000; i++) {
+        TEST_ASSERT_TRUE(bucket.take(0xFFFFFF00u + i * 50));
+    }
+}
+
+// ============================================================================
+// GattRateLimiter
+// ============================================================================
+
+static void test_well_behaved_client_is_never_dropped() {
+    // Reads at 10/s, writes at 2/s and an admin session at 5/s, for 10 minutes
+    GattRateLimiter limiter;
+    limiter.reset(1000);
+
+    for (uint32_t t = 1000; t < 601000; t++) {
+        if (t % 100 == 0) {
+            TEST_ASSERT_EQUAL(Verdict::ALLOW, limiter.check(Op::READ, t));
+        }
+        if (t % 500 == 0) {
+            TEST_ASSERT_EQUAL(Verdict::ALLOW, limiter.check(Op::WRITE, t));
+        }
+        if (t < 7000 && t % 200 == 0) {
+            TEST_ASSERT_EQUAL(Verdict::ALLOW, limiter.check(Op::ADMIN, t));
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, limiter.getDropped(Op::READ));
+}
+
+static void test_connect_burst_is_allowed_then_dropped() {
+    GattRateLimiter limiter;
+    limiter.reset(0);
+
+    for (int i = 0; i < RATE_LIMIT_READ_BURST; i++) {
+        TEST_ASSERT_EQUAL(Verdict::ALLOW, limiter.check(Op::READ, 0));
+    }
+    TEST_ASSERT_EQUAL(Verdict::DROP, limiter.check(Op::READ, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, limiter.getDropped(Op::READ));
+
+    // Other operation classes have their own allowance
+    TEST_ASSERT_EQUAL(Verdict::ALLOW, limiter.check(Op::WRITE, 0));
+}
+
+static void test_occasional_bursts_are_only_dropped() {
+    // Twice the read burst every 10 s: the excess is dropped, never kicked
+    GattRateLimiter limiter;
+    limiter.reset(0);
+
+    for (uint32_t t = 0; t < 120000; t += 10000) {
+        for (int i = 0; i < 2 * RATE_LIMIT_READ_BURST; i++) {
+            TEST_ASSERT_NOT_EQUAL(Verdict::DISCONNECT, limiter.check(Op::READ, t));
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(0, limiter.getDropped(Op::READ));
+}
+
+static void test_flood_is_disconnected_quickly() {
+    // One request per millisecond
+    GattRateLimiter limiter;
+    limiter.reset(0);
+
+    uint32_t allowed = 0;
+    uint32_t t = 0;
+    for (; t < 10000; t++) {
+        Verdict verdict = limiter.check(Op::READ, t);
+        if (verdict == Verdict::DISCONNECT) {
+            break;
+        }
+        allowed += verdict == Verdict::ALLOW;
+    }
+
+    TEST_ASSERT_LESS_THAN(100, t);
+    TEST_ASSERT_LESS_OR_EQUAL(RATE_LIMIT_READ_BURST + 2, allowed);
+}
+
+static void test_sustained_overrate_is_disconnected() {
+    // 25 reads/s against a 20/s limit: strikes outpace forgiveness
+    GattRateLimiter limiter;
+    limiter.reset(0);
+
+    uint32_t t = 0;
+    for (; t < 600000; t += 40) {
+        if (limiter.check(Op::READ, t) == Verdict::DISCONNECT) {
+            break;
+        }
+    }
+    TEST_ASSERT_LESS_THAN(60000, t);
+}
+
+static void test_reset_gives_a_fresh_allowance() {
+    GattRateLimiter limiter;
+    limiter.reset(0);
+    for (int i = 0; i < RATE_LIMIT_READ_BURST + RATE_LIMIT_STRIKES; i++) {
+        limiter.check(Op::READ, 0);
+    }
+    TEST_ASSERT_EQUAL(Verdict::DISCONNECT, limiter.check(Op::READ, 0));
+
+    limiter.reset(0);
+    TEST_ASSERT_EQUAL_UINT32(0, limiter.getDropped(Op::READ));
+    TEST_ASSERT_EQUAL(Verdict::ALLOW, limiter.check(Op::READ, 0));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bucket_starts_full_and_refills_at_rate);
+    RUN_TEST(test_bucket_refill_is_capped_at_burst);
+    RUN_TEST(test_bucket_survives_millis_wrap);
+    RUN_TEST(test_well_behaved_client_is_never_dropped);
+    RUN_TEST(test_connect_burst_is_allowed_then_dropped);
+    RUN_TEST(test_occasional_bursts_are_only_dropped);
+    RUN_TEST(test_flood_is_disconnected_quickly);
+    RUN_TEST(test_sustained_overrate_is_disconnected);
+    RUN_TEST(test_reset_gives_a_fresh_allowance);
+    return UNITY_END();
+}
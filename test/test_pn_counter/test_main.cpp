@@ -0,0 +1,212 @@
+#include <unity.h>
+#include <vector>
+#include "replication/pn_counter.h"
+
+void setUp() {}
+void tearDown() {}
+
+// ============================================================================
+// Gossip simulator
+// ============================================================================
+
+// Each round every node sends one frame the way CounterReplica::encode
+// builds it: dirty entries first, then a rotating cursor, capped at
+// REPLICATION_ENTRIES_PER_FRAME. Frames are broadcast to every other node;
+// each delivery is lost with probability lossPercent and otherwise merged
+// twice, since ESP-NOW can duplicate.
+struct SimNode {
+    PNCounter counter;
+    size_t cursor = 0;
+};
+
+struct Simulation {
+    std::vector<SimNode> nodes;
+    uint32_t seed;
+    uint32_t lossPercent;
+    int32_t truth = 0;
+
+    Simulation(size_t count, uint32_t lossPercent, uint32_t seed)
+        : nodes(count), seed(seed), lossPercent(lossPercent) {
+        for (size_t i = 0; i < count; i++) {
+            nodes[i].counter.reset(0x1000 + (uint32_t)i, 0, 0);
+        }
+    }
+
+    uint32_t random() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    }
+
+    void addEverywhere() {
+        for (SimNode& node : nodes) {
+            int32_t delta = (int32_t)(random() % 50) - 10;
+            node.counter.add(delta);
+            truth += delta;
+        }
+    }
+
+    std::vector<PNCounter::Entry> encode(SimNode& node) {
+        PNCounter& counter = node.counter;
+        std::vector<PNCounter::Entry> frame;
+        std::vector<bool> included(counter.size(), false);
+
+        for (size_t i = 0; i < counter.size() && frame.size() < REPLICATION_ENTRIES_PER_FRAME; i++) {
+            if (counter.isDirty(i)) {
+                frame.push_back(counter.at(i));
+                counter.clearDirty(i);
+                included[i] = true;
+            }
+        }
+        for (size_t scanned = 0; scanned < counter.size() &&
+                                 frame.size() < REPLICATION_ENTRIES_PER_FRAME; scanned++) {
+            size_t i = node.cursor;
+            node.cursor = (node.cursor + 1) % counter.size();
+            if (!included[i]) {
+                frame.push_back(counter.at(i));
+            }
+        }
+        return frame;
+    }
+
+    void round() {
+        std::vector<std::vector<PNCounter::Entry>> frames;
+        for (SimNode& node : nodes) {
+            frames.push_back(encode(node));
+        }
+        for (size_t from = 0; from < nodes.size(); from++) {
+            for (size_t to = 0; to < nodes.size(); to++) {
+                if (from == to || random() % 100 < lossPercent) {
+                    continue;
+                }
+                for (const PNCounter::Entry& entry : frames[from]) {
+                    nodes[to].counter.merge(entry);
+                    nodes[to].counter.merge(entry);
+                }
+            }
+        }
+    }
+
+    bool converged() const {
+        for (const SimNode& node : nodes) {
+            if (node.counter.value() != truth || node.counter.size() != nodes.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Rounds until every node agrees on the total, or -1
+    int run(int maxRounds) {
+        for (int rounds = 0; rounds <= maxRounds; rounds++) {
+            if (converged()) {
+                return rounds;
+            }
+            round();
+        }
+        return -1;
+    }
+};
+
+static void checkConverges(size_t nodeCount, int maxRounds) {
+    Simulation sim(nodeCount, 10, 1);
+    sim.addEverywhere();
+
+    int rounds = sim.run(maxRounds);
+    char message[64];
+    snprintf(message, sizeof(message), "%u nodes converged in %d rounds", (unsigned)nodeCount, rounds);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE_MESSAGE(rounds >= 0, message);
+}
+
+static void test_gossip_converges_2_nodes() {
+    checkConverges(2, 5);
+}
+
+static void test_gossip_converges_8_nodes() {
+    checkConverges(8, 10);
+}
+
+static void test_gossip_converges_32_nodes() {
+    checkConverges(REPLICATION_MAX_NODES, 20);
+}
+
+static void test_gossip_converges_with_changes_in_flight() {
+    Simulation sim(8, 30, 7);
+    for (int i = 0; i < 5; i++) {
+        sim.addEverywhere();
+        sim.round();
+    }
+    TEST_ASSERT_TRUE(sim.run(30) >= 0);
+}
+
+// ============================================================================
+// Merge rules
+// ============================================================================
+
+static void test_add_splits_into_increments_and_decrements() {
+    PNCounter counter;
+    counter.reset(1, 0, 0);
+    TEST_ASSERT_EQUAL_INT32(5, counter.add(5));
+    TEST_ASSERT_EQUAL_INT32(2, counter.add(-3));
+    TEST_ASSERT_EQUAL_UINT32(5, counter.local().p);
+    TEST_ASSERT_EQUAL_UINT32(3, counter.local().n);
+}
+
+static void test_merge_is_idempotent_and_order_free() {
+    PNCounter a;
+    PNCounter b;
+    a.reset(1, 0, 0);
+    b.reset(1, 0, 0);
+
+    PNCounter::Entry first = { 2, 10, 1 };
+    PNCounter::Entry second = { 2, 12, 4 };
+    PNCounter::Entry other = { 3, 7, 0 };
+
+    TEST_ASSERT_TRUE(a.merge(first));
+    TEST_ASSERT_TRUE(a.merge(second));
+    TEST_ASSERT_TRUE(a.merge(other));
+    TEST_ASSERT_FALSE(a.merge(second));
+
+    b.merge(other);
+    b.merge(second);
+    TEST_ASSERT_FALSE(b.merge(first));
+
+    TEST_ASSERT_EQUAL_INT32(a.value(), b.value());
+    TEST_ASSERT_EQUAL_INT32(12 - 4 + 7, a.value());
+}
+
+static void test_merge_catches_up_own_entry() {
+    // A peer holds a newer copy of this node's entry than it kept itself
+    PNCounter counter;
+    counter.reset(1, 3, 0);
+    PNCounter::Entry remote = { 1, 9, 2 };
+    TEST_ASSERT_TRUE(counter.merge(remote));
+    TEST_ASSERT_EQUAL_INT32(7, counter.value());
+    TEST_ASSERT_EQUAL_size_t(1, counter.size());
+}
+
+static void test_merge_beyond_capacity_is_counted() {
+    // Three more remote nodes than the table has room for
+    PNCounter counter;
+    counter.reset(1, 0, 0);
+    for (uint32_t node = 2; node < REPLICATION_MAX_NODES + 4; node++) {
+        PNCounter::Entry entry = { node, 1, 0 };
+        counter.merge(entry);
+    }
+    TEST_ASSERT_EQUAL_size_t(REPLICATION_MAX_NODES, counter.size());
+    TEST_ASSERT_EQUAL_UINT32(3, counter.getOverflow());
+    TEST_ASSERT_EQUAL_INT32(REPLICATION_MAX_NODES - 1, counter.value());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_add_splits_into_increments_and_decrements);
+    RUN_TEST(test_merge_is_idempotent_and_order_free);
+    RUN_TEST(test_merge_catches_up_own_entry);
+    RUN_TEST(test_merge_beyond_capacity_is_counted);
+    RUN_TEST(test_gossip_converges_2_nodes);
+    RUN_TEST(test_gossip_converges_8_nodes);
+    RUN_TEST(test_gossip_converges_32_nodes);
+    RUN_TEST(test_gossip_converges_with_changes_in_flight);
+    return UNITY_END();
+}
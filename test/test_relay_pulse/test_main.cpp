@@ -0,0 +1,140 @@
+#include <unity.h>
+#include "gate/relay_pulse.h"
+
+// Output level history against a manual clock; the pulse timer fires when
+// advance() passes its deadline
+class FakeDriver : public RelayDriver {
+public:
+    bool output = false;
+    int outputChanges = 0;
+    int64_t now = 1000000;
+    int64_t timerDeadline = -1;
+    PulseEndCallback callback = nullptr;
+    void* callbackArg = nullptr;
+
+    bool begin(PulseEndCallback onPulseEnd, void* arg) override {
+        callback = onPulseEnd;
+        callbackArg = arg;
+        setOutput(false);
+        return true;
+    }
+
+    void setOutput(bool on) override {
+        if (on != output) {
+            outputChanges++;
+        }
+        output = on;
+    }
+
+    int64_t nowUs() override { return now; }
+
+    void startPulseTimer(uint64_t delayUs) override {
+        timerDeadline = now + (int64_t)delayUs;
+    }
+
+    void advanceMs(int64_t ms) {
+        now += ms * 1000;
+        if (timerDeadline >= 0 && now >= timerDeadline) {
+            timerDeadline = -1;
+            callback(callbackArg);
+        }
+    }
+};
+
+static const uint32_t PULSE_MS = 500;
+static const uint32_t LOCKOUT_MS = 2000;
+
+static FakeDriver* driver;
+static RelayPulse* pulse;
+
+void setUp() {
+    driver = new FakeDriver();
+    pulse = new RelayPulse(*driver, PULSE_MS, LOCKOUT_MS);
+    pulse->begin();
+}
+
+void tearDown() {
+    delete pulse;
+    delete driver;
+}
+
+static void test_trigger_drives_output_for_pulse_length() {
+    int64_t startUs = 0;
+    TEST_ASSERT_TRUE(pulse->trigger(startUs));
+    TEST_ASSERT_EQUAL_INT64(driver->now, startUs);
+    TEST_ASSERT_TRUE(driver->output);
+    TEST_ASSERT_TRUE(pulse->isActive());
+    TEST_ASSERT_EQUAL_INT64(driver->now + PULSE_MS * 1000, driver->timerDeadline);
+
+    driver->advanceMs(PULSE_MS - 1);
+    TEST_ASSERT_TRUE(driver->output);
+
+    driver->advanceMs(1);
+    TEST_ASSERT_FALSE(driver->output);
+    TEST_ASSERT_FALSE(pulse->isActive());
+    TEST_ASSERT_EQUAL(2, driver->outputChanges);
+}
+
+static void test_trigger_during_pulse_is_refused() {
+    int64_t startUs = 0;
+    TEST_ASSERT_TRUE(pulse->trigger(startUs));
+    driver->advanceMs(100);
+
+    int64_t secondUs = 0;
+    TEST_ASSERT_FALSE(pulse->trigger(secondUs));
+    TEST_ASSERT_EQUAL_INT64(0, secondUs);
+
+    // The refused trigger did not extend the pulse
+    driver->advanceMs(PULSE_MS - 100);
+    TEST_ASSERT_FALSE(driver->output);
+}
+
+static void test_lockout_runs_from_pulse_start() {
+    int64_t startUs = 0;
+    TEST_ASSERT_TRUE(pulse->trigger(startUs));
+    driver->advanceMs(PULSE_MS);
+    TEST_ASSERT_FALSE(driver->output);
+    TEST_ASSERT_TRUE(pulse->isLockedOut());
+
+    driver->advanceMs(LOCKOUT_MS - PULSE_MS - 1);
+    TEST_ASSERT_FALSE(pulse->trigger(startUs));
+    TEST_ASSERT_FALSE(driver->output);
+
+    driver->advanceMs(1);
+    TEST_ASSERT_FALSE(pulse->isLockedOut());
+    TEST_ASSERT_TRUE(pulse->trigger(startUs));
+    TEST_ASSERT_TRUE(driver->output);
+}
+
+static void test_not_locked_out_before_first_pulse() {
+    TEST_ASSERT_FALSE(pulse->isLockedOut());
+    TEST_ASSERT_FALSE(pulse->isActive());
+    TEST_ASSERT_FALSE(driver->output);
+}
+
+static void test_dry_run_keeps_timing_without_output() {
+    pulse->setDryRun(true);
+
+    int64_t startUs = 0;
+    TEST_ASSERT_TRUE(pulse->trigger(startUs));
+    TEST_ASSERT_FALSE(driver->output);
+    TEST_ASSERT_TRUE(pulse->isActive());
+    TEST_ASSERT_EQUAL(0, driver->outputChanges);
+
+    driver->advanceMs(PULSE_MS);
+    TEST_ASSERT_FALSE(pulse->isActive());
+    TEST_ASSERT_FALSE(pulse->trigger(startUs));
+
+    driver->advanceMs(LOCKOUT_MS);
+    TEST_ASSERT_TRUE(pulse->trigger(startUs));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_trigger_drives_output_for_pulse_length);
+    RUN_TEST(test_trigger_during_pulse_is_refused);
+    RUN_TEST(test_lockout_runs_from_pulse_start);
+    RUN_TEST(test_not_locked_out_before_first_pulse);
+    RUN_TEST(test_dry_run_keeps_timing_without_output);
+    return UNITY_END();
+}